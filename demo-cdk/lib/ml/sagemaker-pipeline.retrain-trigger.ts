@@ -42,6 +42,70 @@ const createWavHeader = (dataLength: number, sampleRate = 16000, numChannels = 1
   return header;
 };
 
+// Encodings of the body named by the audio-encoding header of the device, see retrain_codec.h
+const imaBlockSize = 256;
+const imaStepTable = [
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+];
+const imaIndexTable = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8];
+
+// IMA-ADPCM blocks, in the mono layout of WAV files: exact first sample, step index, then a nibble per sample
+const decodeImaAdpcm = (data: Buffer): Buffer | null => {
+  let samples = 0;
+  for (let block = 0; block < data.length; block += imaBlockSize) {
+    const blockLength = Math.min(imaBlockSize, data.length - block);
+    if (blockLength < 4 || data[block + 2] > 88) {
+      return null;
+    }
+    samples += 1 + 2 * (blockLength - 4);
+  }
+
+  const pcm = Buffer.alloc(2 * samples);
+  let offset = 0;
+  for (let block = 0; block < data.length; block += imaBlockSize) {
+    const end = Math.min(block + imaBlockSize, data.length);
+    let predictor = data.readInt16LE(block);
+    let index = data[block + 2];
+    offset = pcm.writeInt16LE(predictor, offset);
+    for (let i = block + 4; i < end; i++) {
+      for (const nibble of [data[i] & 0x0f, data[i] >> 4]) {
+        const step = imaStepTable[index];
+        let delta = step >> 3;
+        if (nibble & 4) delta += step;
+        if (nibble & 2) delta += step >> 1;
+        if (nibble & 1) delta += step >> 2;
+        predictor = Math.max(-32768, Math.min(32767, predictor + ((nibble & 8) ? -delta : delta)));
+        index = Math.max(0, Math.min(88, index + imaIndexTable[nibble]));
+        offset = pcm.writeInt16LE(predictor, offset);
+      }
+    }
+  }
+  return pcm;
+};
+
+// G.711 mu-law, a byte per sample
+const decodeMulaw = (data: Buffer): Buffer => {
+  const pcm = Buffer.alloc(2 * data.length);
+  for (let i = 0; i < data.length; i++) {
+    const code = ~data[i] & 0xff;
+    const exponent = (code >> 4) & 0x07;
+    const magnitude = ((((code & 0x0f) << 3) + 0x84) << exponent) - 0x84;
+    pcm.writeInt16LE((code & 0x80) ? -magnitude : magnitude, 2 * i);
+  }
+  return pcm;
+};
+
+// A Map, so that a header naming an Object.prototype member such as toString is not taken for a decoder
+const audioDecoders = new Map<string, (data: Buffer) => Buffer | null>([
+  ['pcm16', (data) => data],
+  ['ima-adpcm', decodeImaAdpcm],
+  ['mulaw', decodeMulaw],
+]);
+
 exports.handler = async (event: any) => {
   try {
     const apiKeyValue = await secretsManager.getSecretValue({
@@ -60,8 +124,11 @@ exports.handler = async (event: any) => {
     }
     const contentType = event.headers['content-type'] || event.headers['Content-Type'];
     const soundClasses = event.headers['sound-classes'];
+    const audioEncoding = event.headers['audio-encoding'] || 'pcm16';
+    const decodeAudio = audioDecoders.get(audioEncoding);
 
-    if (!contentType || !soundClasses || soundClasses.length === 0 || contentType !== 'audio/wav') {
+    if (!contentType || !soundClasses || soundClasses.length === 0 || contentType !== 'audio/wav'
+        || !decodeAudio) {
       return {
         statusCode: 400,
         body: JSON.stringify({ message: 'Invalid' }),
@@ -70,9 +137,19 @@ exports.handler = async (event: any) => {
 
 
     const isBase64Encoded = event.isBase64Encoded || false; // Confirm if payload is Base64
-    const audioFile = isBase64Encoded
+    const audioBody = isBase64Encoded
         ? Buffer.from(event.body, 'base64') // Decode Base64 to binary
-        : event.body;
+        : Buffer.from(event.body, 'binary');
+
+    // The training pipeline reads 16-bit PCM WAV files, compressed uploads are decoded back to it
+    const audioFile = decodeAudio(audioBody);
+    if (!audioFile) {
+      return {
+        statusCode: 400,
+        body: JSON.stringify({ message: 'Invalid' }),
+      };
+    }
+    console.log(`Audio received in ${audioEncoding}: ${audioBody.length} bytes, ${audioFile.length} bytes of PCM`);
 
     const timestamp = Date.now();
     const audioFileName = `${timestamp}.wav`;
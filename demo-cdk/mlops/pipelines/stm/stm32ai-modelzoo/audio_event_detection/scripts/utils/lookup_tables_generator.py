@@ -55,10 +55,24 @@ def generate_hann_window_LUT(config):
 
     return hann_window
 
+def to_q15(values, shift=0):
+    '''Converts values to Q15, scaled by 2^shift, with saturation'''
+    scaled = np.round(np.asarray(values, dtype=np.float64) * (1 << (15 + shift)))
+    return np.clip(scaled, -32768, 32767).astype(np.int16)
+
+def generate_q15_LUTs(melFilterLut, hannWin):
+    '''Converts the LUTs for the fixed-point on-target pre-processing'''
+    # Scale the mel coefficients by a power of two to use the Q15 range,
+    # they are much smaller than 1 with the slaney normalization
+    melFilterLutShift = max(0, int(np.floor(np.log2(1.0 / np.max(melFilterLut)))))
+
+    return to_q15(melFilterLut, melFilterLutShift), melFilterLutShift, to_q15(hannWin)
+
 def generate_LUTs_header_file(melFilterLut,
                               melFilterStartIndices,
                               melFilterStopIndices,
-                              hannWin):
+                              hannWin,
+                              melFilterLutShift):
 
     path = os.path.join(HydraConfig.get().runtime.output_dir, "C_header/")
 
@@ -89,12 +103,19 @@ def generate_LUTs_header_file(melFilterLut,
         f.write('extern const uint32_t  user_melFiltersStopIndices[{}];\n'.format(len(melFilterStopIndices)))
         f.write('extern const float32_t user_melFilterLut[{}];\n'.format(len(melFilterLut)))
         f.write('\n')
+        f.write('/* Fixed-point tables: user_melFilterLut_q15 holds the coefficients scaled by 2^USER_MEL_LUT_Q15_SHIFT */\n')
+        f.write('#define USER_MEL_LUT_Q15_SHIFT ({}U)\n'.format(melFilterLutShift))
+        f.write('extern const q15_t userWin_q15[{}];\n'.format(len(hannWin)))
+        f.write('extern const q15_t user_melFilterLut_q15[{}];\n'.format(len(melFilterLut)))
+        f.write('\n')
         f.write('#endif /* _MEL_USER_TABLES_H */\n')
 
 def generate_LUTs_c_file(melFilterLut,
                          melFilterStartIndices,
                          melFilterStopIndices,
-                         hannWin):
+                         hannWin,
+                         melFilterLutQ15,
+                         hannWinQ15):
     path = os.path.join(HydraConfig.get().runtime.output_dir, "C_header/")
     # Convert LUTs to str to be able to write to file
     melFilterLut_str = np.array2string(melFilterLut,
@@ -118,6 +139,10 @@ def generate_LUTs_c_file(melFilterLut,
 
     hannWin_str = '{' + hannWin_str[1:-1] + '}'
 
+    melFilterLutQ15_str = np.array2string(melFilterLutQ15, separator=',', threshold=sys.maxsize)
+    hannWinQ15_str = np.array2string(hannWinQ15, separator=',', threshold=sys.maxsize)
+    melFilterLutQ15_str = '{' + melFilterLutQ15_str[1:-1] + '}'
+    hannWinQ15_str = '{' + hannWinQ15_str[1:-1] + '}'
 
     # Write file
 
@@ -149,21 +174,28 @@ def generate_LUTs_c_file(melFilterLut,
                 len(melFilterStopIndices), melFilterStopIndices_str))
         f.write('const float32_t user_melFilterLut[{}] = {};\n'.format(
             len(melFilterLut), melFilterLut_str))
+        f.write('const q15_t userWin_q15[{}] = {};\n'.format(len(hannWinQ15), hannWinQ15_str))
+        f.write('const q15_t user_melFilterLut_q15[{}] = {};\n'.format(
+            len(melFilterLutQ15), melFilterLutQ15_str))
         f.write('\n')
 
 def generate_mel_LUT_files(config):
     '''Wrapper function to compute LUTs and write the appropriate files'''
     melFilterLut, melFilterStartIndices, melFilterStopIndices = generate_mel_LUTs(config)
     hannWin = generate_hann_window_LUT(config)
+    melFilterLutQ15, melFilterLutShift, hannWinQ15 = generate_q15_LUTs(melFilterLut, hannWin)
     print("[INFO] Generating LUT header file")
     generate_LUTs_header_file(melFilterLut, 
                               melFilterStartIndices,
                               melFilterStopIndices,
-                              hannWin)
+                              hannWin,
+                              melFilterLutShift)
     print("[INFO] Done generating LUT header file")
     print("[INFO] Generating LUT C file")
     generate_LUTs_c_file(melFilterLut,
                          melFilterStartIndices,
                          melFilterStopIndices,
-                         hannWin)
+                         hannWin,
+                         melFilterLutQ15,
+                         hannWinQ15)
     print('[INFO] : Done generating LUT C file')
@@ -0,0 +1,108 @@
+"""
+This module decodes the binary detection messages of the device.
+
+The device sends them instead of the JSON telemetry after the
+"set-telemetry-format cbor" command, as a CBOR array of integers:
+
+    [version, sequence, time_ms, class, confidence, class, confidence, ...]
+
+Only the subset of CBOR the device writes is decoded: unsigned and negative
+integers and one array.
+"""
+
+import re
+
+BINARY_VERSION = 1
+BINARY_HEADER_ITEMS = 3
+
+CBOR_UNSIGNED = 0
+CBOR_NEGATIVE = 1
+CBOR_ARRAY = 4
+
+CLASS_LIST_PATTERN = r"#define\s+CTRL_X_CUBE_AI_MODE_CLASS_LIST\s+\{(.*)\}"
+
+
+class TelemetryDecodeError(Exception):
+    """Custom exception for binary messages that cannot be decoded"""
+    pass
+
+def read_class_labels(model_config_path: str) -> list:
+    """Returns the class labels of the ai_model_config.h of a model"""
+    with open(model_config_path, "r", encoding="utf-8") as model_config:
+        match = re.search(CLASS_LIST_PATTERN, model_config.read())
+    if match is None:
+        raise TelemetryDecodeError(f"No class list in {model_config_path}")
+    return [label.strip().strip('"') for label in match.group(1).split(",")]
+
+def decode_cbor_head(payload: bytes, pos: int) -> tuple:
+    """Returns the major type, the argument and the position after the head at pos"""
+    if pos >= len(payload):
+        raise TelemetryDecodeError("Message truncated")
+    major = payload[pos] >> 5
+    info = payload[pos] & 0x1F
+    pos += 1
+    if info < 24:
+        return major, info, pos
+    if info > 27:
+        raise TelemetryDecodeError(f"Unsupported CBOR item 0x{payload[pos - 1]:02x}")
+    size = 1 << (info - 24)
+    if pos + size > len(payload):
+        raise TelemetryDecodeError("Message truncated")
+    return major, int.from_bytes(payload[pos:pos + size], "big"), pos + size
+
+def decode_cbor_int(payload: bytes, pos: int) -> tuple:
+    """Returns the integer and the position after it"""
+    major, argument, pos = decode_cbor_head(payload, pos)
+    if major == CBOR_UNSIGNED:
+        return argument, pos
+    if major == CBOR_NEGATIVE:
+        return -1 - argument, pos
+    raise TelemetryDecodeError(f"Integer expected, got CBOR major type {major}")
+
+def decode_detection(payload: bytes, class_labels: list) -> dict:
+    """
+    Returns the attributes of a binary detection message:
+     - class, confidence and labels, as in the JSON telemetry, labels only
+       when several classes are reported
+     - sequence, the number of the detection since the device started
+     - time_ms, the device uptime
+    """
+    major, items, pos = decode_cbor_head(payload, 0)
+    if major != CBOR_ARRAY or items < BINARY_HEADER_ITEMS + 2 or (items - BINARY_HEADER_ITEMS) % 2 != 0:
+        raise TelemetryDecodeError("Not a detection message")
+
+    values = []
+    for _ in range(items):
+        value, pos = decode_cbor_int(payload, pos)
+        values.append(value)
+    if pos != len(payload):
+        raise TelemetryDecodeError(f"{len(payload) - pos} bytes after the message")
+    if values[0] != BINARY_VERSION:
+        raise TelemetryDecodeError(f"Unsupported message version {values[0]}")
+
+    labels = []
+    for class_idx, confidence in zip(values[BINARY_HEADER_ITEMS::2], values[BINARY_HEADER_ITEMS + 1::2]):
+        class_name = class_labels[class_idx] if class_idx < len(class_labels) else str(class_idx)
+        labels.append((class_name, confidence))
+
+    detection = {
+        "class": labels[0][0],
+        "confidence": labels[0][1]
+    }
+    if len(labels) > 1:
+        detection["labels"] = ",".join(f"{name}:{confidence}" for name, confidence in labels)
+    detection["sequence"] = values[1]
+    detection["time_ms"] = values[2]
+    return detection
+
+def to_iotconnect_message(detection: dict, version: str, position: str) -> dict:
+    """Returns the JSON telemetry message the device sends for the detection"""
+    attributes = {
+        "version": f"MLDEMO-{version}",
+        "class": detection["class"],
+        "confidence": detection["confidence"]
+    }
+    if "labels" in detection:
+        attributes["labels"] = detection["labels"]
+    attributes["position"] = [float(coordinate) for coordinate in position.split(",")]
+    return {"d": [{"d": attributes}], "mt": 0}
@@ -0,0 +1,66 @@
+"""This module decodes the binary detection messages of the devices."""
+
+import argparse
+import json
+import os
+import sys
+
+from common.telemetry import (
+    TelemetryDecodeError,
+    read_class_labels,
+    decode_detection,
+    to_iotconnect_message
+)
+
+DEFAULT_MODEL_CONFIG = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                    "..", "models", "ml-source-fsd50k", "C_header", "ai_model_config.h")
+
+
+def iot_connect_telemetry_decode():
+    """Decode the messages given in hexadecimal, one per argument or per line of stdin"""
+    args = parse_arguments()
+    class_labels = read_class_labels(args.model_config)
+    messages = args.messages if args.messages else (line.strip() for line in sys.stdin)
+    next_sequence = None
+    errors = 0
+    for message in messages:
+        if not message:
+            continue
+        try:
+            detection = decode_detection(bytes.fromhex(message), class_labels)
+        except (ValueError, TelemetryDecodeError) as error:
+            print(f"{message}: {error}", file=sys.stderr)
+            errors += 1
+            continue
+
+        if next_sequence is not None and detection["sequence"] > next_sequence:
+            print(f"{detection['sequence'] - next_sequence} messages lost before {detection['sequence']}",
+                  file=sys.stderr)
+        next_sequence = detection["sequence"] + 1
+
+        if args.iotconnect:
+            print(json.dumps(to_iotconnect_message(detection, args.version, args.position), separators=(",", ":")))
+        else:
+            print(json.dumps(detection))
+    return 1 if errors else 0
+
+def parse_arguments() -> argparse.Namespace:
+    """
+    Parse CLI arguments
+     - messages in hexadecimal, read from stdin when none
+     - ai_model_config.h of the model of the devices, for the class labels
+     - whether to print them as the JSON telemetry of the device, with its version and position
+    """
+    parser=argparse.ArgumentParser()
+    parser.add_argument("messages", nargs="*", help="messages in hexadecimal, one per line of stdin when none")
+    parser.add_argument("--model-config", default=DEFAULT_MODEL_CONFIG,
+                        help="ai_model_config.h of the model of the devices")
+    parser.add_argument("--iotconnect", action="store_true",
+                        help="print the JSON telemetry message the device would have sent")
+    parser.add_argument("--version", default="0.0.0", help="firmware version of the JSON telemetry")
+    parser.add_argument("--position", default="0,0", help="device position of the JSON telemetry")
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    sys.exit(iot_connect_telemetry_decode())
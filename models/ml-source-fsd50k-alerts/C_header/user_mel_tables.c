@@ -313,4 +313,77 @@ const float32_t user_melFilterLut[461] = {9.4856154919e-01F ,5.1438424736e-02F ,
  8.7825644016e-01F ,7.6847434044e-01F ,6.5869230032e-01F ,
  5.4891026020e-01F ,4.3912822008e-01F ,3.2934615016e-01F ,
  2.1956411004e-01F ,1.0978205502e-01F};
+const q15_t userWin_q15[400] = {    0,    2,    8,   18,   32,   51,   73,   99,  129,  163,  202,  244,
+   290,  340,  395,  453,  515,  581,  651,  724,  802,  883,  969, 1058,
+  1151, 1247, 1348, 1452, 1559, 1671, 1786, 1904, 2027, 2152, 2282, 2414,
+  2551, 2690, 2833, 2979, 3129, 3282, 3438, 3597, 3760, 3926, 4094, 4266,
+  4441, 4618, 4799, 4982, 5168, 5357, 5549, 5743, 5940, 6140, 6342, 6547,
+  6754, 6963, 7175, 7389, 7605, 7823, 8044, 8266, 8491, 8717, 8946, 9176,
+  9408, 9642, 9877,10114,10353,10593,10834,11077,11321,11566,11813,12061,
+ 12309,12559,12810,13062,13314,13567,13821,14075,14331,14586,14842,15099,
+ 15355,15612,15869,16127,16384,16641,16899,17156,17413,17669,17926,18182,
+ 18437,18693,18947,19201,19454,19706,19958,20209,20459,20707,20955,21202,
+ 21447,21691,21934,22175,22415,22654,22891,23126,23360,23592,23822,24051,
+ 24277,24502,24724,24945,25163,25379,25593,25805,26014,26221,26426,26628,
+ 26828,27025,27219,27411,27600,27786,27969,28150,28327,28502,28674,28842,
+ 29008,29171,29330,29486,29639,29789,29935,30078,30217,30354,30486,30616,
+ 30741,30864,30982,31097,31209,31316,31420,31521,31617,31710,31799,31885,
+ 31966,32044,32117,32187,32253,32315,32373,32428,32478,32524,32566,32605,
+ 32639,32669,32695,32717,32736,32750,32760,32766,32767,32766,32760,32750,
+ 32736,32717,32695,32669,32639,32605,32566,32524,32478,32428,32373,32315,
+ 32253,32187,32117,32044,31966,31885,31799,31710,31617,31521,31420,31316,
+ 31209,31097,30982,30864,30741,30616,30486,30354,30217,30078,29935,29789,
+ 29639,29486,29330,29171,29008,28842,28674,28502,28327,28150,27969,27786,
+ 27600,27411,27219,27025,26828,26628,26426,26221,26014,25805,25593,25379,
+ 25163,24945,24724,24502,24277,24051,23822,23592,23360,23126,22891,22654,
+ 22415,22175,21934,21691,21447,21202,20955,20707,20459,20209,19958,19706,
+ 19454,19201,18947,18693,18437,18182,17926,17669,17413,17156,16899,16641,
+ 16384,16127,15869,15612,15355,15099,14842,14586,14331,14075,13821,13567,
+ 13314,13062,12810,12559,12309,12061,11813,11566,11321,11077,10834,10593,
+ 10353,10114, 9877, 9642, 9408, 9176, 8946, 8717, 8491, 8266, 8044, 7823,
+  7605, 7389, 7175, 6963, 6754, 6547, 6342, 6140, 5940, 5743, 5549, 5357,
+  5168, 4982, 4799, 4618, 4441, 4266, 4094, 3926, 3760, 3597, 3438, 3282,
+  3129, 2979, 2833, 2690, 2551, 2414, 2282, 2152, 2027, 1904, 1786, 1671,
+  1559, 1452, 1348, 1247, 1151, 1058,  969,  883,  802,  724,  651,  581,
+   515,  453,  395,  340,  290,  244,  202,  163,  129,   99,   73,   51,
+    32,   18,    8,    2};
+const q15_t user_melFilterLut_q15[461] = {31082, 1686,30612, 2156,31274,  231, 1494,32537, 3026,29742, 6763,26005,
+ 11375,21393,16797,15971,22965, 9803,29823, 4710, 2945,28058,13073,19695,
+ 21987,10781,31404, 8817, 1364,23951,19475,13293,30521, 9474, 2247,23294,
+ 21597, 1281,11171,31487,14394,18374,27733, 8803, 5035,23965,22992, 4719,
+  9776,28049,19685, 2047,13083,30721,17717,  691,15051,32077,17000,  565,
+ 15768,32203,17449, 1584,15319,31184,18983, 3669,13785,29099,21528, 6745,
+ 11240,26023,25010,10741, 7758,22027,29362,15589, 1815, 3406,17179,30953,
+ 21224, 7929,11544,24839,27587,14753, 1919, 5181,18015,30849,22232, 9843,
+ 10536,22925,30311,18353, 6394, 2457,14415,26374,27397,15853, 4310, 5371,
+ 16915,28458,25786,14643, 3500, 6982,18125,29268,25391,14635, 3879, 7377,
+ 18133,28889,26130,15748, 5365, 6638,17020,27403,27925,17903, 7881, 4843,
+ 14865,24887,30701,21027,11353, 1678, 2067,11741,21415,31090,25050,15712,
+  6373, 7718,17056,26395,29906,20892,11877, 2863, 2862,11876,20891,29905,
+ 26831,18129, 9428,  727, 5937,14639,23340,32041,25071,16671, 8272, 7697,
+ 16097,24496,32645,24538,16430, 8323,  215,  123, 8230,16338,24445,32553,
+ 25149,17323, 9497, 1671, 7619,15445,23271,31097,26826,19272,11717, 4163,
+  5942,13496,21051,28605,29494,22202,14910, 7617,  325, 3274,10566,17858,
+ 25151,32443,26043,19004,11964, 4925, 6725,13764,20804,27843,30728,23933,
+ 17138,10343, 3549, 2040, 8835,15630,22425,29219,29635,23076,16517, 9958,
+  3399, 3133, 9692,16251,22810,29369,29718,23387,17056,10724, 4393, 3050,
+  9381,15712,22044,28375,30897,24786,18674,12563, 6452,  340, 1871, 7982,
+ 14094,20205,26316,32428,27197,21298,15399, 9499, 3600, 5571,11470,17369,
+ 23269,29168,30549,24854,19160,13465, 7771, 2076, 2219, 7914,13608,19303,
+ 24997,30692,29275,23779,18282,12785, 7288, 1792, 3493, 8989,14486,19983,
+ 25480,30976,29191,23885,18579,13273, 7967, 2661, 3577, 8883,14189,19495,
+ 24801,30107,30215,25094,19972,14850, 9728, 4606, 2553, 7674,12796,17918,
+ 23040,28162,32270,27326,22383,17439,12495, 7551, 2607,  498, 5442,10385,
+ 15329,20273,25217,30161,30512,25739,20967,16195,11422, 6650, 1878, 2256,
+  7029,11801,16573,21346,26118,30890,29974,25367,20760,16154,11547, 6940,
+  2334, 2794, 7401,12008,16614,21221,25828,30434,30574,26127,21680,17233,
+ 12787, 8340, 3893, 2194, 6641,11088,15535,19981,24428,28875,32234,27941,
+ 23649,19356,15064,10771, 6479, 2187,  534, 4827, 9119,13412,17704,21997,
+ 26289,30581,30735,26592,22449,18305,14162,10018, 5875, 1732, 2033, 6176,
+ 10319,14463,18606,22750,26893,31036,30440,26440,22441,18441,14442,10442,
+  6442, 2443, 2328, 6328,10327,14327,18326,22326,26326,30325,31265,27405,
+ 23544,19683,15822,11962, 8101, 4240,  379, 1503, 5363, 9224,13085,16946,
+ 20806,24667,28528,32389,29408,25681,21954,18227,14501,10774, 7047, 3321,
+  3360, 7087,10814,14541,18267,21994,25721,29447,32376,28779,25181,21584,
+ 17987,14389,10792, 7195, 3597};
 
@@ -22,4 +22,9 @@ extern const uint32_t  user_melFiltersStartIndices[64];
 extern const uint32_t  user_melFiltersStopIndices[64];
 extern const float32_t user_melFilterLut[461];
 
+/* Fixed-point tables: user_melFilterLut_q15 holds the coefficients scaled by 2^USER_MEL_LUT_Q15_SHIFT */
+#define USER_MEL_LUT_Q15_SHIFT (0U)
+extern const q15_t userWin_q15[400];
+extern const q15_t user_melFilterLut_q15[461];
+
 #endif /* _MEL_USER_TABLES_H */
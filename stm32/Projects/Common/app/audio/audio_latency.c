@@ -0,0 +1,278 @@
+/**
+ * @file audio_latency.c
+ * @brief Per-stage latency statistics of the audio inference loop.
+ *
+ * Samples are kept in a log-linear histogram: values below 4 us have their
+ * own bucket, above that every power of two is split into 4 buckets, so the
+ * reported percentile is within 25% of the real value at any scale.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "audio_latency.h"
+
+#if defined(HOST_BUILD)
+#include <time.h>
+#else
+#include "stm32u5xx.h"
+#endif
+
+/* ============================ Constants and Macros ============================ */
+
+/* Sub-buckets per power of two, as a number of bits */
+#define HISTOGRAM_SUB_BITS      2U
+#define HISTOGRAM_SUB_BUCKETS   (1U << HISTOGRAM_SUB_BITS)
+
+/* Largest power of two tracked separately (2^20 us ~ 1 s); longer samples share the last bucket */
+#define HISTOGRAM_MAX_MSB       20U
+#define HISTOGRAM_BUCKETS       ((HISTOGRAM_MAX_MSB - HISTOGRAM_SUB_BITS + 2U) * HISTOGRAM_SUB_BUCKETS)
+
+/* Percentile reported by the statistics, in percent */
+#define LATENCY_PERCENTILE      99U
+
+/* ============================ Type Definitions ============================ */
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t histogram[HISTOGRAM_BUCKETS];
+} StageStats_t;
+
+/* ============================ Static Variables ============================ */
+
+static const char* const s_stage_names[AUDIO_LATENCY_STAGE_NUMBER] = {
+    "capture-wait",
+    "preproc",
+    "handoff",
+    "inference",
+    "decision",
+    "publish"
+};
+
+/* Short names used for the telemetry attributes */
+static const char* const s_stage_keys[AUDIO_LATENCY_STAGE_NUMBER] = {
+    "lat_wait",
+    "lat_pre",
+    "lat_hnd",
+    "lat_inf",
+    "lat_dec",
+    "lat_pub"
+};
+
+static StageStats_t s_stats[AUDIO_LATENCY_STAGE_NUMBER];
+static uint32_t s_ticks_per_us = 1;
+static volatile uint32_t s_deadline_us = 0;
+static uint32_t s_frame_busy_us = 0;
+static uint32_t s_frames = 0;
+static uint32_t s_deadline_misses = 0;
+static volatile bool s_reset_requested = false;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t prvGetTicks(void) {
+#if defined(HOST_BUILD)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((uint64_t)ts.tv_sec * 1000000ULL) + ((uint64_t)ts.tv_nsec / 1000ULL));
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+static void prvInitTimeSource(void) {
+#if defined(HOST_BUILD)
+    s_ticks_per_us = 1;
+#else
+    /* Enable the DWT cycle counter; the wrap period (~26 s at 160 MHz) is far above any stage duration */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    s_ticks_per_us = SystemCoreClock / 1000000U;
+    if (s_ticks_per_us == 0) {
+        s_ticks_per_us = 1;
+    }
+#endif
+}
+
+static uint32_t prvBucketIndex(uint32_t value_us) {
+    if (value_us < HISTOGRAM_SUB_BUCKETS) {
+        return value_us;
+    }
+
+    uint32_t msb = 31U - (uint32_t)__builtin_clz(value_us);
+    if (msb > HISTOGRAM_MAX_MSB) {
+        return HISTOGRAM_BUCKETS - 1U;
+    }
+
+    uint32_t sub = (value_us >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1U);
+    return ((msb - HISTOGRAM_SUB_BITS + 1U) * HISTOGRAM_SUB_BUCKETS) + sub;
+}
+
+static uint32_t prvBucketUpperBound(uint32_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    uint32_t msb = (index / HISTOGRAM_SUB_BUCKETS) + HISTOGRAM_SUB_BITS - 1U;
+    uint32_t sub = index % HISTOGRAM_SUB_BUCKETS;
+    uint32_t step = 1U << (msb - HISTOGRAM_SUB_BITS);
+    return (1U << msb) + ((sub + 1U) * step) - 1U;
+}
+
+static void prvClear(void) {
+    memset(s_stats, 0, sizeof(s_stats));
+    s_frame_busy_us = 0;
+    s_frames = 0;
+    s_deadline_misses = 0;
+}
+
+static void prvHandleResetRequest(void) {
+    if (s_reset_requested) {
+        s_reset_requested = false;
+        prvClear();
+    }
+}
+
+void AudioLatency_Init(uint32_t deadline_us) {
+    prvInitTimeSource();
+    s_deadline_us = deadline_us;
+    s_reset_requested = false;
+    prvClear();
+}
+
+uint32_t AudioLatency_Start(void) {
+    return prvGetTicks();
+}
+
+uint32_t AudioLatency_Stop(AudioLatencyStage_t stage, uint32_t start) {
+    uint32_t now = prvGetTicks();
+    AudioLatency_Record(stage, (now - start) / s_ticks_per_us);
+    return now;
+}
+
+uint32_t AudioLatency_Lap(uint32_t* start) {
+    uint32_t now = prvGetTicks();
+    uint32_t elapsed_us = (now - *start) / s_ticks_per_us;
+    *start = now;
+    return elapsed_us;
+}
+
+void AudioLatency_Record(AudioLatencyStage_t stage, uint32_t duration_us) {
+    if (stage >= AUDIO_LATENCY_STAGE_NUMBER) {
+        return;
+    }
+
+    prvHandleResetRequest();
+
+    StageStats_t* stats = &s_stats[stage];
+    if (stats->count == 0 || duration_us < stats->min_us) {
+        stats->min_us = duration_us;
+    }
+    if (duration_us > stats->max_us) {
+        stats->max_us = duration_us;
+    }
+    stats->count++;
+    stats->sum_us += duration_us;
+    stats->histogram[prvBucketIndex(duration_us)]++;
+
+    /* Waiting is not processing */
+    if (stage != AUDIO_LATENCY_STAGE_CAPTURE_WAIT && stage != AUDIO_LATENCY_STAGE_HANDOFF) {
+        s_frame_busy_us += duration_us;
+    }
+}
+
+void AudioLatency_EndFrame(void) {
+    prvHandleResetRequest();
+
+    s_frames++;
+    if (s_deadline_us != 0 && s_frame_busy_us > s_deadline_us) {
+        s_deadline_misses++;
+    }
+    s_frame_busy_us = 0;
+}
+
+void AudioLatency_GetStats(AudioLatencyStage_t stage, AudioLatencyStats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (stage >= AUDIO_LATENCY_STAGE_NUMBER || s_stats[stage].count == 0) {
+        return;
+    }
+
+    const StageStats_t* stage_stats = &s_stats[stage];
+    stats->count = stage_stats->count;
+    stats->min_us = stage_stats->min_us;
+    stats->max_us = stage_stats->max_us;
+    stats->avg_us = (uint32_t)(stage_stats->sum_us / stage_stats->count);
+
+    /* Smallest bucket whose cumulative count reaches the percentile rank */
+    uint32_t rank = (uint32_t)(((uint64_t)stage_stats->count * LATENCY_PERCENTILE + 99U) / 100U);
+    uint32_t cumulative = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        cumulative += stage_stats->histogram[i];
+        if (cumulative >= rank) {
+            stats->p99_us = prvBucketUpperBound(i);
+            break;
+        }
+    }
+
+    /* The bucket bounds are coarser than the exact extremes */
+    if (stats->p99_us > stats->max_us) {
+        stats->p99_us = stats->max_us;
+    }
+    if (stats->p99_us < stats->min_us) {
+        stats->p99_us = stats->min_us;
+    }
+}
+
+void AudioLatency_GetFrameStats(uint32_t* frames, uint32_t* deadline_misses) {
+    *frames = s_frames;
+    *deadline_misses = s_deadline_misses;
+}
+
+uint32_t AudioLatency_GetDeadline(void) {
+    return s_deadline_us;
+}
+
+void AudioLatency_SetDeadline(uint32_t deadline_us) {
+    s_deadline_us = deadline_us;
+}
+
+void AudioLatency_Reset(void) {
+    s_reset_requested = true;
+}
+
+const char* AudioLatency_GetStageName(AudioLatencyStage_t stage) {
+    if (stage >= AUDIO_LATENCY_STAGE_NUMBER) {
+        return "unknown";
+    }
+    return s_stage_names[stage];
+}
+
+size_t AudioLatency_FormatAttributes(char* buffer, size_t buffer_size) {
+    size_t total = 0;
+
+    for (uint32_t stage = 0; stage < AUDIO_LATENCY_STAGE_NUMBER; stage++) {
+        AudioLatencyStats_t stats;
+        AudioLatency_GetStats((AudioLatencyStage_t)stage, &stats);
+
+        int written = snprintf(&buffer[(total < buffer_size) ? total : buffer_size],
+                               (total < buffer_size) ? (buffer_size - total) : 0,
+                               "\"%s_avg\":%lu,\"%s_p99\":%lu,\"%s_max\":%lu,",
+                               s_stage_keys[stage], (unsigned long)stats.avg_us,
+                               s_stage_keys[stage], (unsigned long)stats.p99_us,
+                               s_stage_keys[stage], (unsigned long)stats.max_us);
+        if (written < 0) {
+            return 0;
+        }
+        total += (size_t)written;
+    }
+
+    int written = snprintf(&buffer[(total < buffer_size) ? total : buffer_size],
+                           (total < buffer_size) ? (buffer_size - total) : 0,
+                           "\"lat_frames\":%lu,\"lat_misses\":%lu",
+                           (unsigned long)s_frames, (unsigned long)s_deadline_misses);
+    if (written < 0) {
+        return 0;
+    }
+    return total + (size_t)written;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file audio_latency.h
+ * @brief Per-stage latency statistics of the audio inference loop.
+ *
+ * Each stage of the mic task loop is timed with the DWT cycle counter on
+ * target (clock_gettime on the host build) and recorded into a fixed
+ * log-linear histogram, from which min/avg/p99/max are derived. Recording a
+ * sample is a handful of integer operations and no allocation, so the
+ * instrumentation can stay enabled in production builds.
+ *
+ * The statistics are written by a single task: the mic task, or the
+ * inference task when preprocessing and inference run in separate tasks
+ * (see inference_pipeline.h). Readers (CLI, telemetry) may observe a sample
+ * being recorded, which is acceptable for diagnostics.
+ */
+
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Period of the latency telemetry messages in milliseconds, 0 to disable.
+ */
+#ifndef AUDIO_LATENCY_TELEMETRY_PERIOD_MS
+#define AUDIO_LATENCY_TELEMETRY_PERIOD_MS 0
+#endif
+
+/**
+ * @brief Stages of the audio inference loop.
+ */
+typedef enum {
+    AUDIO_LATENCY_STAGE_CAPTURE_WAIT = 0,   ///< Waiting for the next DMA event
+    AUDIO_LATENCY_STAGE_PREPROC,            ///< Spectrogram computation
+    AUDIO_LATENCY_STAGE_HANDOFF,            ///< Waiting for the inference task, when the pipeline is used
+    AUDIO_LATENCY_STAGE_INFERENCE,          ///< Network inference
+    AUDIO_LATENCY_STAGE_DECISION,           ///< Post-processing of the network output
+    AUDIO_LATENCY_STAGE_PUBLISH,            ///< Payload formatting and MQTT publish
+    AUDIO_LATENCY_STAGE_NUMBER
+} AudioLatencyStage_t;
+
+/**
+ * @brief Latency statistics of one stage, in microseconds.
+ */
+typedef struct {
+    uint32_t count;     ///< Number of recorded samples
+    uint32_t min_us;    ///< Smallest sample
+    uint32_t avg_us;    ///< Mean of the samples
+    uint32_t p99_us;    ///< 99th percentile, upper bound of its histogram bucket
+    uint32_t max_us;    ///< Largest sample
+} AudioLatencyStats_t;
+
+/**
+ * @brief Initialize the time source and clear the statistics.
+ *
+ * @param[in] deadline_us Processing budget of one audio frame. Frames whose
+ *                        processing stages add up to more are counted as
+ *                        deadline misses. 0 disables the check.
+ */
+void AudioLatency_Init(uint32_t deadline_us);
+
+/**
+ * @brief Get the current timestamp to be passed to AudioLatency_Stop().
+ */
+uint32_t AudioLatency_Start(void);
+
+/**
+ * @brief Record the time elapsed since a timestamp for a stage.
+ *
+ * @param[in] stage Stage being measured.
+ * @param[in] start Timestamp returned by AudioLatency_Start().
+ *
+ * @return A new timestamp, so consecutive stages can be chained.
+ */
+uint32_t AudioLatency_Stop(AudioLatencyStage_t stage, uint32_t start);
+
+/**
+ * @brief Measure the time elapsed since a timestamp without recording it,
+ *        for a stage recorded later by another task.
+ *
+ * @param[in,out] start Timestamp returned by AudioLatency_Start(), advanced
+ *                      to the current time.
+ *
+ * @return Elapsed time in microseconds.
+ */
+uint32_t AudioLatency_Lap(uint32_t* start);
+
+/**
+ * @brief Record an already measured duration for a stage.
+ */
+void AudioLatency_Record(AudioLatencyStage_t stage, uint32_t duration_us);
+
+/**
+ * @brief Close the current audio frame and check it against the deadline.
+ *
+ * The time spent in all stages except the capture wait and the hand-off
+ * since the previous call is the processing time of the frame.
+ */
+void AudioLatency_EndFrame(void);
+
+/**
+ * @brief Get the statistics of a stage.
+ */
+void AudioLatency_GetStats(AudioLatencyStage_t stage, AudioLatencyStats_t* stats);
+
+/**
+ * @brief Get the number of frames closed and the number of deadline misses.
+ */
+void AudioLatency_GetFrameStats(uint32_t* frames, uint32_t* deadline_misses);
+
+/**
+ * @brief Get the processing budget of one audio frame in microseconds.
+ */
+uint32_t AudioLatency_GetDeadline(void);
+
+/**
+ * @brief Change the processing budget of one audio frame, e.g. when the
+ *        inference rate changes. Can be called from any task.
+ */
+void AudioLatency_SetDeadline(uint32_t deadline_us);
+
+/**
+ * @brief Request the statistics to be cleared.
+ *
+ * The statistics are cleared by the recording task before its next sample,
+ * so this can be called from any task.
+ */
+void AudioLatency_Reset(void);
+
+/**
+ * @brief Get the printable name of a stage.
+ */
+const char* AudioLatency_GetStageName(AudioLatencyStage_t stage);
+
+/**
+ * @brief Format the statistics as telemetry attributes.
+ *
+ * Writes a comma separated list of "name":value pairs without the enclosing
+ * braces, so that the result can be embedded into a telemetry message.
+ *
+ * @param[out] buffer Destination buffer.
+ * @param[in] buffer_size Size of the destination buffer.
+ *
+ * @return Number of characters that would have been written, as snprintf().
+ */
+size_t AudioLatency_FormatAttributes(char* buffer, size_t buffer_size);
+
+/**
+ * @brief Register the "latency" CLI command. Target only.
+ */
+void AudioLatency_RegisterCliCommand(void);
+
+#endif // AUDIO_LATENCY_H
@@ -0,0 +1,76 @@
+/**
+ * @file audio_latency_cli.c
+ * @brief "latency" CLI command printing the audio inference loop statistics.
+ *
+ * Usage:
+ *   latency         Print min/avg/p99/max of every stage in microseconds
+ *   latency reset   Clear the statistics
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "cli/cli.h"
+#include "FreeRTOS_CLI.h"
+
+#include "audio_latency.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define LATENCY_CLI_LINE_LEN 96
+
+/* ============================ Function Implementations ============================ */
+
+static void prvLatencyCommand(ConsoleIO_t * const pxCIO, uint32_t ulArgc, char * ppcArgv[]) {
+    char line[LATENCY_CLI_LINE_LEN];
+
+    if (ulArgc > 1) {
+        if (0 == strcmp(ppcArgv[1], "reset")) {
+            AudioLatency_Reset();
+            pxCIO->print("Latency statistics cleared.\r\n");
+        } else {
+            pxCIO->print("Usage: latency [reset]\r\n");
+        }
+        return;
+    }
+
+    snprintf(line, sizeof(line), "%-14s %8s %8s %8s %8s %8s\r\n",
+             "stage (us)", "count", "min", "avg", "p99", "max");
+    pxCIO->print(line);
+
+    for (uint32_t stage = 0; stage < AUDIO_LATENCY_STAGE_NUMBER; stage++) {
+        AudioLatencyStats_t stats;
+        AudioLatency_GetStats((AudioLatencyStage_t)stage, &stats);
+        snprintf(line, sizeof(line), "%-14s %8lu %8lu %8lu %8lu %8lu\r\n",
+                 AudioLatency_GetStageName((AudioLatencyStage_t)stage),
+                 (unsigned long)stats.count,
+                 (unsigned long)stats.min_us,
+                 (unsigned long)stats.avg_us,
+                 (unsigned long)stats.p99_us,
+                 (unsigned long)stats.max_us);
+        pxCIO->print(line);
+    }
+
+    uint32_t frames;
+    uint32_t misses;
+    AudioLatency_GetFrameStats(&frames, &misses);
+    snprintf(line, sizeof(line), "frames: %lu, deadline: %lu us, deadline misses: %lu\r\n",
+             (unsigned long)frames,
+             (unsigned long)AudioLatency_GetDeadline(),
+             (unsigned long)misses);
+    pxCIO->print(line);
+}
+
+static const CLI_Command_Definition_t xCommandDef_latency = {
+    .pcCommand = "latency",
+    .pcHelpString =
+        "latency [reset]\r\n"
+        "    Print the per-stage latency statistics of the audio inference loop.\r\n"
+        "    reset: clear the statistics.\r\n\n",
+    .pxCommandInterpreter = prvLatencyCommand
+};
+
+void AudioLatency_RegisterCliCommand(void) {
+    (void)FreeRTOS_CLIRegisterCommand(&xCommandDef_latency);
+}
@@ -0,0 +1,216 @@
+/**
+ * @file decision_config.c
+ * @brief Persistent configuration of the detection decision.
+ *
+ * Record layout, little endian:
+ *
+ *   0   magic "SDCF"
+ *   4   version
+ *   5   number of classes
+ *   6   reserved, 0
+ *   8   model hash, see DecisionConfig_ModelHash()
+ *   12  end of the header
+ *   12  confidence threshold
+ *   16  inactivity timeout
+ *   20  hysteresis margin
+ *   24  largest number of labels
+ *   28  inactivity timeout of each class
+ *   28 + 4 * classes  confidence offset of each class
+ *   28 + 8 * classes  CRC-32 of the bytes before
+ */
+
+#include <string.h>
+
+#include "decision_config.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define RECORD_MAGIC                0x46434453UL    // "SDCF"
+#define RECORD_VERSION              1U
+
+#define RECORD_MAGIC_OFFSET         0U
+#define RECORD_VERSION_OFFSET       4U
+#define RECORD_CLASSES_OFFSET       5U
+#define RECORD_MODEL_OFFSET         8U
+#define RECORD_THRESHOLD_OFFSET     12U
+#define RECORD_TIMEOUT_OFFSET       16U
+#define RECORD_HYSTERESIS_OFFSET    20U
+#define RECORD_LABELS_OFFSET        24U
+#define RECORD_TIMEOUTS_OFFSET      28U
+#define RECORD_OFFSETS_OFFSET       (RECORD_TIMEOUTS_OFFSET + 4U * SOUND_DECISION_CLASS_NUMBER)
+#define RECORD_CRC_OFFSET           (RECORD_OFFSETS_OFFSET + 4U * SOUND_DECISION_CLASS_NUMBER)
+
+#define RECORD_HEADER_SIZE          12U
+
+#define CRC32_POLYNOMIAL            0xEDB88320UL
+
+#define FNV1A_OFFSET_BASIS          0x811C9DC5UL
+#define FNV1A_PRIME                 0x01000193UL
+
+#if SOUND_DECISION_CLASS_NUMBER > 255
+#error "The record holds the number of classes in a byte"
+#endif
+
+/* ============================ Static Variables ============================ */
+
+static const char* const s_class_labels[SOUND_DECISION_CLASS_NUMBER] = CTRL_X_CUBE_AI_MODE_CLASS_LIST;
+
+/* ============================ Static Function Implementations ============================ */
+
+static uint32_t prvCrc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFUL;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (0U - (crc & 1U)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t prvFnv1a(uint32_t hash, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * FNV1A_PRIME;
+    }
+    return hash;
+}
+
+static void prvPutU32(uint8_t* dest, uint32_t value) {
+    dest[0] = (uint8_t)value;
+    dest[1] = (uint8_t)(value >> 8);
+    dest[2] = (uint8_t)(value >> 16);
+    dest[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t prvGetU32(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static bool prvInRange(int value, int min, int max) {
+    return value >= min && value <= max;
+}
+
+/* ============================ Function Implementations ============================ */
+
+uint32_t DecisionConfig_ModelHash(void) {
+    uint8_t classes = (uint8_t)SOUND_DECISION_CLASS_NUMBER;
+    uint32_t hash = prvFnv1a(FNV1A_OFFSET_BASIS, &classes, 1U);
+
+    // labels with their terminator, so that "ab","c" and "a","bc" differ
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        hash = prvFnv1a(hash, (const uint8_t*)s_class_labels[i], strlen(s_class_labels[i]) + 1U);
+    }
+    return hash;
+}
+
+void DecisionConfig_Capture(DecisionConfig_t* config) {
+    config->threshold = SoundDecision_GetThreshold();
+    config->inactivity_timeout = SoundDecision_GetInactivityTimeout();
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        config->class_timeouts[i] = SoundDecision_GetClassTimeout(i);
+        config->offsets[i] = SoundDecision_GetOffset(i);
+    }
+    config->hysteresis = SoundDecision_GetHysteresis();
+    config->max_labels = SoundDecision_GetMaxLabels();
+}
+
+bool DecisionConfig_Validate(const DecisionConfig_t* config) {
+    if (!prvInRange(config->threshold, 0, DECISION_CONFIG_MAX_PERCENT)
+            || !prvInRange(config->inactivity_timeout, 0, DECISION_CONFIG_MAX_TIMEOUT_MS)
+            || !prvInRange(config->hysteresis, 0, DECISION_CONFIG_MAX_PERCENT)
+            || config->max_labels < 1U || config->max_labels > SOUND_DECISION_MAX_LABELS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        if (!prvInRange(config->class_timeouts[i], 0, DECISION_CONFIG_MAX_TIMEOUT_MS)
+                || !prvInRange(config->offsets[i], -DECISION_CONFIG_MAX_OFFSET, DECISION_CONFIG_MAX_OFFSET)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DecisionConfig_Apply(const DecisionConfig_t* config) {
+    if (!DecisionConfig_Validate(config)) {
+        return false;
+    }
+    SoundDecision_SetThreshold(config->threshold);
+    // sets the timeout of every class, the per-class ones are set next
+    SoundDecision_SetInactivityTimeout(config->inactivity_timeout);
+    SoundDecision_SetClassTimeouts(config->class_timeouts);
+    SoundDecision_SetOffsets(config->offsets);
+    SoundDecision_SetHysteresis(config->hysteresis);
+    (void)SoundDecision_SetMaxLabels(config->max_labels);
+    return true;
+}
+
+size_t DecisionConfig_Encode(const DecisionConfig_t* config, uint8_t* record, size_t size) {
+    if (size < DECISION_CONFIG_RECORD_SIZE) {
+        return 0U;
+    }
+    memset(record, 0, DECISION_CONFIG_RECORD_SIZE);
+    prvPutU32(&record[RECORD_MAGIC_OFFSET], RECORD_MAGIC);
+    record[RECORD_VERSION_OFFSET] = RECORD_VERSION;
+    record[RECORD_CLASSES_OFFSET] = (uint8_t)SOUND_DECISION_CLASS_NUMBER;
+    prvPutU32(&record[RECORD_MODEL_OFFSET], DecisionConfig_ModelHash());
+    prvPutU32(&record[RECORD_THRESHOLD_OFFSET], (uint32_t)config->threshold);
+    prvPutU32(&record[RECORD_TIMEOUT_OFFSET], (uint32_t)config->inactivity_timeout);
+    prvPutU32(&record[RECORD_HYSTERESIS_OFFSET], (uint32_t)config->hysteresis);
+    prvPutU32(&record[RECORD_LABELS_OFFSET], config->max_labels);
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        prvPutU32(&record[RECORD_TIMEOUTS_OFFSET + 4U * i], (uint32_t)config->class_timeouts[i]);
+        prvPutU32(&record[RECORD_OFFSETS_OFFSET + 4U * i], (uint32_t)config->offsets[i]);
+    }
+    prvPutU32(&record[RECORD_CRC_OFFSET], prvCrc32(record, RECORD_CRC_OFFSET));
+    return DECISION_CONFIG_RECORD_SIZE;
+}
+
+DecisionConfigResult_t DecisionConfig_Decode(const uint8_t* record, size_t length, DecisionConfig_t* config) {
+    // not even a header, e.g. the default value of the KVStore entry
+    if (length < RECORD_HEADER_SIZE) {
+        return DECISION_CONFIG_EMPTY;
+    }
+    // a record of another number of classes has another size, told apart from a corrupt one by its header
+    if (prvGetU32(&record[RECORD_MAGIC_OFFSET]) == RECORD_MAGIC
+            && record[RECORD_VERSION_OFFSET] == RECORD_VERSION
+            && record[RECORD_CLASSES_OFFSET] != (uint8_t)SOUND_DECISION_CLASS_NUMBER) {
+        return DECISION_CONFIG_OTHER_MODEL;
+    }
+    if (length != DECISION_CONFIG_RECORD_SIZE
+            || prvGetU32(&record[RECORD_MAGIC_OFFSET]) != RECORD_MAGIC
+            || record[RECORD_VERSION_OFFSET] != RECORD_VERSION
+            || prvGetU32(&record[RECORD_CRC_OFFSET]) != prvCrc32(record, RECORD_CRC_OFFSET)) {
+        return DECISION_CONFIG_CORRUPT;
+    }
+    if (prvGetU32(&record[RECORD_MODEL_OFFSET]) != DecisionConfig_ModelHash()) {
+        return DECISION_CONFIG_OTHER_MODEL;
+    }
+
+    config->threshold = (int)prvGetU32(&record[RECORD_THRESHOLD_OFFSET]);
+    config->inactivity_timeout = (int)prvGetU32(&record[RECORD_TIMEOUT_OFFSET]);
+    config->hysteresis = (int)prvGetU32(&record[RECORD_HYSTERESIS_OFFSET]);
+    config->max_labels = prvGetU32(&record[RECORD_LABELS_OFFSET]);
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        config->class_timeouts[i] = (int)prvGetU32(&record[RECORD_TIMEOUTS_OFFSET + 4U * i]);
+        config->offsets[i] = (int)prvGetU32(&record[RECORD_OFFSETS_OFFSET + 4U * i]);
+    }
+    return DecisionConfig_Validate(config) ? DECISION_CONFIG_OK : DECISION_CONFIG_INVALID;
+}
+
+const char* DecisionConfig_ResultName(DecisionConfigResult_t result) {
+    switch (result) {
+    case DECISION_CONFIG_OK:
+        return "ok";
+    case DECISION_CONFIG_EMPTY:
+        return "empty";
+    case DECISION_CONFIG_CORRUPT:
+        return "corrupt";
+    case DECISION_CONFIG_OTHER_MODEL:
+        return "made for another model";
+    case DECISION_CONFIG_INVALID:
+        return "out of range";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * @file decision_config.h
+ * @brief Persistent configuration of the detection decision.
+ *
+ * The threshold, timeouts, offsets, hysteresis and number of labels set by
+ * the C2D commands only live in the statics of sound_decision.c, so a reset
+ * brings back the defaults until the cloud sends them again. This module
+ * turns them into a record to be kept in the KVStore and back.
+ *
+ * The record carries the number of classes and a hash of the class labels
+ * of the model it was made for: the offsets and timeouts are per class, so
+ * a record made for another model is rejected instead of being spread over
+ * classes it was not meant for. The values are checked against the ranges
+ * below before any of them is applied, so a record is applied whole or not
+ * at all.
+ *
+ * The module has no RTOS dependency: the same logic runs on target and on
+ * the host.
+ */
+
+#ifndef DECISION_CONFIG_H
+#define DECISION_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sound_decision.h"
+
+/** Size of a record */
+#define DECISION_CONFIG_RECORD_SIZE     (32U + 8U * SOUND_DECISION_CLASS_NUMBER)
+
+/** Largest confidence threshold and hysteresis margin in percent */
+#define DECISION_CONFIG_MAX_PERCENT     100
+
+/** Largest offset magnitude in percent */
+#define DECISION_CONFIG_MAX_OFFSET      100
+
+/** Largest inactivity timeout in milliseconds, a day */
+#define DECISION_CONFIG_MAX_TIMEOUT_MS  86400000
+
+/**
+ * @brief Parameters of the detection decision.
+ */
+typedef struct {
+    int threshold;                                      ///< Confidence threshold in percent
+    int inactivity_timeout;                             ///< Inactivity timeout last set for every class in ms
+    int class_timeouts[SOUND_DECISION_CLASS_NUMBER];    ///< Inactivity timeout of each class in ms
+    int offsets[SOUND_DECISION_CLASS_NUMBER];           ///< Confidence offset of each class in percent
+    int hysteresis;                                     ///< Hysteresis margin in percent
+    uint32_t max_labels;                                ///< Largest number of classes reported by one detection
+} DecisionConfig_t;
+
+/**
+ * @brief Outcome of the decoding of a record.
+ */
+typedef enum {
+    DECISION_CONFIG_OK = 0,         ///< Record decoded and valid
+    DECISION_CONFIG_EMPTY,          ///< No record, e.g. never saved, or shorter than a record header
+    DECISION_CONFIG_CORRUPT,        ///< Wrong size, magic, version or CRC
+    DECISION_CONFIG_OTHER_MODEL,    ///< Record made for another model
+    DECISION_CONFIG_INVALID,        ///< Values out of range
+} DecisionConfigResult_t;
+
+/**
+ * @brief Hash of the number of classes and the class labels of the model.
+ */
+uint32_t DecisionConfig_ModelHash(void);
+
+/**
+ * @brief Get the parameters in use by the decision logic.
+ */
+void DecisionConfig_Capture(DecisionConfig_t* config);
+
+/**
+ * @brief Check that every parameter is in range.
+ */
+bool DecisionConfig_Validate(const DecisionConfig_t* config);
+
+/**
+ * @brief Set all the parameters of the decision logic.
+ *
+ * SoundDecision_Init() must have been called, it sets the defaults.
+ *
+ * @return false, nothing being set, if a parameter is out of range.
+ */
+bool DecisionConfig_Apply(const DecisionConfig_t* config);
+
+/**
+ * @brief Encode parameters into a record.
+ *
+ * @param[out] record Record, DECISION_CONFIG_RECORD_SIZE bytes at least.
+ * @param[in] size Size of record.
+ *
+ * @return DECISION_CONFIG_RECORD_SIZE, 0 if size is too small.
+ */
+size_t DecisionConfig_Encode(const DecisionConfig_t* config, uint8_t* record, size_t size);
+
+/**
+ * @brief Decode and check a record.
+ *
+ * @param[in] record Record, as read from the store.
+ * @param[in] length Length read. Below the size of a record header, e.g. 0 or
+ *                   the default value of the KVStore entry, there is no record.
+ * @param[out] config Parameters, only valid if DECISION_CONFIG_OK.
+ *
+ * @return Outcome.
+ */
+DecisionConfigResult_t DecisionConfig_Decode(const uint8_t* record, size_t length, DecisionConfig_t* config);
+
+/**
+ * @brief Get a description of an outcome.
+ */
+const char* DecisionConfig_ResultName(DecisionConfigResult_t result);
+
+#endif // DECISION_CONFIG_H
@@ -0,0 +1,90 @@
+/**
+ * @file inference_pipeline.c
+ * @brief Hand-off of the spectrograms from the preprocessing task to the
+ *        inference task through a pair of ping-pong buffers.
+ *
+ * The free buffers and the submitted frames travel in two FreeRTOS queues.
+ * The preprocessing task always holds one buffer, so the free queue holds at
+ * most INFERENCE_PIPELINE_SLOTS - 1 buffers and the frame queue never fills.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include "inference_pipeline.h"
+#include "audio_latency.h"
+#include "spectrogram_engine.h"
+
+/* ============================ Static Variables ============================ */
+
+static int8_t s_buffers[INFERENCE_PIPELINE_SLOTS][SPECTROGRAM_ENGINE_SIZE];
+static QueueHandle_t s_free_queue = NULL;
+static QueueHandle_t s_frame_queue = NULL;
+
+/* Written by the preprocessing task only */
+static uint32_t s_sequence = 0;
+static uint32_t s_submitted = 0;
+static uint32_t s_dropped = 0;
+
+/* Written by the inference task only */
+static uint32_t s_completed = 0;
+
+/* Counter values at the last InferencePipeline_ClearStats(), written by the caller only */
+static InferencePipelineStats_t s_base;
+
+/* ============================ Function Implementations ============================ */
+
+int8_t* InferencePipeline_Init(void) {
+    s_free_queue = xQueueCreate(INFERENCE_PIPELINE_SLOTS, sizeof(int8_t*));
+    s_frame_queue = xQueueCreate(INFERENCE_PIPELINE_SLOTS, sizeof(InferenceFrame_t));
+    if (s_free_queue == NULL || s_frame_queue == NULL) {
+        return NULL;
+    }
+
+    /* The first buffer is filled right away, the others wait in the free queue */
+    for (uint32_t i = 1; i < INFERENCE_PIPELINE_SLOTS; i++) {
+        int8_t* buffer = s_buffers[i];
+        (void)xQueueSend(s_free_queue, &buffer, 0);
+    }
+    return s_buffers[0];
+}
+
+int8_t* InferencePipeline_Submit(InferenceFrame_t* frame, TickType_t timeout) {
+    int8_t* next = NULL;
+
+    frame->sequence = s_sequence++;
+    if (xQueueReceive(s_free_queue, &next, timeout) != pdTRUE) {
+        s_dropped++;
+        return frame->spectrogram;
+    }
+
+    frame->submit_ticks = AudioLatency_Start();
+    (void)xQueueSend(s_frame_queue, frame, 0);
+    s_submitted++;
+    return next;
+}
+
+bool InferencePipeline_Receive(InferenceFrame_t* frame, TickType_t timeout) {
+    return xQueueReceive(s_frame_queue, frame, timeout) == pdTRUE;
+}
+
+void InferencePipeline_Release(const InferenceFrame_t* frame) {
+    int8_t* buffer = frame->spectrogram;
+
+    s_completed++;
+    (void)xQueueSend(s_free_queue, &buffer, 0);
+}
+
+void InferencePipeline_GetStats(InferencePipelineStats_t* stats) {
+    stats->submitted = s_submitted - s_base.submitted;
+    stats->dropped = s_dropped - s_base.dropped;
+    stats->completed = s_completed - s_base.completed;
+}
+
+void InferencePipeline_ClearStats(void) {
+    s_base.submitted = s_submitted;
+    s_base.dropped = s_dropped;
+    s_base.completed = s_completed;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file inference_pipeline.h
+ * @brief Hand-off of the spectrograms from the preprocessing task to the
+ *        inference task through a pair of ping-pong buffers.
+ *
+ * The preprocessing task builds the spectrogram in one buffer while the
+ * inference task runs the network on the other one, so the audio keeps being
+ * consumed as it arrives whatever the inference time:
+ *
+ *  - when an inference is due, InferencePipeline_Submit() passes the filled
+ *    buffer to the inference task and returns the other one to continue in,
+ *  - the inference task waits in InferencePipeline_Receive(), runs the
+ *    network and gives the buffer back with InferencePipeline_Release().
+ *
+ * A frame is submitted only if the inference of the previous one has
+ * released its buffer. Otherwise, after the given timeout (none on target,
+ * where the audio does not wait), it is dropped and counted, and the
+ * preprocessing goes on in the same buffer: a frame never waits behind
+ * another one, so the latency from the audio to the inference stays bounded
+ * by one frame.
+ */
+
+#ifndef INFERENCE_PIPELINE_H
+#define INFERENCE_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "arm_math.h"
+
+/** Number of spectrogram buffers */
+#define INFERENCE_PIPELINE_SLOTS 2U
+
+/**
+ * @brief Spectrogram handed to the inference task, with what the inference
+ *        and the decision need to know about its audio.
+ */
+typedef struct {
+    int8_t* spectrogram;            ///< Quantized spectrogram, mel-major
+    float32_t energy;               ///< Spectrum sum of the spectrogram, for the silence detection
+    uint32_t time_ms;               ///< Time of the end of the audio of the frame
+    uint32_t half;                  ///< DMA buffer half holding the end of the audio of the frame
+    uint32_t capture_wait_us;       ///< Time spent waiting for audio since the previous frame
+    uint32_t preproc_us;            ///< Time spent computing the columns since the previous frame
+    uint32_t submit_ticks;          ///< AudioLatency_Start() at submission, for the hand-off latency
+    uint32_t sequence;              ///< Frame number, dropped frames included
+} InferenceFrame_t;
+
+/**
+ * @brief Frame counters of the pipeline.
+ */
+typedef struct {
+    uint32_t submitted;             ///< Frames handed to the inference task
+    uint32_t dropped;               ///< Frames dropped as the inference of the previous one was not done
+    uint32_t completed;             ///< Frames released by the inference task
+} InferencePipelineStats_t;
+
+/**
+ * @brief Create the hand-off queues and return the first buffer to fill.
+ *
+ * Called once, before the inference task starts.
+ *
+ * @return Buffer of SPECTROGRAM_ENGINE_SIZE bytes, NULL if the queues
+ *         cannot be created.
+ */
+int8_t* InferencePipeline_Init(void);
+
+/**
+ * @brief Pass a spectrogram to the inference task.
+ *
+ * Called by the preprocessing task only.
+ *
+ * @param[in] frame Frame whose spectrogram is the buffer being filled; the
+ *                  sequence number and submission time are set here.
+ * @param[in] timeout Ticks to wait for the inference of the previous frame,
+ *                    0 to drop the frame right away if it is not done.
+ *
+ * @return Buffer to fill next: the other buffer if the frame was submitted,
+ *         the same one if it was dropped.
+ */
+int8_t* InferencePipeline_Submit(InferenceFrame_t* frame, TickType_t timeout);
+
+/**
+ * @brief Wait for a spectrogram to run the inference on.
+ *
+ * @param[out] frame Frame to process.
+ * @param[in] timeout Ticks to wait, portMAX_DELAY to wait forever.
+ *
+ * @return false on timeout.
+ */
+bool InferencePipeline_Receive(InferenceFrame_t* frame, TickType_t timeout);
+
+/**
+ * @brief Give the buffer of a processed frame back to the preprocessing task.
+ */
+void InferencePipeline_Release(const InferenceFrame_t* frame);
+
+/**
+ * @brief Get the frame counters.
+ */
+void InferencePipeline_GetStats(InferencePipelineStats_t* stats);
+
+/**
+ * @brief Clear the frame counters.
+ */
+void InferencePipeline_ClearStats(void);
+
+/**
+ * @brief Register the "pipeline" CLI command printing the frame counters.
+ */
+void InferencePipeline_RegisterCliCommand(void);
+
+#endif // INFERENCE_PIPELINE_H
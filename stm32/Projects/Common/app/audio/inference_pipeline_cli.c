@@ -0,0 +1,59 @@
+/**
+ * @file inference_pipeline_cli.c
+ * @brief "pipeline" CLI command printing the preprocessing/inference hand-off counters.
+ *
+ * Usage:
+ *   pipeline          Print the submitted, dropped and completed frames
+ *   pipeline reset    Clear the counters
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "cli/cli.h"
+#include "FreeRTOS_CLI.h"
+
+#include "inference_pipeline.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define PIPELINE_CLI_LINE_LEN 96
+
+/* ============================ Function Implementations ============================ */
+
+static void prvPipelineCommand(ConsoleIO_t * const pxCIO, uint32_t ulArgc, char * ppcArgv[]) {
+    char line[PIPELINE_CLI_LINE_LEN];
+
+    if (ulArgc == 2 && 0 == strcmp(ppcArgv[1], "reset")) {
+        InferencePipeline_ClearStats();
+        pxCIO->print("Pipeline counters cleared.\r\n");
+        return;
+    }
+
+    if (ulArgc != 1) {
+        pxCIO->print("Usage: pipeline [reset]\r\n");
+        return;
+    }
+
+    InferencePipelineStats_t stats;
+    InferencePipeline_GetStats(&stats);
+
+    snprintf(line, sizeof(line), "submitted: %lu, dropped: %lu, completed: %lu\r\n",
+             (unsigned long)stats.submitted, (unsigned long)stats.dropped, (unsigned long)stats.completed);
+    pxCIO->print(line);
+}
+
+static const CLI_Command_Definition_t xCommandDef_pipeline = {
+    .pcCommand = "pipeline",
+    .pcHelpString =
+        "pipeline [reset]\r\n"
+        "    Print the frames handed from the preprocessing to the inference task,\r\n"
+        "    and those dropped as the previous inference was not done.\r\n"
+        "    reset: clear the counters.\r\n\n",
+    .pxCommandInterpreter = prvPipelineCommand
+};
+
+void InferencePipeline_RegisterCliCommand(void) {
+    (void)FreeRTOS_CLIRegisterCommand(&xCommandDef_pipeline);
+}
@@ -0,0 +1,218 @@
+/**
+ * @file logmel_fixed.c
+ * @brief Fixed-point log-mel spectrogram column.
+ *
+ * Scaling: the CMSIS-DSP real FFT of length N scales its output down by N
+ * (output format 10.22 in Q31, 10.6 in Q15 for N = 512), and the complex
+ * magnitude returns 2.30 (Q31) or 2.14 (Q15) from 1.31 or 1.15 inputs. One
+ * magnitude LSB is therefore worth N / 2^30 (or N / 2^14) in the units of the
+ * float spectrum of samples normalized to [-1, 1).
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "logmel_fixed.h"
+#include "user_mel_tables.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Fractional bits of the magnitude returned by arm_cmplx_mag_q31() / arm_cmplx_mag_q15() */
+#if LOGMEL_FIXED_FFT_Q31
+#define MAGNITUDE_FRAC_BITS 30
+#else
+#define MAGNITUDE_FRAC_BITS 14
+#endif
+
+/* Fractional bits of the mel coefficients of user_melFilterLut_q15 */
+#define MEL_COEF_FRAC_BITS (15 + (int)USER_MEL_LUT_Q15_SHIFT)
+
+/* Largest threshold, leaving room for the normalization shift of the Q15 FFT */
+#define THRESHOLD_MAX (INT64_MAX >> 17)
+
+/* ============================ Function Implementations ============================ */
+
+/**
+ * Tabulate the mel accumulators at which the quantized log-mel value steps
+ * up: round(log(x + LOG_OFFSET) * inv_scale) + offset >= value if and only if
+ * x >= exp((value - offset - 0.5) / inv_scale) - LOG_OFFSET.
+ */
+static bool prvInitThresholds(LogMelFixed_t* ctx, float32_t inv_scale, int32_t offset) {
+    if (!(inv_scale > 0.0F)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < LOGMEL_FIXED_THRESHOLDS; i++) {
+        int32_t value = INT8_MIN + 1 + (int32_t)i;
+        double mel_min = exp(((double)(value - offset) - 0.5) / (double)inv_scale) - (double)LOGMEL_FIXED_LOG_OFFSET;
+        double acc_min = ceil(mel_min / (double)ctx->mel_scale);
+
+        if (acc_min <= 0.0) {
+            ctx->thresholds[i] = 0;
+        } else if (acc_min >= (double)THRESHOLD_MAX) {
+            ctx->thresholds[i] = THRESHOLD_MAX;
+        } else {
+            ctx->thresholds[i] = (int64_t)acc_min;
+        }
+    }
+    return true;
+}
+
+bool LogMelFixed_Init(LogMelFixed_t* ctx, const AudioProcCtx_t* proc) {
+    memset(ctx, 0, sizeof(*ctx));
+
+#if LOGMEL_FIXED_FFT_Q31
+    if (arm_rfft_init_q31(&ctx->rfft, LOGMEL_FIXED_NFFT, 0, 1) != ARM_MATH_SUCCESS) {
+        return false;
+    }
+#else
+    if (arm_rfft_init_q15(&ctx->rfft, LOGMEL_FIXED_NFFT, 0, 1) != ARM_MATH_SUCCESS) {
+        return false;
+    }
+#endif
+
+    ctx->magnitude_scale = ldexpf((float32_t)LOGMEL_FIXED_NFFT, -MAGNITUDE_FRAC_BITS);
+    ctx->mel_scale = ldexpf(ctx->magnitude_scale, -MEL_COEF_FRAC_BITS);
+    return prvInitThresholds(ctx, proc->output_Q_inv_scale, (int32_t)proc->output_Q_offset);
+}
+
+/* Q15 x Q15 products are exact in Q31, rounding them to Q15 would add noise to the quiet frames */
+static void prvWindowSegment(q31_t* dst, const int16_t* src, const q15_t* win, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = ((q31_t)src[i] * win[i]) * 2;
+    }
+}
+
+/* Apply the Hann window to the frame made of head_len samples of head followed by tail */
+static void prvWindow(q31_t* windowed, const int16_t* head, uint32_t head_len, const int16_t* tail) {
+    uint32_t from_head = (head_len < LOGMEL_FIXED_WIN_LEN) ? head_len : LOGMEL_FIXED_WIN_LEN;
+
+    if (from_head > 0) {
+        prvWindowSegment(windowed, head, userWin_q15, from_head);
+    }
+    if (from_head < LOGMEL_FIXED_WIN_LEN) {
+        prvWindowSegment(&windowed[from_head], tail, &userWin_q15[from_head], LOGMEL_FIXED_WIN_LEN - from_head);
+    }
+}
+
+#if !LOGMEL_FIXED_FFT_Q31
+/**
+ * Convert the windowed frame to Q15, scaled up by 2^shift so that its peak
+ * uses the Q15 range. Returns the shift.
+ */
+static uint32_t prvNormalizeToQ15(const q31_t* windowed, q15_t* dst) {
+    uint32_t peak = 0;
+    for (uint32_t i = 0; i < LOGMEL_FIXED_WIN_LEN; i++) {
+        uint32_t magnitude = (uint32_t)((windowed[i] < 0) ? -windowed[i] : windowed[i]);
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
+    }
+
+    /* Largest shift keeping the peak in Q31, which the conversion to Q15 then truncates */
+    uint32_t shift = 0;
+    while (shift < 16U && peak <= (0x7FFFFFFFU >> (shift + 1U))) {
+        shift++;
+    }
+
+    for (uint32_t i = 0; i < LOGMEL_FIXED_WIN_LEN; i++) {
+        dst[i] = (q15_t)((windowed[i] * (int32_t)(1U << shift)) >> 16);
+    }
+    return shift;
+}
+#endif
+
+/**
+ * Compute the magnitude spectrum of the frame into ctx->magnitude. Returns
+ * its sum in magnitude LSBs, and the normalization shift of the frame: the
+ * magnitudes are 2^shift times too large.
+ */
+static int64_t prvSpectrum(LogMelFixed_t* ctx, const int16_t* head, uint32_t head_len,
+                           const int16_t* tail, uint32_t* shift) {
+#if LOGMEL_FIXED_FFT_Q31
+    prvWindow(ctx->fft_in, head, head_len, tail);
+    memset(&ctx->fft_in[LOGMEL_FIXED_WIN_LEN], 0,
+           (LOGMEL_FIXED_NFFT - LOGMEL_FIXED_WIN_LEN) * sizeof(ctx->fft_in[0]));
+    arm_rfft_q31(&ctx->rfft, ctx->fft_in, ctx->fft_out);
+    arm_cmplx_mag_q31(ctx->fft_out, ctx->magnitude, LOGMEL_FIXED_NBINS);
+    *shift = 0;
+#else
+    prvWindow(ctx->windowed, head, head_len, tail);
+    *shift = prvNormalizeToQ15(ctx->windowed, ctx->fft_in);
+    memset(&ctx->fft_in[LOGMEL_FIXED_WIN_LEN], 0,
+           (LOGMEL_FIXED_NFFT - LOGMEL_FIXED_WIN_LEN) * sizeof(ctx->fft_in[0]));
+    arm_rfft_q15(&ctx->rfft, ctx->fft_in, ctx->fft_out);
+    arm_cmplx_mag_q15(ctx->fft_out, ctx->magnitude, LOGMEL_FIXED_NBINS);
+#endif
+
+    int64_t magnitude_sum = 0;
+    for (uint32_t bin = 0; bin < LOGMEL_FIXED_NBINS; bin++) {
+        magnitude_sum += ctx->magnitude[bin];
+    }
+    return magnitude_sum;
+}
+
+/**
+ * Sparse mel filterbank: the coefficients of band m cover the bins start[m]
+ * to stop[m]. Accumulates one band and moves coef to the next one.
+ */
+static inline int64_t prvMelEnergy(const LogMelFixed_t* ctx, uint32_t mel, const q15_t** coef) {
+    uint32_t start = CTRL_X_CUBE_AI_SPECTROGRAM_MEL_START_IDX[mel];
+    uint32_t stop = CTRL_X_CUBE_AI_SPECTROGRAM_MEL_STOP_IDX[mel];
+    const q15_t* c = *coef;
+    int64_t acc = 0;
+
+    for (uint32_t bin = start; bin <= stop; bin++) {
+        acc += (int64_t)ctx->magnitude[bin] * *c++;
+    }
+    *coef = c;
+    return acc;
+}
+
+/* Number of thresholds, scaled up by 2^shift, that acc reaches, as an int8 value */
+static inline int8_t prvQuantize(const int64_t* thresholds, int64_t acc, uint32_t shift) {
+    uint32_t low = 0;
+    uint32_t high = LOGMEL_FIXED_THRESHOLDS;
+
+    while (low < high) {
+        uint32_t mid = (low + high) / 2U;
+        if (acc >= (thresholds[mid] << shift)) {
+            low = mid + 1U;
+        } else {
+            high = mid;
+        }
+    }
+    return (int8_t)((int32_t)low + INT8_MIN);
+}
+
+float32_t LogMelFixed_Column(LogMelFixed_t* ctx, const int16_t* head, uint32_t head_len,
+                             const int16_t* tail, float32_t* mel_column) {
+    uint32_t shift;
+    int64_t magnitude_sum = prvSpectrum(ctx, head, head_len, tail, &shift);
+
+    /* Undo the normalization */
+    float32_t magnitude_scale = ldexpf(ctx->magnitude_scale, -(int)shift);
+    float32_t mel_scale = ldexpf(ctx->mel_scale, -(int)shift);
+
+    const q15_t* coef = user_melFilterLut_q15;
+    for (uint32_t mel = 0; mel < LOGMEL_FIXED_NMEL; mel++) {
+        int64_t acc = prvMelEnergy(ctx, mel, &coef);
+        mel_column[mel] = logf(((float32_t)acc * mel_scale) + LOGMEL_FIXED_LOG_OFFSET);
+    }
+
+    return (float32_t)magnitude_sum * magnitude_scale;
+}
+
+float32_t LogMelFixed_ColumnQuantized(LogMelFixed_t* ctx, const int16_t* head, uint32_t head_len,
+                                      const int16_t* tail, int8_t* dst, uint32_t dst_stride) {
+    uint32_t shift;
+    int64_t magnitude_sum = prvSpectrum(ctx, head, head_len, tail, &shift);
+
+    const q15_t* coef = user_melFilterLut_q15;
+    for (uint32_t mel = 0; mel < LOGMEL_FIXED_NMEL; mel++) {
+        int64_t acc = prvMelEnergy(ctx, mel, &coef);
+        dst[mel * dst_stride] = prvQuantize(ctx->thresholds, acc, shift);
+    }
+
+    return (float32_t)magnitude_sum * ldexpf(ctx->magnitude_scale, -(int)shift);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file logmel_fixed.h
+ * @brief Fixed-point log-mel spectrogram column.
+ *
+ * Computes the same column as LogMelSpectrogramColumn() for the magnitude
+ * spectrum and LOGMELSPECTROGRAM_SCALE_LOG configuration of the model, but
+ * with the CMSIS-DSP fixed-point functions instead of the float ones:
+ *
+ *  - Hann window with Q15 coefficients on the 16-bit PCM samples, which are
+ *    Q15 already, keeping the exact Q31 products,
+ *  - real FFT and magnitude in Q31, or in Q15 (see LOGMEL_FIXED_FFT_Q31) on
+ *    the windowed frame normalized to its peak (block floating point),
+ *  - sparse mel filterbank with Q15 coefficients and 64-bit accumulation.
+ *
+ * LogMelFixed_ColumnQuantized() goes on to the network input without any
+ * logarithm or float: log(x + offset) * inv_scale + offset rounded to int8 is
+ * a step function of the mel energy x, so the 255 energies at which it steps
+ * up are tabulated once by LogMelFixed_Init() in mel accumulator units, and
+ * each band is quantized by a binary search of its 64-bit accumulator in this
+ * table, then written straight into the spectrogram window.
+ *
+ * LogMelFixed_Column() converts the NMEL mel energies to float log-mel values
+ * instead, to measure the accuracy of the fixed-point spectrum.
+ *
+ * The Q15 tables userWin_q15 and user_melFilterLut_q15 are generated along
+ * the float ones in user_mel_tables.c by lookup_tables_generator.py.
+ */
+
+#ifndef LOGMEL_FIXED_H
+#define LOGMEL_FIXED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arm_math.h"
+#include "preproc_dpu.h"
+
+/**
+ * FFT precision: 1 for the Q31 FFT and magnitude, 0 for the Q15 ones, which
+ * are faster but lose the weakest bins of each frame.
+ */
+#ifndef LOGMEL_FIXED_FFT_Q31
+#define LOGMEL_FIXED_FFT_Q31    1
+#endif
+
+/** FFT length */
+#define LOGMEL_FIXED_NFFT       CTRL_X_CUBE_AI_SPECTROGRAM_NFFT
+
+/** Number of samples the window applies to; the rest of the FFT input is zero */
+#define LOGMEL_FIXED_WIN_LEN    CTRL_X_CUBE_AI_SPECTROGRAM_WINDOW_LENGTH
+
+/** Number of mel bands */
+#define LOGMEL_FIXED_NMEL       CTRL_X_CUBE_AI_SPECTROGRAM_NMEL
+
+/** Number of spectrum bins, DC to Nyquist */
+#define LOGMEL_FIXED_NBINS      ((LOGMEL_FIXED_NFFT / 2U) + 1U)
+
+/** Offset added to the mel energies before the logarithm, as in the training feature extraction */
+#define LOGMEL_FIXED_LOG_OFFSET (1e-4F)
+
+/** Number of quantization thresholds: one per int8 value above INT8_MIN */
+#define LOGMEL_FIXED_THRESHOLDS 255U
+
+#if LOGMEL_FIXED_FFT_Q31
+typedef q31_t LogMelFixedSample_t;
+typedef arm_rfft_instance_q31 LogMelFixedRfft_t;
+#else
+typedef q15_t LogMelFixedSample_t;
+typedef arm_rfft_instance_q15 LogMelFixedRfft_t;
+#endif
+
+/**
+ * @brief State and scratch buffers of the fixed-point column.
+ */
+typedef struct {
+    LogMelFixedRfft_t rfft;                                     ///< CMSIS-DSP real FFT instance
+#if !LOGMEL_FIXED_FFT_Q31
+    q31_t windowed[LOGMEL_FIXED_WIN_LEN];                       ///< Windowed samples before normalization
+#endif
+    LogMelFixedSample_t fft_in[LOGMEL_FIXED_NFFT];              ///< FFT input, zero padded; modified by the FFT
+    LogMelFixedSample_t fft_out[2U * LOGMEL_FIXED_NFFT];        ///< FFT output, interleaved complex
+    LogMelFixedSample_t magnitude[LOGMEL_FIXED_NBINS];          ///< Magnitude spectrum
+    float32_t magnitude_scale;                                  ///< Float value of one magnitude LSB
+    float32_t mel_scale;                                        ///< Float value of one mel accumulator LSB
+    int64_t thresholds[LOGMEL_FIXED_THRESHOLDS];                ///< Smallest mel accumulator quantized to each int8 value above INT8_MIN
+} LogMelFixed_t;
+
+/**
+ * @brief Initialize the FFT instance, the scale factors and the quantization
+ *        thresholds.
+ *
+ * @param[out] ctx State.
+ * @param[in] proc Preprocessing context with the output quantization
+ *                 parameters set.
+ *
+ * @return false if the FFT length is not supported by CMSIS-DSP or the
+ *         quantization scale is not positive.
+ */
+bool LogMelFixed_Init(LogMelFixed_t* ctx, const AudioProcCtx_t* proc);
+
+/**
+ * @brief Compute one log-mel column.
+ *
+ * The frame is given in two parts so that it can straddle two buffers
+ * without a copy: head_len samples from head followed by tail.
+ *
+ * @param[in] ctx State initialized by LogMelFixed_Init().
+ * @param[in] head First samples of the frame, may be NULL if head_len is 0.
+ * @param[in] head_len Number of samples taken from head.
+ * @param[in] tail Rest of the frame, may be NULL if head_len covers the window.
+ * @param[out] mel_column LOGMEL_FIXED_NMEL log-mel values.
+ *
+ * @return Sum of the magnitude spectrum of the frame, for the silence
+ *         detection.
+ */
+float32_t LogMelFixed_Column(LogMelFixed_t* ctx, const int16_t* head, uint32_t head_len,
+                             const int16_t* tail, float32_t* mel_column);
+
+/**
+ * @brief Compute one column of the network input.
+ *
+ * Same as LogMelFixed_Column() followed by the quantization of each value,
+ * without computing the log-mel values.
+ *
+ * @param[in] ctx State initialized by LogMelFixed_Init().
+ * @param[in] head First samples of the frame, may be NULL if head_len is 0.
+ * @param[in] head_len Number of samples taken from head.
+ * @param[in] tail Rest of the frame, may be NULL if head_len covers the window.
+ * @param[out] dst Quantized value of the first mel band.
+ * @param[in] dst_stride Distance between the values of two consecutive mel
+ *                       bands in dst, the number of columns of a mel-major
+ *                       spectrogram.
+ *
+ * @return Sum of the magnitude spectrum of the frame, for the silence
+ *         detection.
+ */
+float32_t LogMelFixed_ColumnQuantized(LogMelFixed_t* ctx, const int16_t* head, uint32_t head_len,
+                                      const int16_t* tail, int8_t* dst, uint32_t dst_stride);
+
+#endif // LOGMEL_FIXED_H
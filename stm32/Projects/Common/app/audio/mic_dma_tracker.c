@@ -0,0 +1,108 @@
+/**
+ * @file mic_dma_tracker.c
+ * @brief Sequence tracking of the microphone DMA half/complete transfers.
+ *
+ * The interrupt side only increments a sequence counter, the task side
+ * compares it with the last consumed sequence. Event k (counting from 1 after
+ * MicDmaTracker_Reset()) always fills part (k - 1) % MIC_DMA_BUFFER_PARTS,
+ * so the halves to process follow from the sequence numbers alone.
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <string.h>
+#include "mic_dma_tracker.h"
+
+/* ============================ Static Variables ============================ */
+
+/* Written by the DMA interrupt only */
+static volatile uint32_t s_seq = 0;
+static volatile uint32_t s_missed_irqs = 0;
+
+/* Written by the mic task only */
+static uint32_t s_consumed_seq = 0;
+static uint32_t s_seq_base = 0;
+static uint32_t s_missed_irqs_base = 0;
+static MicDmaStats_t s_stats;
+
+static volatile bool s_clear_requested = false;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t prvHalfOfSeq(uint32_t seq) {
+    return (seq - 1U) % MIC_DMA_BUFFER_PARTS;
+}
+
+void MicDmaTracker_Reset(void) {
+    s_seq = 0;
+    s_missed_irqs = 0;
+    s_consumed_seq = 0;
+    s_seq_base = 0;
+    s_missed_irqs_base = 0;
+    s_clear_requested = false;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+uint32_t MicDmaTracker_OnTransfer(uint32_t half) {
+    uint32_t seq = s_seq;
+
+    /* The next event should fill part seq % MIC_DMA_BUFFER_PARTS; otherwise callbacks were not serviced */
+    uint32_t missed = (half + MIC_DMA_BUFFER_PARTS - (seq % MIC_DMA_BUFFER_PARTS)) % MIC_DMA_BUFFER_PARTS;
+    seq += missed;
+    s_missed_irqs += missed;
+
+    seq++;
+    s_seq = seq;
+    return seq;
+}
+
+bool MicDmaTracker_Next(MicDmaWork_t* work) {
+    uint32_t seq = s_seq;
+    uint32_t pending = seq - s_consumed_seq;
+
+    if (s_clear_requested) {
+        s_clear_requested = false;
+        memset(&s_stats, 0, sizeof(s_stats));
+        s_seq_base = s_consumed_seq;
+        s_missed_irqs_base = s_missed_irqs;
+    }
+
+    work->count = 0;
+    work->dropped = 0;
+
+    if (pending == 0) {
+        return false;
+    }
+
+    if (pending > s_stats.max_backlog) {
+        s_stats.max_backlog = pending;
+    }
+
+    work->halves[work->count++] = prvHalfOfSeq(seq);
+    if (pending > 1U) {
+        s_stats.overruns++;
+        /* The DMA is refilling the half of event seq - 1 already */
+        work->dropped = pending - work->count;
+        LogDebug("Audio overrun: %lu halves pending, %lu dropped",
+                 (unsigned long)pending, (unsigned long)work->dropped);
+    }
+
+    s_consumed_seq = seq;
+    s_stats.processed += work->count;
+    s_stats.dropped += work->dropped;
+    return true;
+}
+
+void MicDmaTracker_GetStats(MicDmaStats_t* stats) {
+    *stats = s_stats;
+    stats->events = s_seq - s_seq_base;
+    stats->missed_irqs = s_missed_irqs - s_missed_irqs_base;
+}
+
+void MicDmaTracker_ClearStats(void) {
+    s_clear_requested = true;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file mic_dma_tracker.h
+ * @brief Sequence tracking of the microphone DMA half/complete transfers.
+ *
+ * The microphone DMA runs in circular mode over a buffer split in two halves
+ * and raises one event per filled half. The DMA callbacks number every event,
+ * and the mic task asks the tracker which halves to process. When the task
+ * falls behind, more than one event is pending: the overrun is counted and
+ * the dropped audio frames are accounted for instead of being merged
+ * silently.
+ *
+ * When the task sees event k, the DMA is already refilling the half that
+ * event k - 1 filled, so only the latest half is intact: on an overrun, it
+ * is the only one processed and the older ones are reported as dropped, so
+ * that a gap is marked. Catching up on the older halves would need a buffer
+ * in more parts, each raising its own DMA event, which the BSP does not
+ * offer.
+ */
+
+#ifndef MIC_DMA_TRACKER_H
+#define MIC_DMA_TRACKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Index of the first half of the capture buffer */
+#define MIC_DMA_FIRST_HALF      0U
+
+/** Index of the second half of the capture buffer */
+#define MIC_DMA_SECOND_HALF     1U
+
+/** Number of parts of the capture buffer, one DMA event per filled part */
+#ifndef MIC_DMA_BUFFER_PARTS
+#define MIC_DMA_BUFFER_PARTS    2U
+#endif
+
+/* The BSP callbacks only report the two halves, and the mic task addresses the buffer by halves */
+#if MIC_DMA_BUFFER_PARTS != 2
+#error "The capture buffer is made of two halves"
+#endif
+
+/** Maximum number of halves returned by one call to MicDmaTracker_Next() */
+#define MIC_DMA_MAX_HALVES      (MIC_DMA_BUFFER_PARTS - 1U)
+
+/**
+ * @brief Halves of the capture buffer to process for one wake-up of the task.
+ */
+typedef struct {
+    uint32_t halves[MIC_DMA_MAX_HALVES];  ///< Half indexes to process, in capture order
+    uint32_t count;                       ///< Number of valid entries in halves
+    uint32_t dropped;                     ///< Number of halves lost since the previous call
+} MicDmaWork_t;
+
+/**
+ * @brief Cumulative DMA event counters.
+ */
+typedef struct {
+    uint32_t events;          ///< Half transfers signalled by the DMA, including missed callbacks
+    uint32_t processed;       ///< Halves handed to the task for processing
+    uint32_t dropped;         ///< Halves never processed
+    uint32_t overruns;        ///< Wake-ups that found more than one pending half
+    uint32_t missed_irqs;     ///< Callbacks out of the half/complete alternation
+    uint32_t max_backlog;     ///< Largest number of pending halves seen at once
+} MicDmaStats_t;
+
+/**
+ * @brief Restart the sequence tracking. Must be called before starting the DMA.
+ */
+void MicDmaTracker_Reset(void);
+
+/**
+ * @brief Record a DMA event. Called from the DMA interrupt callbacks.
+ *
+ * @param[in] half Index of the half that has just been filled.
+ *
+ * @return Sequence number of the event.
+ */
+uint32_t MicDmaTracker_OnTransfer(uint32_t half);
+
+/**
+ * @brief Get the halves to process since the previous call.
+ *
+ * @param[out] work Halves to process and number of halves dropped.
+ *
+ * @return true if at least one half is to be processed, false if no event is pending.
+ */
+bool MicDmaTracker_Next(MicDmaWork_t* work);
+
+/**
+ * @brief Get the cumulative event counters.
+ */
+void MicDmaTracker_GetStats(MicDmaStats_t* stats);
+
+/**
+ * @brief Clear the cumulative event counters, without affecting the sequence tracking.
+ */
+void MicDmaTracker_ClearStats(void);
+
+/**
+ * @brief Register the "micdma" CLI command. Target only.
+ */
+void MicDmaTracker_RegisterCliCommand(void);
+
+#endif // MIC_DMA_TRACKER_H
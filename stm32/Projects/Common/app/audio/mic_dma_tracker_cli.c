@@ -0,0 +1,61 @@
+/**
+ * @file mic_dma_tracker_cli.c
+ * @brief "micdma" CLI command printing the microphone DMA event counters.
+ *
+ * Usage:
+ *   micdma                          Print the event counters
+ *   micdma reset                    Clear the event counters
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "cli/cli.h"
+#include "FreeRTOS_CLI.h"
+
+#include "mic_dma_tracker.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define MIC_DMA_CLI_LINE_LEN 96
+
+/* ============================ Function Implementations ============================ */
+
+static void prvMicDmaCommand(ConsoleIO_t * const pxCIO, uint32_t ulArgc, char * ppcArgv[]) {
+    char line[MIC_DMA_CLI_LINE_LEN];
+
+    if (ulArgc == 2 && 0 == strcmp(ppcArgv[1], "reset")) {
+        MicDmaTracker_ClearStats();
+        pxCIO->print("Microphone DMA counters cleared.\r\n");
+        return;
+    }
+
+    if (ulArgc != 1) {
+        pxCIO->print("Usage: micdma [reset]\r\n");
+        return;
+    }
+
+    MicDmaStats_t stats;
+    MicDmaTracker_GetStats(&stats);
+
+    snprintf(line, sizeof(line), "events: %lu, processed: %lu, dropped: %lu\r\n",
+             (unsigned long)stats.events, (unsigned long)stats.processed, (unsigned long)stats.dropped);
+    pxCIO->print(line);
+    snprintf(line, sizeof(line), "overruns: %lu, missed irqs: %lu, max backlog: %lu\r\n",
+             (unsigned long)stats.overruns, (unsigned long)stats.missed_irqs, (unsigned long)stats.max_backlog);
+    pxCIO->print(line);
+}
+
+static const CLI_Command_Definition_t xCommandDef_micdma = {
+    .pcCommand = "micdma",
+    .pcHelpString =
+        "micdma [reset]\r\n"
+        "    Print the microphone DMA event counters, an overrun keeping the latest half only.\r\n"
+        "    reset: clear the counters.\r\n\n",
+    .pxCommandInterpreter = prvMicDmaCommand
+};
+
+void MicDmaTracker_RegisterCliCommand(void) {
+    (void)FreeRTOS_CLIRegisterCommand(&xCommandDef_micdma);
+}
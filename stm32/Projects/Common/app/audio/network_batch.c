@@ -0,0 +1,95 @@
+/**
+ * @file network_batch.c
+ * @brief Inference of the network on batches of spectrogram patches.
+ */
+
+#include <string.h>
+
+#include "network_batch.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#if defined(AI_NETWORK_INPUTS_IN_ACTIVATIONS)
+#define NETWORK_BATCH_INPUT_IN_ACTIVATIONS 1
+#else
+#define NETWORK_BATCH_INPUT_IN_ACTIVATIONS 0
+#endif
+
+#if defined(AI_NETWORK_OUTPUTS_IN_ACTIVATIONS)
+#define NETWORK_BATCH_OUTPUT_IN_ACTIVATIONS 1
+#else
+#define NETWORK_BATCH_OUTPUT_IN_ACTIVATIONS 0
+#endif
+
+/* ============================ Function Implementations ============================ */
+
+bool NetworkBatch_Init(NetworkBatch_t* batch, void* activations) {
+    const ai_handle activations_table[] = { AI_HANDLE_PTR(activations) };
+
+    memset(batch, 0, sizeof(*batch));
+
+    ai_error err = ai_network_create_and_init(&batch->network, activations_table, NULL);
+    if (err.type != AI_ERROR_NONE) {
+        batch->network = AI_HANDLE_NULL;
+        return false;
+    }
+
+    ai_buffer* inputs = ai_network_inputs_get(batch->network, NULL);
+    if (inputs == NULL) {
+        NetworkBatch_Deinit(batch);
+        return false;
+    }
+    batch->input_scale = AI_BUFFER_META_INFO_INTQ_GET_SCALE(inputs[0].meta_info, 0);
+    batch->input_zero_point = AI_BUFFER_META_INFO_INTQ_GET_ZEROPOINT(inputs[0].meta_info, 0);
+    if (!(batch->input_scale > 0.0F)) {
+        NetworkBatch_Deinit(batch);
+        return false;
+    }
+    return true;
+}
+
+uint32_t NetworkBatch_Run(NetworkBatch_t* batch, const int8_t* patches, uint32_t count, float32_t* scores) {
+    ai_buffer* inputs = ai_network_inputs_get(batch->network, NULL);
+    ai_buffer* outputs = ai_network_outputs_get(batch->network, NULL);
+#if NETWORK_BATCH_INPUT_IN_ACTIVATIONS
+    int8_t* input = (int8_t*)inputs[0].data;
+#endif
+#if NETWORK_BATCH_OUTPUT_IN_ACTIVATIONS
+    const float32_t* output = (const float32_t*)outputs[0].data;
+#endif
+
+    uint32_t done = 0;
+    while (done < count) {
+        const int8_t* patch = &patches[done * NETWORK_BATCH_PATCH_SIZE];
+        float32_t* patch_scores = &scores[done * NETWORK_BATCH_CLASSES];
+
+        /* The previous inference overwrote the activations, input tensor included */
+#if NETWORK_BATCH_INPUT_IN_ACTIVATIONS
+        memcpy(input, patch, NETWORK_BATCH_PATCH_SIZE);
+#else
+        inputs[0].data = AI_HANDLE_PTR(patch);
+#endif
+#if !NETWORK_BATCH_OUTPUT_IN_ACTIVATIONS
+        outputs[0].data = AI_HANDLE_PTR(patch_scores);
+#endif
+
+        if (ai_network_run(batch->network, &inputs[0], &outputs[0]) != 1) {
+            break;
+        }
+
+#if NETWORK_BATCH_OUTPUT_IN_ACTIVATIONS
+        memcpy(patch_scores, output, NETWORK_BATCH_CLASSES * sizeof(float32_t));
+#endif
+        done++;
+    }
+
+    batch->patches_run += done;
+    return done;
+}
+
+void NetworkBatch_Deinit(NetworkBatch_t* batch) {
+    if (batch->network != AI_HANDLE_NULL) {
+        (void)ai_network_destroy(batch->network);
+        batch->network = AI_HANDLE_NULL;
+    }
+}
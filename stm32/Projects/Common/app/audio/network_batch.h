@@ -0,0 +1,83 @@
+/**
+ * @file network_batch.h
+ * @brief Inference of the network on batches of spectrogram patches.
+ *
+ * On target, AiDPUProcess() runs the network on one patch per inference.
+ * For the offline evaluation of recorded audio, NetworkBatch_Run() runs the
+ * network of network.c on any number of patches per call:
+ *
+ *  - the network is created once, on an activations buffer provided by the
+ *    caller, and reused for every patch,
+ *  - each patch is passed to the network where it is when the input tensor
+ *    is not in the activations buffer, and copied to the input tensor
+ *    otherwise,
+ *  - the scores of each patch are written to the caller's array, straight
+ *    from the network when the output tensor is not in the activations
+ *    buffer.
+ *
+ * The generated code holds a single network instance: a program using this
+ * must not call AiDPULoadModel(), and the batches cannot run from several
+ * threads. Run several processes to use several cores.
+ */
+
+#ifndef NETWORK_BATCH_H
+#define NETWORK_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arm_math.h"
+#include "network.h"
+#include "network_data.h"
+
+/** Size of one patch in bytes: the quantized spectrogram of one inference, mel-major */
+#define NETWORK_BATCH_PATCH_SIZE        AI_NETWORK_IN_1_SIZE_BYTES
+
+/** Number of scores of one patch */
+#define NETWORK_BATCH_CLASSES           AI_NETWORK_OUT_1_SIZE
+
+/** Size in bytes of the activations buffer to pass to NetworkBatch_Init() */
+#define NETWORK_BATCH_ACTIVATIONS_SIZE  AI_NETWORK_DATA_ACTIVATIONS_SIZE
+
+/**
+ * @brief Network instance running the batches.
+ */
+typedef struct {
+    ai_handle network;                  ///< Network instance of network.c
+    float32_t input_scale;              ///< Value of one LSB of the quantized input
+    int32_t input_zero_point;           ///< Quantized value of 0
+    uint32_t patches_run;               ///< Total number of patches run
+} NetworkBatch_t;
+
+/**
+ * @brief Create and initialize the network.
+ *
+ * @param[out] batch Network instance.
+ * @param[in] activations Buffer of NETWORK_BATCH_ACTIVATIONS_SIZE bytes,
+ *                        aligned on 32 bytes, kept until
+ *                        NetworkBatch_Deinit().
+ *
+ * @return false if the network cannot be created or its input is not
+ *         quantized.
+ */
+bool NetworkBatch_Init(NetworkBatch_t* batch, void* activations);
+
+/**
+ * @brief Run the network on consecutive patches.
+ *
+ * @param[in] batch Network instance.
+ * @param[in] patches count patches of NETWORK_BATCH_PATCH_SIZE bytes.
+ * @param[in] count Number of patches.
+ * @param[out] scores count x NETWORK_BATCH_CLASSES scores, patch-major.
+ *
+ * @return Number of patches run, less than count if the network failed on
+ *         the next one.
+ */
+uint32_t NetworkBatch_Run(NetworkBatch_t* batch, const int8_t* patches, uint32_t count, float32_t* scores);
+
+/**
+ * @brief Destroy the network.
+ */
+void NetworkBatch_Deinit(NetworkBatch_t* batch);
+
+#endif // NETWORK_BATCH_H
@@ -0,0 +1,51 @@
+/**
+ * @file network_buffers.c
+ * @brief Location of the network input and output tensors.
+ */
+
+#include <stddef.h>
+
+#include "network_buffers.h"
+#include "network.h"
+#include "ai_model_config.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#if AI_NETWORK_IN_1_SIZE_BYTES != (CTRL_X_CUBE_AI_SPECTROGRAM_COL * CTRL_X_CUBE_AI_SPECTROGRAM_NMEL)
+#error "The network input does not match the spectrogram size of ai_model_config.h"
+#endif
+
+#if defined(AI_NETWORK_INPUTS_IN_ACTIVATIONS) && defined(AI_NETWORK_OUTPUTS_IN_ACTIVATIONS)
+#define NETWORK_BUFFERS_IN_ACTIVATIONS 1
+#else
+#define NETWORK_BUFFERS_IN_ACTIVATIONS 0
+#endif
+
+/* ============================ Static Variables ============================ */
+
+#if !NETWORK_BUFFERS_IN_ACTIVATIONS
+static int8_t s_input[AI_NETWORK_IN_1_SIZE_BYTES];
+static float32_t s_output[AI_NETWORK_OUT_1_SIZE];
+#endif
+
+/* ============================ Function Implementations ============================ */
+
+bool NetworkBuffers_Init(NetworkBuffers_t* buffers) {
+#if NETWORK_BUFFERS_IN_ACTIVATIONS
+    /* The generated code has a single network instance, which AI_HANDLE_NULL selects */
+    ai_buffer* inputs = ai_network_inputs_get(AI_HANDLE_NULL, NULL);
+    ai_buffer* outputs = ai_network_outputs_get(AI_HANDLE_NULL, NULL);
+
+    if (inputs == NULL || outputs == NULL || inputs[0].data == NULL || outputs[0].data == NULL) {
+        return false;
+    }
+    buffers->input = (int8_t*)inputs[0].data;
+    buffers->output = (float32_t*)outputs[0].data;
+    buffers->in_activations = true;
+#else
+    buffers->input = s_input;
+    buffers->output = s_output;
+    buffers->in_activations = false;
+#endif
+    return true;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file network_buffers.h
+ * @brief Location of the network input and output tensors.
+ *
+ * When the model is generated with its inputs and outputs allocated in the
+ * activations buffer (AI_NETWORK_INPUTS_IN_ACTIVATIONS and
+ * AI_NETWORK_OUTPUTS_IN_ACTIVATIONS in network.h), the spectrogram is built
+ * directly at the input tensor address and the scores are read where the
+ * network writes them, so no separate spectrogram or output buffer is needed.
+ * Otherwise, static buffers are used as before.
+ *
+ * A network input in the activations buffer is overwritten by the inference:
+ * see SpectrogramEngine_SetVolatileWindow().
+ */
+
+#ifndef NETWORK_BUFFERS_H
+#define NETWORK_BUFFERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arm_math.h"
+
+/**
+ * @brief Network input and output tensors.
+ */
+typedef struct {
+    int8_t* input;                  ///< Quantized spectrogram, mel-major
+    float32_t* output;              ///< Class scores
+    bool in_activations;            ///< The tensors are in the activations buffer
+} NetworkBuffers_t;
+
+/**
+ * @brief Get the addresses of the network input and output tensors.
+ *
+ * Must be called after AiDPULoadModel(), which sets up the activations
+ * buffer.
+ *
+ * @param[out] buffers Tensor addresses.
+ *
+ * @return false if the network does not provide the tensor addresses.
+ */
+bool NetworkBuffers_Init(NetworkBuffers_t* buffers);
+
+#endif // NETWORK_BUFFERS_H
@@ -0,0 +1,227 @@
+/**
+ * @file score_smoothing.c
+ * @brief Temporal smoothing of the class scores
+ *
+ * This module keeps the ring of the last score vectors and computes the
+ * smoothed scores passed to the detection decision.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "score_smoothing.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Longest method name accepted by ScoreSmoothing_Parse(), terminator excluded */
+#define MODE_NAME_MAX_LEN 7
+
+/* ============================ Static Variables ============================ */
+
+static const char* const s_mode_names[] = { "none", "ema", "median", "vote" };
+
+static ScoreSmoothingConfig_t s_config = { SCORE_SMOOTHING_NONE, 100U, 1U, 1U };
+static ScoreSmoothingConfig_t s_pending_config;
+static volatile bool s_config_pending = false;
+
+static float s_history[SCORE_SMOOTHING_MAX_FRAMES][SCORE_SMOOTHING_CLASS_NUMBER];
+static uint8_t s_history_best[SCORE_SMOOTHING_MAX_FRAMES];
+static uint32_t s_history_head = 0;     // index of the next frame to write
+static uint32_t s_history_count = 0;
+static float s_smoothed[SCORE_SMOOTHING_CLASS_NUMBER];
+
+/* ============================ Static Function Implementations ============================ */
+
+static bool prvIsValid(const ScoreSmoothingConfig_t* config) {
+    switch (config->mode) {
+    case SCORE_SMOOTHING_NONE:
+        return true;
+    case SCORE_SMOOTHING_EMA:
+        return (config->alpha_percent >= 1U) && (config->alpha_percent <= 100U);
+    case SCORE_SMOOTHING_MEDIAN:
+        return (config->frames >= 1U) && (config->frames <= SCORE_SMOOTHING_MAX_FRAMES);
+    case SCORE_SMOOTHING_VOTE:
+        return (config->frames >= 1U) && (config->frames <= SCORE_SMOOTHING_MAX_FRAMES)
+            && (config->votes >= 1U) && (config->votes <= config->frames);
+    default:
+        return false;
+    }
+}
+
+static void prvHandlePendingConfig(void) {
+    if (s_config_pending) {
+        s_config = s_pending_config;
+        s_config_pending = false;
+        ScoreSmoothing_Reset();
+    }
+}
+
+/* Index of the frame added i frames before the last one, i < s_history_count */
+static uint32_t prvHistoryIndex(uint32_t i) {
+    return (s_history_head + SCORE_SMOOTHING_MAX_FRAMES - 1U - i) % SCORE_SMOOTHING_MAX_FRAMES;
+}
+
+static void prvPush(const float* scores) {
+    uint32_t best = 0;
+    for (uint32_t c = 1; c < SCORE_SMOOTHING_CLASS_NUMBER; c++) {
+        if (scores[c] > scores[best]) {
+            best = c;
+        }
+    }
+
+    memcpy(s_history[s_history_head], scores, sizeof(s_history[0]));
+    s_history_best[s_history_head] = (uint8_t)best;
+    s_history_head = (s_history_head + 1U) % SCORE_SMOOTHING_MAX_FRAMES;
+    if (s_history_count < SCORE_SMOOTHING_MAX_FRAMES) {
+        s_history_count++;
+    }
+}
+
+static void prvEma(const float* scores) {
+    if (s_history_count == 1U) {
+        memcpy(s_smoothed, scores, sizeof(s_smoothed));
+        return;
+    }
+
+    const float alpha = (float)s_config.alpha_percent / 100.0F;
+    for (uint32_t c = 0; c < SCORE_SMOOTHING_CLASS_NUMBER; c++) {
+        s_smoothed[c] += alpha * (scores[c] - s_smoothed[c]);
+    }
+}
+
+static void prvMedian(uint32_t frames) {
+    float sorted[SCORE_SMOOTHING_MAX_FRAMES];
+
+    for (uint32_t c = 0; c < SCORE_SMOOTHING_CLASS_NUMBER; c++) {
+        // insertion sort, N is small
+        for (uint32_t i = 0; i < frames; i++) {
+            float value = s_history[prvHistoryIndex(i)][c];
+            uint32_t j = i;
+            while ((j > 0U) && (sorted[j - 1U] > value)) {
+                sorted[j] = sorted[j - 1U];
+                j--;
+            }
+            sorted[j] = value;
+        }
+
+        if ((frames % 2U) != 0U) {
+            s_smoothed[c] = sorted[frames / 2U];
+        } else {
+            s_smoothed[c] = (sorted[frames / 2U - 1U] + sorted[frames / 2U]) / 2.0F;
+        }
+    }
+}
+
+static void prvVote(uint32_t frames) {
+    uint32_t votes[SCORE_SMOOTHING_CLASS_NUMBER] = { 0 };
+
+    memset(s_smoothed, 0, sizeof(s_smoothed));
+    for (uint32_t i = 0; i < frames; i++) {
+        uint32_t index = prvHistoryIndex(i);
+        votes[s_history_best[index]]++;
+        for (uint32_t c = 0; c < SCORE_SMOOTHING_CLASS_NUMBER; c++) {
+            s_smoothed[c] += s_history[index][c];
+        }
+    }
+
+    for (uint32_t c = 0; c < SCORE_SMOOTHING_CLASS_NUMBER; c++) {
+        s_smoothed[c] = (votes[c] >= s_config.votes) ? (s_smoothed[c] / (float)frames) : 0.0F;
+    }
+}
+
+/* ============================ Function Implementations ============================ */
+
+void ScoreSmoothing_Init(void) {
+    s_config.mode = SCORE_SMOOTHING_NONE;
+    s_config_pending = false;
+    ScoreSmoothing_Reset();
+}
+
+bool ScoreSmoothing_Configure(const ScoreSmoothingConfig_t* config) {
+    if (!prvIsValid(config)) {
+        return false;
+    }
+    s_pending_config = *config;
+    s_config_pending = true;
+    return true;
+}
+
+void ScoreSmoothing_GetConfig(ScoreSmoothingConfig_t* config) {
+    *config = s_config_pending ? s_pending_config : s_config;
+}
+
+bool ScoreSmoothing_Parse(const char* text, ScoreSmoothingConfig_t* config) {
+    char name[MODE_NAME_MAX_LEN + 1];
+    unsigned int first = 0;
+    unsigned int second = 0;
+    char extra;
+
+    int fields = sscanf(text, "%7s %u %u %c", name, &first, &second, &extra);
+    if (fields < 1) {
+        return false;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->alpha_percent = 100U;
+    config->frames = 1U;
+    config->votes = 1U;
+
+    if ((0 == strcmp(name, s_mode_names[SCORE_SMOOTHING_NONE])) && (fields == 1)) {
+        config->mode = SCORE_SMOOTHING_NONE;
+    } else if ((0 == strcmp(name, s_mode_names[SCORE_SMOOTHING_EMA])) && (fields == 2)) {
+        config->mode = SCORE_SMOOTHING_EMA;
+        config->alpha_percent = first;
+    } else if ((0 == strcmp(name, s_mode_names[SCORE_SMOOTHING_MEDIAN])) && (fields == 2)) {
+        config->mode = SCORE_SMOOTHING_MEDIAN;
+        config->frames = first;
+    } else if ((0 == strcmp(name, s_mode_names[SCORE_SMOOTHING_VOTE])) && (fields == 3)) {
+        config->mode = SCORE_SMOOTHING_VOTE;
+        config->votes = first;
+        config->frames = second;
+    } else {
+        return false;
+    }
+    return prvIsValid(config);
+}
+
+int ScoreSmoothing_Format(const ScoreSmoothingConfig_t* config, char* text, uint32_t size) {
+    switch (config->mode) {
+    case SCORE_SMOOTHING_EMA:
+        return snprintf(text, size, "ema %u", (unsigned int)config->alpha_percent);
+    case SCORE_SMOOTHING_MEDIAN:
+        return snprintf(text, size, "median %u", (unsigned int)config->frames);
+    case SCORE_SMOOTHING_VOTE:
+        return snprintf(text, size, "vote %u %u", (unsigned int)config->votes, (unsigned int)config->frames);
+    default:
+        return snprintf(text, size, "none");
+    }
+}
+
+void ScoreSmoothing_Reset(void) {
+    s_history_head = 0;
+    s_history_count = 0;
+}
+
+const float* ScoreSmoothing_Update(const float* scores) {
+    prvHandlePendingConfig();
+
+    if (s_config.mode == SCORE_SMOOTHING_NONE) {
+        return scores;
+    }
+
+    prvPush(scores);
+
+    uint32_t frames = (s_history_count < s_config.frames) ? s_history_count : s_config.frames;
+    switch (s_config.mode) {
+    case SCORE_SMOOTHING_EMA:
+        prvEma(scores);
+        break;
+    case SCORE_SMOOTHING_MEDIAN:
+        prvMedian(frames);
+        break;
+    default:
+        prvVote(frames);
+        break;
+    }
+    return s_smoothed;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file score_smoothing.h
+ * @brief Temporal smoothing of the class scores before the detection decision.
+ *
+ * SoundDecision_Evaluate() decides on the scores of one inference, so a single
+ * noisy frame is enough to publish a detection. This module keeps a ring of
+ * the last SCORE_SMOOTHING_MAX_FRAMES score vectors and turns each new vector
+ * into a smoothed one, passed to the decision instead:
+ *
+ *  - none: the scores of the last frame, as before,
+ *  - ema: exponential moving average, the new frame weighting alpha percent,
+ *  - median: per-class median of the last N frames,
+ *  - vote: a class keeps its mean score over the last N frames if it was the
+ *    best raw class in at least K of them, and scores 0 otherwise.
+ *
+ * Until the ring holds N frames, the median and the vote use the frames
+ * available, so a vote cannot pass before K frames. The history is cleared by
+ * ScoreSmoothing_Reset(), e.g. on silence, so that an event is never smoothed
+ * with the previous one.
+ *
+ * The cost is a few operations per class and frame. The module has no RTOS
+ * dependency: the same logic runs on target and on the host.
+ */
+
+#ifndef SCORE_SMOOTHING_H
+#define SCORE_SMOOTHING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ai_model_config.h"
+
+/** Number of scores of one frame */
+#define SCORE_SMOOTHING_CLASS_NUMBER    CTRL_X_CUBE_AI_MODE_CLASS_NUMBER
+
+/** Number of frames kept in the ring, largest N of the median and the vote */
+#define SCORE_SMOOTHING_MAX_FRAMES      8U
+
+/**
+ * @brief Smoothing method.
+ */
+typedef enum {
+    SCORE_SMOOTHING_NONE = 0,         ///< Scores of the last frame
+    SCORE_SMOOTHING_EMA,              ///< Exponential moving average
+    SCORE_SMOOTHING_MEDIAN,           ///< Per-class median of the last N frames
+    SCORE_SMOOTHING_VOTE              ///< Mean of the last N frames for the classes best in K of them
+} ScoreSmoothingMode_t;
+
+/**
+ * @brief Smoothing configuration.
+ */
+typedef struct {
+    ScoreSmoothingMode_t mode;        ///< Smoothing method
+    uint32_t alpha_percent;           ///< Weight of the new frame in percent, ema only, 1 to 100
+    uint32_t frames;                  ///< N, median and vote only, 1 to SCORE_SMOOTHING_MAX_FRAMES
+    uint32_t votes;                   ///< K, vote only, 1 to N
+} ScoreSmoothingConfig_t;
+
+/**
+ * @brief Initialize the module without smoothing.
+ */
+void ScoreSmoothing_Init(void);
+
+/**
+ * @brief Change the smoothing configuration.
+ *
+ * Takes effect, with an empty history, at the next ScoreSmoothing_Update();
+ * can be called from another task.
+ *
+ * @param[in] config New configuration.
+ *
+ * @return false if the configuration is out of range.
+ */
+bool ScoreSmoothing_Configure(const ScoreSmoothingConfig_t* config);
+
+/**
+ * @brief Get the smoothing configuration, including a pending one.
+ */
+void ScoreSmoothing_GetConfig(ScoreSmoothingConfig_t* config);
+
+/**
+ * @brief Parse a configuration: "none", "ema <alpha>", "median <n>" or "vote <k> <n>".
+ *
+ * @param[in] text Configuration, words separated by spaces.
+ * @param[out] config Parsed configuration, only valid if true is returned.
+ *
+ * @return false if the text is not a valid configuration.
+ */
+bool ScoreSmoothing_Parse(const char* text, ScoreSmoothingConfig_t* config);
+
+/**
+ * @brief Print a configuration in the format of ScoreSmoothing_Parse().
+ *
+ * @return Number of characters written, as snprintf().
+ */
+int ScoreSmoothing_Format(const ScoreSmoothingConfig_t* config, char* text, uint32_t size);
+
+/**
+ * @brief Clear the history of score vectors.
+ *
+ * Must be called from the task calling ScoreSmoothing_Update().
+ */
+void ScoreSmoothing_Reset(void);
+
+/**
+ * @brief Add the scores of a new frame to the history and smooth them.
+ *
+ * @param[in] scores Array of SCORE_SMOOTHING_CLASS_NUMBER class scores.
+ *
+ * @return Array of SCORE_SMOOTHING_CLASS_NUMBER smoothed scores, valid until
+ *         the next update, or scores itself without smoothing.
+ */
+const float* ScoreSmoothing_Update(const float* scores);
+
+#endif // SCORE_SMOOTHING_H
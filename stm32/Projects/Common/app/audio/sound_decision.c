@@ -0,0 +1,435 @@
+/**
+ * @file sound_decision.c
+ * @brief Detection decision logic
+ *
+ * This module applies the per-class confidence offsets to the network output,
+ * selects the best class and gates it with the confidence threshold, the
+ * hysteresis and the inactivity timeout of the class.
+ *
+ * The parameters are set in percent but applied in the score domain: the
+ * offsets are converted to scores and the thresholds to the lowest score
+ * reaching them when they change, so a frame only costs one addition per
+ * class and comparisons, without division nor double-precision arithmetic
+ * (software emulated on the Cortex-M33). The levels are exact: the outcome
+ * and the confidence are the same as computing (int)(100.0 * score) for
+ * every class.
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "sound_decision.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Time subtracted from "now" so that the next detection is never blocked (in milliseconds) */
+#define DETECTED_NEVER_OFFSET_MS 99999U
+
+/* Label of the catch-all class that is never reported */
+#define OTHER_CLASS_LABEL "other"
+
+/* Index of the "other" class when the model has none */
+#define NO_CLASS_IDX UINT32_MAX
+
+/* Largest confidence in percent */
+#define PERCENT_MAX 100
+
+/* ============================ Static Variables ============================ */
+
+static const char* const* s_class_labels = NULL;
+static uint32_t s_last_detection_times[SOUND_DECISION_CLASS_NUMBER];
+static int s_confidence_threshold = SOUND_DECISION_DEFAULT_THRESHOLD;
+static int s_inactivity_timeout = SOUND_DECISION_DEFAULT_INACTIVITY_TIMEOUT;
+static int s_class_timeouts[SOUND_DECISION_CLASS_NUMBER];
+static const int s_default_offsets[] = SOUND_DECISION_DEFAULT_OFFSETS;
+static int s_confidence_offsets[SOUND_DECISION_CLASS_NUMBER];
+static int s_hysteresis_margin = SOUND_DECISION_DEFAULT_HYSTERESIS;
+static bool s_class_active[SOUND_DECISION_CLASS_NUMBER];
+static uint32_t s_max_labels = SOUND_DECISION_DEFAULT_LABELS;
+static uint32_t s_other_idx = NO_CLASS_IDX;
+
+/* Parameters converted to the score domain */
+static float s_percent_levels[PERCENT_MAX + 1];    // lowest score of each confidence, index 0 unused
+static float s_offset_scores[SOUND_DECISION_CLASS_NUMBER];
+static float s_threshold_level;
+static float s_release_level;
+
+/* ============================ Static Function Implementations ============================ */
+
+/* Lowest score x such that 100.0 * x >= percent, the product being exact in double */
+static float prvComputePercentLevel(int percent) {
+    float level = (float)percent / 100.0F;
+    while ((100.0 * level) < (double)percent) {
+        level = nextafterf(level, INFINITY);
+    }
+    while ((100.0 * nextafterf(level, -INFINITY)) >= (double)percent) {
+        level = nextafterf(level, -INFINITY);
+    }
+    return level;
+}
+
+/* Lowest score whose confidence reaches percent */
+static float prvPercentLevel(int percent) {
+    if (percent <= 0) {
+        return -INFINITY;
+    }
+    if (percent > PERCENT_MAX) {
+        return INFINITY;
+    }
+    return s_percent_levels[percent];
+}
+
+static void prvUpdateOffsetScores(void) {
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        s_offset_scores[i] = (float)s_confidence_offsets[i] / 100.0F;
+    }
+}
+
+static void prvUpdateThresholdLevels(void) {
+    s_threshold_level = prvPercentLevel(s_confidence_threshold);
+    s_release_level = prvPercentLevel(s_confidence_threshold - s_hysteresis_margin);
+}
+
+/* Make inactive the classes whose confidence fell below the release level */
+static void prvReleaseClasses(const float* scores) {
+    int hysteresis_margin = s_hysteresis_margin;
+    if (hysteresis_margin <= 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        if (s_class_active[i]) {
+            float class_out = scores[i] + s_offset_scores[i];
+            if (class_out < s_release_level) {
+                LogInfo("Releasing %s with score %d", s_class_labels[i], SoundDecision_ToPercent(class_out));
+                s_class_active[i] = false;
+            }
+        }
+    }
+}
+
+/* Insert a class in the labels sorted by decreasing score, keeping the best max_labels */
+static void prvInsertLabel(SoundDecision_t* decision, float* label_scores, uint32_t max_labels,
+                           uint32_t class_idx, float class_out) {
+    uint32_t pos = decision->label_count;
+    while ((pos > 0U) && (class_out > label_scores[pos - 1U])) {
+        pos--;
+    }
+    if (pos >= max_labels) {
+        return;
+    }
+
+    uint32_t last = (decision->label_count < max_labels) ? decision->label_count : (max_labels - 1U);
+    for (uint32_t i = last; i > pos; i--) {
+        decision->labels[i] = decision->labels[i - 1U];
+        label_scores[i] = label_scores[i - 1U];
+    }
+    decision->labels[pos].class_idx = class_idx;
+    label_scores[pos] = class_out;
+    if (decision->label_count < max_labels) {
+        decision->label_count++;
+    }
+}
+
+/* Report every class reaching the threshold, up to max_labels, the best class being evaluated already */
+static bool prvEvaluateLabels(const float* scores, uint32_t now_ms, uint32_t max_labels, SoundDecision_t* decision) {
+    float label_scores[SOUND_DECISION_MAX_LABELS];
+    uint32_t held_count = 0;
+    uint32_t blocked_count = 0;
+
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        float class_out = scores[i] + s_offset_scores[i];
+        if ((i == s_other_idx) || (class_out < s_threshold_level)) {
+            continue;
+        }
+        if ((s_hysteresis_margin > 0) && s_class_active[i]) {
+            held_count++;
+            continue;
+        }
+        if (SoundDecision_IsClassBlocked(i, now_ms)) {
+            blocked_count++;
+            if (s_hysteresis_margin > 0) {
+                // the sound is the same when the timeout ends
+                s_class_active[i] = true;
+            }
+            continue;
+        }
+        prvInsertLabel(decision, label_scores, max_labels, i, class_out);
+    }
+
+    if (decision->label_count == 0U) {
+        if (blocked_count > 0U) {
+            LogInfo("Blocking %u classes...", (unsigned)blocked_count);
+            decision->outcome = SOUND_DECISION_BLOCKED;
+        } else if (held_count > 0U) {
+            LogInfo("Holding %u classes...", (unsigned)held_count);
+            decision->outcome = SOUND_DECISION_HELD;
+        } else if (decision->class_idx == s_other_idx) {
+            LogInfo("Detected \"other\" with score %d. Ignoring...", decision->confidence_percent);
+            decision->outcome = SOUND_DECISION_OTHER;
+        } else {
+            LogInfo("Confidence is low for %s (%d<%d). Ignoring...",
+                    decision->class_name,
+                    decision->confidence_percent,
+                    s_confidence_threshold
+            );
+            decision->outcome = SOUND_DECISION_LOW_CONFIDENCE;
+        }
+        return false;
+    }
+
+    for (uint32_t i = 0; i < decision->label_count; i++) {
+        SoundDecisionLabel_t* label = &decision->labels[i];
+        label->class_name = s_class_labels[label->class_idx];
+        label->confidence_percent = SoundDecision_ToPercent(label_scores[i]);
+        s_last_detection_times[label->class_idx] = now_ms;
+        if (s_hysteresis_margin > 0) {
+            s_class_active[label->class_idx] = true;
+        }
+    }
+    decision->class_idx = decision->labels[0].class_idx;
+    decision->class_name = decision->labels[0].class_name;
+    decision->confidence_percent = decision->labels[0].confidence_percent;
+    decision->outcome = SOUND_DECISION_DETECTED;
+    return true;
+}
+
+/* ============================ Function Implementations ============================ */
+
+void SoundDecision_Init(const char* const* class_labels) {
+    s_class_labels = class_labels;
+    SoundDecision_SetInactivityTimeout(s_inactivity_timeout);
+    // the default offsets were calibrated for one model, not to be spread over the classes of another
+    if ((sizeof(s_default_offsets) / sizeof(s_default_offsets[0])) == SOUND_DECISION_CLASS_NUMBER) {
+        memcpy(s_confidence_offsets, s_default_offsets, sizeof(s_confidence_offsets));
+    } else {
+        memset(s_confidence_offsets, 0, sizeof(s_confidence_offsets));
+    }
+    for (int percent = 1; percent <= PERCENT_MAX; percent++) {
+        s_percent_levels[percent] = prvComputePercentLevel(percent);
+    }
+    prvUpdateOffsetScores();
+    prvUpdateThresholdLevels();
+
+    s_other_idx = NO_CLASS_IDX;
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        if (0 == strcmp(OTHER_CLASS_LABEL, class_labels[i])) {
+            s_other_idx = i;
+        }
+    }
+}
+
+int SoundDecision_ToPercent(float score) {
+    // largest confidence whose level the score reaches, 0 if none
+    int low = 0;
+    int high = PERCENT_MAX + 1;
+    while ((high - low) > 1) {
+        int mid = (low + high) / 2;
+        if (score >= s_percent_levels[mid]) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void SoundDecision_SetDetectedNever(uint32_t now_ms) {
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        s_last_detection_times[i] = now_ms - DETECTED_NEVER_OFFSET_MS;
+    }
+}
+
+bool SoundDecision_IsClassBlocked(uint32_t class_idx, uint32_t now_ms) {
+    return ((int)(now_ms - s_last_detection_times[class_idx]) < s_class_timeouts[class_idx]);
+}
+
+bool SoundDecision_IsBlocked(uint32_t now_ms) {
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        if (SoundDecision_IsClassBlocked(i, now_ms)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SoundDecision_Evaluate(const float* scores, uint32_t now_ms, SoundDecision_t* decision) {
+    uint32_t max_idx = 0; // assume best is at index 0 and disprove
+    float max_out = scores[0] + s_offset_scores[0];
+
+    for (uint32_t i = 1; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        float class_out = scores[i] + s_offset_scores[i];
+        if (class_out > max_out) {
+            max_idx = i;
+            max_out = class_out;
+        }
+    }
+
+    int confidence_score_percent = SoundDecision_ToPercent(max_out);
+    bool confident = (max_out >= s_threshold_level);
+    prvReleaseClasses(scores);
+
+    const char* c = s_class_labels[max_idx];
+    decision->class_idx = max_idx;
+    decision->class_name = c;
+    decision->confidence_percent = confidence_score_percent;
+    decision->label_count = 0;
+
+    uint32_t max_labels = s_max_labels;
+    if (max_labels > 1U) {
+        return prvEvaluateLabels(scores, now_ms, max_labels, decision);
+    }
+
+    if (max_idx == s_other_idx) {
+        LogInfo("Detected \"other\" with score %s%d. Ignoring...",
+                (confident ? "*" : " "),
+                confidence_score_percent
+        );
+        decision->outcome = SOUND_DECISION_OTHER;
+        return false;
+    }
+
+    if (!confident) {
+        LogInfo("Confidence is low for %s (%d<%d). Ignoring...",
+                c,
+                confidence_score_percent,
+                s_confidence_threshold
+        );
+        decision->outcome = SOUND_DECISION_LOW_CONFIDENCE;
+        return false;
+    }
+
+    if (s_hysteresis_margin > 0) {
+        if (s_class_active[max_idx]) {
+            LogInfo("Holding %s with score %d...", c, confidence_score_percent);
+            decision->outcome = SOUND_DECISION_HELD;
+            return false;
+        }
+        // also when blocked below: the sound is the same when the timeout ends
+        s_class_active[max_idx] = true;
+    }
+
+    if (SoundDecision_IsClassBlocked(max_idx, now_ms)) {
+        LogInfo("Blocking %s with score %s%d...",
+                c,
+                (confident ? "*" : " "),
+                confidence_score_percent
+        );
+        decision->outcome = SOUND_DECISION_BLOCKED;
+        return false;
+    }
+
+    // we are good
+    s_last_detection_times[max_idx] = now_ms;
+    decision->outcome = SOUND_DECISION_DETECTED;
+    decision->labels[0].class_idx = max_idx;
+    decision->labels[0].class_name = c;
+    decision->labels[0].confidence_percent = confidence_score_percent;
+    decision->label_count = 1;
+    return true;
+}
+
+void SoundDecision_SetThreshold(int threshold) {
+    s_confidence_threshold = threshold;
+    prvUpdateThresholdLevels();
+}
+
+int SoundDecision_GetThreshold(void) {
+    return s_confidence_threshold;
+}
+
+void SoundDecision_SetInactivityTimeout(int timeout_ms) {
+    s_inactivity_timeout = timeout_ms;
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        s_class_timeouts[i] = timeout_ms;
+    }
+}
+
+int SoundDecision_GetInactivityTimeout(void) {
+    return s_inactivity_timeout;
+}
+
+void SoundDecision_SetClassTimeouts(const int* timeouts_ms) {
+    memcpy(s_class_timeouts, timeouts_ms, sizeof(s_class_timeouts));
+}
+
+int SoundDecision_GetClassTimeout(uint32_t class_idx) {
+    if (class_idx >= SOUND_DECISION_CLASS_NUMBER) {
+        return 0;
+    }
+    return s_class_timeouts[class_idx];
+}
+
+bool SoundDecision_SetMaxLabels(uint32_t count) {
+    if ((count < 1U) || (count > SOUND_DECISION_MAX_LABELS)) {
+        return false;
+    }
+    s_max_labels = count;
+    return true;
+}
+
+uint32_t SoundDecision_GetMaxLabels(void) {
+    return s_max_labels;
+}
+
+int SoundDecision_FormatLabels(const SoundDecision_t* decision, char* text, uint32_t size) {
+    int len = 0;
+    if (size > 0U) {
+        text[0] = '\0';
+    }
+    for (uint32_t i = 0; i < decision->label_count; i++) {
+        bool room = ((uint32_t)len < size);
+        int written = snprintf(room ? &text[len] : NULL, room ? (size - (uint32_t)len) : 0U, "%s%s:%d",
+                               (i > 0U) ? "," : "",
+                               decision->labels[i].class_name,
+                               decision->labels[i].confidence_percent);
+        if (written < 0) {
+            return written;
+        }
+        len += written;
+    }
+    return len;
+}
+
+void SoundDecision_SetHysteresis(int margin) {
+    s_hysteresis_margin = margin;
+    prvUpdateThresholdLevels();
+}
+
+int SoundDecision_GetHysteresis(void) {
+    return s_hysteresis_margin;
+}
+
+void SoundDecision_ClearHysteresis(void) {
+    memset(s_class_active, 0, sizeof(s_class_active));
+}
+
+void SoundDecision_SetOffsets(const int* offsets) {
+    memcpy(s_confidence_offsets, offsets, sizeof(s_confidence_offsets));
+    prvUpdateOffsetScores();
+}
+
+bool SoundDecision_SetClassOffset(const char* class_name, int offset) {
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        if (0 == strcmp(class_name, s_class_labels[i])) {
+            LogInfo("Applying offset %d to %s", offset, s_class_labels[i]);
+            s_confidence_offsets[i] = offset;
+            prvUpdateOffsetScores();
+            return true;
+        }
+    }
+    return false;
+}
+
+int SoundDecision_GetOffset(uint32_t class_idx) {
+    if (class_idx >= SOUND_DECISION_CLASS_NUMBER) {
+        return 0;
+    }
+    return s_confidence_offsets[class_idx];
+}
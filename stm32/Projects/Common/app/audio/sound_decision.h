@@ -0,0 +1,244 @@
+/**
+ * @file sound_decision.h
+ * @brief Post-processing of the network output into detection decisions.
+ *
+ * Holds the tunable decision parameters (confidence threshold, per-class
+ * confidence offsets, per-class inactivity timeouts, hysteresis and number of
+ * labels)
+ * and turns one vector of class scores into a detection decision.
+ *
+ * By default the decision reports the best class only. With more labels, it
+ * reports every class reaching the threshold once its offset is added, i.e.
+ * a class threshold of the confidence threshold minus the class offset, best
+ * first: overlapping sounds are reported together by a single detection
+ * instead of successive detections separated by the inactivity timeout.
+ *
+ * Each class has its own inactivity timeout, started by its own detections:
+ * a detection never blocks the detections of the other classes. The module has no RTOS dependency: time
+ * is passed in by the caller so the same logic runs on target and on the host.
+ */
+
+#ifndef SOUND_DECISION_H
+#define SOUND_DECISION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ai_model_config.h"
+
+/** Number of classes handled by the decision logic */
+#define SOUND_DECISION_CLASS_NUMBER     CTRL_X_CUBE_AI_MODE_CLASS_NUMBER
+
+/** Default confidence threshold in percent */
+#define SOUND_DECISION_DEFAULT_THRESHOLD          42
+
+/** Default inactivity timeout of every class in milliseconds */
+#define SOUND_DECISION_DEFAULT_INACTIVITY_TIMEOUT 5000
+
+/** Default hysteresis margin in percent, 0 to disable the hysteresis */
+#define SOUND_DECISION_DEFAULT_HYSTERESIS         0
+
+/** Largest number of classes reported by one detection */
+#define SOUND_DECISION_MAX_LABELS       SOUND_DECISION_CLASS_NUMBER
+
+/** Default number of classes reported by one detection, the best one only */
+#define SOUND_DECISION_DEFAULT_LABELS   1U
+
+/** Default per-class confidence offsets in percent, only applied to a model with as many classes, 0 otherwise */
+#define SOUND_DECISION_DEFAULT_OFFSETS  {0, -49, -19, 39, 27, -25}
+
+/**
+ * @brief Outcome of the evaluation of one score vector.
+ */
+typedef enum {
+    SOUND_DECISION_DETECTED = 0,      ///< A class was detected and should be reported
+    SOUND_DECISION_OTHER,             ///< Best class is "other", nothing to report
+    SOUND_DECISION_LOW_CONFIDENCE,    ///< Best class is below the confidence threshold
+    SOUND_DECISION_BLOCKED,           ///< Best class is confident but inside its inactivity timeout
+    SOUND_DECISION_HELD               ///< Best class is confident but was already, see SoundDecision_SetHysteresis()
+} SoundDecisionOutcome_t;
+
+/**
+ * @brief Class reported by a detection.
+ */
+typedef struct {
+    uint32_t class_idx;               ///< Index of the class
+    const char* class_name;           ///< Label of the class
+    int confidence_percent;           ///< Confidence of the class, offset applied, clamped to [0, 100]
+} SoundDecisionLabel_t;
+
+/**
+ * @brief Result of the evaluation of one score vector.
+ */
+typedef struct {
+    SoundDecisionOutcome_t outcome;   ///< Outcome of the evaluation
+    uint32_t class_idx;               ///< Index of the best class after offsets are applied, the first label if detected
+    const char* class_name;           ///< Label of the best class
+    int confidence_percent;           ///< Confidence of the best class, clamped to [0, 100]
+    uint32_t label_count;             ///< Number of classes reported, 0 unless detected
+    SoundDecisionLabel_t labels[SOUND_DECISION_MAX_LABELS]; ///< Classes reported, by decreasing confidence
+} SoundDecision_t;
+
+/**
+ * @brief Initialize the decision logic with its default parameters.
+ *
+ * Every class gets the inactivity timeout last set by
+ * SoundDecision_SetInactivityTimeout(), the default one if none.
+ *
+ * @param[in] class_labels Array of SOUND_DECISION_CLASS_NUMBER class labels.
+ *                         The array must stay valid for the lifetime of the module.
+ */
+void SoundDecision_Init(const char* const* class_labels);
+
+/**
+ * @brief Evaluate one vector of class scores.
+ *
+ * @param[in] scores Array of SOUND_DECISION_CLASS_NUMBER class scores in the range [0, 1].
+ * @param[in] now_ms Current time in milliseconds.
+ * @param[out] decision Evaluation result.
+ *
+ * @return true if a class has been detected and should be reported, false otherwise.
+ */
+bool SoundDecision_Evaluate(const float* scores, uint32_t now_ms, SoundDecision_t* decision);
+
+/**
+ * @brief Convert a score, offset applied, to the confidence reported in percent.
+ *
+ * Same result as (int)(100.0 * score) clamped to [0, 100], without
+ * double-precision arithmetic. SoundDecision_Init() must have been called.
+ */
+int SoundDecision_ToPercent(float score);
+
+/**
+ * @brief Make the next confident detection of every class pass regardless of its inactivity timeout.
+ *
+ * @param[in] now_ms Current time in milliseconds.
+ */
+void SoundDecision_SetDetectedNever(uint32_t now_ms);
+
+/**
+ * @brief Check whether detections of any class are currently suppressed by its inactivity timeout.
+ *
+ * @param[in] now_ms Current time in milliseconds.
+ *
+ * @return true if a class was detected less than its inactivity timeout ago.
+ */
+bool SoundDecision_IsBlocked(uint32_t now_ms);
+
+/**
+ * @brief Check whether the detections of a class are currently suppressed by its inactivity timeout.
+ *
+ * @param[in] class_idx Index of the class, below SOUND_DECISION_CLASS_NUMBER.
+ * @param[in] now_ms Current time in milliseconds.
+ *
+ * @return true if the class was detected less than its inactivity timeout ago.
+ */
+bool SoundDecision_IsClassBlocked(uint32_t class_idx, uint32_t now_ms);
+
+/**
+ * @brief Set the confidence threshold in percent.
+ */
+void SoundDecision_SetThreshold(int threshold);
+
+/**
+ * @brief Get the confidence threshold in percent.
+ */
+int SoundDecision_GetThreshold(void);
+
+/**
+ * @brief Set the inactivity timeout of every class in milliseconds.
+ */
+void SoundDecision_SetInactivityTimeout(int timeout_ms);
+
+/**
+ * @brief Get the inactivity timeout last set for every class in milliseconds.
+ */
+int SoundDecision_GetInactivityTimeout(void);
+
+/**
+ * @brief Set all per-class inactivity timeouts at once.
+ *
+ * @param[in] timeouts_ms Array of SOUND_DECISION_CLASS_NUMBER timeouts in milliseconds.
+ */
+void SoundDecision_SetClassTimeouts(const int* timeouts_ms);
+
+/**
+ * @brief Get the inactivity timeout of a class.
+ *
+ * @param[in] class_idx Index of the class.
+ *
+ * @return Timeout in milliseconds, 0 if the index is out of range.
+ */
+int SoundDecision_GetClassTimeout(uint32_t class_idx);
+
+/**
+ * @brief Set the largest number of classes reported by one detection.
+ *
+ * @param[in] count From 1, the best class only, to SOUND_DECISION_MAX_LABELS.
+ *
+ * @return false if the count is out of range.
+ */
+bool SoundDecision_SetMaxLabels(uint32_t count);
+
+/**
+ * @brief Get the largest number of classes reported by one detection.
+ */
+uint32_t SoundDecision_GetMaxLabels(void);
+
+/**
+ * @brief Print the classes reported by a detection as "class:confidence", comma separated.
+ *
+ * @return Number of characters written, as snprintf().
+ */
+int SoundDecision_FormatLabels(const SoundDecision_t* decision, char* text, uint32_t size);
+
+/**
+ * @brief Set the hysteresis margin in percent.
+ *
+ * With a margin, a class becomes active on its first confident frame and is
+ * reported once: it stays active, its confident frames being held, until its
+ * confidence falls below the threshold minus the margin. A sound lasting
+ * longer than the inactivity timeout is thus not reported again, and a
+ * confidence oscillating around the threshold reports once. 0 disables the
+ * hysteresis: every confident frame out of the inactivity timeout is reported.
+ * With several labels, each class reaching the threshold is held separately.
+ */
+void SoundDecision_SetHysteresis(int margin);
+
+/**
+ * @brief Get the hysteresis margin in percent.
+ */
+int SoundDecision_GetHysteresis(void);
+
+/**
+ * @brief Make all classes inactive, e.g. when the sound stops.
+ */
+void SoundDecision_ClearHysteresis(void);
+
+/**
+ * @brief Set all per-class confidence offsets at once.
+ *
+ * @param[in] offsets Array of SOUND_DECISION_CLASS_NUMBER offsets in percent.
+ */
+void SoundDecision_SetOffsets(const int* offsets);
+
+/**
+ * @brief Set the confidence offset of a single class.
+ *
+ * @param[in] class_name Label of the class.
+ * @param[in] offset Offset in percent.
+ *
+ * @return true if the class was found, false otherwise.
+ */
+bool SoundDecision_SetClassOffset(const char* class_name, int offset);
+
+/**
+ * @brief Get the confidence offset of a class.
+ *
+ * @param[in] class_idx Index of the class.
+ *
+ * @return Offset in percent, 0 if the index is out of range.
+ */
+int SoundDecision_GetOffset(uint32_t class_idx);
+
+#endif // SOUND_DECISION_H
@@ -0,0 +1,296 @@
+/**
+ * @file spectrogram_engine.c
+ * @brief Incremental log-mel spectrogram over a stream of audio samples.
+ *
+ * The pushed samples are seen as the concatenation of the carried samples and
+ * the new ones. Columns start at multiples of the hop length in this virtual
+ * stream; whatever is left after the last complete column becomes the carry
+ * of the next push.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "spectrogram_engine.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Scale of the 16-bit PCM samples into [-1, 1), as PreProc_DPU() */
+#define PCM16_NORM (1.0F / 32768.0F)
+
+/* Index of a value in the mel-major window */
+#define WINDOW_INDEX(col, mel) (((mel) * SPECTROGRAM_ENGINE_COL) + (col))
+
+/* ============================ Function Implementations ============================ */
+
+#if !SPECTROGRAM_ENGINE_FIXED_POINT
+static void prvToFloat(float32_t* dst, const int16_t* src, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = (float32_t)src[i] * PCM16_NORM;
+    }
+}
+#endif
+
+int8_t SpectrogramEngine_Quantize(const AudioProcCtx_t* proc, float32_t value) {
+    int32_t q = (int32_t)roundf(value * proc->output_Q_inv_scale) + (int32_t)proc->output_Q_offset;
+    if (q > INT8_MAX) {
+        q = INT8_MAX;
+    } else if (q < INT8_MIN) {
+        q = INT8_MIN;
+    }
+    return (int8_t)q;
+}
+
+/* Move every mel row left by the given number of columns, freeing the last ones */
+static void prvSlideWindow(SpectrogramEngine_t* engine, uint32_t new_columns) {
+    if (new_columns == 0 || new_columns >= SPECTROGRAM_ENGINE_COL) {
+        return;
+    }
+
+    uint32_t kept = SPECTROGRAM_ENGINE_COL - new_columns;
+    for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+        int8_t* row = &engine->window[WINDOW_INDEX(0, mel)];
+        memmove(row, &row[new_columns], kept);
+    }
+}
+
+/**
+ * Compute one column into the window from a frame made of the end of the
+ * carry followed by the start of the new samples.
+ */
+static void prvComputeColumn(SpectrogramEngine_t* engine, uint32_t col,
+                             const int16_t* head, uint32_t head_len, const int16_t* tail) {
+#if SPECTROGRAM_ENGINE_FIXED_POINT
+    float32_t energy = LogMelFixed_ColumnQuantized(&engine->fixed, head, head_len, tail,
+                                                   &engine->window[WINDOW_INDEX(col, 0)], SPECTROGRAM_ENGINE_COL);
+#else
+    AudioProcCtx_t* proc = engine->proc;
+
+    prvToFloat(engine->frame, head, head_len);
+    prvToFloat(&engine->frame[head_len], tail, SPECTROGRAM_ENGINE_FRAME_LEN - head_len);
+
+    /* The spectrum sum accumulates in the preprocessing context, restart it to get this column's share */
+    proc->S_Spectr.spectro_sum = 0;
+    LogMelSpectrogramColumn(&proc->S_LogMelSpectr, engine->frame, engine->mel_column);
+    float32_t energy = (float32_t)proc->S_Spectr.spectro_sum;
+
+    for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+        engine->window[WINDOW_INDEX(col, mel)] = SpectrogramEngine_Quantize(proc, engine->mel_column[mel]);
+    }
+#endif
+
+    engine->column_energy[engine->energy_head] = energy;
+    engine->energy_head = (engine->energy_head + 1U) % SPECTROGRAM_ENGINE_COL;
+    engine->columns_computed++;
+}
+
+bool SpectrogramEngine_Init(SpectrogramEngine_t* engine, AudioProcCtx_t* proc, int8_t* window) {
+    memset(engine, 0, sizeof(*engine));
+    engine->proc = proc;
+    engine->window = window;
+    engine->stride = SPECTROGRAM_ENGINE_COL;
+    SpectrogramEngine_Reset(engine);
+
+#if SPECTROGRAM_ENGINE_FIXED_POINT
+    return LogMelFixed_Init(&engine->fixed, proc);
+#else
+    return true;
+#endif
+}
+
+void SpectrogramEngine_SetVolatileWindow(SpectrogramEngine_t* engine, int8_t* kept) {
+    engine->kept = kept;
+    engine->kept_columns = 0;
+}
+
+void SpectrogramEngine_Reset(SpectrogramEngine_t* engine) {
+    memset(engine->window, 0, SPECTROGRAM_ENGINE_SIZE);
+    engine->kept_columns = 0;
+    memset(engine->column_energy, 0, sizeof(engine->column_energy));
+    engine->energy_head = 0;
+    engine->columns = 0;
+    engine->carry_len = 0;
+    engine->columns_since_inference = 0;
+}
+
+void SpectrogramEngine_MarkGap(SpectrogramEngine_t* engine) {
+    engine->carry_len = 0;
+}
+
+/* Number of columns the next inference shares with the one just due, the last COL - stride */
+static uint32_t prvSharedColumns(uint32_t stride) {
+    return (stride < SPECTROGRAM_ENGINE_COL) ? (SPECTROGRAM_ENGINE_COL - stride) : 0U;
+}
+
+/**
+ * Save the columns of a volatile window that the next inference shares with
+ * this one. The others are invalid after the inference.
+ */
+static void prvSaveKept(SpectrogramEngine_t* engine, uint32_t stride) {
+    uint32_t kept_columns = prvSharedColumns(stride);
+
+    for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+        memcpy(&engine->kept[mel * kept_columns],
+               &engine->window[WINDOW_INDEX(SPECTROGRAM_ENGINE_COL - kept_columns, mel)], kept_columns);
+    }
+    engine->kept_columns = kept_columns;
+    engine->columns = kept_columns;
+}
+
+/* Put the saved columns back where they were before the inference overwrote the window */
+static void prvRestoreKept(SpectrogramEngine_t* engine) {
+    uint32_t kept_columns = engine->kept_columns;
+
+    for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+        memcpy(&engine->window[WINDOW_INDEX(SPECTROGRAM_ENGINE_COL - kept_columns, mel)],
+               &engine->kept[mel * kept_columns], kept_columns);
+    }
+    engine->kept_columns = 0;
+}
+
+/* Number of samples to push to complete the given number of columns */
+static uint32_t prvSamplesForColumns(const SpectrogramEngine_t* engine, uint32_t columns) {
+    return ((columns - 1U) * SPECTROGRAM_ENGINE_HOP) + SPECTROGRAM_ENGINE_FRAME_LEN - engine->carry_len;
+}
+
+/**
+ * Consume samples, computing at most the last max_columns columns they
+ * complete. Returns the number of columns the stream advanced by.
+ */
+static uint32_t prvAdvance(SpectrogramEngine_t* engine, const int16_t* samples, uint32_t count,
+                           uint32_t max_columns) {
+    uint32_t carry_len = engine->carry_len;
+    uint32_t total = carry_len + count;
+
+    if (engine->kept_columns > 0) {
+        prvRestoreKept(engine);
+    }
+
+    if (total < SPECTROGRAM_ENGINE_FRAME_LEN) {
+        memcpy(&engine->carry[carry_len], samples, count * sizeof(int16_t));
+        engine->carry_len = total;
+        return 0;
+    }
+
+    uint32_t available = ((total - SPECTROGRAM_ENGINE_FRAME_LEN) / SPECTROGRAM_ENGINE_HOP) + 1U;
+    uint32_t skipped = 0;
+    if (available > max_columns) {
+        skipped = available - max_columns;
+    }
+    uint32_t new_columns = available - skipped;
+
+    prvSlideWindow(engine, new_columns);
+
+    /* Start of the next column in the virtual stream carry + samples */
+    uint32_t start = skipped * SPECTROGRAM_ENGINE_HOP;
+    uint32_t col = SPECTROGRAM_ENGINE_COL - new_columns;
+
+    for (uint32_t i = 0; i < new_columns; i++, col++, start += SPECTROGRAM_ENGINE_HOP) {
+        if (start >= carry_len) {
+            prvComputeColumn(engine, col, NULL, 0, &samples[start - carry_len]);
+        } else if (start + SPECTROGRAM_ENGINE_FRAME_LEN <= carry_len) {
+            prvComputeColumn(engine, col, &engine->carry[start], SPECTROGRAM_ENGINE_FRAME_LEN, NULL);
+        } else {
+            prvComputeColumn(engine, col, &engine->carry[start], carry_len - start, samples);
+        }
+    }
+
+    /* Keep what the next column needs: the virtual stream from start to its end, less than a frame */
+    uint32_t remaining = total - start;
+    if (start < carry_len) {
+        uint32_t from_carry = carry_len - start;
+        memmove(engine->carry, &engine->carry[start], from_carry * sizeof(int16_t));
+        memcpy(&engine->carry[from_carry], samples, count * sizeof(int16_t));
+    } else {
+        memcpy(engine->carry, &samples[start - carry_len], remaining * sizeof(int16_t));
+    }
+    engine->carry_len = remaining;
+
+    engine->columns += new_columns;
+    if (engine->columns > SPECTROGRAM_ENGINE_COL) {
+        engine->columns = SPECTROGRAM_ENGINE_COL;
+    }
+    engine->columns_skipped += skipped;
+    return available;
+}
+
+uint32_t SpectrogramEngine_Push(SpectrogramEngine_t* engine, const int16_t* samples, uint32_t count) {
+    return prvAdvance(engine, samples, count, SPECTROGRAM_ENGINE_COL);
+}
+
+uint32_t SpectrogramEngine_Feed(SpectrogramEngine_t* engine, const int16_t* samples, uint32_t count,
+                                bool* inference_due) {
+    uint32_t stride = engine->stride;
+    uint32_t due = (engine->columns_since_inference < stride) ? (stride - engine->columns_since_inference) : 1U;
+
+    uint32_t consumed = prvSamplesForColumns(engine, due);
+    if (consumed > count) {
+        consumed = count;
+    }
+
+    uint32_t advanced;
+    if (due > SPECTROGRAM_ENGINE_COL && consumed <= prvSamplesForColumns(engine, due - SPECTROGRAM_ENGINE_COL)) {
+        /* None of these columns is still in the window at the next inference */
+        advanced = prvAdvance(engine, samples, consumed, 0);
+        if (advanced > 0) {
+            engine->columns = 0;
+        }
+    } else {
+        advanced = prvAdvance(engine, samples, consumed, SPECTROGRAM_ENGINE_COL);
+    }
+
+    engine->columns_since_inference += advanced;
+    *inference_due = false;
+    if (engine->columns_since_inference >= stride && SpectrogramEngine_IsFull(engine)) {
+        engine->columns_since_inference = 0;
+        *inference_due = true;
+        if (engine->kept != NULL) {
+            prvSaveKept(engine, stride);
+        }
+    }
+    return consumed;
+}
+
+void SpectrogramEngine_SwapWindow(SpectrogramEngine_t* engine, int8_t* window) {
+    if (window == engine->window) {
+        return;
+    }
+
+    uint32_t shared = prvSharedColumns(engine->stride);
+    for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+        memcpy(&window[WINDOW_INDEX(SPECTROGRAM_ENGINE_COL - shared, mel)],
+               &engine->window[WINDOW_INDEX(SPECTROGRAM_ENGINE_COL - shared, mel)], shared);
+    }
+    engine->window = window;
+    if (engine->columns > shared) {
+        engine->columns = shared;
+    }
+}
+
+bool SpectrogramEngine_SetStride(SpectrogramEngine_t* engine, uint32_t columns) {
+    if (columns < 1U || columns > SPECTROGRAM_ENGINE_MAX_STRIDE) {
+        return false;
+    }
+    engine->stride = columns;
+    return true;
+}
+
+uint32_t SpectrogramEngine_GetStride(const SpectrogramEngine_t* engine) {
+    return engine->stride;
+}
+
+bool SpectrogramEngine_IsFull(const SpectrogramEngine_t* engine) {
+    return engine->columns >= SPECTROGRAM_ENGINE_COL;
+}
+
+int8_t* SpectrogramEngine_GetView(SpectrogramEngine_t* engine) {
+    return engine->window;
+}
+
+float32_t SpectrogramEngine_GetEnergy(const SpectrogramEngine_t* engine) {
+    /* Sum oldest first, so the result only depends on the columns in the window */
+    float32_t energy = 0.0F;
+    for (uint32_t i = 0; i < SPECTROGRAM_ENGINE_COL; i++) {
+        energy += engine->column_energy[(engine->energy_head + i) % SPECTROGRAM_ENGINE_COL];
+    }
+    return energy;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file spectrogram_engine.h
+ * @brief Incremental log-mel spectrogram over a stream of audio samples.
+ *
+ * PreProc_DPU() rebuilds the whole spectrogram from one DMA half buffer. This
+ * engine instead consumes the audio as a continuous stream: samples are
+ * pushed as they arrive, only the STFT columns made complete by the new
+ * samples are computed (one every CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH
+ * samples), and the window of the last CTRL_X_CUBE_AI_SPECTROGRAM_COL columns
+ * slides by the number of new columns. The samples that do not complete a
+ * column yet are carried over to the next push.
+ *
+ * The window is kept linear in the layout produced by PreProc_DPU()
+ * (mel-major: CTRL_X_CUBE_AI_SPECTROGRAM_NMEL rows of
+ * CTRL_X_CUBE_AI_SPECTROGRAM_COL quantized values), so it is passed to
+ * AiDPUProcess() as is, without copy. It is typically the network input
+ * tensor itself; when the network overwrites its input during the inference
+ * (input in the activations buffer), only the columns still needed by the
+ * next inference are saved, see SpectrogramEngine_SetVolatileWindow().
+ *
+ * Inference can run every N columns (the stride), independently of the size
+ * of the pushed blocks: SpectrogramEngine_Feed() only consumes the
+ * samples up to the next inference point, so one DMA half buffer may give
+ * several inferences, or one inference may span several half buffers.
+ *
+ * Columns use the log-mel configuration and the quantization parameters of
+ * the AudioProcCtx_t initialized by PreProc_DPUInit(). They are computed by
+ * LogMelSpectrogramColumn() in float, or by the fixed-point implementation of
+ * logmel_fixed.h when SPECTROGRAM_ENGINE_FIXED_POINT is set to 1, which
+ * quantizes the mel energies straight into the window without computing the
+ * log-mel values.
+ */
+
+#ifndef SPECTROGRAM_ENGINE_H
+#define SPECTROGRAM_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "preproc_dpu.h"
+
+/** Set to 1 in the project settings to compute the columns in fixed point */
+#ifndef SPECTROGRAM_ENGINE_FIXED_POINT
+#define SPECTROGRAM_ENGINE_FIXED_POINT  0
+#endif
+
+#if SPECTROGRAM_ENGINE_FIXED_POINT
+#include "logmel_fixed.h"
+#endif
+
+/** Number of columns of the spectrogram window */
+#define SPECTROGRAM_ENGINE_COL          CTRL_X_CUBE_AI_SPECTROGRAM_COL
+
+/** Number of mel bands of a column */
+#define SPECTROGRAM_ENGINE_NMEL         CTRL_X_CUBE_AI_SPECTROGRAM_NMEL
+
+/** Number of samples between the starts of two consecutive columns */
+#define SPECTROGRAM_ENGINE_HOP          CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH
+
+/** Number of samples used to compute one column */
+#define SPECTROGRAM_ENGINE_FRAME_LEN    CTRL_X_CUBE_AI_SPECTROGRAM_NFFT
+
+/** Size of the spectrogram window in bytes */
+#define SPECTROGRAM_ENGINE_SIZE         (SPECTROGRAM_ENGINE_COL * SPECTROGRAM_ENGINE_NMEL)
+
+/** Largest number of columns between two inferences */
+#define SPECTROGRAM_ENGINE_MAX_STRIDE   (SPECTROGRAM_ENGINE_COL * 10U)
+
+/** Size in bytes of the buffer keeping the columns of a volatile window across an inference */
+#define SPECTROGRAM_ENGINE_KEPT_SIZE    ((SPECTROGRAM_ENGINE_COL - 1U) * SPECTROGRAM_ENGINE_NMEL)
+
+/**
+ * @brief State of the incremental spectrogram.
+ */
+typedef struct {
+    AudioProcCtx_t* proc;                                   ///< Preprocessing context providing the log-mel configuration
+    int8_t* window;                                         ///< Quantized spectrogram window, mel-major
+    uint32_t columns;                                       ///< Number of valid columns in the window
+    int16_t carry[SPECTROGRAM_ENGINE_FRAME_LEN - 1];        ///< Samples pushed but not consumed by a full column yet
+    uint32_t carry_len;                                     ///< Number of valid samples in carry
+    float32_t column_energy[SPECTROGRAM_ENGINE_COL];        ///< Spectrum sum of each column, circular
+    uint32_t energy_head;                                   ///< Index of the oldest column in column_energy
+#if SPECTROGRAM_ENGINE_FIXED_POINT
+    LogMelFixed_t fixed;                                    ///< Fixed-point column state and scratch buffers
+#else
+    float32_t frame[SPECTROGRAM_ENGINE_FRAME_LEN];          ///< Scratch input of one column
+    float32_t mel_column[SPECTROGRAM_ENGINE_NMEL];          ///< Scratch output of one column
+#endif
+    uint32_t columns_computed;                              ///< Total number of columns computed
+    uint32_t columns_skipped;                               ///< Total number of columns skipped as they would not reach inference
+    volatile uint32_t stride;                               ///< Number of columns between two inferences
+    uint32_t columns_since_inference;                       ///< Number of columns the stream advanced by since the last inference
+    int8_t* kept;                                           ///< Columns saved across an inference overwriting the window, NULL if it does not
+    uint32_t kept_columns;                                  ///< Number of columns in kept to restore before the next push
+} SpectrogramEngine_t;
+
+/**
+ * @brief Initialize the engine.
+ *
+ * @param[out] engine Engine state.
+ * @param[in] proc Preprocessing context, initialized by PreProc_DPUInit() and
+ *                 with the output quantization parameters set.
+ * @param[in] window Buffer of SPECTROGRAM_ENGINE_SIZE bytes receiving the
+ *                   spectrogram, typically the network input.
+ *
+ * @return false if the fixed-point front end cannot be initialized.
+ */
+bool SpectrogramEngine_Init(SpectrogramEngine_t* engine, AudioProcCtx_t* proc, int8_t* window);
+
+/**
+ * @brief Declare that the window is overwritten by each inference.
+ *
+ * Needed when the window is the network input tensor in the activations
+ * buffer. With a stride below SPECTROGRAM_ENGINE_COL, the columns shared
+ * with the next inference are saved to kept when SpectrogramEngine_Feed()
+ * reports an inference due, and put back in the window by the next push.
+ * With a larger stride, nothing is copied: every column is computed again
+ * before the next inference.
+ *
+ * @param[in] engine Engine state.
+ * @param[in] kept Buffer of SPECTROGRAM_ENGINE_KEPT_SIZE bytes.
+ */
+void SpectrogramEngine_SetVolatileWindow(SpectrogramEngine_t* engine, int8_t* kept);
+
+/**
+ * @brief Discard all columns and carried samples.
+ */
+void SpectrogramEngine_Reset(SpectrogramEngine_t* engine);
+
+/**
+ * @brief Drop the carried samples after a gap in the audio stream.
+ *
+ * The columns already in the window are kept; the next column starts at the
+ * first sample of the next push instead of straddling the gap.
+ */
+void SpectrogramEngine_MarkGap(SpectrogramEngine_t* engine);
+
+/**
+ * @brief Push audio samples and compute the columns they complete.
+ *
+ * When a push completes more columns than the window holds, only the last
+ * SPECTROGRAM_ENGINE_COL are computed.
+ *
+ * @param[in] engine Engine state.
+ * @param[in] samples 16-bit mono PCM samples.
+ * @param[in] count Number of samples.
+ *
+ * @return Number of columns the stream advanced by, including the skipped ones.
+ */
+uint32_t SpectrogramEngine_Push(SpectrogramEngine_t* engine, const int16_t* samples, uint32_t count);
+
+/**
+ * @brief Push audio samples up to the next inference point.
+ *
+ * Consumes the samples completing the columns due before the next inference,
+ * at most count. When the next inference is more than a window away, the
+ * columns that would slide out of the window before it are not computed.
+ *
+ * @param[in] engine Engine state.
+ * @param[in] samples 16-bit mono PCM samples.
+ * @param[in] count Number of samples available.
+ * @param[out] inference_due Set when the stride is reached and the window is
+ *                           full: the window is ready for AiDPUProcess(),
+ *                           which must run before the next push.
+ *
+ * @return Number of samples consumed. Feed the remaining ones after the
+ *         inference, if any.
+ */
+uint32_t SpectrogramEngine_Feed(SpectrogramEngine_t* engine, const int16_t* samples, uint32_t count,
+                                bool* inference_due);
+
+/**
+ * @brief Continue the spectrogram in another buffer.
+ *
+ * Called right after SpectrogramEngine_Feed() reported an inference due, to
+ * leave the window to the inference while the next one is built, e.g. in
+ * ping-pong buffers. Only the columns shared with the next inference, with a
+ * stride below SPECTROGRAM_ENGINE_COL, are copied; nothing if window is the
+ * current one.
+ *
+ * @param[in] engine Engine state.
+ * @param[in] window Buffer of SPECTROGRAM_ENGINE_SIZE bytes.
+ */
+void SpectrogramEngine_SwapWindow(SpectrogramEngine_t* engine, int8_t* window);
+
+/**
+ * @brief Set the number of columns between two inferences.
+ *
+ * Takes effect at the next SpectrogramEngine_Feed(); can be called from
+ * another task. The default is SPECTROGRAM_ENGINE_COL.
+ *
+ * @param[in] engine Engine state.
+ * @param[in] columns Stride, from 1 to SPECTROGRAM_ENGINE_MAX_STRIDE.
+ *
+ * @return false if the stride is out of range.
+ */
+bool SpectrogramEngine_SetStride(SpectrogramEngine_t* engine, uint32_t columns);
+
+/**
+ * @brief Get the number of columns between two inferences.
+ */
+uint32_t SpectrogramEngine_GetStride(const SpectrogramEngine_t* engine);
+
+/**
+ * @brief Check whether the window holds SPECTROGRAM_ENGINE_COL valid columns.
+ */
+bool SpectrogramEngine_IsFull(const SpectrogramEngine_t* engine);
+
+/**
+ * @brief Quantize a log-mel value to the network input format, as the columns are.
+ */
+int8_t SpectrogramEngine_Quantize(const AudioProcCtx_t* proc, float32_t value);
+
+/**
+ * @brief Get the spectrogram window, ready to be passed to AiDPUProcess().
+ */
+int8_t* SpectrogramEngine_GetView(SpectrogramEngine_t* engine);
+
+/**
+ * @brief Get the spectrum sum of the columns in the window.
+ *
+ * Equivalent to S_Spectr.spectro_sum after PreProc_DPU() on the same audio,
+ * for the silence detection.
+ */
+float32_t SpectrogramEngine_GetEnergy(const SpectrogramEngine_t* engine);
+
+#endif // SPECTROGRAM_ENGINE_H
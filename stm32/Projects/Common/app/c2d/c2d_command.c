@@ -0,0 +1,524 @@
+/**
+ * @file c2d_command.c
+ * @brief Parsing and dispatch of the cloud-to-device commands.
+ *
+ * The envelope is read through a cursor bounded by the payload length, so
+ * the payload is never written nor read past its end, and each byte is
+ * looked at once. The members other than "v", "ct" and "cmd" are skipped
+ * with a recursion bounded by C2D_MAX_DEPTH.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "c2d_command.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define ARG_SEPARATOR ' '
+
+/* Separator of the integers of a list, with optional spaces around it */
+#define INT_LIST_SEPARATOR ','
+
+/* Bytes of a word of the string scan, 0x01 and 0x80 in each */
+#define WORD_ONES  ((size_t)-1 / 0xFFU)
+#define WORD_HIGHS (WORD_ONES * 0x80U)
+
+/* Longest key looked for, plus one to tell the longer ones apart */
+#define KEY_MAX_LEN 4U
+
+typedef struct {
+    const char* pos;
+    const char* end;
+} Cursor_t;
+
+static const char* const s_result_names[] = {
+    "ok", "bad envelope", "command too long", "unknown command", "bad arguments", "failed"
+};
+
+/* ============================ Static Function Implementations ============================ */
+
+static bool prvIsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool prvIsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/* Whether no byte of a word ends a run of plain string characters: '"', '\\' or a control character */
+static bool prvIsPlainWord(size_t word) {
+    size_t quote = word ^ (WORD_ONES * (size_t)'"');
+    size_t backslash = word ^ (WORD_ONES * (size_t)'\\');
+    // a byte below n borrows into its high bit in (x - n), the exact byte being found by the byte loop
+    size_t special = ((quote - WORD_ONES) & ~quote)
+                     | ((backslash - WORD_ONES) & ~backslash)
+                     | ((word - (WORD_ONES * 0x20U)) & ~word);
+    return (special & WORD_HIGHS) == 0U;
+}
+
+static void prvSkipSpace(Cursor_t* cur) {
+    while (cur->pos < cur->end && prvIsSpace(*cur->pos)) {
+        cur->pos++;
+    }
+}
+
+/* Skip the spaces and the given character, return false if it is not next */
+static bool prvExpect(Cursor_t* cur, char c) {
+    prvSkipSpace(cur);
+    if (cur->pos < cur->end && *cur->pos == c) {
+        cur->pos++;
+        return true;
+    }
+    return false;
+}
+
+static int prvHexDigit(char c) {
+    if (prvIsDigit(c)) {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Store a character of a string value if there is room left, count it anyway */
+static void prvPut(char* out, size_t size, size_t* len, uint32_t c) {
+    if (out != NULL && (*len + 1U) < size) {
+        out[*len] = (char)c;
+    }
+    (*len)++;
+}
+
+/*
+ * Parse a string, unescaped into out unless NULL, truncated to size - 1 bytes
+ * and null terminated. len is the length of the whole value.
+ */
+static bool prvParseString(Cursor_t* cur, char* out, size_t size, size_t* len) {
+    *len = 0;
+    if (!prvExpect(cur, '"')) {
+        return false;
+    }
+    while (cur->pos < cur->end) {
+        // run of plain characters, scanned a word at a time and copied at once
+        const char* run = cur->pos;
+        while ((size_t)(cur->end - cur->pos) >= sizeof(size_t)) {
+            size_t word;
+            memcpy(&word, cur->pos, sizeof(word));
+            if (!prvIsPlainWord(word)) {
+                break;
+            }
+            cur->pos += sizeof(word);
+        }
+        while (cur->pos < cur->end && *cur->pos != '"' && *cur->pos != '\\' && (unsigned char)*cur->pos >= 0x20U) {
+            cur->pos++;
+        }
+        size_t run_len = (size_t)(cur->pos - run);
+        if (out != NULL && (*len + 1U) < size) {
+            size_t room = size - 1U - *len;
+            memcpy(&out[*len], run, (run_len < room) ? run_len : room);
+        }
+        *len += run_len;
+        if (cur->pos >= cur->end) {
+            break;
+        }
+
+        char c = *cur->pos++;
+        if (c == '"') {
+            if (out != NULL) {
+                out[(*len < size) ? *len : (size - 1U)] = '\0';
+            }
+            return true;
+        }
+        if (c != '\\') {
+            return false;
+        }
+        if (cur->pos >= cur->end) {
+            return false;
+        }
+        c = *cur->pos++;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            prvPut(out, size, len, (uint8_t)c);
+            break;
+        case 'b':
+            prvPut(out, size, len, '\b');
+            break;
+        case 'f':
+            prvPut(out, size, len, '\f');
+            break;
+        case 'n':
+            prvPut(out, size, len, '\n');
+            break;
+        case 'r':
+            prvPut(out, size, len, '\r');
+            break;
+        case 't':
+            prvPut(out, size, len, '\t');
+            break;
+        case 'u': {
+            uint32_t code = 0;
+            if ((cur->end - cur->pos) < 4) {
+                return false;
+            }
+            for (int i = 0; i < 4; i++) {
+                int digit = prvHexDigit(cur->pos[i]);
+                if (digit < 0) {
+                    return false;
+                }
+                code = (code << 4) | (uint32_t)digit;
+            }
+            cur->pos += 4;
+            // UTF-8, the surrogate halves are encoded as they are
+            if (code < 0x80U) {
+                prvPut(out, size, len, code);
+            } else if (code < 0x800U) {
+                prvPut(out, size, len, 0xC0U | (code >> 6));
+                prvPut(out, size, len, 0x80U | (code & 0x3FU));
+            } else {
+                prvPut(out, size, len, 0xE0U | (code >> 12));
+                prvPut(out, size, len, 0x80U | ((code >> 6) & 0x3FU));
+                prvPut(out, size, len, 0x80U | (code & 0x3FU));
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+/* Parse a number, its integer part clamped to an int */
+static bool prvParseNumber(Cursor_t* cur, int* value) {
+    bool negative = false;
+    int64_t magnitude = 0;
+
+    prvSkipSpace(cur);
+    if (cur->pos < cur->end && *cur->pos == '-') {
+        negative = true;
+        cur->pos++;
+    }
+    if (cur->pos >= cur->end || !prvIsDigit(*cur->pos)) {
+        return false;
+    }
+    while (cur->pos < cur->end && prvIsDigit(*cur->pos)) {
+        if (magnitude <= INT_MAX) {
+            magnitude = (magnitude * 10) + (*cur->pos - '0');
+        }
+        cur->pos++;
+    }
+    if (cur->pos < cur->end && *cur->pos == '.') {
+        cur->pos++;
+        if (cur->pos >= cur->end || !prvIsDigit(*cur->pos)) {
+            return false;
+        }
+        while (cur->pos < cur->end && prvIsDigit(*cur->pos)) {
+            cur->pos++;
+        }
+    }
+    if (cur->pos < cur->end && (*cur->pos == 'e' || *cur->pos == 'E')) {
+        cur->pos++;
+        if (cur->pos < cur->end && (*cur->pos == '+' || *cur->pos == '-')) {
+            cur->pos++;
+        }
+        if (cur->pos >= cur->end || !prvIsDigit(*cur->pos)) {
+            return false;
+        }
+        while (cur->pos < cur->end && prvIsDigit(*cur->pos)) {
+            cur->pos++;
+        }
+    }
+    if (magnitude > INT_MAX) {
+        magnitude = INT_MAX;
+    }
+    *value = negative ? -(int)magnitude : (int)magnitude;
+    return true;
+}
+
+static bool prvParseLiteral(Cursor_t* cur) {
+    static const char* const literals[] = { "true", "false", "null" };
+
+    for (size_t i = 0; i < (sizeof(literals) / sizeof(literals[0])); i++) {
+        size_t len = strlen(literals[i]);
+        if ((size_t)(cur->end - cur->pos) >= len && 0 == memcmp(cur->pos, literals[i], len)) {
+            cur->pos += len;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool prvSkipValue(Cursor_t* cur, uint32_t depth) {
+    size_t len;
+    int number;
+
+    prvSkipSpace(cur);
+    if (cur->pos >= cur->end) {
+        return false;
+    }
+
+    char c = *cur->pos;
+    if (c == '"') {
+        return prvParseString(cur, NULL, 0, &len);
+    }
+    if (c == '{' || c == '[') {
+        char close = (c == '{') ? '}' : ']';
+        if (depth >= C2D_MAX_DEPTH) {
+            return false;
+        }
+        cur->pos++;
+        if (prvExpect(cur, close)) {
+            return true;
+        }
+        do {
+            if (c == '{' && (!prvParseString(cur, NULL, 0, &len) || !prvExpect(cur, ':'))) {
+                return false;
+            }
+            if (!prvSkipValue(cur, depth + 1U)) {
+                return false;
+            }
+        } while (prvExpect(cur, ','));
+        return prvExpect(cur, close);
+    }
+    if (c == '-' || prvIsDigit(c)) {
+        return prvParseNumber(cur, &number);
+    }
+    return prvParseLiteral(cur);
+}
+
+/* Parse an integer argument followed by a separator, a comma or the end of the line */
+static bool prvParseInt(const char** text, int* value) {
+    const char* pos = *text;
+    bool negative = false;
+    int64_t magnitude = 0;
+
+    if (*pos == '-' || *pos == '+') {
+        negative = (*pos == '-');
+        pos++;
+    }
+    if (!prvIsDigit(*pos)) {
+        return false;
+    }
+    while (prvIsDigit(*pos)) {
+        magnitude = (magnitude * 10) + (*pos - '0');
+        if (magnitude > ((int64_t)INT_MAX + 1)) {
+            return false;
+        }
+        pos++;
+    }
+    if ((*pos != ARG_SEPARATOR && *pos != INT_LIST_SEPARATOR && *pos != '\0')
+            || (!negative && magnitude > INT_MAX)) {
+        return false;
+    }
+    *value = (int)(negative ? -magnitude : magnitude);
+    *text = pos;
+    return true;
+}
+
+/* Skip the separator after an integer: spaces, or a comma with optional spaces around it */
+static bool prvSkipIntSeparator(const char** text) {
+    const char* pos = *text;
+
+    while (*pos == ARG_SEPARATOR) {
+        pos++;
+    }
+    if (*pos == INT_LIST_SEPARATOR) {
+        pos++;
+        while (*pos == ARG_SEPARATOR) {
+            pos++;
+        }
+        // a comma is followed by an integer
+        if (*pos == '\0') {
+            return false;
+        }
+    }
+    *text = pos;
+    return true;
+}
+
+/* ============================ Function Implementations ============================ */
+
+C2dResult_t C2dCommand_ParseEnvelope(const char* payload, size_t length, C2dEnvelope_t* envelope) {
+    Cursor_t cur = { payload, payload + length };
+    bool found = false;
+    bool too_long = false;
+
+    envelope->version[0] = '\0';
+    envelope->type = C2D_TYPE_NONE;
+    envelope->command[0] = '\0';
+    envelope->command_len = 0;
+
+    // some senders count the terminator in the length
+    while (cur.end > cur.pos && cur.end[-1] == '\0') {
+        cur.end--;
+    }
+    prvSkipSpace(&cur);
+    if (cur.pos >= cur.end) {
+        return C2D_BAD_ENVELOPE;
+    }
+
+    if (*cur.pos != '{') {
+        // a bare command line
+        size_t len = (size_t)(cur.end - cur.pos);
+        if (len >= sizeof(envelope->command)) {
+            return C2D_TOO_LONG;
+        }
+        if (memchr(cur.pos, '\0', len) != NULL) {
+            return C2D_BAD_ENVELOPE;
+        }
+        memcpy(envelope->command, cur.pos, len);
+        envelope->command[len] = '\0';
+        envelope->command_len = len;
+        return C2D_OK;
+    }
+
+    cur.pos++;
+    if (!prvExpect(&cur, '}')) {
+        do {
+            char key[KEY_MAX_LEN + 1U];
+            size_t key_len;
+            size_t len;
+
+            if (!prvParseString(&cur, key, sizeof(key), &key_len) || !prvExpect(&cur, ':')) {
+                return C2D_BAD_ENVELOPE;
+            }
+            if (key_len == 3U && 0 == memcmp(key, "cmd", 3U)) {
+                if (!prvParseString(&cur, envelope->command, sizeof(envelope->command), &len)) {
+                    return C2D_BAD_ENVELOPE;
+                }
+                found = true;
+                too_long = (len >= sizeof(envelope->command));
+                envelope->command_len = too_long ? 0U : len;
+            } else if (key_len == 1U && key[0] == 'v') {
+                if (!prvParseString(&cur, envelope->version, sizeof(envelope->version), &len)) {
+                    return C2D_BAD_ENVELOPE;
+                }
+                if (len >= sizeof(envelope->version)) {
+                    envelope->version[0] = '\0';
+                }
+            } else if (key_len == 2U && 0 == memcmp(key, "ct", 2U)) {
+                prvSkipSpace(&cur);
+                bool is_number = (cur.pos < cur.end) && (*cur.pos == '-' || prvIsDigit(*cur.pos));
+                if (!(is_number ? prvParseNumber(&cur, &envelope->type) : prvSkipValue(&cur, 1U))) {
+                    return C2D_BAD_ENVELOPE;
+                }
+            } else if (!prvSkipValue(&cur, 1U)) {
+                return C2D_BAD_ENVELOPE;
+            }
+        } while (prvExpect(&cur, ','));
+        if (!prvExpect(&cur, '}')) {
+            return C2D_BAD_ENVELOPE;
+        }
+    }
+
+    prvSkipSpace(&cur);
+    if (cur.pos != cur.end || !found) {
+        return C2D_BAD_ENVELOPE;
+    }
+    if (too_long) {
+        return C2D_TOO_LONG;
+    }
+    // an escaped terminator would cut the command short
+    if (strlen(envelope->command) != envelope->command_len) {
+        return C2D_BAD_ENVELOPE;
+    }
+    return C2D_OK;
+}
+
+C2dResult_t C2dCommand_Execute(const C2dCommand_t* table, size_t count, char* line, const C2dCommand_t** command) {
+    const C2dCommand_t* entry = NULL;
+    C2dArgs_t args;
+
+    if (command != NULL) {
+        *command = NULL;
+    }
+
+    while (*line == ARG_SEPARATOR) {
+        line++;
+    }
+    size_t len = strlen(line);
+    while (len > 0U && line[len - 1U] == ARG_SEPARATOR) {
+        line[--len] = '\0';
+    }
+
+    const char* end = strchr(line, ARG_SEPARATOR);
+    size_t name_len = (end != NULL) ? (size_t)(end - line) : len;
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(table[i].name) == name_len && 0 == strncmp(table[i].name, line, name_len)) {
+            entry = &table[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        return C2D_UNKNOWN_COMMAND;
+    }
+    if (command != NULL) {
+        *command = entry;
+    }
+
+    const char* rest = &line[name_len];
+    while (*rest == ARG_SEPARATOR) {
+        rest++;
+    }
+    args.count = 0;
+    args.text = "";
+
+    switch (entry->args) {
+    case C2D_ARGS_NONE:
+        if (*rest != '\0') {
+            return C2D_BAD_ARGUMENTS;
+        }
+        break;
+    case C2D_ARGS_TEXT:
+        if (*rest == '\0') {
+            return C2D_BAD_ARGUMENTS;
+        }
+        args.text = rest;
+        break;
+    case C2D_ARGS_INTS:
+        while (*rest != '\0') {
+            if (args.count >= entry->max_ints || args.count >= C2D_COMMAND_MAX_INTS
+                    || !prvParseInt(&rest, &args.values[args.count])) {
+                return C2D_BAD_ARGUMENTS;
+            }
+            args.count++;
+            if (!prvSkipIntSeparator(&rest)) {
+                return C2D_BAD_ARGUMENTS;
+            }
+        }
+        if (args.count < entry->min_ints) {
+            return C2D_BAD_ARGUMENTS;
+        }
+        break;
+    default:
+        return C2D_BAD_ARGUMENTS;
+    }
+
+    return entry->handler(&args) ? C2D_OK : C2D_FAILED;
+}
+
+C2dResult_t C2dCommand_Dispatch(const C2dCommand_t* table, size_t count, const char* payload, size_t length,
+                                C2dEnvelope_t* envelope, const C2dCommand_t** command) {
+    if (command != NULL) {
+        *command = NULL;
+    }
+    C2dResult_t result = C2dCommand_ParseEnvelope(payload, length, envelope);
+    if (result != C2D_OK) {
+        return result;
+    }
+    return C2dCommand_Execute(table, count, envelope->command, command);
+}
+
+const char* C2dCommand_ResultName(C2dResult_t result) {
+    if ((size_t)result >= (sizeof(s_result_names) / sizeof(s_result_names[0]))) {
+        return "?";
+    }
+    return s_result_names[result];
+}
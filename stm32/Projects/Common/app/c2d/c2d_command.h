@@ -0,0 +1,141 @@
+/**
+ * @file c2d_command.h
+ * @brief Parsing and dispatch of the cloud-to-device commands.
+ *
+ * IoTConnect sends the commands in a JSON envelope, not null terminated:
+ *
+ *   {"v":"2.1","ct":0,"cmd":"set-confidence-threshold 22"}
+ *
+ * The envelope is scanned once, within its length, for the "v", "ct" and
+ * "cmd" members, the other ones being skipped whatever their value. A
+ * payload that is not a JSON object is taken as the command line itself.
+ *
+ * The command line is a name followed by its arguments, separated by
+ * spaces. The name selects an entry of a command table, whose schema
+ * decides how the arguments are parsed before its handler is called: none,
+ * a number of integers in a range, or the rest of the line as text. The
+ * integers are separated by spaces or by commas, as in "1, -2, 3".
+ */
+
+#ifndef C2D_COMMAND_H
+#define C2D_COMMAND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Largest command line, terminator included */
+#ifndef C2D_COMMAND_MAX_LEN
+#define C2D_COMMAND_MAX_LEN 256U
+#endif
+
+/** Largest number of integer arguments */
+#ifndef C2D_COMMAND_MAX_INTS
+#define C2D_COMMAND_MAX_INTS 16U
+#endif
+
+/** Largest envelope version, terminator included */
+#define C2D_VERSION_MAX_LEN 8U
+
+/** Deepest nesting of the skipped members of the envelope */
+#define C2D_MAX_DEPTH 8U
+
+/** Command type of an envelope without "ct" */
+#define C2D_TYPE_NONE (-1)
+
+/**
+ * @brief Outcome of a command.
+ */
+typedef enum {
+    C2D_OK = 0,             ///< Handler called and successful
+    C2D_BAD_ENVELOPE,       ///< Payload not a valid envelope or without command
+    C2D_TOO_LONG,           ///< Command line longer than C2D_COMMAND_MAX_LEN
+    C2D_UNKNOWN_COMMAND,    ///< Name not in the table
+    C2D_BAD_ARGUMENTS,      ///< Arguments not matching the schema of the command
+    C2D_FAILED,             ///< Handler called and failed
+} C2dResult_t;
+
+/**
+ * @brief Arguments expected by a command.
+ */
+typedef enum {
+    C2D_ARGS_NONE = 0,      ///< No argument
+    C2D_ARGS_INTS,          ///< min_ints to max_ints integers
+    C2D_ARGS_TEXT,          ///< The rest of the line, not empty
+} C2dArgsType_t;
+
+/**
+ * @brief Parsed arguments passed to a handler.
+ */
+typedef struct {
+    uint32_t count;                         ///< Number of integers
+    int values[C2D_COMMAND_MAX_INTS];       ///< Integers
+    const char* text;                       ///< Rest of the line, trimmed, "" unless C2D_ARGS_TEXT
+} C2dArgs_t;
+
+/**
+ * @brief Entry of a command table.
+ */
+typedef struct {
+    const char* name;                       ///< Command name
+    C2dArgsType_t args;                     ///< Schema of the arguments
+    uint32_t min_ints;                      ///< Fewest integers, C2D_ARGS_INTS only
+    uint32_t max_ints;                      ///< Most integers, C2D_ARGS_INTS only
+    bool (*handler)(const C2dArgs_t* args); ///< Returns false if the command failed, having logged why
+    const char* usage;                      ///< Arguments, for the error messages
+} C2dCommand_t;
+
+/**
+ * @brief Members of the envelope.
+ */
+typedef struct {
+    char version[C2D_VERSION_MAX_LEN];      ///< "v", empty if absent or too long
+    int type;                               ///< "ct", C2D_TYPE_NONE if absent
+    char command[C2D_COMMAND_MAX_LEN];      ///< "cmd", unescaped
+    size_t command_len;                     ///< Length of command
+} C2dEnvelope_t;
+
+/**
+ * @brief Parse the envelope of a command.
+ *
+ * @param[in] payload Payload, not necessarily null terminated.
+ * @param[in] length Length of the payload.
+ * @param[out] envelope Members found.
+ *
+ * @return C2D_OK, C2D_BAD_ENVELOPE or C2D_TOO_LONG.
+ */
+C2dResult_t C2dCommand_ParseEnvelope(const char* payload, size_t length, C2dEnvelope_t* envelope);
+
+/**
+ * @brief Run a command line.
+ *
+ * @param[in] table Commands.
+ * @param[in] count Number of commands.
+ * @param[in,out] line Command line, null terminated, cut at its trailing spaces.
+ * @param[out] command Entry of the command, NULL if unknown, may be NULL.
+ *
+ * @return Outcome.
+ */
+C2dResult_t C2dCommand_Execute(const C2dCommand_t* table, size_t count, char* line, const C2dCommand_t** command);
+
+/**
+ * @brief Parse the envelope of a command and run it.
+ *
+ * @param[in] table Commands.
+ * @param[in] count Number of commands.
+ * @param[in] payload Payload, not necessarily null terminated.
+ * @param[in] length Length of the payload.
+ * @param[out] envelope Members of the envelope.
+ * @param[out] command Entry of the command, NULL if unknown, may be NULL.
+ *
+ * @return Outcome.
+ */
+C2dResult_t C2dCommand_Dispatch(const C2dCommand_t* table, size_t count, const char* payload, size_t length,
+                                C2dEnvelope_t* envelope, const C2dCommand_t** command);
+
+/**
+ * @brief Get a description of an outcome.
+ */
+const char* C2dCommand_ResultName(C2dResult_t result);
+
+#endif // C2D_COMMAND_H
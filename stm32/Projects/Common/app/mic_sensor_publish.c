@@ -65,6 +65,36 @@
 /* Retrain handler includes */
 #include "app/retrain/retrain_handler.h"
 
+/* Decision logic includes */
+#include "app/audio/sound_decision.h"
+#include "app/audio/score_smoothing.h"
+#include "app/audio/decision_config.h"
+
+/* Latency instrumentation includes */
+#include "app/audio/audio_latency.h"
+
+/* DMA overrun detection includes */
+#include "app/audio/mic_dma_tracker.h"
+
+/* Incremental spectrogram includes */
+#include "app/audio/spectrogram_engine.h"
+
+/* Telemetry includes */
+#include "app/telemetry/telemetry_encoder.h"
+#include "app/telemetry/publish_queue.h"
+#include "app/telemetry/telemetry_batch.h"
+#include "app/telemetry/detection_log.h"
+#include "app/telemetry/detection_log_ram.h"
+
+/* C2D command includes */
+#include "app/c2d/c2d_command.h"
+
+/* Network tensors includes */
+#include "app/audio/network_buffers.h"
+
+/* Preprocessing/inference hand-off includes */
+#include "app/audio/inference_pipeline.h"
+
 /* OTA app version header for firmware versioning */
 #include "ota_appversion32.h"
 
@@ -74,6 +104,8 @@ extern UBaseType_t uxRand(void);
 #define MQTT_PUBLISH_TIME_BETWEEN_MS (5000)
 #define MQTT_PUBLISH_TOPIC "mic_sensor_data"
 #define MQTT_PUBLICH_TOPIC_STR_LEN (256)
+#define MQTT_BINARY_TOPIC_STR_LEN (80)
+#define MIC_LABELS_MAX_LEN (256)   // "class:confidence" of each class of a detection, comma separated
 #define IOTC_CD_MAX_LEN (10)
 #define MQTT_PUBLISH_BLOCK_TIME_MS (1000)
 #define MQTT_PUBLISH_NOTIFICATION_WAIT_MS (1000)
@@ -84,6 +116,80 @@ extern UBaseType_t uxRand(void);
 #define MIC_EVT_DMA_HALF (1 << 0)
 #define MIC_EVT_DMA_CPLT (1 << 1)
 
+/* Number of 16-bit samples in one DMA half buffer */
+#define MIC_HALF_BUFF_SAMPLES ((uint32_t)(AUDIO_HALF_BUFF_SIZE / sizeof(int16_t)))
+
+/* Default number of spectrogram columns between two inferences: one inference per DMA half buffer */
+#define MIC_DEFAULT_INFERENCE_STRIDE (MIC_HALF_BUFF_SAMPLES / CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH)
+
+/* Processing budget of one inference: the duration of the audio between two inferences */
+#define MIC_STRIDE_DEADLINE_US(columns) \
+	((columns) * CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH * 1000U / (AUDIO_FREQUENCY_16K / 1000U))
+
+/**
+ * Set to 1 in the project settings to run the inference, decision and publish in a separate task
+ * at a lower priority, so that the mic task keeps pre-processing the audio while they run
+ */
+#ifndef MIC_INFERENCE_PIPELINE
+#define MIC_INFERENCE_PIPELINE (0)
+#endif
+
+/* Stack depth of the inference task in words, as the mic task */
+#ifndef MIC_INFERENCE_TASK_STACK_SIZE
+#define MIC_INFERENCE_TASK_STACK_SIZE (1024)
+#endif
+
+/* Stack depth of the MQTT sender task in words */
+#ifndef MIC_PUBLISH_TASK_STACK_SIZE
+#define MIC_PUBLISH_TASK_STACK_SIZE (1024)
+#endif
+
+/* Coalescing keys of the queued messages: only the latest idle message or latency report is worth sending */
+#define MIC_PUBLISH_KEY_IDLE (1U)
+#define MIC_PUBLISH_KEY_LATENCY (2U)
+
+#if (PUBLISH_QUEUE_PAYLOAD_SIZE < MQTT_PUBLISH_MAX_LEN) || (PUBLISH_QUEUE_PAYLOAD_SIZE < TELEMETRY_BATCH_SIZE) \
+	|| (PUBLISH_QUEUE_MAX_DETECTIONS < TELEMETRY_BATCH_MAX_MESSAGES)
+#error "The publish queue slots must hold MQTT_PUBLISH_MAX_LEN bytes and a batch of detections"
+#endif
+
+/**
+ * Log of the detections made while offline: sectors of the RAM storage, 256 detections with the defaults
+ */
+#ifndef MIC_DETECTION_LOG_SECTOR_SIZE
+#define MIC_DETECTION_LOG_SECTOR_SIZE (1024U)
+#endif
+#ifndef MIC_DETECTION_LOG_SECTORS
+#define MIC_DETECTION_LOG_SECTORS (8U)
+#endif
+
+/**
+ * Section of the detection log memory, e.g. __attribute__((section(".noinit"))) with a linker script
+ * leaving it alone at start-up, for the log to survive a reset
+ */
+#ifndef MIC_DETECTION_LOG_SECTION
+#define MIC_DETECTION_LOG_SECTION
+#endif
+
+/* Logged detections replayed every MIC_REPLAY_PERIOD_MS once online, leaving room in the publish queue */
+#ifndef MIC_REPLAY_RECORDS
+#define MIC_REPLAY_RECORDS (2U)
+#endif
+#ifndef MIC_REPLAY_PERIOD_MS
+#define MIC_REPLAY_PERIOD_MS (1000U)
+#endif
+
+/* Age of the replayed detections made before the last reset */
+#define MIC_REPLAY_AGE_UNKNOWN (-1)
+
+/**
+ * Topic of the binary detection messages, outside of IoTConnect which only takes JSON,
+ * for the cloud to decode them with iot-connect/common/telemetry.py
+ */
+#ifndef MIC_BINARY_TOPIC_FORMAT
+#define MIC_BINARY_TOPIC_FORMAT "iot/%s/bin"
+#endif
+
 /**
  * @brief Defines the structure to use as the command callback context in this
  * demo.
@@ -94,10 +200,35 @@ struct MQTTAgentCommandContext
 	TaskHandle_t xTaskToNotify;
 };
 
+/**
+ * @brief State of the inference, decision and publish, kept across frames.
+ */
+typedef struct
+{
+	MQTTAgentHandle_t xAgentHandle;
+	const char *pcTopicString;
+	const char *pcBinaryTopicString;
+	TelemetryEncoder_t xTelemetry;
+	volatile TelemetryFormat_t xTelemetryFormat; ///< Format of the detections, saved by set-telemetry-format, JSON by default
+	uint32_t ulDetectionSequence;                 ///< Number of detections, sent with the binary ones
+	uint32_t ulReplayTime;                        ///< Time of the last replay of logged detections
+	bool xReplaying;                              ///< Logged detections being replayed
+	bool idle_needs_sending;
+	DetectionLogEntry_t xBatchDetections[TELEMETRY_BATCH_MAX_MESSAGES]; ///< Detections in the batch, new or taken from the log
+	uint32_t ulBatchDetections;                   ///< Number of entries in xBatchDetections
+#if (AUDIO_LATENCY_TELEMETRY_PERIOD_MS > 0)
+	uint32_t ulLatencyReportTime;
+#endif
+	char payloadBuf[MQTT_PUBLISH_MAX_LEN];
+	char labelsBuf[MIC_LABELS_MAX_LEN];
+} MicInferenceCtx_t;
+
 /* Private variables ---------------------------------------------------------*/
 static uint8_t pucAudioBuff[AUDIO_BUFF_SIZE];
-static int8_t pcSpectroGram[CTRL_X_CUBE_AI_SPECTROGRAM_COL * CTRL_X_CUBE_AI_SPECTROGRAM_NMEL];
-static float32_t pfAIOutput[AI_NETWORK_OUT_1_SIZE];
+/**
+ * Spectrogram columns kept across an inference when the network input is in the activations buffer
+ */
+static int8_t pcKeptColumns[SPECTROGRAM_ENGINE_KEPT_SIZE];
 
 /**
  * Specifies the labels for the classes of the demo.
@@ -108,41 +239,30 @@ static const char *sAiClassLabels[CTRL_X_CUBE_AI_MODE_CLASS_NUMBER] = CTRL_X_CUB
  */
 static AudioProcCtx_t xAudioProcCtx;
 static AIProcCtx_t xAIProcCtx;
+/**
+ * Network input and output tensors
+ */
+static NetworkBuffers_t xNetworkBuffers;
+/**
+ * Incremental spectrogram filling the network input
+ */
+static SpectrogramEngine_t xSpectrogramEngine;
 /**
  * Microphone task handle
  */
 static TaskHandle_t xMicTask;
-
-static TickType_t last_detection_time;
-static int confidence_threshold = 42;
-static int inactivity_timeout = 5000;
-static int retrain_cmd_arg = 0;
-static int confidence_offsets[AI_NETWORK_OUT_1_SIZE] = {0, -49, -19, 39, 27, -25};
-/*-----------------------------------------------------------*/
 /**
- * @brief Checks if the MIC_EVT_DMA_HALF event flag is set in the notified value.
- *
- * This function evaluates whether the `MIC_EVT_DMA_HALF` flag is present within
- * the `notifiedValue`. It is used to determine if the DMA half-transfer event
- * has occurred.
- *
- * @param notifiedValue The value received from task notifications.
- * @return `true` if the `MIC_EVT_DMA_HALF` flag is set, `false` otherwise.
+ * Inference, decision and publish state
  */
-static bool is_dma_half_event(uint32_t notifiedValue);
-
+static MicInferenceCtx_t xInferenceCtx;
 /**
- * @brief Checks if the MIC_EVT_DMA_CPLT event flag is set in the notified value.
- *
- * This function evaluates whether the `MIC_EVT_DMA_CPLT` flag is present within
- * the `notifiedValue`. It is used to determine if the DMA complete-transfer event
- * has occurred.
- *
- * @param notifiedValue The value received from task notifications.
- * @return `true` if the `MIC_EVT_DMA_CPLT` flag is set, `false` otherwise.
+ * Detections made while offline, replayed once online
  */
-static bool is_dma_cplt_event(uint32_t notifiedValue);
+static uint8_t pucDetectionLogMem[MIC_DETECTION_LOG_SECTOR_SIZE * MIC_DETECTION_LOG_SECTORS] MIC_DETECTION_LOG_SECTION;
+static DetectionLogRam_t xDetectionLogRam;
 
+static int retrain_cmd_arg = 0;
+/*-----------------------------------------------------------*/
 /**
  * @brief Parse the values separated by the provided separator.
  *
@@ -272,6 +392,28 @@ static BaseType_t prvPublishAndWaitForAck(MQTTAgentHandle_t xAgentHandle,
 	return xResult;
 }
 
+#if (AUDIO_LATENCY_TELEMETRY_PERIOD_MS > 0)
+static void prvPublishLatencyTelemetry(const char *pcTopic,
+									   char *pcPayloadBuf)
+{
+	size_t uxLen = (size_t) snprintf(pcPayloadBuf, MQTT_PUBLISH_MAX_LEN, "{\"d\":[{\"d\":{");
+	uxLen += AudioLatency_FormatAttributes(&pcPayloadBuf[uxLen], MQTT_PUBLISH_MAX_LEN - uxLen);
+	if (uxLen >= MQTT_PUBLISH_MAX_LEN) {
+		LogError("Not enough buffer space for latency telemetry.");
+		return;
+	}
+	uxLen += (size_t) snprintf(&pcPayloadBuf[uxLen], MQTT_PUBLISH_MAX_LEN - uxLen, "}}],\"mt\":0}");
+	if (uxLen >= MQTT_PUBLISH_MAX_LEN) {
+		LogError("Not enough buffer space for latency telemetry.");
+		return;
+	}
+
+	if (!PublishQueue_Submit(pcTopic, MIC_PUBLISH_KEY_LATENCY, pcPayloadBuf, uxLen, NULL, 0)) {
+		LogWarn("Publish queue full, latency telemetry dropped.");
+	}
+}
+#endif
+
 static BaseType_t xIsMqttConnected(void)
 {
 	/* Wait for MQTT to be connected */
@@ -317,167 +459,337 @@ static BaseType_t xInitSensors(void)
 	return (lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE);
 }
 
-static bool scan_command_number_array_arg(const char* payload, const char* command, int *value_array, size_t num_values) {
-    // we should get something like {"v":"2.1","ct":0,"cmd":"set-confidence-threshold 22"}
-    const char* command_pos = strstr(payload, command);
+static bool prvSetInferenceStride(uint32_t ulColumns)
+{
+	if (!SpectrogramEngine_SetStride(&xSpectrogramEngine, ulColumns)) {
+		return false;
+	}
+	AudioLatency_SetDeadline(MIC_STRIDE_DEADLINE_US(ulColumns));
+	return true;
+}
 
-    if (!command_pos) {
-        return false;
-    }
+/* Apply the decision parameters at boot, if saved for this model */
+static void prvLoadDecisionConfig(void)
+{
+	uint8_t pucRecord[DECISION_CONFIG_RECORD_SIZE];
+	DecisionConfig_t xConfig;
+	DecisionConfigResult_t xResult;
+
+	size_t xLength = KVStore_getValueLength(CS_DECISION_CONFIG);
+	if (xLength > sizeof(pucRecord)) {
+		LogWarn("Saved decision configuration ignored: larger than the record of this model.");
+		return;
+	}
+	if (xLength > 0U) {
+		xLength = KVStore_getBlob(CS_DECISION_CONFIG, pucRecord, sizeof(pucRecord));
+	}
+	xResult = DecisionConfig_Decode(pucRecord, xLength, &xConfig);
+	if (xResult == DECISION_CONFIG_OK && DecisionConfig_Apply(&xConfig)) {
+		LogInfo("Saved decision configuration applied: threshold %d, inactivity timeout %d.",
+				xConfig.threshold, xConfig.inactivity_timeout);
+	} else if (xResult != DECISION_CONFIG_EMPTY) {
+		LogWarn("Saved decision configuration ignored: %s.", DecisionConfig_ResultName(xResult));
+	}
+}
 
-    if (0 == num_values) {
-        return false;
-    }
+/* Apply decision parameters changed by a command, and save them for the next boot */
+static bool prvUpdateDecisionConfig(const DecisionConfig_t *pxConfig)
+{
+	uint8_t pucRecord[DECISION_CONFIG_RECORD_SIZE];
 
-    const char * value_pos = &command_pos[strlen(command)];
-    size_t value_idx = 0;
-    do {
-        int num_found = sscanf(value_pos, "%d", &value_array[value_idx]);
-        if (num_found != 1) {
-        	return false;
-        }
-        value_idx++;
-    	value_pos = strstr(value_pos, " ");
-    	if (NULL == value_pos) {
-    		break;
-    	}
-    	value_pos++; // move the the "end" of space
-    } while(NULL != value_pos && value_idx < num_values);
-
-    if (value_idx < num_values) {
-    	return false;
-    }
-    return true;
+	if (!DecisionConfig_Apply(pxConfig)) {
+		return false;
+	}
+	size_t xLength = DecisionConfig_Encode(pxConfig, pucRecord, sizeof(pucRecord));
+	if (KVStore_setBlob(CS_DECISION_CONFIG, xLength, pucRecord) != pdTRUE || KVStore_xCommitChanges() != pdTRUE) {
+		// still in use until the next reset
+		LogError("Failed to save the decision configuration.");
+	}
+	return true;
+}
+
+/* Select at boot the format of the detections saved by set-telemetry-format, JSON if none */
+static void prvLoadTelemetryFormat(void)
+{
+	BaseType_t xSuccess = pdFALSE;
+	uint32_t ulFormat = KVStore_getUInt32(CS_TELEMETRY_FORMAT, &xSuccess);
+
+	if (xSuccess != pdTRUE || ulFormat == (uint32_t)TELEMETRY_FORMAT_JSON) {
+		return;
+	}
+	if (ulFormat == (uint32_t)TELEMETRY_FORMAT_CBOR) {
+		xInferenceCtx.xTelemetryFormat = TELEMETRY_FORMAT_CBOR;
+		LogInfo("Saved telemetry format applied: %s.", TelemetryEncoder_FormatName(TELEMETRY_FORMAT_CBOR));
+	} else {
+		LogWarn("Saved telemetry format %u ignored.", (unsigned)ulFormat);
+	}
 }
 
-static void apply_class_offset(const char* name, int offset) {
-	for (int i = 0; i < AI_NETWORK_OUT_1_SIZE; i++) {
-    	if (0 == strcmp(name, sAiClassLabels[i])) {
-    		LogInfo("Applying offset %d to %s", offset, sAiClassLabels[i]);
-    		confidence_offsets[i] = offset;
-    		return;
-    	}
+/* C2D command handlers, called with the arguments checked against the schema of their entry of xC2dCommands */
+
+static bool prvCmdSetOffsets(const C2dArgs_t *pxArgs)
+{
+	DecisionConfig_t xConfig;
+	DecisionConfig_Capture(&xConfig);
+	memcpy(xConfig.offsets, pxArgs->values, sizeof(xConfig.offsets));
+	if (!prvUpdateDecisionConfig(&xConfig)) {
+		LogError("Failed set-confidence-offsets! Expected offsets of %d to %d.",
+				-DECISION_CONFIG_MAX_OFFSET, DECISION_CONFIG_MAX_OFFSET);
+		return false;
+	}
+	LogInfo("New offsets set:");
+	for (int i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+		LogInfo("%s: %d", sAiClassLabels[i], SoundDecision_GetOffset(i));
 	}
+	return true;
 }
 
-static bool scan_command_number_arg(const char* payload, const char* command, int *value) {
-    // we should get something like {"v":"2.1","ct":0,"cmd":"set-confidence-threshold 22"}
-    const char* command_pos = strstr(payload, command);
-    if (!command_pos) {
-        return false;
-    }
-    const char * value_pos = &command_pos[strlen(command)];
-    int num_found = sscanf(value_pos, "%d", value);
-    return (num_found == 1);
+static bool prvCmdSetThreshold(const C2dArgs_t *pxArgs)
+{
+	DecisionConfig_t xConfig;
+	DecisionConfig_Capture(&xConfig);
+	xConfig.threshold = pxArgs->values[0];
+	if (!prvUpdateDecisionConfig(&xConfig)) {
+		LogError("Failed set-confidence-threshold! Expected 0 to %d.", DECISION_CONFIG_MAX_PERCENT);
+		return false;
+	}
+	LogInfo("New confidence threshold: %d", xConfig.threshold);
+	return true;
+}
+
+static bool prvCmdSetInactivityTimeout(const C2dArgs_t *pxArgs)
+{
+	DecisionConfig_t xConfig;
+	DecisionConfig_Capture(&xConfig);
+	xConfig.inactivity_timeout = pxArgs->values[0];
+	for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+		xConfig.class_timeouts[i] = xConfig.inactivity_timeout;
+	}
+	if (!prvUpdateDecisionConfig(&xConfig)) {
+		LogError("Failed set-inactivity-timeout! Expected 0 to %d ms.", DECISION_CONFIG_MAX_TIMEOUT_MS);
+		return false;
+	}
+	LogInfo("New inactivity timeout: %d", xConfig.inactivity_timeout);
+	return true;
+}
+
+static bool prvCmdSetClassTimeouts(const C2dArgs_t *pxArgs)
+{
+	DecisionConfig_t xConfig;
+	DecisionConfig_Capture(&xConfig);
+	memcpy(xConfig.class_timeouts, pxArgs->values, sizeof(xConfig.class_timeouts));
+	if (!prvUpdateDecisionConfig(&xConfig)) {
+		LogError("Failed set-class-timeouts! Expected 0 to %d ms.", DECISION_CONFIG_MAX_TIMEOUT_MS);
+		return false;
+	}
+	LogInfo("New inactivity timeouts set:");
+	for (int i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+		LogInfo("%s: %d", sAiClassLabels[i], SoundDecision_GetClassTimeout(i));
+	}
+	return true;
 }
 
+static bool prvCmdSetInferenceStride(const C2dArgs_t *pxArgs)
+{
+	int stride = pxArgs->values[0];
+	if (stride <= 0 || !prvSetInferenceStride((uint32_t)stride)) {
+		LogError("Failed set-inference-stride! Expected 1 to %d columns.", (int)SPECTROGRAM_ENGINE_MAX_STRIDE);
+		return false;
+	}
+	LogInfo("New inference stride: %d columns", stride);
+	return true;
+}
+
+static bool prvCmdSetScoreSmoothing(const C2dArgs_t *pxArgs)
+{
+	char smoothing[24];
+	ScoreSmoothingConfig_t xSmoothing;
+	if (!ScoreSmoothing_Parse(pxArgs->text, &xSmoothing) || !ScoreSmoothing_Configure(&xSmoothing)) {
+		LogError("Failed set-score-smoothing! Expected none, ema <alpha>, median <n> or vote <k> <n> with n up to %u.",
+				(unsigned)SCORE_SMOOTHING_MAX_FRAMES);
+		return false;
+	}
+	(void)ScoreSmoothing_Format(&xSmoothing, smoothing, sizeof(smoothing));
+	LogInfo("New score smoothing: %s", smoothing);
+	return true;
+}
+
+static bool prvCmdSetHysteresis(const C2dArgs_t *pxArgs)
+{
+	DecisionConfig_t xConfig;
+	DecisionConfig_Capture(&xConfig);
+	xConfig.hysteresis = pxArgs->values[0];
+	if (!prvUpdateDecisionConfig(&xConfig)) {
+		LogError("Failed set-hysteresis! Expected 0 to %d.", DECISION_CONFIG_MAX_PERCENT);
+		return false;
+	}
+	LogInfo("New hysteresis margin: %d", xConfig.hysteresis);
+	return true;
+}
+
+static bool prvCmdSetMaxLabels(const C2dArgs_t *pxArgs)
+{
+	DecisionConfig_t xConfig;
+	DecisionConfig_Capture(&xConfig);
+	xConfig.max_labels = (pxArgs->values[0] > 0) ? (uint32_t)pxArgs->values[0] : 0U;
+	if (!prvUpdateDecisionConfig(&xConfig)) {
+		LogError("Failed set-max-labels! Expected 1 to %d labels.", (int)SOUND_DECISION_MAX_LABELS);
+		return false;
+	}
+	LogInfo("New maximum number of labels: %u", (unsigned)xConfig.max_labels);
+	return true;
+}
+
+static bool prvCmdSetTelemetryFormat(const C2dArgs_t *pxArgs)
+{
+	TelemetryFormat_t xFormat;
+	if (!TelemetryEncoder_ParseFormat(pxArgs->text, &xFormat)) {
+		LogError("Failed set-telemetry-format! Expected json or cbor.");
+		return false;
+	}
+	xInferenceCtx.xTelemetryFormat = xFormat;
+	if (KVStore_setUInt32(CS_TELEMETRY_FORMAT, (uint32_t)xFormat) != pdTRUE || KVStore_xCommitChanges() != pdTRUE) {
+		// still in use until the next reset
+		LogError("Failed to save the telemetry format.");
+	}
+	LogInfo("New telemetry format: %s", TelemetryEncoder_FormatName(xFormat));
+	return true;
+}
+
+static bool prvCmdSetDetectionBatch(const C2dArgs_t *pxArgs)
+{
+	int messages = pxArgs->values[0];
+	int window = pxArgs->values[1];
+	TelemetryBatchConfig_t xBatch = { .messages = (uint32_t)messages, .window_ms = (uint32_t)window };
+	if (messages <= 0 || window < 0 || !TelemetryBatch_Configure(&xBatch)) {
+		LogError("Failed set-detection-batch! Expected 1 to %u detections and a window of 1 to %u ms.",
+				(unsigned)TELEMETRY_BATCH_MAX_MESSAGES, (unsigned)TELEMETRY_BATCH_MAX_WINDOW_MS);
+		return false;
+	}
+	LogInfo("New detection batch: %d detections within %d ms", messages, window);
+	return true;
+}
+
+static bool prvCmdRetrainStart(const C2dArgs_t *pxArgs)
+{
+	retrain_cmd_arg = pxArgs->values[0];
+	LogInfo("Retrain command received: %d", retrain_cmd_arg);
+
+	const char * classification = RetrainHandler_GetClassName((uint8_t)retrain_cmd_arg);
+	if (!classification) {
+		LogError("Failed to retrieve classification argument: %d", retrain_cmd_arg);
+		return false;
+	}
+	// Check if the classification is allowed for retraining
+	if (!RetrainHandler_IsClassificationAllowed(classification)) {
+		LogError("Retraining for classification not allowed: %s", classification);
+		return false;
+	}
+	// Enqueue buffer data for retraining if allowed
+	if (RetrainHandler_EnqueueBufferData(classification) == RETRAIN_HANDLER_OK) {
+		LogDebug("Retrain data enqueued successfully");
+	}
+	return true;
+}
+
+static bool prvCmdCredsS3(const C2dArgs_t *pxArgs)
+{
+	// Define an enumeration for the credential keys
+	enum CredKeys{ENDPOINT_KEY = 0, API_KEY, KEYS_NUM};
+	// Arrays to store the lengths and values of the credentials
+	uint32_t length[KEYS_NUM];
+	const char *values[KEYS_NUM];
+	const char values_separator = ' ';
+	// Symbols to be stripped from the arguments, quotes and braces being still accepted around them
+	char symbols[] = {'"', ' ', '{', '}'};
+	// Arguments copied to be stripped, the MQTT agent calls the handlers one at a time
+	static char args_buffer[C2D_COMMAND_MAX_LEN];
+
+	(void)snprintf(args_buffer, sizeof(args_buffer), "%s", pxArgs->text);
+	char* args = strip_symbols(args_buffer, symbols, sizeof(symbols));
+
+	// Parse values from the arguments
+	uint32_t count = parse_values_with_separator((const char *)args, values, length, KEYS_NUM, values_separator);
+	if (count != KEYS_NUM) {
+		LogError("Failed to parse S3 credentials. Expected items num %d, got %d", KEYS_NUM, count);
+		return false;
+	}
+	LogInfo("Received new S3 credentials");
+
+	// Create buffers to store the endpoint and API key
+	char endpoint_buffer[length[ENDPOINT_KEY] + 1];
+	char api_key_buffer[length[API_KEY] + 1];
+
+	// Copy the parsed values into the buffers
+	sprintf(endpoint_buffer, "%.*s", (int)length[ENDPOINT_KEY], values[ENDPOINT_KEY]);
+	sprintf(api_key_buffer, "%.*s", (int)length[API_KEY], values[API_KEY]);
+
+	// Store the new credentials in the key-value store
+	KVStore_setString(CS_S3_ENDPOINT, endpoint_buffer);
+	KVStore_setString(CS_S3_API_KEY, api_key_buffer);
+
+	// Commit the new credentials to the key-value store
+	if (KVStore_xCommitChanges() != pdTRUE) {
+		LogError("Failed to commit S3 credentials.");
+		return false;
+	}
+	LogInfo("S3 credentials committed successfully.");
+	return true;
+}
+
+#if SOUND_DECISION_CLASS_NUMBER > C2D_COMMAND_MAX_INTS
+#error "C2D_COMMAND_MAX_INTS must hold a value per class for set-confidence-offsets and set-class-timeouts"
+#endif
+
+/* Commands accepted from the cloud, see DEMO.md */
+static const C2dCommand_t xC2dCommands[] = {
+	{ "set-confidence-offsets", C2D_ARGS_INTS, SOUND_DECISION_CLASS_NUMBER, SOUND_DECISION_CLASS_NUMBER,
+			prvCmdSetOffsets, "<offset per class>" },
+	{ "set-confidence-threshold", C2D_ARGS_INTS, 1, 1, prvCmdSetThreshold, "<confidence>" },
+	{ "set-inactivity-timeout", C2D_ARGS_INTS, 1, 1, prvCmdSetInactivityTimeout, "<ms>" },
+	{ "set-class-timeouts", C2D_ARGS_INTS, SOUND_DECISION_CLASS_NUMBER, SOUND_DECISION_CLASS_NUMBER,
+			prvCmdSetClassTimeouts, "<ms per class>" },
+	{ "set-inference-stride", C2D_ARGS_INTS, 1, 1, prvCmdSetInferenceStride, "<columns>" },
+	{ "set-score-smoothing", C2D_ARGS_TEXT, 0, 0, prvCmdSetScoreSmoothing,
+			"none | ema <alpha> | median <n> | vote <k> <n>" },
+	{ "set-hysteresis", C2D_ARGS_INTS, 1, 1, prvCmdSetHysteresis, "<margin>" },
+	{ "set-max-labels", C2D_ARGS_INTS, 1, 1, prvCmdSetMaxLabels, "<labels>" },
+	{ "set-telemetry-format", C2D_ARGS_TEXT, 0, 0, prvCmdSetTelemetryFormat, "json | cbor" },
+	{ "set-detection-batch", C2D_ARGS_INTS, 2, 2, prvCmdSetDetectionBatch, "<detections> <window ms>" },
+	{ "retrain_start", C2D_ARGS_INTS, 1, 1, prvCmdRetrainStart, "<class>" },
+	{ "creds_s3", C2D_ARGS_TEXT, 0, 0, prvCmdCredsS3, "<endpoint> <api key>" },
+};
+
 static void on_c2d_message( void * subscription_context, MQTTPublishInfo_t * publish_info ) {
     (void) subscription_context;
 
-    const char* OFFSETS_CMD = "set-confidence-offsets ";
-    const char* THRESHOLD_CMD = "set-confidence-threshold ";
-    const char* INACTIVITY_TIMEOUT_CMD = "set-inactivity-timeout ";
-	const char* RETRAIN_CMD = "retrain_start";
-	const char* S3_CREDS_CMD = "creds_s3";
+    // the MQTT agent task delivers the messages one at a time
+    static C2dEnvelope_t xEnvelope;
+    const C2dCommand_t *pxCommand = NULL;
+
     if (!publish_info) {
         LogError("on_c2d_message: Publish info is NULL?");
         return;
     }
     LogInfo("<<< %.*s", publish_info->payloadLength, publish_info->pPayload);
 
-    char* payload = (char *)publish_info->pPayload;
-    // terminate the string just in case.
-    // Don't really care about the last char for now so we can overwrite it with null and truncate the value
-    payload[publish_info->payloadLength] = 0;
-
-    if (NULL != strstr(payload, OFFSETS_CMD)) {
-    	if (scan_command_number_array_arg(payload, OFFSETS_CMD, confidence_offsets, AI_NETWORK_OUT_1_SIZE)) {
-        	LogInfo("New offsets set:");
-        	for (int i = 0; i < AI_NETWORK_OUT_1_SIZE; i++) {
-            	LogInfo("%s: %d", sAiClassLabels[i], confidence_offsets[i]);
-        	}
-    	} else {
-    		LogError("Failed %s!", OFFSETS_CMD);
-    	}
-    } else if (NULL != strstr(payload, THRESHOLD_CMD)) {
-    	if (scan_command_number_arg(payload, THRESHOLD_CMD, &confidence_threshold)) {
-        	LogInfo("New confidence threshold: %d", confidence_threshold);
-    	} else {
-    		LogError("Failed %s!", THRESHOLD_CMD);
-    	}
-    } else if (NULL != strstr(payload, INACTIVITY_TIMEOUT_CMD)) {
-    	if (scan_command_number_arg(payload, INACTIVITY_TIMEOUT_CMD, &inactivity_timeout)) {
-        	LogInfo("New inactivity timeout: %d", inactivity_timeout);
-    	} else {
-    		LogError("Failed %s!", INACTIVITY_TIMEOUT_CMD);
-    	}
-	} else if (NULL != strstr(payload, RETRAIN_CMD)) {
-		if (scan_command_number_arg(payload, RETRAIN_CMD, &retrain_cmd_arg)) {
-			LogInfo("Retrain command received: %d", retrain_cmd_arg);
-			
-			const char * classification = RetrainHandler_GetClassName((uint8_t)retrain_cmd_arg);
-
-			if(classification){
-				// Check if the classification is allowed for retraining
-				if(RetrainHandler_IsClassificationAllowed(classification)){
-					// Enqueue buffer data for retraining if allowed
-					if(RetrainHandler_EnqueueBufferData(classification) == RETRAIN_HANDLER_OK){
-						LogDebug("Retrain data enqueued successfully");
-					}
-				} else {
-					LogError("Retraining for classification not allowed: %s", classification);
-				}
-			}
-			else
-				LogError("Failed to retrieve classification argument: %d", retrain_cmd_arg);
-			
-		} else {
-			LogError("Failed scanning %s command arguments", RETRAIN_CMD);
-		}
-	} else if (NULL != strstr(payload, S3_CREDS_CMD)) {
-        // Define an enumeration for the credential keys
-        enum CredKeys{ENDPOINT_KEY = 0, API_KEY, KEYS_NUM};
-        // Arrays to store the lengths and values of the credentials
-        uint32_t length[KEYS_NUM];
-        const char *values[KEYS_NUM];
-		const char values_separator = ' ';
-        // Symbols to be stripped from the arguments
-        char symbols[] = {'"', ' ', '{', '}'};
-        char* args = NULL;
-        
-        // Find the S3 credentials command in the payload and move the pointer to the arguments
-        args = strstr(payload, S3_CREDS_CMD) + strlen(S3_CREDS_CMD);
-        // Strip unwanted symbols from the arguments
-        args = strip_symbols(args, symbols, sizeof(symbols));
-
-        // Parse values from the arguments
-        uint32_t count = parse_values_with_separator((const char *)args, values, length, KEYS_NUM, values_separator);
-        if (count == KEYS_NUM) {
-            LogInfo("Received new S3 credentials");
-
-            // Create buffers to store the endpoint and API key
-            char endpoint_buffer[length[ENDPOINT_KEY] + 1];
-            char api_key_buffer[length[API_KEY] + 1];
-
-            // Copy the parsed values into the buffers
-            sprintf(endpoint_buffer, "%.*s", (int)length[ENDPOINT_KEY], values[ENDPOINT_KEY]);
-            sprintf(api_key_buffer, "%.*s", (int)length[API_KEY], values[API_KEY]);
-
-            // Store the new credentials in the key-value store
-            KVStore_setString(CS_S3_ENDPOINT, endpoint_buffer);
-            KVStore_setString(CS_S3_API_KEY, api_key_buffer);
-
-			// Commit the new credentials to the key-value store
-			if (KVStore_xCommitChanges() == pdTRUE) {
-				LogInfo("S3 credentials committed successfully.");
-			} else {
-				LogError("Failed to commit S3 credentials.");
-			}
-        } else {
-            LogError("Failed to parse S3 credentials. Expected items num %d, got %d", KEYS_NUM, count);
-        }
-    } else {
-    	LogError("Unknown command!");
+    // the payload is not null terminated, it is parsed within its length
+    C2dResult_t xResult = C2dCommand_Dispatch(xC2dCommands, sizeof(xC2dCommands) / sizeof(xC2dCommands[0]),
+    		(const char *)publish_info->pPayload, publish_info->payloadLength, &xEnvelope, &pxCommand);
+    switch (xResult) {
+    case C2D_OK:
+    case C2D_FAILED:
+    	// logged by the handler
+    	break;
+    case C2D_BAD_ARGUMENTS:
+    	LogError("Failed %s! Usage: %s %s", pxCommand->name, pxCommand->name, pxCommand->usage);
+    	break;
+    case C2D_UNKNOWN_COMMAND:
+    	LogError("Unknown command: %.*s", (int)xEnvelope.command_len, xEnvelope.command);
+    	break;
+    default:
+    	LogError("Failed to process the command: %s", C2dCommand_ResultName(xResult));
+    	break;
     }
 }
 
@@ -508,23 +820,8 @@ static bool subscribe_to_c2d_topic(const char * device_id)
     return true;
 }
 
-// basically makes the next detection trigger due to long time diff:
-static void set_detected_never(void) {
-	last_detection_time = pdMS_TO_TICKS(xTaskGetTickCount()) - 99999U;
-}
-static void set_detected_now(void) {
-	last_detection_time = pdMS_TO_TICKS(xTaskGetTickCount());
-}
-static bool is_detection_blocked(void) {
-	return ((int)(pdMS_TO_TICKS(xTaskGetTickCount()) - last_detection_time) < inactivity_timeout);
-}
-
-static bool is_dma_half_event(uint32_t notifiedValue) {
-    return (notifiedValue & MIC_EVT_DMA_HALF) != 0;
-}
-
-static bool is_dma_cplt_event(uint32_t notifiedValue) {
-    return (notifiedValue & MIC_EVT_DMA_CPLT) != 0;
+static uint32_t get_time_ms(void) {
+	return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
 }
 
 static uint32_t parse_values_with_separator(const char *payload, const char **values, uint32_t *lengths, uint32_t max_values, char separator) {
@@ -602,13 +899,447 @@ static const char* getAppFirmwareVersionString(void)
     return versionString;
 }
 
+/**
+ * @brief Queue a message for the sender task, the audio does not wait for the MQTT agent.
+ *
+ * The detections it reports come back to prvProcessPublished() once it is published or failed.
+ *
+ * @return true if the message was queued.
+ */
+static bool prvSubmitMessage(const char *pcTopic, uint32_t ulKey, const void *pvPayload, size_t xLength,
+							 const DetectionLogEntry_t *pxDetections, uint32_t ulDetections)
+{
+	if (xIsMqttConnected() != pdTRUE) {
+		return false;
+	}
+	if (!PublishQueue_Submit(pcTopic, ulKey, pvPayload, xLength, pxDetections, ulDetections)) {
+		LogDebug("Publish queue full, message dropped.");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Record a detection of this boot as the detection log does.
+ */
+static void prvMakeLogEntry(const SoundDecision_t *pxDecision, uint32_t ulSequence, uint32_t ulTime,
+							DetectionLogEntry_t *pxEntry)
+{
+	uint32_t ulCount = (pxDecision->label_count < DETECTION_LOG_MAX_LABELS) ? pxDecision->label_count
+																			: DETECTION_LOG_MAX_LABELS;
+
+	memset(pxEntry, 0, sizeof(*pxEntry));
+	pxEntry->sequence = ulSequence;
+	pxEntry->time_ms = ulTime;
+	pxEntry->current_boot = true;
+	pxEntry->label_count = ulCount;
+	for (uint32_t i = 0; i < ulCount; i++) {
+		pxEntry->labels[i].class_idx = (uint8_t)pxDecision->labels[i].class_idx;
+		pxEntry->labels[i].confidence = (uint8_t)pxDecision->labels[i].confidence_percent;
+	}
+}
+
+/**
+ * @brief Append a detection to the detection log, to be replayed once online.
+ */
+static void prvLogDetection(const DetectionLogEntry_t *pxEntry)
+{
+	if (!DetectionLog_Append(pxEntry->sequence, pxEntry->time_ms, pxEntry->labels, pxEntry->label_count)) {
+		LogError("Detection %u not logged.", (unsigned)pxEntry->sequence);
+	}
+}
+
+/**
+ * @brief Queue the batched detections, if any, as one message.
+ *
+ * The batch is emptied once its message is queued or, if it cannot be, offline or with the
+ * publish queue full, once its new detections are in the detection log and those taken from
+ * it are to be taken again: none is lost with it.
+ *
+ * @return true if a message was queued.
+ */
+static bool prvFlushBatch(MicInferenceCtx_t *pxCtx)
+{
+	size_t xLength;
+	uint32_t ulMessages;
+	const char *pcBatch = TelemetryBatch_Peek(&xLength, &ulMessages);
+
+	if (pcBatch == NULL) {
+		return false;
+	}
+	if (ulMessages > 1U) {
+		LogDebug("%u detections in one message", (unsigned)ulMessages);
+	}
+	bool xQueued = prvSubmitMessage(pxCtx->pcTopicString, PUBLISH_QUEUE_KEY_NONE, pcBatch, xLength,
+									pxCtx->xBatchDetections, pxCtx->ulBatchDetections);
+	if (!xQueued && pxCtx->ulBatchDetections > 0U) {
+		bool xRewind = false;
+		LogWarn("Batch of %u detections not queued.", (unsigned)pxCtx->ulBatchDetections);
+		for (uint32_t i = 0; i < pxCtx->ulBatchDetections; i++) {
+			if (pxCtx->xBatchDetections[i].logged) {
+				xRewind = true;
+			} else {
+				prvLogDetection(&pxCtx->xBatchDetections[i]);
+			}
+		}
+		if (xRewind) {
+			DetectionLog_Rewind();
+		}
+	}
+	TelemetryBatch_Commit();
+	pxCtx->ulBatchDetections = 0;
+	return xQueued;
+}
+
+/**
+ * @brief Encode a detection and queue it, or add it to the batch.
+ *
+ * @param pxCtx Decision and publish state.
+ * @param pxDecision Detection, its labels at least.
+ * @param pxEntry Detection as recorded, taken from the detection log if replayed, sent with its age.
+ * @param lAge Seconds since a replayed detection, MIC_REPLAY_AGE_UNKNOWN if made before the last reset.
+ * @param pxQueued Set if a message was queued.
+ * @return false if the detection could not be queued and may be tried again, true if
+ *         it was queued or batched, or could never be encoded.
+ */
+static bool prvSendDetection(MicInferenceCtx_t *pxCtx, const SoundDecision_t *pxDecision,
+							 const DetectionLogEntry_t *pxEntry, int lAge, bool *pxQueued)
+{
+	char *payloadBuf = pxCtx->payloadBuf;
+	size_t bytesWritten;
+
+	if (pxCtx->xTelemetryFormat == TELEMETRY_FORMAT_CBOR) {
+		/**
+		 * the reported classes as a CBOR array, on the binary topic, not batched
+		 */
+		TelemetryLabel_t xLabels[SOUND_DECISION_MAX_LABELS];
+		for (uint32_t i = 0; i < pxDecision->label_count; i++) {
+			xLabels[i].class_idx = pxDecision->labels[i].class_idx;
+			xLabels[i].confidence = pxDecision->labels[i].confidence_percent;
+		}
+		bytesWritten = TelemetryEncoder_Binary(pxEntry->sequence,
+				pxEntry->time_ms,
+				xLabels,
+				pxDecision->label_count,
+				(uint8_t *)payloadBuf,
+				MQTT_PUBLISH_MAX_LEN
+		);
+		if (bytesWritten == 0) {
+			LogError("Not enough buffer space.");
+			return true;
+		}
+		if (!prvSubmitMessage(pxCtx->pcBinaryTopicString, PUBLISH_QUEUE_KEY_NONE, payloadBuf, bytesWritten,
+							  pxEntry, 1U)) {
+			return false;
+		}
+		*pxQueued = true;
+		return true;
+	}
+
+	const char *pcLabels = NULL;
+	if (SoundDecision_GetMaxLabels() > 1U || pxDecision->label_count > 1U) {
+		/**
+		 * all the classes detected in one message, the best one also as class and confidence
+		 */
+		if (SoundDecision_FormatLabels(pxDecision, pxCtx->labelsBuf, sizeof(pxCtx->labelsBuf))
+				>= (int)sizeof(pxCtx->labelsBuf)) {
+			LogWarn("Labels truncated to %s", pxCtx->labelsBuf);
+		}
+		pcLabels = pxCtx->labelsBuf;
+	}
+	if (pxEntry->logged) {
+		bytesWritten = TelemetryEncoder_ReplayedDetection(&pxCtx->xTelemetry,
+				pxDecision->class_name,
+				pxDecision->confidence_percent,
+				pcLabels,
+				lAge,
+				payloadBuf,
+				MQTT_PUBLISH_MAX_LEN
+		);
+	} else {
+		bytesWritten = TelemetryEncoder_Detection(&pxCtx->xTelemetry,
+				pxDecision->class_name,
+				pxDecision->confidence_percent,
+				pcLabels,
+				payloadBuf,
+				MQTT_PUBLISH_MAX_LEN
+		);
+	}
+	if (bytesWritten >= MQTT_PUBLISH_MAX_LEN) {
+		LogError("Not enough buffer space.");
+		return true;
+	}
+	if (pxCtx->ulBatchDetections >= TELEMETRY_BATCH_MAX_MESSAGES
+			|| !TelemetryBatch_Add(payloadBuf, bytesWritten, get_time_ms())) {
+		/**
+		 * no room left in the batch, send it and start the next one with this detection
+		 */
+		*pxQueued |= prvFlushBatch(pxCtx);
+		if (!TelemetryBatch_Add(payloadBuf, bytesWritten, get_time_ms())) {
+			return false;
+		}
+	}
+	pxCtx->xBatchDetections[pxCtx->ulBatchDetections++] = *pxEntry;
+	return true;
+}
+
+/**
+ * @brief Send the oldest logged detections not in flight, MIC_REPLAY_RECORDS at most.
+ *
+ * They are marked as sent by prvProcessPublished() once acknowledged.
+ *
+ * @return true if a message was queued.
+ */
+static bool prvReplayDetections(MicInferenceCtx_t *pxCtx, uint32_t ulNow)
+{
+	DetectionLogEntry_t xEntry;
+	SoundDecision_t xDecision;
+	bool xQueued = false;
+
+	if (!pxCtx->xReplaying) {
+		DetectionLogStats_t xStats;
+		DetectionLog_GetStats(&xStats);
+		LogInfo("Replaying %u detections made offline, %u overwritten.",
+				(unsigned)xStats.pending, (unsigned)xStats.overwritten);
+		pxCtx->xReplaying = true;
+	}
+
+	for (uint32_t i = 0; i < MIC_REPLAY_RECORDS && DetectionLog_Take(&xEntry); i++) {
+		xDecision.label_count = 0;
+		for (uint32_t l = 0; l < xEntry.label_count; l++) {
+			// the log may be older than the model
+			if (xEntry.labels[l].class_idx < CTRL_X_CUBE_AI_MODE_CLASS_NUMBER
+					&& xDecision.label_count < SOUND_DECISION_MAX_LABELS) {
+				SoundDecisionLabel_t *pxLabel = &xDecision.labels[xDecision.label_count++];
+				pxLabel->class_idx = xEntry.labels[l].class_idx;
+				pxLabel->class_name = sAiClassLabels[pxLabel->class_idx];
+				pxLabel->confidence_percent = xEntry.labels[l].confidence;
+			}
+		}
+		if (xDecision.label_count == 0U) {
+			LogWarn("Logged detection %u of an unknown class dropped.", (unsigned)xEntry.sequence);
+			(void)DetectionLog_MarkSent(&xEntry);
+			continue;
+		}
+		xDecision.class_idx = xDecision.labels[0].class_idx;
+		xDecision.class_name = xDecision.labels[0].class_name;
+		xDecision.confidence_percent = xDecision.labels[0].confidence_percent;
+
+		int lAge = xEntry.current_boot ? (int)((ulNow - xEntry.time_ms) / 1000U) : MIC_REPLAY_AGE_UNKNOWN;
+		if (!prvSendDetection(pxCtx, &xDecision, &xEntry, lAge, &xQueued)) {
+			DetectionLog_Rewind();
+			break;
+		}
+		if (TelemetryBatch_IsDue(ulNow)) {
+			xQueued |= prvFlushBatch(pxCtx);
+		}
+	}
+	return xQueued;
+}
+
+/**
+ * @brief Settle the detections of the messages the sender task is done with.
+ *
+ * Those taken from the detection log are marked as sent once their message is acknowledged;
+ * if it failed, the log is rewound to send them again, and the new ones are logged.
+ */
+static void prvProcessPublished(MicInferenceCtx_t *pxCtx)
+{
+	PublishMessage_t *pxMessage;
+	bool xRewind = false;
+
+	while ((pxMessage = PublishQueue_ReceiveDone()) != NULL) {
+		if (!pxMessage->sent) {
+			LogWarn("Message of %u detections not published.", (unsigned)pxMessage->detection_count);
+		}
+		for (uint32_t i = 0; i < pxMessage->detection_count; i++) {
+			const DetectionLogEntry_t *pxEntry = &pxMessage->detections[i];
+			if (pxEntry->logged && pxMessage->sent) {
+				(void)DetectionLog_MarkSent(pxEntry);
+			} else if (pxEntry->logged) {
+				xRewind = true;
+			} else if (!pxMessage->sent) {
+				prvLogDetection(pxEntry);
+			}
+		}
+		PublishQueue_Recycle(pxMessage);
+	}
+	if (xRewind) {
+		DetectionLog_Rewind();
+	}
+
+	if (pxCtx->xReplaying && DetectionLog_Pending() == 0U) {
+		LogInfo("Detections made offline replayed.");
+		pxCtx->xReplaying = false;
+	}
+}
+
+/**
+ * @brief Run the inference on a spectrogram, evaluate the decision and publish it.
+ *
+ * Called by the mic task, or by the inference task with MIC_INFERENCE_PIPELINE,
+ * in which case the spectrogram buffer is released as soon as the network is done with it.
+ *
+ * @param pxCtx Decision and publish state.
+ * @param pxFrame Spectrogram and its audio.
+ * @param ulLatencyStart Latency timestamp of the start of the inference.
+ */
+static void prvInferAndPublish(MicInferenceCtx_t *pxCtx, const InferenceFrame_t *pxFrame, uint32_t ulLatencyStart)
+{
+	/**
+	 * AI processing
+	 */
+	AiDPUProcess(&xAIProcCtx, pxFrame->spectrogram, xNetworkBuffers.output);
+#if MIC_INFERENCE_PIPELINE
+	InferencePipeline_Release(pxFrame);
+#endif
+
+	ulLatencyStart = AudioLatency_Stop(AUDIO_LATENCY_STAGE_INFERENCE, ulLatencyStart);
+
+	const char* detected_class = NULL;
+	SoundDecision_t xDecision;
+
+	if (pxFrame->energy > CTRL_X_CUBE_AI_SPECTROGRAM_SILENCE_THR) {
+		/**
+		 * if not silence frame
+		 */
+		const float32_t *pfScores = ScoreSmoothing_Update(xNetworkBuffers.output);
+		if (SoundDecision_Evaluate(pfScores, get_time_ms(), &xDecision)) {
+			detected_class = xDecision.class_name;
+		} else if (xDecision.outcome == SOUND_DECISION_LOW_CONFIDENCE) {
+			// In case of low confidence, we need to retrain the model
+			// with the audio around this frame, captured by the mic task.
+			(void)RetrainHandler_TriggerCapture(xDecision.confidence_percent);
+		}
+	} else {
+		/**
+		 * the sound stopped, do not smooth the next one with it
+		 */
+		ScoreSmoothing_Reset();
+		SoundDecision_ClearHysteresis();
+	}
+
+	ulLatencyStart = AudioLatency_Stop(AUDIO_LATENCY_STAGE_DECISION, ulLatencyStart);
+
+#if (AUDIO_LATENCY_TELEMETRY_PERIOD_MS > 0)
+	if ((get_time_ms() - pxCtx->ulLatencyReportTime) >= AUDIO_LATENCY_TELEMETRY_PERIOD_MS) {
+		pxCtx->ulLatencyReportTime = get_time_ms();
+		if (xIsMqttConnected() == pdTRUE) {
+			prvPublishLatencyTelemetry(pxCtx->pcTopicString, pxCtx->payloadBuf);
+		}
+		ulLatencyStart = AudioLatency_Start();
+	}
+#endif
+
+	uint32_t ulNow = get_time_ms();
+	bool xQueued = false;
+	size_t bytesWritten;
+	prvProcessPublished(pxCtx);
+	if (detected_class) {
+		DetectionLogEntry_t xEntry;
+		prvMakeLogEntry(&xDecision, pxCtx->ulDetectionSequence++, ulNow, &xEntry);
+		pxCtx->idle_needs_sending = true;
+		/**
+		 * offline, or behind the logged detections not acknowledged yet to keep the order:
+		 * kept in the detection log, as when the publish queue is full
+		 */
+		if (xIsMqttConnected() != pdTRUE || DetectionLog_Pending() > 0U
+				|| !prvSendDetection(pxCtx, &xDecision, &xEntry, 0, &xQueued)) {
+			prvLogDetection(&xEntry);
+		}
+	} else if (pxCtx->idle_needs_sending && DetectionLog_Pending() == 0U && !SoundDecision_IsBlocked(ulNow)) {
+		/**
+		 * the detections still batched go first
+		 */
+		pxCtx->idle_needs_sending = false;
+		xQueued = prvFlushBatch(pxCtx);
+		const char *pcIdle = TelemetryEncoder_Idle(&pxCtx->xTelemetry, &bytesWritten);
+		xQueued |= prvSubmitMessage(pxCtx->pcTopicString, MIC_PUBLISH_KEY_IDLE, pcIdle, bytesWritten, NULL, 0);
+	}
+
+	if (DetectionLog_Pending() > 0U && xIsMqttConnected() == pdTRUE
+			&& (ulNow - pxCtx->ulReplayTime) >= MIC_REPLAY_PERIOD_MS) {
+		pxCtx->ulReplayTime = ulNow;
+		xQueued |= prvReplayDetections(pxCtx, ulNow);
+	}
+
+	if (TelemetryBatch_IsDue(ulNow)) {
+		xQueued |= prvFlushBatch(pxCtx);
+	}
+
+	if (xQueued) {
+		AudioLatency_Stop(AUDIO_LATENCY_STAGE_PUBLISH, ulLatencyStart);
+	}
+	AudioLatency_EndFrame();
+}
+
+/**
+ * @brief Sender task: publish the messages queued by prvInferAndPublish(), in order.
+ *
+ * Waiting for the MQTT agent here keeps a slow link from stalling the audio processing.
+ */
+static void prvPublishTask(void *pvParameters)
+{
+	MicInferenceCtx_t *pxCtx = (MicInferenceCtx_t *)pvParameters;
+
+	for (;;)
+	{
+		PublishMessage_t *pxMessage = PublishQueue_Receive(portMAX_DELAY);
+		if (pxMessage == NULL) {
+			continue;
+		}
+
+		BaseType_t xResult = pdFALSE;
+		if (xIsMqttConnected() == pdTRUE) {
+			xResult = prvPublishAndWaitForAck(pxCtx->xAgentHandle,
+											  pxMessage->topic,
+											  pxMessage->payload,
+											  pxMessage->length
+			);
+		}
+
+		if (xResult == pdTRUE && pxMessage->topic == pxCtx->pcBinaryTopicString) {
+			LogDebug("%u bytes to %s", (unsigned)pxMessage->length, pxMessage->topic);
+		} else if (xResult == pdTRUE) {
+			LogDebug("%.*s", (int)pxMessage->length, (const char *)pxMessage->payload);
+		}
+		PublishQueue_Release(pxMessage, xResult == pdTRUE);
+	}
+}
+
+#if MIC_INFERENCE_PIPELINE
+/**
+ * @brief Inference task: process the spectrograms handed over by the mic task.
+ *
+ * The latency statistics are all recorded here, including the pre-processing
+ * time and the capture wait measured by the mic task for each frame.
+ */
+static void prvInferenceTask(void *pvParameters)
+{
+	MicInferenceCtx_t *pxCtx = (MicInferenceCtx_t *)pvParameters;
+	InferenceFrame_t xFrame;
+
+	for (;;)
+	{
+		if (!InferencePipeline_Receive(&xFrame, portMAX_DELAY)) {
+			continue;
+		}
+
+		AudioLatency_Record(AUDIO_LATENCY_STAGE_CAPTURE_WAIT, xFrame.capture_wait_us);
+		AudioLatency_Record(AUDIO_LATENCY_STAGE_PREPROC, xFrame.preproc_us);
+		uint32_t ulLatencyStart = AudioLatency_Stop(AUDIO_LATENCY_STAGE_HANDOFF, xFrame.submit_ticks);
+
+		prvInferAndPublish(pxCtx, &xFrame, ulLatencyStart);
+	}
+}
+#endif
+
 void vMicSensorPublishTask(void *pvParameters)
 {
 	BaseType_t xResult = pdFALSE;
 	BaseType_t xExitFlag = pdFALSE;
-	char payloadBuf[MQTT_PUBLISH_MAX_LEN];
-	MQTTAgentHandle_t xAgentHandle = NULL;
 	char pcTopicString[MQTT_PUBLICH_TOPIC_STR_LEN] = {0};
+	char pcBinaryTopicString[MQTT_BINARY_TOPIC_STR_LEN] = {0};
 	uint32_t ulNotifiedValue = 0;
 
 	(void)pvParameters; /* unused parameter */
@@ -651,6 +1382,74 @@ void vMicSensorPublishTask(void *pvParameters)
 	xAudioProcCtx.output_Q_offset = xAIProcCtx.input_Q_offset;
 	xAudioProcCtx.output_Q_inv_scale = xAIProcCtx.input_Q_inv_scale;
 
+	/**
+	 * locate the network input and output, in the activations buffer when the model allows it
+	 */
+	if (!NetworkBuffers_Init(&xNetworkBuffers))
+	{
+		LogError("Error while locating the network input and output.");
+		vTaskDelete(NULL);
+	}
+
+	/**
+	 * the spectrogram is built incrementally from the audio stream, directly in the network input buffer
+	 */
+	if (!SpectrogramEngine_Init(&xSpectrogramEngine, &xAudioProcCtx, xNetworkBuffers.input))
+	{
+		LogError("Error while initializing the spectrogram.");
+		vTaskDelete(NULL);
+	}
+#if MIC_INFERENCE_PIPELINE
+	/**
+	 * the spectrogram is built in the ping-pong buffers of the pipeline instead,
+	 * one of them is handed to the inference task at each inference
+	 */
+	int8_t *pcFirstBuffer = InferencePipeline_Init();
+	if (pcFirstBuffer == NULL)
+	{
+		LogError("Error while creating the inference pipeline.");
+		vTaskDelete(NULL);
+	}
+	SpectrogramEngine_SwapWindow(&xSpectrogramEngine, pcFirstBuffer);
+	InferencePipeline_RegisterCliCommand();
+#else
+	if (xNetworkBuffers.in_activations)
+	{
+		// the inference overwrites its input, keep the columns the next inference needs
+		SpectrogramEngine_SetVolatileWindow(&xSpectrogramEngine, pcKeptColumns);
+	}
+#endif
+
+	/**
+	 * initialize the decision logic with the model class labels, then apply the
+	 * parameters saved for this model before the first inference
+	 */
+	SoundDecision_Init(sAiClassLabels);
+	prvLoadDecisionConfig();
+	ScoreSmoothing_Init();
+	TelemetryBatch_Init();
+	prvLoadTelemetryFormat();
+
+	/**
+	 * the detections of an offline period are logged until the device is online again
+	 */
+	DetectionLogRam_Init(&xDetectionLogRam, pucDetectionLogMem, MIC_DETECTION_LOG_SECTOR_SIZE,
+						 MIC_DETECTION_LOG_SECTORS, NULL);
+	if (!DetectionLog_Init(&xDetectionLogRam.storage)) {
+		LogError("Error while initializing the detection log.");
+	} else if (DetectionLog_Pending() > 0U) {
+		LogInfo("%u detections logged before the reset.", (unsigned)DetectionLog_Pending());
+	}
+
+	/**
+	 * start the latency statistics, an inference and its decision must be processed
+	 * before the audio of the next inference is captured
+	 */
+	AudioLatency_Init(MIC_STRIDE_DEADLINE_US(MIC_DEFAULT_INFERENCE_STRIDE));
+	(void)prvSetInferenceStride(MIC_DEFAULT_INFERENCE_STRIDE);
+	AudioLatency_RegisterCliCommand();
+	MicDmaTracker_RegisterCliCommand();
+
     char pcDeviceId[64];
     size_t uxDevNameLen = KVStore_getString(CS_CORE_THING_NAME, pcDeviceId, 64);
 
@@ -659,6 +1458,10 @@ void vMicSensorPublishTask(void *pvParameters)
 	{
 		sprintf(pcTopicString, "$aws/rules/msg_d2c_rpt/%s/2.1/0", pcDeviceId);
         uxTopicLen = strlen(pcTopicString);
+		if ((size_t)snprintf(pcBinaryTopicString, MQTT_BINARY_TOPIC_STR_LEN, MIC_BINARY_TOPIC_FORMAT, pcDeviceId)
+				>= MQTT_BINARY_TOPIC_STR_LEN) {
+			uxTopicLen = 0;
+		}
 	}
 
 	if ((uxTopicLen == 0) || (uxTopicLen >= MQTT_PUBLICH_TOPIC_STR_LEN))
@@ -698,22 +1501,63 @@ void vMicSensorPublishTask(void *pvParameters)
 
 	vSleepUntilMQTTAgentReady();
 
-	xAgentHandle = xGetMqttAgentHandle();
+	xInferenceCtx.xAgentHandle = xGetMqttAgentHandle();
+	xInferenceCtx.pcTopicString = pcTopicString;
+	xInferenceCtx.pcBinaryTopicString = pcBinaryTopicString;
+	if (!TelemetryEncoder_Init(&xInferenceCtx.xTelemetry, getAppFirmwareVersionString(),
+							   device_position, inactive_position))
+	{
+		LogError("Error while formatting the telemetry messages.");
+		vTaskDelete(NULL);
+	}
+
+	/**
+	 * the messages are published by a sender task, at the priority of the inference task
+	 */
+	if (!PublishQueue_Init()
+		|| xTaskCreate(prvPublishTask, "MicPublish", MIC_PUBLISH_TASK_STACK_SIZE, &xInferenceCtx,
+					   uxTaskPriorityGet(NULL) - 1, NULL) != pdPASS)
+	{
+		LogError("Error while creating the publish task.");
+		vTaskDelete(NULL);
+	}
+	PublishQueue_RegisterCliCommand();
 
 	LogDebug("start audio");
+	MicDmaTracker_Reset();
 	if (BSP_AUDIO_IN_Record(0, pucAudioBuff, AUDIO_BUFF_SIZE) != BSP_ERROR_NONE)
 	{
 		LogError("AUDIO IN : FAILED.\n");
 	}
 
 	// trigger sending idle immediately if we don't detect:
-	set_detected_never();
-	bool idle_needs_sending = true;
+	SoundDecision_SetDetectedNever(get_time_ms());
+	xInferenceCtx.idle_needs_sending = true;
+	MicDmaWork_t xDmaWork = { .count = 0 };
+	uint32_t ulWorkHalf = 0;   // index in xDmaWork of the half being pre-processed
+	uint32_t ulWorkOffset = 0; // number of samples of this half already pre-processed
+#if (AUDIO_LATENCY_TELEMETRY_PERIOD_MS > 0)
+	xInferenceCtx.ulLatencyReportTime = get_time_ms();
+#endif
+#if MIC_INFERENCE_PIPELINE
+	uint32_t ulCaptureWaitUs = 0; // time waited for audio since the last frame was handed over
+	uint32_t ulPreprocUs = 0;     // time spent pre-processing since the last frame was handed over
+
+	/**
+	 * the inference runs below the mic task priority, so that the audio is pre-processed as soon as it arrives
+	 */
+	if (xTaskCreate(prvInferenceTask, "MicInfer", MIC_INFERENCE_TASK_STACK_SIZE, &xInferenceCtx,
+					uxTaskPriorityGet(NULL) - 1, NULL) != pdPASS)
+	{
+		LogError("Error while creating the inference task.");
+		vTaskDelete(NULL);
+	}
+#endif
 
 
 	LogInfo("**** DEMO SOUNDS v%s ****", getAppFirmwareVersionString());
 	for (uint32_t clidx = 0; clidx < CTRL_X_CUBE_AI_MODE_CLASS_NUMBER; clidx++) {
-		LogInfo("**** %s [%d]", sAiClassLabels[clidx], confidence_offsets[clidx]);
+		LogInfo("**** %s [%d]", sAiClassLabels[clidx], SoundDecision_GetOffset(clidx));
 	}
 	LogInfo("********");
 
@@ -722,137 +1566,95 @@ void vMicSensorPublishTask(void *pvParameters)
 	{
 		TimeOut_t xTimeOut;
 
-        xAudioProcCtx.S_Spectr.spectro_sum = 0;
-
 		vTaskSetTimeOutState(&xTimeOut);
 
-		if (xTaskNotifyWait(0, 0xFFFFFFFF, &ulNotifiedValue, portMAX_DELAY) == pdTRUE) {
-			/**
-			 * Audio pre-processing on audio buffer events
-			 */
-			if (is_dma_half_event(ulNotifiedValue))
-				PreProc_DPU(&xAudioProcCtx, pucAudioBuff, pcSpectroGram);
-			if (is_dma_cplt_event(ulNotifiedValue))
-				PreProc_DPU(&xAudioProcCtx, pucAudioBuff + AUDIO_HALF_BUFF_SIZE, pcSpectroGram);
+		uint32_t ulLatencyStart = AudioLatency_Start();
+
+		/**
+		 * Wait for audio once the buffer halves filled since the last wake-up are all pre-processed
+		 */
+		if (ulWorkHalf >= xDmaWork.count) {
+			if (xTaskNotifyWait(0, 0xFFFFFFFF, &ulNotifiedValue, portMAX_DELAY) != pdTRUE) {
+				continue;
+			}
+#if MIC_INFERENCE_PIPELINE
+			ulCaptureWaitUs += AudioLatency_Lap(&ulLatencyStart);
+#else
+			ulLatencyStart = AudioLatency_Stop(AUDIO_LATENCY_STAGE_CAPTURE_WAIT, ulLatencyStart);
+#endif
 
 			/**
-			 * AI processing
+			 * The halves signalled by this notification may already have been consumed
+			 * on the previous wake-up if the DMA callback ran while it was processed
 			 */
-			AiDPUProcess(&xAIProcCtx, pcSpectroGram, pfAIOutput);
+			if (!MicDmaTracker_Next(&xDmaWork)) {
+				continue;
+			}
+
+			if (xDmaWork.dropped > 0) {
+				SpectrogramEngine_MarkGap(&xSpectrogramEngine);
+				RetrainHandler_MarkAudioGap();
+			}
+			ulWorkHalf = 0;
+			ulWorkOffset = 0;
 		}
 
-		const char* detected_class = NULL;
-		int confidence_score_percent;
-
-		if (xAudioProcCtx.S_Spectr.spectro_sum > CTRL_X_CUBE_AI_SPECTROGRAM_SILENCE_THR) {
-			do { // to easily step out
-				detected_class = NULL;
-				/**
-				 * if not silence frame
-				 */
-				uint32_t max_idx = 0; // assume best is at index 0 and disprove
-				float max_out = pfAIOutput[0] + ((float32_t)confidence_offsets[0]) / 100.0F;
-				for (uint32_t i = 1; i < CTRL_X_CUBE_AI_MODE_CLASS_NUMBER; i++) {
-					float32_t class_out = pfAIOutput[i]  + ((float32_t)confidence_offsets[i] / 100.0F);
-					if (class_out > max_out) {
-						max_idx = i;
-						max_out = class_out;
-					}
-				}
-				const char* c = sAiClassLabels[max_idx];
-
-				confidence_score_percent = (int)(100.0 * max_out);
-				if (confidence_score_percent > 100) {
-					confidence_score_percent = 100;
-				} else if (confidence_score_percent < 0) {
-					confidence_score_percent = 0;
-				}
-
-				if (0 == strcmp("other", c)) {
-					LogInfo("Detected \"other\" with score %s%d. Ignoring...",
-							((confidence_score_percent < confidence_threshold) ? " " : "*"),
-							confidence_score_percent
-					);
-					break;
-				}
-
-				if (confidence_score_percent < confidence_threshold) {
-					LogInfo("Confidence is low for %s (%d<%d). Ignoring...",
-							c,
-							confidence_score_percent,
-							confidence_threshold
-					);
-
-					// In case of low confidence, we need to retrain the model 
-					// with the retrain buffer completely filled.
-					if (is_dma_cplt_event(ulNotifiedValue)) {
-						RetrainHandler_SetBufferData(pucAudioBuff, AUDIO_BUFF_SIZE);
-						LogInfo("*** Retrain buffer is fully populated. ***");
-						LogInfo("*** The retrain buffer can be sent for retraining. ***");
-					}
-					break;
-				}
-
-				if (is_detection_blocked()) {
-					LogInfo("Blocking %s with score %s%d...",
-							c,
-							((confidence_score_percent < confidence_threshold) ? " " : "*"),
-							confidence_score_percent
-					);
-					break;
-				}
-
-				// we are good
-				set_detected_now();
-				detected_class = c;
-			} while (false);  // to easily step out
+		/**
+		 * Audio pre-processing of the buffer halves, oldest first, up to the next inference point.
+		 * Only the spectrogram columns completed by the new samples are computed.
+		 */
+		uint32_t ulHalf = xDmaWork.halves[ulWorkHalf];
+		const int16_t *psHalfSamples = (const int16_t *)(pucAudioBuff + (ulHalf * AUDIO_HALF_BUFF_SIZE));
+		bool inference_due = false;
+
+		/**
+		 * The half is kept in the retrain audio ring before the DMA overwrites it, once
+		 */
+		if (ulWorkOffset == 0 && RetrainHandler_WriteAudio(psHalfSamples, MIC_HALF_BUFF_SAMPLES)) {
+			LogInfo("*** Retrain buffer is fully populated. ***");
+			LogInfo("*** The retrain buffer can be sent for retraining. ***");
 		}
 
-		size_t bytesWritten;
-		if (detected_class) {
-			idle_needs_sending = true;
-			bytesWritten = (size_t) snprintf(payloadBuf, (size_t)MQTT_PUBLISH_MAX_LEN,
-					"{\"d\":"\
-					"[{\"d\":{\"version\":\"MLDEMO-%s\",\"class\":\"%s\",\"confidence\":%d,\"position\":[%s]}}]"\
-					",\"mt\":0}",
-					getAppFirmwareVersionString(),
-					detected_class,
-					confidence_score_percent,
-					device_position
-			);
-		} else if (idle_needs_sending && !is_detection_blocked()) {
-			idle_needs_sending = false;
-			bytesWritten = (size_t) snprintf(payloadBuf, (size_t)MQTT_PUBLISH_MAX_LEN,
-					"{\"d\":"\
-					"[{\"d\":{\"version\":\"MLDEMO-%s \",\"class\":\"%s\",\"confidence\":%d,\"position\":[%s]}}]"\
-					",\"mt\":0}",
-					getAppFirmwareVersionString(),
-					"not-active",
-					100,
-					inactive_position
-			);
-		} else {
-			// do not send anything
-			continue;
+		ulWorkOffset += SpectrogramEngine_Feed(&xSpectrogramEngine,
+											   &psHalfSamples[ulWorkOffset],
+											   MIC_HALF_BUFF_SAMPLES - ulWorkOffset,
+											   &inference_due);
+		if (ulWorkOffset >= MIC_HALF_BUFF_SAMPLES) {
+			ulWorkHalf++;
+			ulWorkOffset = 0;
 		}
 
-		if (xIsMqttConnected() == pdTRUE) {
-			if (bytesWritten < MQTT_PUBLISH_MAX_LEN) {
-				xResult = prvPublishAndWaitForAck(xAgentHandle,
-												  pcTopicString,
-												  payloadBuf,
-												  bytesWritten
-				);
-			} else if (bytesWritten > 0) {
-				LogError("Not enough buffer space.");
-			} else {
-				LogError("MQTT Publish call failed.");
-			}
+#if MIC_INFERENCE_PIPELINE
+		ulPreprocUs += AudioLatency_Lap(&ulLatencyStart);
+#else
+		ulLatencyStart = AudioLatency_Stop(AUDIO_LATENCY_STAGE_PREPROC, ulLatencyStart);
+#endif
 
-			if (xResult == pdTRUE) {
-				LogDebug(payloadBuf);
-			}
+		if (!inference_due) {
+			// the frame goes on until the next inference
+			continue;
 		}
+
+		InferenceFrame_t xFrame = {
+			.spectrogram = SpectrogramEngine_GetView(&xSpectrogramEngine),
+			.energy = SpectrogramEngine_GetEnergy(&xSpectrogramEngine),
+			.time_ms = get_time_ms(),
+			.half = ulHalf,
+		};
+
+#if MIC_INFERENCE_PIPELINE
+		/**
+		 * Hand the spectrogram over to the inference task and go on in the other buffer.
+		 * The frame is dropped if the inference of the previous one is not done yet.
+		 */
+		xFrame.capture_wait_us = ulCaptureWaitUs;
+		xFrame.preproc_us = ulPreprocUs;
+		ulCaptureWaitUs = 0;
+		ulPreprocUs = 0;
+		SpectrogramEngine_SwapWindow(&xSpectrogramEngine, InferencePipeline_Submit(&xFrame, 0));
+#else
+		prvInferAndPublish(&xInferenceCtx, &xFrame, ulLatencyStart);
+#endif
 	}
 }
 
@@ -868,6 +1670,7 @@ void BSP_AUDIO_IN_HalfTransfer_CallBack(uint32_t Instance)
 	assert_param(Instance == 0);
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	BaseType_t rslt = pdFALSE;
+	MicDmaTracker_OnTransfer(MIC_DMA_FIRST_HALF);
 	rslt = xTaskNotifyFromISR(xMicTask,
 							  MIC_EVT_DMA_HALF,
 							  eSetBits,
@@ -887,6 +1690,7 @@ void BSP_AUDIO_IN_TransferComplete_CallBack(uint32_t Instance)
 	assert_param(Instance == 0);
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	BaseType_t rslt = pdFALSE;
+	MicDmaTracker_OnTransfer(MIC_DMA_SECOND_HALF);
 	rslt = xTaskNotifyFromISR(xMicTask,
 							  MIC_EVT_DMA_CPLT,
 							  eSetBits,
@@ -0,0 +1,178 @@
+/**
+ * @file retrain_codec.c
+ * @brief Compression of the audio windows uploaded for retraining.
+ *
+ * IMA-ADPCM block, little endian:
+ *
+ *   0   first sample, exact
+ *   2   step index
+ *   3   reserved, 0
+ *   4   samples 1 to 504, a nibble each, the earlier one in the low nibble
+ */
+
+#include "retrain_codec.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define IMA_INDEX_MAX       88
+
+#define MULAW_BIAS          0x84
+#define MULAW_CLIP          32635
+
+/* ============================ Static Variables ============================ */
+
+static const int16_t s_ima_steps[IMA_INDEX_MAX + 1] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t s_ima_index_steps[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/* ============================ Static Function Implementations ============================ */
+
+/* Nibble of a sample, the predictor and index following it as in the decoder */
+static uint8_t prvImaEncode(RetrainEncoder_t* encoder, int32_t sample) {
+    int32_t step = s_ima_steps[encoder->index];
+    int32_t diff = sample - encoder->predictor;
+    int32_t delta = step >> 3;
+    uint8_t nibble = 0;
+
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 1;
+        delta += step;
+    }
+
+    encoder->predictor += (nibble & 8U) ? -delta : delta;
+    if (encoder->predictor > INT16_MAX) {
+        encoder->predictor = INT16_MAX;
+    } else if (encoder->predictor < INT16_MIN) {
+        encoder->predictor = INT16_MIN;
+    }
+    encoder->index += s_ima_index_steps[nibble];
+    if (encoder->index < 0) {
+        encoder->index = 0;
+    } else if (encoder->index > IMA_INDEX_MAX) {
+        encoder->index = IMA_INDEX_MAX;
+    }
+    return nibble;
+}
+
+static bool prvImaWrite(RetrainEncoder_t* encoder, int16_t sample) {
+    if (encoder->block_samples == 0U) {
+        // the block starts from the exact sample, decoded without the previous blocks
+        if ((encoder->size - encoder->length) < 4U) {
+            return false;
+        }
+        encoder->predictor = sample;
+        encoder->out[encoder->length++] = (uint8_t)(uint16_t)sample;
+        encoder->out[encoder->length++] = (uint8_t)((uint16_t)sample >> 8);
+        encoder->out[encoder->length++] = (uint8_t)encoder->index;
+        encoder->out[encoder->length++] = 0;
+    } else if ((encoder->block_samples & 1U) != 0U) {
+        if (encoder->length >= encoder->size) {
+            return false;
+        }
+        encoder->out[encoder->length++] = prvImaEncode(encoder, sample);
+    } else {
+        encoder->out[encoder->length - 1U] |= (uint8_t)(prvImaEncode(encoder, sample) << 4);
+    }
+    if (++encoder->block_samples == RETRAIN_CODEC_IMA_BLOCK_SAMPLES) {
+        encoder->block_samples = 0;
+    }
+    return true;
+}
+
+static uint8_t prvMulawEncode(int32_t sample) {
+    uint8_t sign = 0;
+
+    if (sample < 0) {
+        sign = 0x80;
+        sample = -sample;
+    }
+    if (sample > MULAW_CLIP) {
+        sample = MULAW_CLIP;
+    }
+    sample += MULAW_BIAS;
+
+    // segment of the biased magnitude, its highest bit from 7 to 14
+    uint8_t exponent = 7;
+    for (int32_t mask = 0x4000; exponent > 0U && (sample & mask) == 0; mask >>= 1) {
+        exponent--;
+    }
+    uint8_t mantissa = (uint8_t)((sample >> (exponent + 3U)) & 0x0F);
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+/* ============================ Function Implementations ============================ */
+
+const char* RetrainCodec_Name(RetrainCodec_t codec) {
+    switch (codec) {
+    case RETRAIN_CODEC_PCM16:
+        return "pcm16";
+    case RETRAIN_CODEC_IMA_ADPCM:
+        return "ima-adpcm";
+    case RETRAIN_CODEC_MULAW:
+        return "mulaw";
+    default:
+        return "unknown";
+    }
+}
+
+void RetrainEncoder_Init(RetrainEncoder_t* encoder, RetrainCodec_t codec, uint8_t* out, size_t size) {
+    encoder->codec = codec;
+    encoder->out = out;
+    encoder->size = size;
+    encoder->length = 0;
+    encoder->predictor = 0;
+    encoder->index = 0;
+    encoder->block_samples = 0;
+    encoder->overflow = false;
+}
+
+bool RetrainEncoder_Write(RetrainEncoder_t* encoder, const int16_t* samples, size_t count) {
+    for (size_t i = 0; i < count && !encoder->overflow; i++) {
+        switch (encoder->codec) {
+        case RETRAIN_CODEC_IMA_ADPCM:
+            encoder->overflow = !prvImaWrite(encoder, samples[i]);
+            break;
+        case RETRAIN_CODEC_MULAW:
+            if (encoder->length >= encoder->size) {
+                encoder->overflow = true;
+            } else {
+                encoder->out[encoder->length++] = prvMulawEncode(samples[i]);
+            }
+            break;
+        default:
+            if ((encoder->size - encoder->length) < 2U) {
+                encoder->overflow = true;
+            } else {
+                encoder->out[encoder->length++] = (uint8_t)(uint16_t)samples[i];
+                encoder->out[encoder->length++] = (uint8_t)((uint16_t)samples[i] >> 8);
+            }
+            break;
+        }
+    }
+    return !encoder->overflow;
+}
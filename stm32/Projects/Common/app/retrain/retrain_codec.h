@@ -0,0 +1,97 @@
+/**
+ * @file retrain_codec.h
+ * @brief Compression of the audio windows uploaded for retraining.
+ *
+ * A window is 2 s of 16-bit PCM, 64000 bytes sent over TLS for each retrain
+ * command. The encoders below shrink it before the upload:
+ *
+ *  - IMA-ADPCM, 4 bits per sample, in the Microsoft IMA-ADPCM mono block
+ *    layout of WAV files (format 0x11): blocks of RETRAIN_CODEC_IMA_BLOCK_SIZE
+ *    bytes, each one starting with the exact sample and the step index so
+ *    that a block decodes on its own, the last block being shorter,
+ *  - mu-law, 8 bits per sample, as G.711.
+ *
+ * The encoder is fed in chunks, e.g. the two parts of a window wrapping
+ * around its ring slot, so that the window needs not be put in order. The
+ * retrain trigger lambda decodes the body back to PCM according to the
+ * RETRAIN_CODEC_HEADER header, whose value is RetrainCodec_Name().
+ *
+ * The module has no RTOS dependency: the same logic runs on target and on
+ * the host.
+ */
+
+#ifndef RETRAIN_CODEC_H
+#define RETRAIN_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** HTTP header naming the encoding of the body, absent for raw PCM */
+#define RETRAIN_CODEC_HEADER            "audio-encoding"
+
+/** Size of an IMA-ADPCM block */
+#define RETRAIN_CODEC_IMA_BLOCK_SIZE    256U
+
+/** Samples of an IMA-ADPCM block, the one of its header and two per byte after it */
+#define RETRAIN_CODEC_IMA_BLOCK_SAMPLES (1U + (RETRAIN_CODEC_IMA_BLOCK_SIZE - 4U) * 2U)
+
+/** Size of samples encoded in IMA-ADPCM */
+#define RETRAIN_CODEC_IMA_SIZE(samples) \
+    (((samples) / RETRAIN_CODEC_IMA_BLOCK_SAMPLES) * RETRAIN_CODEC_IMA_BLOCK_SIZE \
+     + (((samples) % RETRAIN_CODEC_IMA_BLOCK_SAMPLES) ? (4U + ((samples) % RETRAIN_CODEC_IMA_BLOCK_SAMPLES) / 2U) : 0U))
+
+/**
+ * @brief Encoding of the uploaded audio.
+ */
+typedef enum {
+    RETRAIN_CODEC_PCM16 = 0,        ///< 16-bit little endian PCM, as captured
+    RETRAIN_CODEC_IMA_ADPCM,        ///< IMA-ADPCM blocks, 4 bits per sample
+    RETRAIN_CODEC_MULAW,            ///< G.711 mu-law, 8 bits per sample
+} RetrainCodec_t;
+
+/** Size of samples in an encoding, as a constant expression */
+#define RETRAIN_CODEC_SIZE(codec, samples) \
+    (((codec) == RETRAIN_CODEC_IMA_ADPCM) ? RETRAIN_CODEC_IMA_SIZE(samples) \
+     : ((codec) == RETRAIN_CODEC_MULAW) ? (samples) : (2U * (samples)))
+
+/**
+ * @brief State of an encoder.
+ */
+typedef struct {
+    RetrainCodec_t codec;           ///< Encoding
+    uint8_t* out;                   ///< Encoded bytes
+    size_t size;                    ///< Size of out
+    size_t length;                  ///< Bytes encoded
+    int32_t predictor;              ///< IMA-ADPCM predicted sample
+    int32_t index;                  ///< IMA-ADPCM step index
+    uint32_t block_samples;         ///< Samples of the current IMA-ADPCM block
+    bool overflow;                  ///< out was too small, samples dropped
+} RetrainEncoder_t;
+
+/**
+ * @brief Get the value of RETRAIN_CODEC_HEADER for an encoding.
+ */
+const char* RetrainCodec_Name(RetrainCodec_t codec);
+
+/**
+ * @brief Start encoding.
+ *
+ * @param[out] encoder Encoder.
+ * @param[in] codec Encoding.
+ * @param[out] out Encoded bytes, RETRAIN_CODEC_SIZE() of the samples at least.
+ * @param[in] size Size of out.
+ */
+void RetrainEncoder_Init(RetrainEncoder_t* encoder, RetrainCodec_t codec, uint8_t* out, size_t size);
+
+/**
+ * @brief Encode the next samples.
+ *
+ * @param[in] samples Samples, following the previous ones.
+ * @param[in] count Number of samples.
+ *
+ * @return false if out is too small, the samples left being dropped.
+ */
+bool RetrainEncoder_Write(RetrainEncoder_t* encoder, const int16_t* samples, size_t count);
+
+#endif // RETRAIN_CODEC_H
@@ -14,6 +14,8 @@
 
 #include <ctype.h>
 #include "retrain_handler.h"
+#include "retrain_ring.h"
+#include "retrain_codec.h"
 #include "mqtt_handler.h"
 #include "app/s3_client/s3_https_client.h"
 #include "ai_model_config.h"
@@ -33,9 +35,6 @@ typedef struct RetrainHandlerContext* RetrainHandlerHandle_t;
 /* Timeout for sending messages to the queue (in milliseconds) */
 #define QUEUE_SEND_TIMEOUT_MS 500
 
-/* Maximum size of the retrain buffer (64 KB) */
-#define AUDIO_BUFFER_SIZE (64 * 1024)
-
 /* Content type header for audio data */
 #define CONTENT_TYPE_AUDIO "audio/wav"
 
@@ -72,16 +71,34 @@ typedef struct RetrainHandlerContext* RetrainHandlerHandle_t;
 /* Delay between retries for posting data to S3 (in milliseconds) */
 #define RETRY_DELAY_POST_MS 10000
 
+/* Size of a window of the audio ring */
+#define AUDIO_WINDOW_SIZE (RETRAIN_RING_WINDOW_SAMPLES * 2U)
+
+#if AUDIO_WINDOW_SIZE > RETRAIN_MAX_BUFFER_SIZE
+#error "A window of the audio ring must fit in a retrain message"
+#endif
+
+/**
+ * Encoding of the uploaded windows, e.g. RETRAIN_CODEC_IMA_ADPCM for a quarter of the bytes,
+ * once the retrain trigger lambda decoding them is deployed
+ */
+#ifndef RETRAIN_UPLOAD_CODEC
+#define RETRAIN_UPLOAD_CODEC RETRAIN_CODEC_PCM16
+#endif
+
+/* Size of an encoded window, raw PCM being sent from its ring slot */
+#define UPLOAD_BUFFER_SIZE ((RETRAIN_UPLOAD_CODEC == RETRAIN_CODEC_PCM16) \
+                            ? 1U : RETRAIN_CODEC_SIZE(RETRAIN_UPLOAD_CODEC, RETRAIN_RING_WINDOW_SAMPLES))
+
 /* ============================ Static Variables ============================ */
 
 /* Internal context structure */
 struct RetrainHandlerContext {
     QueueHandle_t retrain_queue;        /**< FreeRTOS queue handle */
     TaskHandle_t processing_task;       /**< Task handling message processing */
-    bool is_buffer_populated;           /**< Indicates if the retrain buffer is populated */
-    bool is_write_blocked;              /**< Indicates if writing to the retrain buffer is blocked */
+    bool is_write_blocked;              /**< Indicates if the capture of retrain windows is blocked */
     bool is_initialized;                /**< Initialization state */
-    uint8_t retrain_buffer[AUDIO_BUFFER_SIZE]; /**< Static buffer for retrain data transfer */
+    uint8_t upload_buffer[UPLOAD_BUFFER_SIZE]; /**< Encoded window being uploaded */
 };
 
 /* Static allocation for low-overhead scenarios */
@@ -120,8 +137,22 @@ static RetrainHandlerStatus_t prvValidateMessageData(const RetrainData_t* messag
  * - false if the strings are not equal.
  */
 static bool CaseInsensitiveCompare(const char* s1, const char* s2);
+
+/**
+ * @brief Guard the slots of the audio ring, shared by the mic task and the retrain tasks.
+ */
+static void prvRingLock(void);
+static void prvRingUnlock(void);
 /* ============================ Function Implementations ============================ */
 
+static void prvRingLock(void) {
+    taskENTER_CRITICAL();
+}
+
+static void prvRingUnlock(void) {
+    taskEXIT_CRITICAL();
+}
+
 static bool CaseInsensitiveCompare(const char* s1, const char* s2) {
     // Iterate through both strings
     while (*s1 && *s2) {
@@ -168,6 +199,7 @@ RetrainHandlerStatus_t RetrainHandler_init(void) {
         return RETRAIN_HANDLER_ERR_QUEUE_CREATION;
     }
 
+    RetrainRing_Init(prvRingLock, prvRingUnlock);
     handler->is_initialized = true;
 
     return RETRAIN_HANDLER_OK;
@@ -199,57 +231,21 @@ RetrainHandlerStatus_t RetrainData_enqueue(const RetrainData_t* message) {
     }
 }
 
-RetrainHandlerStatus_t RetrainHandler_SetBufferData(const uint8_t* data, size_t size) {
-    RetrainHandlerHandle_t handler = &s_default_context;
-
-      if (handler->is_write_blocked) {
-        LogError("Writing to retrain buffer is blocked. Unblock writing before attempting to set buffer data.");
-        return RETRAIN_HANDLER_ERR_WRITE_BLOCKED;
-    }
-
-    /* Validate input data */
-    if (data == NULL) {
-        LogError("Invalid input data: NULL");
-        return RETRAIN_HANDLER_ERR_INVALID_BUFFER;
-    }
-
-    /* Validate buffer size */
-    if (size > AUDIO_BUFFER_SIZE) {
-        LogError("Input data size exceeds retrain buffer size: %d", size);
-        return RETRAIN_HANDLER_ERR_BUFFER_OVERFLOW;
-    }
+bool RetrainHandler_WriteAudio(const int16_t* samples, size_t count) {
+    return RetrainRing_Write(samples, count);
+}
 
-    /* Copy data to the retrain buffer */
-    memcpy(handler->retrain_buffer, data, size);
-    handler->is_buffer_populated = true;
-    return RETRAIN_HANDLER_OK;
+void RetrainHandler_MarkAudioGap(void) {
+    RetrainRing_MarkGap();
 }
 
-RetrainHandlerStatus_t RetrainHandler_SetBufferDataWithOffset(const uint8_t* data, size_t size, size_t offset) {
+RetrainHandlerStatus_t RetrainHandler_TriggerCapture(int confidence) {
     RetrainHandlerHandle_t handler = &s_default_context;
 
     if (handler->is_write_blocked) {
-        LogError("Writing to retrain buffer is blocked. Unblock writing before attempting to set buffer data.");
         return RETRAIN_HANDLER_ERR_WRITE_BLOCKED;
     }
-
-    /* Validate input data */
-    if (data == NULL) {
-        LogError("Invalid input data: NULL");
-        return RETRAIN_HANDLER_ERR_INVALID_BUFFER;
-    }
-
-    /* Validate buffer size */
-    if ((offset + size) > AUDIO_BUFFER_SIZE) {
-        LogError("Input data size exceeds retrain buffer size: %d", size);
-        return RETRAIN_HANDLER_ERR_BUFFER_OVERFLOW;
-    }
-
-    /* Copy data to the retrain buffer at the specified offset */
-    memcpy(&handler->retrain_buffer[offset], data, size);
-    handler->is_buffer_populated = true;
-    LogDebug("Buffer set at offset %lu with size %lu", offset, size);
-
+    RetrainRing_Trigger(confidence);
     return RETRAIN_HANDLER_OK;
 }
 
@@ -262,12 +258,6 @@ RetrainHandlerStatus_t RetrainHandler_EnqueueBufferData(const char* classificati
         return RETRAIN_HANDLER_ERR_NOT_INITIALIZED;
     }
 
-    /* Check if buffer is populated */
-    if (!handler->is_buffer_populated) {
-        LogError("Retrain buffer is not populated. Ensure that the buffer is populated before enqueuing data.");
-        return RETRAIN_HANDLER_ERR_INVALID_BUFFER;
-    }
-
     /* Validate classification string */
     if (classification == NULL) {
         LogError("Invalid classification string: NULL");
@@ -279,18 +269,32 @@ RetrainHandlerStatus_t RetrainHandler_EnqueueBufferData(const char* classificati
         return RETRAIN_HANDLER_ERR_INVALID_MESSAGE;
     }
 
-    LogInfo("Enqueuing buffer data with classification: %s", classification);
+    /* Lock the last window captured not queued yet, kept until it is sent */
+    RetrainRingWindow_t window;
+    if (!RetrainRing_Lock(&window)) {
+        LogError("No retrain window captured. Wait for a low confidence inference before enqueuing data.");
+        return RETRAIN_HANDLER_ERR_INVALID_BUFFER;
+    }
+
+    if (window.relocked) {
+        LogWarn("No new retrain window captured, the last one queued is queued again.");
+    }
+    LogInfo("Enqueuing buffer data with classification: %s, confidence %d", classification, window.confidence);
 
-    /* Prepare the message */
+    /* Prepare the message, the window being put in order by the retrain task */
     RetrainData_t message;
-    message.buffer = handler->retrain_buffer;
-    message.buffer_size = AUDIO_BUFFER_SIZE;
+    message.buffer = (void*)window.first;
+    message.buffer_size = AUDIO_WINDOW_SIZE;
+    message.audio_slot = window.slot;
     strncpy(message.classification, classification, RETRAIN_MAX_CLASSIFICATION_LEN);
 
     LogDebug("Message prepared with buffer size: %d", message.buffer_size);
 
     /* Enqueue the message */
     RetrainHandlerStatus_t enqueue_status = RetrainData_enqueue(&message);
+    if (enqueue_status != RETRAIN_HANDLER_OK) {
+        RetrainRing_Release(window.slot);
+    }
 
     return enqueue_status;
 }
@@ -310,16 +314,46 @@ void vRetrainProcessingTask(void* pvParameters) {
     }
 
     for (;;) {
-        /* Wait for message */
-        BaseType_t receive_status = xQueueReceive(handler->retrain_queue, &received_message, portMAX_DELAY);
-
-        if (receive_status == pdTRUE) {
+        /* Wait for message, the connection of the last upload being closed once idle */
+        uint32_t idle_left_ms = S3Client_GetIdleTimeLeft();
+        TickType_t wait = (idle_left_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(idle_left_ms);
+        BaseType_t receive_status = xQueueReceive(handler->retrain_queue, &received_message, wait);
+
+        if (receive_status != pdTRUE) {
+            (void)S3Client_CloseIfIdle();
+        } else {
             LogDebug("Retrain data received");
             LogDebug("Data size: %d", received_message.buffer_size);
 
+            /* The body is sent from a single buffer, the window wrapping around its slot is encoded or put in order */
+            RetrainRingWindow_t window;
+            const char* encoding = NULL;
+            if (RetrainRing_GetWindow(received_message.audio_slot, &window)) {
+                LogDebug("Retrain window triggered at sample %lu", (unsigned long)window.trigger_offset);
+                if (RETRAIN_UPLOAD_CODEC != RETRAIN_CODEC_PCM16) {
+                    RetrainEncoder_t encoder;
+                    RetrainEncoder_Init(&encoder, RETRAIN_UPLOAD_CODEC, handler->upload_buffer,
+                                        sizeof(handler->upload_buffer));
+                    (void)RetrainEncoder_Write(&encoder, window.first, window.first_count);
+                    (void)RetrainEncoder_Write(&encoder, window.second, window.second_count);
+                    received_message.buffer = handler->upload_buffer;
+                    received_message.buffer_size = encoder.length;
+                    encoding = RetrainCodec_Name(RETRAIN_UPLOAD_CODEC);
+                    LogInfo("Retrain window encoded in %s: %lu bytes", encoding, (unsigned long)encoder.length);
+
+                    /* The slot is not needed for the upload anymore */
+                    RetrainRing_Release(received_message.audio_slot);
+                    received_message.audio_slot = RETRAIN_RING_NO_SLOT;
+                } else {
+                    RetrainRing_Linearize(&window);
+                    received_message.buffer = (void*)window.first;
+                }
+            }
+
             int init_result = S3Client_Init();
             if (init_result != S3_CLIENT_SUCCESS) {
                 LogError("Failed to initialize S3 client, error code: %d", init_result);
+                RetrainRing_Release(received_message.audio_slot);
                 continue;
             }
             
@@ -402,17 +436,19 @@ void vRetrainProcessingTask(void* pvParameters) {
             }
 
             // Here we assume that the S3 API Key and Endpoint are already obtained
-            // and we can use them to connect to the S3 client
+            // and we can use them to connect to the S3 client, or reuse the connection of the last upload
             int connect_result = S3Client_Connect( pcS3Endpoint );
             if (connect_result != S3_CLIENT_SUCCESS) {
                 LogError("Failed to connect to S3 client, error code: %d", connect_result);
+                RetrainRing_Release(received_message.audio_slot);
                 continue;
             }
 
             HTTPCustomHeader_t headers[] = {
                 {"Content-Type", CONTENT_TYPE_AUDIO},
                 {"x-api-key", pcS3ApiKey},
-                {"sound-classes", received_message.classification} // Use received classification
+                {"sound-classes", received_message.classification}, // Use received classification
+                {RETRAIN_CODEC_HEADER, encoding} // Skipped for raw PCM
             };
 
             int result;
@@ -448,11 +484,8 @@ void vRetrainProcessingTask(void* pvParameters) {
             if (result != S3_CLIENT_SUCCESS) {
                 LogError("Failed to send data after %d retries", retry_count);
             }
-            
-            int disconnect_result = S3Client_Disconnect();
-            if (disconnect_result != S3_CLIENT_SUCCESS) {
-                LogError("Failed to disconnect from AWS S3. Error code: %d", disconnect_result);
-            }
+            RetrainRing_Release(received_message.audio_slot);
+            /* The connection is left open for the next upload */
         }
     }
 }
@@ -40,47 +40,57 @@ RetrainHandlerStatus_t RetrainHandler_init(void);
 RetrainHandlerStatus_t RetrainData_enqueue(const RetrainData_t* message);
 
 /**
- * @brief Set the buffer data.
+ * @brief Append microphone samples to the audio ring.
  *
- * This function copies provided data to the the internal static buffer.
+ * Called by the mic task for each buffer half, in order. The ring keeps the
+ * last samples so that a window holds the audio before and after a trigger.
  *
- * @param[in] data Pointer to the data buffer.
- * @param[in] size Size of the data buffer.
+ * @param[in] samples Pointer to the samples.
+ * @param[in] count Number of samples.
  *
- * @return RetrainHandlerStatus_t
- * - RETRAIN_HANDLER_OK if the buffer data was successfully set.
- * - RETRAIN_HANDLER_ERR_INVALID_BUFFER if the input data is NULL or the buffer size is invalid.
- * - RETRAIN_HANDLER_ERR_BUFFER_OVERFLOW if the buffer size exceeds the maximum allowed size.
+ * @return bool
+ * - true if a retrain window was completed by these samples.
+ * - false otherwise.
+ */
+bool RetrainHandler_WriteAudio(const int16_t* samples, size_t count);
+
+/**
+ * @brief Restart the audio ring after samples were lost.
+ *
+ * Called by the mic task when buffer halves were overwritten before being read.
  */
-RetrainHandlerStatus_t RetrainHandler_SetBufferData(const uint8_t* data, size_t size);
+void RetrainHandler_MarkAudioGap(void);
 
 /**
- * @brief Set the buffer data with an offset.
+ * @brief Request the capture of a retrain window around the next samples.
  *
- * This function copies provided data to the internal static buffer at the specified offset.
+ * The window is completed once the samples following the trigger are written
+ * by RetrainHandler_WriteAudio(). The windows not yet enqueued are kept in a
+ * pool of slots, the one evicted when the pool is full being chosen by
+ * RETRAIN_RING_EVICTION.
  *
- * @param[in] data Pointer to the data buffer.
- * @param[in] size Size of the data buffer.
- * @param[in] offset Offset in the internal buffer where the data should be copied.
+ * @param[in] confidence Confidence of the inference in percent.
  *
  * @return RetrainHandlerStatus_t
- * - RETRAIN_HANDLER_OK if the buffer data was successfully set.
- * - RETRAIN_HANDLER_ERR_INVALID_BUFFER if the input data is NULL or the buffer size is invalid.
- * - RETRAIN_HANDLER_ERR_BUFFER_OVERFLOW if the buffer size exceeds the maximum allowed size.
+ * - RETRAIN_HANDLER_OK if the capture was requested.
+ * - RETRAIN_HANDLER_ERR_WRITE_BLOCKED if the capture is blocked.
  */
-RetrainHandlerStatus_t RetrainHandler_SetBufferDataWithOffset(const uint8_t* data, size_t size, size_t offset);
+RetrainHandlerStatus_t RetrainHandler_TriggerCapture(int confidence);
 
 /**
- * @brief Enqueue the internal buffer data with classification for retraining.
+ * @brief Enqueue the last retrain window with classification for retraining.
  *
- * This function enqueues the buffer data along with the classification
- * string into the retrain handler's message queue.
+ * This function enqueues the last window captured and not enqueued yet along
+ * with the classification string into the retrain handler's message queue,
+ * the last one enqueued once more if all were. The window is kept until it is
+ * sent.
  *
  * @param[in] classification Pointer to the classification string.
  *
  * @return RetrainHandlerStatus_t
  * - RETRAIN_HANDLER_OK if the message was successfully enqueued.
  * - RETRAIN_HANDLER_ERR_INVALID_MESSAGE if the classification string is NULL or invalid.
+ * - RETRAIN_HANDLER_ERR_INVALID_BUFFER if no window was captured.
  * - RETRAIN_HANDLER_ERR_QUEUE_FULL if the message queue is full and the message could not be enqueued.
  */
 RetrainHandlerStatus_t RetrainHandler_EnqueueBufferData(const char* classification);
@@ -122,17 +132,17 @@ const char* RetrainHandler_GetClassName(uint8_t index);
 void vRetrainProcessingTask(void* pvParameters);
 
 /**
- * @brief Block writing to the retrain buffer.
+ * @brief Block the capture of retrain windows.
  *
- * This function sets a flag to block any further writing to the retrain buffer.
- * It can be used to prevent modifications to the buffer.
+ * This function sets a flag making RetrainHandler_TriggerCapture() fail.
+ * It can be used to keep the last window captured.
  */
 void RetrainHandler_BlockBufferWrite(void);
 
 /**
- * @brief Unblock writing to the retrain buffer.
+ * @brief Unblock the capture of retrain windows.
  *
- * This function clears the flag that blocks writing to the retrain buffer.
+ * This function clears the flag that blocks the capture of retrain windows.
  */
 void RetrainHandler_UnblockBufferWrite(void);
 
@@ -46,6 +46,7 @@ typedef enum {
 typedef struct {
     void* buffer;                   ///< Pointer to message payload
     size_t buffer_size;             ///< Actual payload size
+    int32_t audio_slot;             ///< Slot of the audio ring holding the payload, released once sent, -1 if none
     char classification[RETRAIN_MAX_CLASSIFICATION_LEN]; ///< Classification string
 } RetrainData_t;
 
@@ -0,0 +1,322 @@
+/**
+ * @file retrain_ring.c
+ * @brief Continuous audio history capturing the windows sent for retraining.
+ *
+ * Each slot is a ring of one window. The recording slot is written at its
+ * position, wrapping around, so that it holds the last samples. Once
+ * triggered, it is written until RETRAIN_RING_POST_SAMPLES followed the
+ * trigger and it is full, then frozen: its oldest sample is at its position.
+ * A frozen slot counts the references of the messages sending it.
+ */
+
+#include <string.h>
+
+#include "retrain_ring.h"
+
+/* ============================ Constants and Macros ============================ */
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_RECORDING,
+    SLOT_PENDING,
+    SLOT_READY,
+    SLOT_LOCKED,
+} SlotState_t;
+
+typedef struct {
+    SlotState_t state;
+    uint32_t pos;               // next sample written
+    uint32_t filled;            // samples held, up to a window
+    uint32_t since_trigger;     // samples written since the trigger, PENDING only
+    uint32_t trigger_offset;    // index of the trigger in the frozen window
+    uint32_t sequence;          // order of the frozen windows
+    uint32_t refs;              // references to the window, LOCKED only
+    int confidence;             // lowest confidence of the triggers, from PENDING
+} Slot_t;
+
+#if RETRAIN_RING_SLOTS < 2
+#error "A slot records while another one holds the window"
+#endif
+
+/* ============================ Static Variables ============================ */
+
+static int16_t s_samples[RETRAIN_RING_SLOTS][RETRAIN_RING_WINDOW_SAMPLES];
+static Slot_t s_slots[RETRAIN_RING_SLOTS];
+static int32_t s_active = RETRAIN_RING_NO_SLOT;
+static uint32_t s_sequence = 0;
+static bool s_trigger_requested = false;
+static int s_trigger_confidence = 0;
+static RetrainRingEviction_t s_eviction = RETRAIN_RING_EVICTION;
+
+static RetrainRingStats_t s_stats;
+
+static void (*s_lock)(void) = NULL;
+static void (*s_unlock)(void) = NULL;
+
+/* ============================ Static Function Implementations ============================ */
+
+static void prvLock(void) {
+    if (s_lock != NULL) {
+        s_lock();
+    }
+}
+
+static void prvUnlock(void) {
+    if (s_unlock != NULL) {
+        s_unlock();
+    }
+}
+
+static void prvRestart(Slot_t* slot) {
+    slot->state = SLOT_RECORDING;
+    slot->pos = 0;
+    slot->filled = 0;
+    slot->since_trigger = 0;
+}
+
+/* Whether a READY window is evicted before another one */
+static bool prvEvictsFirst(const Slot_t* slot, const Slot_t* other) {
+    if (s_eviction == RETRAIN_RING_EVICT_LOWEST_CONFIDENCE && slot->confidence != other->confidence) {
+        return slot->confidence < other->confidence;
+    }
+    return (int32_t)(slot->sequence - other->sequence) < 0;
+}
+
+/* A FREE slot, else the READY one evicted first, called locked */
+static int32_t prvTakeSlot(void) {
+    int32_t evicted = RETRAIN_RING_NO_SLOT;
+
+    for (int32_t i = 0; i < (int32_t)RETRAIN_RING_SLOTS; i++) {
+        if (s_slots[i].state == SLOT_FREE) {
+            prvRestart(&s_slots[i]);
+            return i;
+        }
+        if (s_slots[i].state == SLOT_READY
+                && (evicted == RETRAIN_RING_NO_SLOT || prvEvictsFirst(&s_slots[i], &s_slots[evicted]))) {
+            evicted = i;
+        }
+    }
+    if (evicted != RETRAIN_RING_NO_SLOT) {
+        s_stats.evicted++;
+        prvRestart(&s_slots[evicted]);
+    }
+    return evicted;
+}
+
+/* Samples still to be written before a pending window is complete */
+static uint32_t prvPendingLeft(const Slot_t* slot) {
+    uint32_t post_left = (slot->since_trigger < RETRAIN_RING_POST_SAMPLES)
+                         ? (RETRAIN_RING_POST_SAMPLES - slot->since_trigger) : 0U;
+    uint32_t fill_left = RETRAIN_RING_WINDOW_SAMPLES - slot->filled;
+    return (post_left > fill_left) ? post_left : fill_left;
+}
+
+static void prvReverse(int16_t* samples, size_t count) {
+    for (size_t i = 0, j = count; i < j && i < --j; i++) {
+        int16_t sample = samples[i];
+        samples[i] = samples[j];
+        samples[j] = sample;
+    }
+}
+
+static void prvGetWindow(int32_t index, RetrainRingWindow_t* window) {
+    const Slot_t* slot = &s_slots[index];
+
+    window->slot = index;
+    window->first = &s_samples[index][slot->pos];
+    window->first_count = RETRAIN_RING_WINDOW_SAMPLES - slot->pos;
+    window->second = &s_samples[index][0];
+    window->second_count = slot->pos;
+    window->trigger_offset = slot->trigger_offset;
+    window->confidence = slot->confidence;
+    window->relocked = false;
+}
+
+/* ============================ Function Implementations ============================ */
+
+void RetrainRing_Init(void (*lock)(void), void (*unlock)(void)) {
+    s_lock = lock;
+    s_unlock = unlock;
+    memset(s_slots, 0, sizeof(s_slots));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_active = RETRAIN_RING_NO_SLOT;
+    s_sequence = 0;
+    s_trigger_requested = false;
+    s_eviction = RETRAIN_RING_EVICTION;
+}
+
+bool RetrainRing_Write(const int16_t* samples, size_t count) {
+    bool frozen = false;
+
+    while (count > 0U) {
+        prvLock();
+        if (s_active == RETRAIN_RING_NO_SLOT) {
+            s_active = prvTakeSlot();
+        }
+        int32_t active = s_active;
+        if (s_trigger_requested) {
+            s_trigger_requested = false;
+            if (active != RETRAIN_RING_NO_SLOT && s_slots[active].state == SLOT_RECORDING) {
+                s_slots[active].state = SLOT_PENDING;
+                s_slots[active].since_trigger = 0;
+                s_slots[active].confidence = s_trigger_confidence;
+            } else if (active != RETRAIN_RING_NO_SLOT && s_slots[active].confidence > s_trigger_confidence) {
+                s_slots[active].confidence = s_trigger_confidence;
+            }
+        }
+        prvUnlock();
+
+        if (active == RETRAIN_RING_NO_SLOT) {
+            // every slot holds a window being sent
+            s_stats.dropped_samples += (uint32_t)count;
+            break;
+        }
+
+        // the active slot is only written here, its samples are copied unlocked
+        Slot_t* slot = &s_slots[active];
+        uint32_t chunk = RETRAIN_RING_WINDOW_SAMPLES - slot->pos;
+        if (chunk > count) {
+            chunk = (uint32_t)count;
+        }
+        if (slot->state == SLOT_PENDING && chunk > prvPendingLeft(slot)) {
+            chunk = prvPendingLeft(slot);
+        }
+        memcpy(&s_samples[active][slot->pos], samples, chunk * sizeof(samples[0]));
+        samples += chunk;
+        count -= chunk;
+        slot->pos = (slot->pos + chunk) % RETRAIN_RING_WINDOW_SAMPLES;
+        slot->filled = ((slot->filled + chunk) < RETRAIN_RING_WINDOW_SAMPLES)
+                       ? (slot->filled + chunk) : RETRAIN_RING_WINDOW_SAMPLES;
+
+        if (slot->state == SLOT_PENDING) {
+            slot->since_trigger += chunk;
+            if (prvPendingLeft(slot) == 0U) {
+                prvLock();
+                slot->state = SLOT_READY;
+                slot->trigger_offset = RETRAIN_RING_WINDOW_SAMPLES - slot->since_trigger;
+                slot->sequence = ++s_sequence;
+                s_active = RETRAIN_RING_NO_SLOT;
+                s_stats.captured++;
+                prvUnlock();
+                frozen = true;
+            }
+        }
+    }
+    return frozen;
+}
+
+void RetrainRing_Trigger(int confidence) {
+    prvLock();
+    // triggers not consumed yet make a single one, of their lowest confidence
+    if (!s_trigger_requested || confidence < s_trigger_confidence) {
+        s_trigger_confidence = confidence;
+    }
+    s_trigger_requested = true;
+    prvUnlock();
+}
+
+void RetrainRing_SetEviction(RetrainRingEviction_t policy) {
+    prvLock();
+    s_eviction = policy;
+    prvUnlock();
+}
+
+void RetrainRing_MarkGap(void) {
+    prvLock();
+    if (s_active != RETRAIN_RING_NO_SLOT) {
+        prvRestart(&s_slots[s_active]);
+    }
+    s_stats.gaps++;
+    prvUnlock();
+}
+
+bool RetrainRing_IsReady(void) {
+    bool ready = false;
+
+    prvLock();
+    for (uint32_t i = 0; i < RETRAIN_RING_SLOTS; i++) {
+        ready = ready || (s_slots[i].state == SLOT_READY);
+    }
+    prvUnlock();
+    return ready;
+}
+
+bool RetrainRing_Lock(RetrainRingWindow_t* window) {
+    int32_t newest = RETRAIN_RING_NO_SLOT;
+
+    prvLock();
+    // a window not queued yet first, else the last one queued once more
+    for (uint32_t pass = 0; pass < 2U && newest == RETRAIN_RING_NO_SLOT; pass++) {
+        SlotState_t state = (pass == 0U) ? SLOT_READY : SLOT_LOCKED;
+        for (int32_t i = 0; i < (int32_t)RETRAIN_RING_SLOTS; i++) {
+            if (s_slots[i].state == state
+                    && (newest == RETRAIN_RING_NO_SLOT
+                        || (int32_t)(s_slots[i].sequence - s_slots[newest].sequence) > 0)) {
+                newest = i;
+            }
+        }
+    }
+    if (newest != RETRAIN_RING_NO_SLOT) {
+        bool relocked = (s_slots[newest].state == SLOT_LOCKED);
+        s_slots[newest].refs = relocked ? (s_slots[newest].refs + 1U) : 1U;
+        s_slots[newest].state = SLOT_LOCKED;
+        prvGetWindow(newest, window);
+        window->relocked = relocked;
+        s_stats.relocked += relocked ? 1U : 0U;
+    }
+    prvUnlock();
+
+    return newest != RETRAIN_RING_NO_SLOT;
+}
+
+bool RetrainRing_GetWindow(int32_t slot, RetrainRingWindow_t* window) {
+    bool locked = false;
+
+    if (slot < 0 || slot >= (int32_t)RETRAIN_RING_SLOTS) {
+        return false;
+    }
+    prvLock();
+    if (s_slots[slot].state == SLOT_LOCKED) {
+        prvGetWindow(slot, window);
+        locked = true;
+    }
+    prvUnlock();
+    return locked;
+}
+
+void RetrainRing_Linearize(RetrainRingWindow_t* window) {
+    if (window->second_count == 0U) {
+        return;
+    }
+    // rotation in place: the parts reversed each, then the whole
+    int16_t* samples = s_samples[window->slot];
+    size_t newest = window->second_count;
+    prvReverse(samples, newest);
+    prvReverse(&samples[newest], RETRAIN_RING_WINDOW_SAMPLES - newest);
+    prvReverse(samples, RETRAIN_RING_WINDOW_SAMPLES);
+    prvLock();
+    s_slots[window->slot].pos = 0;
+    prvUnlock();
+
+    window->first = samples;
+    window->first_count = RETRAIN_RING_WINDOW_SAMPLES;
+    window->second = NULL;
+    window->second_count = 0;
+}
+
+void RetrainRing_Release(int32_t slot) {
+    if (slot < 0 || slot >= (int32_t)RETRAIN_RING_SLOTS) {
+        return;
+    }
+    prvLock();
+    if (s_slots[slot].state == SLOT_LOCKED && --s_slots[slot].refs == 0U) {
+        s_slots[slot].state = SLOT_FREE;
+    }
+    prvUnlock();
+}
+
+void RetrainRing_GetStats(RetrainRingStats_t* stats) {
+    prvLock();
+    *stats = s_stats;
+    prvUnlock();
+}
@@ -0,0 +1,194 @@
+/**
+ * @file retrain_ring.h
+ * @brief Continuous audio history capturing the windows sent for retraining.
+ *
+ * The microphone samples are written without interruption into a ring of
+ * RETRAIN_RING_WINDOW_SAMPLES, one window long, so that it always holds the
+ * last RETRAIN_RING_PRE_MS + RETRAIN_RING_POST_MS of audio. A trigger, e.g.
+ * a low confidence inference, is only a flag: the ring goes on for
+ * RETRAIN_RING_POST_MS, then is frozen as it is, and the writer goes on in
+ * another slot. The window thus holds the audio before and after the
+ * trigger without being copied. It starts at the write position of its
+ * slot and wraps around its end, RetrainRing_Linearize() puts it in order
+ * in place when it is to be sent.
+ *
+ * Slots:
+ *
+ *  - RECORDING: written by RetrainRing_Write(), a single one at a time,
+ *  - PENDING: triggered, written until the end of the window,
+ *  - READY: frozen window, evicted for the next one if no slot is FREE,
+ *  - LOCKED: window referenced by messages being sent, kept until each of
+ *    them called RetrainRing_Release(), then FREE.
+ *
+ * The slots form a pool: several windows can be queued for upload, each
+ * one locked in its own slot, and the same window can be queued more than
+ * once, e.g. under two classifications, its slot counting the references.
+ * The READY window evicted is chosen by the RetrainRingEviction_t policy.
+ * When the writer finds no slot FREE or READY, it drops the samples until
+ * a slot is released, the history starting again from there.
+ *
+ * The module has no RTOS dependency: the lock passed to RetrainRing_Init()
+ * guards the slot states shared by the audio task, which writes, and the
+ * tasks that lock and release the windows. The samples are copied outside
+ * of it.
+ */
+
+#ifndef RETRAIN_RING_H
+#define RETRAIN_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Sample rate of the microphone */
+#define RETRAIN_RING_SAMPLE_RATE    16000U
+
+/** Audio kept before the trigger, in milliseconds */
+#ifndef RETRAIN_RING_PRE_MS
+#define RETRAIN_RING_PRE_MS         1000U
+#endif
+
+/** Audio kept after the trigger, in milliseconds */
+#ifndef RETRAIN_RING_POST_MS
+#define RETRAIN_RING_POST_MS        1000U
+#endif
+
+/** Number of slots, one recording and the others holding windows */
+#ifndef RETRAIN_RING_SLOTS
+#define RETRAIN_RING_SLOTS          3U
+#endif
+
+#define RETRAIN_RING_PRE_SAMPLES    ((RETRAIN_RING_SAMPLE_RATE / 1000U) * RETRAIN_RING_PRE_MS)
+#define RETRAIN_RING_POST_SAMPLES   ((RETRAIN_RING_SAMPLE_RATE / 1000U) * RETRAIN_RING_POST_MS)
+
+/** Samples of a window */
+#define RETRAIN_RING_WINDOW_SAMPLES (RETRAIN_RING_PRE_SAMPLES + RETRAIN_RING_POST_SAMPLES)
+
+/** No slot */
+#define RETRAIN_RING_NO_SLOT        (-1)
+
+/**
+ * @brief READY window evicted when the writer needs a slot and none is FREE.
+ */
+typedef enum {
+    RETRAIN_RING_EVICT_OLDEST = 0,          ///< The window frozen first
+    RETRAIN_RING_EVICT_LOWEST_CONFIDENCE,   ///< The window of the lowest trigger confidence, the oldest of equals
+} RetrainRingEviction_t;
+
+/** Default eviction policy */
+#ifndef RETRAIN_RING_EVICTION
+#define RETRAIN_RING_EVICTION       RETRAIN_RING_EVICT_OLDEST
+#endif
+
+/**
+ * @brief Frozen window, in two parts as it wraps around the end of its slot.
+ */
+typedef struct {
+    int32_t slot;                   ///< Slot holding the window
+    const int16_t* first;           ///< Oldest samples
+    size_t first_count;             ///< Number of oldest samples
+    const int16_t* second;          ///< Newest samples, from the start of the slot
+    size_t second_count;            ///< Number of newest samples, 0 once linearized
+    uint32_t trigger_offset;        ///< Index of the sample of the trigger in the window
+    int confidence;                 ///< Lowest confidence of the triggers of the window in percent
+    bool relocked;                  ///< Set by RetrainRing_Lock() if the window was already locked, none being READY
+} RetrainRingWindow_t;
+
+/**
+ * @brief Counters, since RetrainRing_Init().
+ */
+typedef struct {
+    uint32_t captured;              ///< Windows frozen
+    uint32_t evicted;               ///< READY windows evicted for a newer one
+    uint32_t dropped_samples;       ///< Samples dropped without any slot to write them
+    uint32_t gaps;                  ///< Histories restarted by RetrainRing_MarkGap()
+    uint32_t relocked;              ///< Windows locked again by RetrainRing_Lock(), none being READY
+} RetrainRingStats_t;
+
+/**
+ * @brief Empty the slots and select the default eviction policy.
+ *
+ * @param[in] lock Enter the section guarding the slot states, NULL if single task.
+ * @param[in] unlock Leave it, NULL if single task.
+ */
+void RetrainRing_Init(void (*lock)(void), void (*unlock)(void));
+
+/**
+ * @brief Append samples to the history, from the audio task only.
+ *
+ * @param[in] samples Samples, in order, without gap from the previous ones.
+ * @param[in] count Number of samples.
+ *
+ * @return true if a window was frozen.
+ */
+bool RetrainRing_Write(const int16_t* samples, size_t count);
+
+/**
+ * @brief Request the capture of a window around the next sample written.
+ *
+ * While a window is pending, only lowers its confidence. Only sets a flag,
+ * from any task.
+ *
+ * @param[in] confidence Confidence of the inference triggering, in percent.
+ */
+void RetrainRing_Trigger(int confidence);
+
+/**
+ * @brief Select the READY window evicted when no slot is FREE.
+ */
+void RetrainRing_SetEviction(RetrainRingEviction_t policy);
+
+/**
+ * @brief Restart the history after samples were lost, e.g. a DMA overrun.
+ *
+ * From the audio task only. A pending window is dropped.
+ */
+void RetrainRing_MarkGap(void);
+
+/**
+ * @brief Check whether a window is READY.
+ */
+bool RetrainRing_IsReady(void);
+
+/**
+ * @brief Lock the newest READY window until RetrainRing_Release().
+ *
+ * Without any READY window, the newest LOCKED one is referenced once more
+ * and must be released as many times.
+ *
+ * @param[out] window Window.
+ *
+ * @return false if no window is READY or LOCKED.
+ */
+bool RetrainRing_Lock(RetrainRingWindow_t* window);
+
+/**
+ * @brief Get again a window locked by RetrainRing_Lock(), e.g. by the task sending it.
+ *
+ * @param[in] slot Slot of the window.
+ * @param[out] window Window.
+ *
+ * @return false if the slot is not locked.
+ */
+bool RetrainRing_GetWindow(int32_t slot, RetrainRingWindow_t* window);
+
+/**
+ * @brief Put a locked window in order in place, as a single part.
+ *
+ * O(window) but outside the audio task, by the single task sending the
+ * windows. A window referenced by several messages is found in order by
+ * the RetrainRing_GetWindow() calls following the first one.
+ */
+void RetrainRing_Linearize(RetrainRingWindow_t* window);
+
+/**
+ * @brief Drop a reference to a locked window, its slot being FREE after the last one.
+ */
+void RetrainRing_Release(int32_t slot);
+
+/**
+ * @brief Get the counters.
+ */
+void RetrainRing_GetStats(RetrainRingStats_t* stats);
+
+#endif // RETRAIN_RING_H
@@ -0,0 +1,122 @@
+/**
+ * @file s3_connection.c
+ * @brief Reuse of the HTTPS connection to the retrain endpoint across uploads.
+ */
+
+#include <string.h>
+
+#include "s3_connection.h"
+
+/* ============================ Static Function Implementations ============================ */
+
+static bool prvSameHost(const S3Connection_t* connection, const char* host, size_t host_len) {
+    return host_len <= S3_CONNECTION_HOST_LEN
+           && strncmp(connection->host, host, host_len) == 0
+           && connection->host[host_len] == '\0';
+}
+
+static bool prvIsIdle(const S3Connection_t* connection, uint32_t now) {
+    return (uint32_t)(now - connection->last_used) >= connection->config.idle_timeout_ms;
+}
+
+/* ============================ Function Implementations ============================ */
+
+void S3Connection_Init(S3Connection_t* connection, const S3ConnectionConfig_t* config) {
+    memset(connection, 0, sizeof(*connection));
+    connection->config = *config;
+}
+
+S3ConnectionAction_t S3Connection_Prepare(S3Connection_t* connection, const char* host, size_t host_len, uint32_t now) {
+    if (!connection->open) {
+        return S3_CONNECTION_OPEN;
+    }
+    if (!prvSameHost(connection, host, host_len)) {
+        connection->open = false;
+        return S3_CONNECTION_REOPEN;
+    }
+    if (prvIsIdle(connection, now)) {
+        // the server may have closed it already, a request would be lost on it
+        connection->open = false;
+        connection->stats.idle_closes++;
+        return S3_CONNECTION_REOPEN;
+    }
+    return S3_CONNECTION_REUSE;
+}
+
+bool S3Connection_CanResume(const S3Connection_t* connection, const char* host, size_t host_len, uint32_t now) {
+    return connection->session
+           && prvSameHost(connection, host, host_len)
+           && (uint32_t)(now - connection->session_time) < connection->config.session_lifetime_ms;
+}
+
+void S3Connection_Opened(S3Connection_t* connection, const char* host, size_t host_len, uint32_t now,
+                         bool resumed, bool session_kept) {
+    if (host_len > S3_CONNECTION_HOST_LEN) {
+        host_len = S3_CONNECTION_HOST_LEN;
+    }
+    memcpy(connection->host, host, host_len);
+    connection->host[host_len] = '\0';
+    connection->open = true;
+    connection->requests = 0;
+    connection->last_used = now;
+
+    if (resumed) {
+        // the lifetime runs from the full handshake, as the ticket of the server
+        connection->stats.resumptions++;
+    } else {
+        connection->stats.handshakes++;
+        connection->session_time = now;
+    }
+    connection->session = session_kept && connection->config.session_lifetime_ms > 0U;
+}
+
+bool S3Connection_Completed(S3Connection_t* connection, uint32_t now, bool keep_alive) {
+    if (connection->requests > 0U) {
+        connection->stats.reuses++;
+    }
+    connection->requests++;
+    connection->last_used = now;
+
+    if (!keep_alive
+            || (connection->config.max_requests > 0U && connection->requests >= connection->config.max_requests)) {
+        connection->open = false;
+        connection->stats.server_closes++;
+    }
+    return connection->open;
+}
+
+bool S3Connection_Failed(S3Connection_t* connection) {
+    bool stale = connection->open && connection->requests > 0U;
+
+    connection->open = false;
+    if (stale) {
+        connection->stats.stale_retries++;
+    }
+    return stale;
+}
+
+void S3Connection_Closed(S3Connection_t* connection, bool forget_session) {
+    connection->open = false;
+    if (forget_session) {
+        connection->session = false;
+    }
+}
+
+uint32_t S3Connection_IdleLeft(const S3Connection_t* connection, uint32_t now) {
+    if (!connection->open) {
+        return UINT32_MAX;
+    }
+    if (prvIsIdle(connection, now)) {
+        return 0;
+    }
+    return connection->config.idle_timeout_ms - (uint32_t)(now - connection->last_used);
+}
+
+bool S3Connection_CloseIdle(S3Connection_t* connection, uint32_t now) {
+    if (!connection->open || !prvIsIdle(connection, now)) {
+        return false;
+    }
+    connection->open = false;
+    connection->stats.idle_closes++;
+    return true;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file s3_connection.h
+ * @brief Reuse of the HTTPS connection to the retrain endpoint across uploads.
+ *
+ * A TLS handshake costs the M33 far more than sending a window, so the
+ * connection is kept open after an upload and the next one is sent on it:
+ *
+ *  - the connection is closed once idle for idle_timeout_ms, below the idle
+ *    timeout of the server so that it is seldom closed under a request,
+ *  - a request failing on a kept connection, which the server closed in the
+ *    meantime, is sent once more on a new connection,
+ *  - a response with "Connection: close", or max_requests sent, closes it,
+ *  - the session of the last handshake is offered to the next one, for
+ *    session_lifetime_ms, so that a new connection resumes it with a ticket
+ *    instead of a full handshake.
+ *
+ * The module only decides: the caller opens and closes the connection and
+ * passes the time, in ms wrapping around. It has no RTOS or TLS dependency:
+ * the same logic runs on target and on the host.
+ */
+
+#ifndef S3_CONNECTION_H
+#define S3_CONNECTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Longest host of a connection */
+#define S3_CONNECTION_HOST_LEN      255U
+
+/**
+ * @brief Limits of a connection.
+ */
+typedef struct {
+    uint32_t idle_timeout_ms;       ///< Idle time after which the connection is closed
+    uint32_t session_lifetime_ms;   ///< Time a session is offered for after its full handshake, 0 for never
+    uint32_t max_requests;          ///< Requests sent on a connection before it is closed, 0 for no limit
+} S3ConnectionConfig_t;
+
+/**
+ * @brief What to do before sending a request.
+ */
+typedef enum {
+    S3_CONNECTION_REUSE = 0,        ///< Send on the open connection
+    S3_CONNECTION_OPEN,             ///< Open a connection
+    S3_CONNECTION_REOPEN,           ///< Close the open connection, then open one
+} S3ConnectionAction_t;
+
+/**
+ * @brief Counters of the connections.
+ */
+typedef struct {
+    uint32_t handshakes;            ///< Full handshakes
+    uint32_t resumptions;           ///< Handshakes resuming the session offered
+    uint32_t reuses;                ///< Requests sent on a connection opened for a previous one
+    uint32_t idle_closes;           ///< Connections closed for being idle
+    uint32_t server_closes;         ///< Connections closed by a response or max_requests
+    uint32_t stale_retries;         ///< Requests sent once more after failing on a kept connection
+} S3ConnectionStats_t;
+
+/**
+ * @brief State of the connection.
+ */
+typedef struct {
+    S3ConnectionConfig_t config;    ///< Limits
+    char host[S3_CONNECTION_HOST_LEN + 1U]; ///< Host of the connection, and of the session
+    bool open;                      ///< A connection is open
+    bool session;                   ///< A session of host is kept
+    uint32_t session_time;          ///< Time of the full handshake of the session
+    uint32_t last_used;             ///< Time the last response was received, or the connection opened
+    uint32_t requests;              ///< Requests sent on the connection
+    S3ConnectionStats_t stats;      ///< Counters
+} S3Connection_t;
+
+/**
+ * @brief Start without connection nor session.
+ */
+void S3Connection_Init(S3Connection_t* connection, const S3ConnectionConfig_t* config);
+
+/**
+ * @brief Decide how to send a request to a host.
+ *
+ * The connection is counted closed on S3_CONNECTION_REOPEN: the caller
+ * closes it before opening one.
+ *
+ * @param[in] host Host, not null terminated.
+ * @param[in] host_len Length of host.
+ * @param[in] now Time, in ms.
+ */
+S3ConnectionAction_t S3Connection_Prepare(S3Connection_t* connection, const char* host, size_t host_len, uint32_t now);
+
+/**
+ * @brief Whether the kept session is offered to the handshake of the connection opened to a host.
+ */
+bool S3Connection_CanResume(const S3Connection_t* connection, const char* host, size_t host_len, uint32_t now);
+
+/**
+ * @brief Count a connection opened to a host.
+ *
+ * @param[in] resumed The handshake resumed the session offered.
+ * @param[in] session_kept The session of the handshake is kept for the next connections.
+ */
+void S3Connection_Opened(S3Connection_t* connection, const char* host, size_t host_len, uint32_t now,
+                         bool resumed, bool session_kept);
+
+/**
+ * @brief Count a response received.
+ *
+ * @param[in] keep_alive The response lets the connection open.
+ *
+ * @return false if the caller closes the connection.
+ */
+bool S3Connection_Completed(S3Connection_t* connection, uint32_t now, bool keep_alive);
+
+/**
+ * @brief Count a request failed before its response, the caller closing the connection.
+ *
+ * @return true if the request failed on a connection kept from a previous one,
+ *         and is sent once more on a new connection.
+ */
+bool S3Connection_Failed(S3Connection_t* connection);
+
+/**
+ * @brief Count the connection closed by the caller for another reason, e.g. on the connection error.
+ *
+ * @param[in] forget_session The session is not offered anymore, e.g. on a handshake failure.
+ */
+void S3Connection_Closed(S3Connection_t* connection, bool forget_session);
+
+/**
+ * @brief Time left before the open connection is idle, in ms.
+ *
+ * @return 0 if the caller closes the connection, UINT32_MAX if none is open.
+ */
+uint32_t S3Connection_IdleLeft(const S3Connection_t* connection, uint32_t now);
+
+/**
+ * @brief Count the connection closed for being idle, if it is.
+ *
+ * @return true if the caller closes the connection.
+ */
+bool S3Connection_CloseIdle(S3Connection_t* connection, uint32_t now);
+
+#endif // S3_CONNECTION_H
@@ -4,6 +4,9 @@
  *
  * This module provides functions to initialize, connect, interact with, and disconnect
  * from AWS S3 using HTTPS.
+ *
+ * The connection is kept open between the uploads as decided by s3_connection.c,
+ * S3Client_Connect() only opening one when none can be reused.
  */
 
 #include <string.h>
@@ -86,6 +89,25 @@
 /* Maximum hostname length */
 #define MAX_HOSTNAME_LEN 255
 
+/* Idle time after which the kept connection is closed, below the idle timeout of the server */
+#ifndef S3_CLIENT_IDLE_TIMEOUT_MS
+#define S3_CLIENT_IDLE_TIMEOUT_MS 30000
+#endif
+
+/* Time a TLS session is resumed for after its full handshake */
+#ifndef S3_CLIENT_SESSION_LIFETIME_MS
+#define S3_CLIENT_SESSION_LIFETIME_MS (60 * 60 * 1000)
+#endif
+
+/* Requests sent on a connection before it is closed, 0 for no limit */
+#ifndef S3_CLIENT_MAX_REQUESTS
+#define S3_CLIENT_MAX_REQUESTS 0
+#endif
+
+/* TLS connection timeouts */
+#define S3_CONNECT_TIMEOUT_MS 10000
+#define S3_SEND_RECV_TIMEOUT_MS 10000
+
 /* Define MASK_SECRETS to control whether secret data should be masked in logs.
  * Set to 1 to mask secret data, or 0 to show the actual values.
  */
@@ -104,6 +126,13 @@ static uint8_t responseBodyBuffer[RESPONSE_BODY_BUFFER_SIZE]; /**< Buffer for HT
 /* Buffer for HTTP headers */
 static uint8_t headersBuffer[HEADERS_BUFFER_SIZE];
 
+/* Connection kept between the uploads */
+static S3Connection_t s3Connection;
+static bool isConnectionInitialized = false;
+
+/* Session resumption of the transport, none if NULL */
+static const S3ClientTlsSession_t *tlsSession = NULL;
+
 /* ============================ Static Function Declarations ============================ */
 
 /**
@@ -121,6 +150,26 @@ static uint8_t headersBuffer[HEADERS_BUFFER_SIZE];
  * @return true if the input string contains a path and it was separated, false otherwise.
  */
 static bool parseHostAndPath(const char *input, const char **hostname, size_t *hostnameLen, const char **path, size_t *pathLen);
+
+/**
+ * @brief Opens a TLS connection to a host, resuming the kept session if any.
+ *
+ * @param[in] hostname The hostname, not null terminated.
+ * @param[in] hostnameLen Length of the hostname.
+ *
+ * @return S3_CLIENT_SUCCESS if the connection was opened, or an appropriate error code on failure.
+ */
+static int openConnection(const char *hostname, size_t hostnameLen);
+
+/**
+ * @brief Closes the TLS connection and frees the network context.
+ */
+static void closeConnection(void);
+
+/**
+ * @brief Gets the time the connection is timed with, in ms.
+ */
+static uint32_t getTimeMs(void);
 /* ============================ Function Implementations ============================ */
 
 static bool parseHostAndPath(const char *input, const char **hostname, size_t *hostnameLen, const char **path, size_t *pathLen)
@@ -145,29 +194,15 @@ static bool parseHostAndPath(const char *input, const char **hostname, size_t *h
     return false;
 }
 
-int S3Client_Init(void)
+static uint32_t getTimeMs(void)
 {
-    LogDebug("Initializing S3 Client buffers.");
-
-    /* Clear memory for request and response buffers */
-    memset(requestBodyBuffer, 0, REQUEST_BODY_BUFFER_SIZE);
-    memset(responseBodyBuffer, 0, RESPONSE_BODY_BUFFER_SIZE);
-
-    LogDebug("S3 Client buffers initialized successfully.");
-
-    return S3_CLIENT_SUCCESS;
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
 }
 
-int S3Client_Connect(const char *hostnameWithPath)
+static int openConnection(const char *hostname, size_t hostnameLen)
 {
-    const char *hostname = NULL;
-    const char *path = NULL;
-    size_t hostnameLen = 0;
-    size_t pathLen = 0;
     char hostnameBuffer[MAX_HOSTNAME_LEN] = {0};
 
-    parseHostAndPath(hostnameWithPath, &hostname, &hostnameLen, &path, &pathLen);
-
     // We have to copy hostname to hostnameBuffer, because mbedtls_transport_connect expects null-terminated string
     if (hostnameLen >= MAX_HOSTNAME_LEN)
     {
@@ -212,20 +247,37 @@ int S3Client_Connect(const char *hostnameWithPath)
     {
         LogError("Failed to configure TLS transport! Error Code: %d", tlsTransportStatus);
         mbedtls_transport_free(ptrNetworkContext);
+        ptrNetworkContext = NULL;
         return S3_CLIENT_TLS_ERROR; // Return TLS specific error code
     }
     LogDebug("TLS transport configured successfully.");
 
+    /* Offer the session of the last full handshake, saving this one */
+    bool sessionOffered = false;
+    if ((tlsSession != NULL) && S3Connection_CanResume(&s3Connection, hostname, hostnameLen, getTimeMs()))
+    {
+        sessionOffered = tlsSession->offer(ptrNetworkContext);
+        LogDebug("TLS session %s.", sessionOffered ? "offered" : "not offered");
+    }
+
     /* Establish the TLS connection to AWS S3 */
     LogInfo("Connecting to AWS S3 at %s:%d.", hostnameBuffer, S3_HTTPS_PORT);
-    tlsTransportStatus = mbedtls_transport_connect(ptrNetworkContext, hostnameBuffer, S3_HTTPS_PORT, 10000, 10000);
+    tlsTransportStatus = mbedtls_transport_connect(ptrNetworkContext, hostnameBuffer, S3_HTTPS_PORT,
+                                                   S3_CONNECT_TIMEOUT_MS, S3_SEND_RECV_TIMEOUT_MS);
     if (tlsTransportStatus != TLS_TRANSPORT_SUCCESS)
     {
         LogError("Failed to connect to AWS S3! Error Code: %d. Please check your network connection and AWS S3 endpoint.", tlsTransportStatus);
         mbedtls_transport_free(ptrNetworkContext);
+        ptrNetworkContext = NULL;
+        /* A session the server refused is not offered again */
+        S3Connection_Closed(&s3Connection, sessionOffered);
         return S3_CLIENT_NETWORK_ERROR; // Return network specific error code
     }
-    LogInfo("Successfully connected to AWS S3.");
+
+    bool resumed = false;
+    bool sessionKept = (tlsSession != NULL) && tlsSession->keep(ptrNetworkContext, &resumed);
+    S3Connection_Opened(&s3Connection, hostname, hostnameLen, getTimeMs(), sessionOffered && resumed, sessionKept);
+    LogInfo("Successfully connected to AWS S3%s.", (sessionOffered && resumed) ? ", TLS session resumed" : "");
 
     /* Initialize the transport interface with the network context and transport functions */
     transport_if.pNetworkContext = ptrNetworkContext;
@@ -237,6 +289,67 @@ int S3Client_Connect(const char *hostnameWithPath)
     return S3_CLIENT_SUCCESS; // Return success code
 }
 
+static void closeConnection(void)
+{
+    if (ptrNetworkContext != NULL)
+    {
+        mbedtls_transport_disconnect(ptrNetworkContext);
+        mbedtls_transport_free(ptrNetworkContext);
+        ptrNetworkContext = NULL;
+        LogInfo("Connection to AWS S3 closed and resources freed.");
+    }
+}
+
+int S3Client_Init(void)
+{
+    LogDebug("Initializing S3 Client buffers.");
+
+    /* Clear memory for request and response buffers */
+    memset(requestBodyBuffer, 0, REQUEST_BODY_BUFFER_SIZE);
+    memset(responseBodyBuffer, 0, RESPONSE_BODY_BUFFER_SIZE);
+
+    /* The state of the connection is kept over the next initializations */
+    if (!isConnectionInitialized)
+    {
+        const S3ConnectionConfig_t config = {
+            .idle_timeout_ms = S3_CLIENT_IDLE_TIMEOUT_MS,
+            .session_lifetime_ms = S3_CLIENT_SESSION_LIFETIME_MS,
+            .max_requests = S3_CLIENT_MAX_REQUESTS,
+        };
+        S3Connection_Init(&s3Connection, &config);
+        isConnectionInitialized = true;
+    }
+
+    LogDebug("S3 Client buffers initialized successfully.");
+
+    return S3_CLIENT_SUCCESS;
+}
+
+int S3Client_Connect(const char *hostnameWithPath)
+{
+    const char *hostname = NULL;
+    const char *path = NULL;
+    size_t hostnameLen = 0;
+    size_t pathLen = 0;
+
+    parseHostAndPath(hostnameWithPath, &hostname, &hostnameLen, &path, &pathLen);
+
+    switch (S3Connection_Prepare(&s3Connection, hostname, hostnameLen, getTimeMs()))
+    {
+        case S3_CONNECTION_REUSE:
+            LogInfo("Reusing the connection to AWS S3.");
+            return S3_CLIENT_SUCCESS;
+        case S3_CONNECTION_REOPEN:
+            LogInfo("Closing the connection to AWS S3, idle or to another host.");
+            closeConnection();
+            break;
+        default:
+            break;
+    }
+
+    return openConnection(hostname, hostnameLen);
+}
+
 int S3Client_Post(const char *hostnameWithPath, const char *payload, 
                         uint32_t payloadLength, 
                         HTTPCustomHeader_t* userHeaders, 
@@ -332,18 +445,57 @@ int S3Client_Post(const char *hostnameWithPath, const char *payload,
     }
     #endif
 
-    /* Transmit payload */
-    https_status = HTTPClient_Send(&transport_if, 
-                                   &headers, 
-                                   (const uint8_t*)payload, 
-                                   payloadLength, 
-                                   &response, 
-                                   0);
-
-    /* Check transmission result */
-    if (https_status != HTTPSuccess) {
-        LogError("Payload upload failed! HTTP Status: %s", HTTPClient_strerror(https_status));
-        return S3_CLIENT_NETWORK_ERROR;
+    /* The connection was closed by the last response */
+    if (ptrNetworkContext == NULL)
+    {
+        int connect_result = openConnection(hostname, hostnameLen);
+        if (connect_result != S3_CLIENT_SUCCESS)
+        {
+            return connect_result;
+        }
+    }
+
+    /* Transmit payload, once more on a new connection if the server closed the kept one */
+    size_t headersLen = headers.headersLen;
+    for (;;)
+    {
+        /* Content-Length is appended to the headers by each send */
+        headers.headersLen = headersLen;
+
+        https_status = HTTPClient_Send(&transport_if, 
+                                       &headers, 
+                                       (const uint8_t*)payload, 
+                                       payloadLength, 
+                                       &response, 
+                                       0);
+        if (https_status == HTTPSuccess)
+        {
+            break;
+        }
+
+        bool closedByServer = (https_status == HTTPNetworkError) || (https_status == HTTPNoResponse);
+        bool retry = closedByServer ? S3Connection_Failed(&s3Connection) : false;
+        S3Connection_Closed(&s3Connection, false);
+        closeConnection();
+
+        if (!retry || (openConnection(hostname, hostnameLen) != S3_CLIENT_SUCCESS))
+        {
+            LogError("Payload upload failed! HTTP Status: %s", HTTPClient_strerror(https_status));
+            return S3_CLIENT_NETWORK_ERROR;
+        }
+        LogWarn("Kept connection closed by the server, sending again on a new one.");
+
+        memset(&response, 0, sizeof(response));
+        response.pBuffer = responseBodyBuffer;
+        response.bufferLen = RESPONSE_BODY_BUFFER_SIZE;
+    }
+
+    /* Keep the connection unless the server closes it */
+    bool keepAlive = (response.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG) == 0U;
+    if (!S3Connection_Completed(&s3Connection, getTimeMs(), keepAlive))
+    {
+        LogInfo("Connection closed by the server response.");
+        closeConnection();
     }
 
     /* Check HTTP response code */
@@ -370,10 +522,8 @@ int S3Client_Disconnect(void)
     if (ptrNetworkContext != NULL)
     {
         LogInfo("Disconnecting from AWS S3.");
-        mbedtls_transport_disconnect(ptrNetworkContext);
-        mbedtls_transport_free(ptrNetworkContext);
-        ptrNetworkContext = NULL;
-        LogInfo("Connection to AWS S3 closed and resources freed.");
+        S3Connection_Closed(&s3Connection, false);
+        closeConnection();
         return S3_CLIENT_SUCCESS;  // Return success code
     }
     else
@@ -382,3 +532,37 @@ int S3Client_Disconnect(void)
         return S3_CLIENT_ERROR;    // Return error code if no network context
     }
 }
+
+uint32_t S3Client_GetIdleTimeLeft(void)
+{
+    if (!isConnectionInitialized || (ptrNetworkContext == NULL))
+    {
+        return UINT32_MAX;
+    }
+    return S3Connection_IdleLeft(&s3Connection, getTimeMs());
+}
+
+bool S3Client_CloseIfIdle(void)
+{
+    if (!isConnectionInitialized || (ptrNetworkContext == NULL)
+        || !S3Connection_CloseIdle(&s3Connection, getTimeMs()))
+    {
+        return false;
+    }
+
+    const S3ConnectionStats_t *stats = &s3Connection.stats;
+    LogInfo("Closing the idle connection to AWS S3 after %lu full handshakes, %lu resumed, %lu requests reusing one.",
+            (unsigned long)stats->handshakes, (unsigned long)stats->resumptions, (unsigned long)stats->reuses);
+    closeConnection();
+    return true;
+}
+
+void S3Client_SetTlsSession(const S3ClientTlsSession_t *session)
+{
+    tlsSession = session;
+}
+
+void S3Client_GetStats(S3ConnectionStats_t *stats)
+{
+    *stats = s3Connection.stats;
+}
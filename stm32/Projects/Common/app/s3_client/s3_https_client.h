@@ -7,6 +7,7 @@
  */
 
 #include "FreeRTOS.h"   /**< FreeRTOS includes for task management and types */
+#include "s3_connection.h"  /**< Reuse of the connection across the uploads */
 
 
 /* ============================ Data Structures ============================ */
@@ -28,6 +29,23 @@ typedef struct {
     uint32_t sentBytes;       /**< Number of bytes already sent. */
 } S3UploadContext;
 
+/* Network context of the transport, see transport_interface.h */
+struct NetworkContext;
+
+/**
+ * @brief TLS session resumption, provided by a transport exposing its TLS context.
+ *
+ * The session of a full handshake is kept and offered to the handshake of the
+ * next connection, which then resumes it with a session ticket instead of
+ * authenticating the server once more.
+ */
+typedef struct {
+    /** Offers the kept session to the handshake of ctx, before it connects. Returns false if none is kept. */
+    bool (*offer)(struct NetworkContext *ctx);
+    /** Keeps the session of the handshake ctx just made, setting resumed if it resumed the one offered. Returns false if none was kept. */
+    bool (*keep)(struct NetworkContext *ctx, bool *resumed);
+} S3ClientTlsSession_t;
+
 /* ============================ Return Codes ============================ */
 
 /** @brief Success code for operations */
@@ -77,6 +95,7 @@ int S3Client_Init(void);
  * @brief Establishes an HTTPS connection to the S3 endpoint.
  * 
  * This function attempts to connect to the S3 endpoint over HTTPS using the provided hostname and path.
+ * The connection left open by the previous upload is reused unless it is idle or to another host.
  * It returns S3_CLIENT_SUCCESS if the connection was successfully established, 
  * or an error code if the connection failed.
  * 
@@ -102,6 +121,9 @@ int S3Client_Connect(const char *hostnameWithPath);
  * @brief Sends a POST request to upload an object to AWS S3.
  * 
  * This function sends a POST request to the S3 endpoint to upload an object.
+ * The connection is left open for the next upload unless the response closes it. A request
+ * failing on a connection kept from a previous upload, closed by the server in the meantime,
+ * is sent once more on a new connection.
  *
  * @param[in] hostnameWithPath The full hostname and path of the S3 endpoint.
  * @param[in] payload Pointer to the data to be uploaded.
@@ -151,4 +173,41 @@ int S3Client_Post(const char *hostnameWithPath, const char *payload,
  */
 int S3Client_Disconnect(void);
 
+/**
+ * @brief Gets the time left before the open connection is idle.
+ *
+ * @return Time in ms, 0 if S3Client_CloseIfIdle() closes it, UINT32_MAX if no connection is open.
+ */
+uint32_t S3Client_GetIdleTimeLeft(void);
+
+/**
+ * @brief Closes the open connection if it is idle.
+ *
+ * @return true if the connection was closed.
+ *
+ * @usage
+ * @code
+ * uint32_t idleMs = S3Client_GetIdleTimeLeft();
+ * TickType_t wait = (idleMs == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(idleMs);
+ * if (xQueueReceive(queue, &message, wait) != pdTRUE) {
+ *     (void)S3Client_CloseIfIdle();
+ * }
+ * @endcode
+ */
+bool S3Client_CloseIfIdle(void);
+
+/**
+ * @brief Sets the TLS session resumption of the transport.
+ *
+ * @param[in] session Session resumption, NULL for full handshakes only.
+ */
+void S3Client_SetTlsSession(const S3ClientTlsSession_t *session);
+
+/**
+ * @brief Gets the counters of the connections.
+ *
+ * @param[out] stats Counters.
+ */
+void S3Client_GetStats(S3ConnectionStats_t *stats);
+
 #endif /* S3_HTTPS_CLIENT_H */
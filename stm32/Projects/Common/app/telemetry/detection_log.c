@@ -0,0 +1,368 @@
+/**
+ * @file detection_log.c
+ * @brief Circular log of the detections made while the device is offline.
+ *
+ * Record layout, little endian:
+ *
+ *   0   log sequence, numbering the records in the order they were written
+ *   4   detection sequence
+ *   8   uptime in ms
+ *   12  number of classes
+ *   13  class index and confidence, DETECTION_LOG_MAX_LABELS pairs
+ *   25  reserved, 0xFF
+ *   27  state: 0xFF blank, RECORD_STORED, then RECORD_SENT
+ *   28  CRC-32 of bytes 0 to 26
+ *
+ * The state byte is left out of the CRC so that it can be programmed again
+ * to mark the record as sent. A slot is only written if blank: one left
+ * dirty by a reset during its programming is skipped.
+ *
+ * The records waiting to be sent are those from the read slot up to the
+ * write slot. The write slot only enters a sector after erasing it, so no
+ * record older than the write slot remains in its sector, and the ring
+ * order from the write slot is the age order Init() relies on.
+ *
+ * The take slot runs from the read slot to the write slot, and the take
+ * sequence keeps the records taken and not yet marked from being taken
+ * again: those past the take slot have a newer log sequence. A rewind sets
+ * the take slot back to the read slot and the take sequence to the oldest
+ * record the ring can hold. Marking a record checks its log sequence, so a
+ * record dropped meanwhile, or another one written in its slot, is left
+ * alone.
+ */
+
+#include <string.h>
+
+#include "detection_log.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define RECORD_SEQUENCE_OFFSET      0U
+#define RECORD_DETECTION_OFFSET     4U
+#define RECORD_TIME_OFFSET          8U
+#define RECORD_COUNT_OFFSET         12U
+#define RECORD_LABELS_OFFSET        13U
+#define RECORD_STATE_OFFSET         27U
+#define RECORD_CRC_OFFSET           28U
+
+#define RECORD_BLANK                0xFFU
+#define RECORD_STORED               0x0FU
+#define RECORD_SENT                 0x00U
+
+#define CRC32_POLYNOMIAL            0xEDB88320UL
+
+/* ============================ Static Variables ============================ */
+
+static const DetectionLogStorage_t* s_storage = NULL;
+static uint32_t s_slots_per_sector = 0;
+static uint32_t s_slot_count = 0;
+
+static uint32_t s_write_slot = 0;
+static uint32_t s_read_slot = 0;
+static uint32_t s_next_sequence = 0;
+static uint32_t s_boot_sequence = 0;
+static uint32_t s_take_slot = 0;
+static uint32_t s_take_sequence = 0;
+
+static uint32_t s_stored = 0;
+static uint32_t s_sent = 0;
+static uint32_t s_overwritten = 0;
+static uint32_t s_errors = 0;
+static uint32_t s_pending = 0;
+
+/* ============================ Static Function Implementations ============================ */
+
+static uint32_t prvCrc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFUL;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (0U - (crc & 1U)));
+        }
+    }
+    return ~crc;
+}
+
+static void prvPutU32(uint8_t* dest, uint32_t value) {
+    dest[0] = (uint8_t)value;
+    dest[1] = (uint8_t)(value >> 8);
+    dest[2] = (uint8_t)(value >> 16);
+    dest[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t prvGetU32(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static uint32_t prvAddress(uint32_t slot) {
+    return slot * DETECTION_LOG_RECORD_SIZE;
+}
+
+static uint32_t prvNextSlot(uint32_t slot) {
+    return (slot + 1U < s_slot_count) ? slot + 1U : 0U;
+}
+
+static bool prvReadSlot(uint32_t slot, uint8_t* record) {
+    if (!s_storage->read(s_storage->context, prvAddress(slot), record, DETECTION_LOG_RECORD_SIZE)) {
+        s_errors++;
+        return false;
+    }
+    return true;
+}
+
+static bool prvIsValid(const uint8_t* record) {
+    return record[RECORD_COUNT_OFFSET] >= 1U && record[RECORD_COUNT_OFFSET] <= DETECTION_LOG_MAX_LABELS
+        && prvGetU32(&record[RECORD_CRC_OFFSET]) == prvCrc32(record, RECORD_STATE_OFFSET);
+}
+
+static bool prvIsPending(const uint8_t* record) {
+    return prvIsValid(record) && record[RECORD_STATE_OFFSET] == RECORD_STORED;
+}
+
+static bool prvIsBlank(const uint8_t* record) {
+    for (uint32_t i = 0; i < DETECTION_LOG_RECORD_SIZE; i++) {
+        if (record[i] != RECORD_BLANK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Erase the sector the write slot enters, dropping the records not sent in it */
+static bool prvEnterSector(void) {
+    uint32_t sector = s_write_slot / s_slots_per_sector;
+
+    if (s_pending > 0U && s_read_slot / s_slots_per_sector == sector) {
+        uint8_t record[DETECTION_LOG_RECORD_SIZE];
+        uint32_t end = (sector + 1U) * s_slots_per_sector;
+        uint32_t dropped = 0;
+
+        for (uint32_t slot = s_read_slot; slot < end; slot++) {
+            if (prvReadSlot(slot, record) && prvIsPending(record)) {
+                dropped++;
+            }
+        }
+        dropped = (dropped < s_pending) ? dropped : s_pending;
+        s_overwritten += dropped;
+        s_pending -= dropped;
+        s_read_slot = (end < s_slot_count) ? end : 0U;
+    }
+    if (s_pending == 0U) {
+        s_read_slot = s_write_slot;
+    }
+    if (s_take_slot / s_slots_per_sector == sector) {
+        s_take_slot = s_read_slot;
+    }
+
+    if (!s_storage->erase(s_storage->context, sector)) {
+        s_errors++;
+        return false;
+    }
+    return true;
+}
+
+/* Move the read slot to the oldest record not sent */
+static void prvSkipSent(void) {
+    uint8_t record[DETECTION_LOG_RECORD_SIZE];
+
+    for (uint32_t i = 0; i < s_slot_count && s_pending > 0U; i++) {
+        if (prvReadSlot(s_read_slot, record) && prvIsPending(record)) {
+            return;
+        }
+        s_read_slot = prvNextSlot(s_read_slot);
+    }
+
+    // no record left to send whatever the count says
+    s_pending = 0;
+    s_read_slot = s_write_slot;
+    s_take_slot = s_write_slot;
+}
+
+/* ============================ Function Implementations ============================ */
+
+bool DetectionLog_Init(const DetectionLogStorage_t* storage) {
+    uint8_t record[DETECTION_LOG_RECORD_SIZE];
+    bool found = false;
+    uint32_t last_slot = 0;
+    uint32_t last_sequence = 0;
+
+    if (storage == NULL || storage->read == NULL || storage->program == NULL || storage->erase == NULL
+            || storage->sector_size < DETECTION_LOG_RECORD_SIZE
+            || (storage->sector_size % DETECTION_LOG_RECORD_SIZE) != 0U || storage->sector_count < 2U) {
+        s_storage = NULL;
+        return false;
+    }
+
+    s_storage = storage;
+    s_slots_per_sector = storage->sector_size / DETECTION_LOG_RECORD_SIZE;
+    s_slot_count = s_slots_per_sector * storage->sector_count;
+    s_stored = 0;
+    s_sent = 0;
+    s_overwritten = 0;
+    s_errors = 0;
+    s_pending = 0;
+
+    // the newest record gives the write slot
+    for (uint32_t slot = 0; slot < s_slot_count; slot++) {
+        if (prvReadSlot(slot, record) && prvIsValid(record)) {
+            uint32_t sequence = prvGetU32(&record[RECORD_SEQUENCE_OFFSET]);
+            if (!found || (int32_t)(sequence - last_sequence) > 0) {
+                found = true;
+                last_slot = slot;
+                last_sequence = sequence;
+            }
+        }
+    }
+    s_write_slot = found ? prvNextSlot(last_slot) : 0U;
+    s_next_sequence = found ? last_sequence + 1U : 0U;
+    s_boot_sequence = s_next_sequence;
+
+    // the oldest record not sent gives the read slot
+    s_read_slot = s_write_slot;
+    uint32_t slot = s_write_slot;
+    for (uint32_t i = 0; i < s_slot_count; i++) {
+        if (prvReadSlot(slot, record) && prvIsPending(record)) {
+            if (s_pending == 0U) {
+                s_read_slot = slot;
+            }
+            s_pending++;
+        }
+        slot = prvNextSlot(slot);
+    }
+    DetectionLog_Rewind();
+    return true;
+}
+
+bool DetectionLog_Append(uint32_t sequence, uint32_t time_ms, const DetectionLogLabel_t* labels, uint32_t count) {
+    uint8_t record[DETECTION_LOG_RECORD_SIZE];
+
+    if (s_storage == NULL || count == 0U) {
+        return false;
+    }
+    if (count > DETECTION_LOG_MAX_LABELS) {
+        count = DETECTION_LOG_MAX_LABELS;
+    }
+
+    // next blank slot, erasing the sectors entered on the way
+    uint32_t tries = 0;
+    for (;;) {
+        if (tries++ >= s_slot_count) {
+            return false;
+        }
+        if ((s_write_slot % s_slots_per_sector) == 0U && !prvEnterSector()) {
+            return false;
+        }
+        if (prvReadSlot(s_write_slot, record) && prvIsBlank(record)) {
+            break;
+        }
+        s_errors++;
+        s_write_slot = prvNextSlot(s_write_slot);
+    }
+
+    memset(record, RECORD_BLANK, sizeof(record));
+    prvPutU32(&record[RECORD_SEQUENCE_OFFSET], s_next_sequence);
+    prvPutU32(&record[RECORD_DETECTION_OFFSET], sequence);
+    prvPutU32(&record[RECORD_TIME_OFFSET], time_ms);
+    record[RECORD_COUNT_OFFSET] = (uint8_t)count;
+    for (uint32_t i = 0; i < count; i++) {
+        record[RECORD_LABELS_OFFSET + 2U * i] = labels[i].class_idx;
+        record[RECORD_LABELS_OFFSET + 2U * i + 1U] = labels[i].confidence;
+    }
+    record[RECORD_STATE_OFFSET] = RECORD_STORED;
+    prvPutU32(&record[RECORD_CRC_OFFSET], prvCrc32(record, RECORD_STATE_OFFSET));
+
+    uint32_t slot = s_write_slot;
+    s_write_slot = prvNextSlot(s_write_slot);
+    s_next_sequence++;
+    if (!s_storage->program(s_storage->context, prvAddress(slot), record, sizeof(record))) {
+        s_errors++;
+        return false;
+    }
+    if (s_pending == 0U) {
+        s_read_slot = slot;
+        s_take_slot = slot;
+    }
+    s_pending++;
+    s_stored++;
+    return true;
+}
+
+bool DetectionLog_Take(DetectionLogEntry_t* entry) {
+    uint8_t record[DETECTION_LOG_RECORD_SIZE];
+
+    if (s_storage == NULL || s_pending == 0U) {
+        return false;
+    }
+
+    // up to the write slot, all around if the log is full
+    uint32_t count = (s_write_slot + s_slot_count - s_take_slot) % s_slot_count;
+    if (count == 0U && s_read_slot == s_write_slot) {
+        count = s_slot_count;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t slot = s_take_slot;
+        s_take_slot = prvNextSlot(s_take_slot);
+        if (!prvReadSlot(slot, record) || !prvIsPending(record)) {
+            continue;
+        }
+        uint32_t sequence = prvGetU32(&record[RECORD_SEQUENCE_OFFSET]);
+        if ((int32_t)(sequence - s_take_sequence) < 0) {
+            continue;
+        }
+        entry->sequence = prvGetU32(&record[RECORD_DETECTION_OFFSET]);
+        entry->time_ms = prvGetU32(&record[RECORD_TIME_OFFSET]);
+        entry->current_boot = (int32_t)(sequence - s_boot_sequence) >= 0;
+        entry->label_count = record[RECORD_COUNT_OFFSET];
+        for (uint32_t l = 0; l < entry->label_count; l++) {
+            entry->labels[l].class_idx = record[RECORD_LABELS_OFFSET + 2U * l];
+            entry->labels[l].confidence = record[RECORD_LABELS_OFFSET + 2U * l + 1U];
+        }
+        entry->logged = true;
+        entry->log_slot = slot;
+        entry->log_sequence = sequence;
+        s_take_sequence = sequence + 1U;
+        return true;
+    }
+    return false;
+}
+
+bool DetectionLog_MarkSent(const DetectionLogEntry_t* entry) {
+    static const uint8_t sent = RECORD_SENT;
+    uint8_t record[DETECTION_LOG_RECORD_SIZE];
+    bool ok;
+
+    if (s_storage == NULL || !entry->logged || entry->log_slot >= s_slot_count
+            || !prvReadSlot(entry->log_slot, record) || !prvIsPending(record)
+            || prvGetU32(&record[RECORD_SEQUENCE_OFFSET]) != entry->log_sequence) {
+        return false;
+    }
+
+    ok = s_storage->program(s_storage->context, prvAddress(entry->log_slot) + RECORD_STATE_OFFSET, &sent, sizeof(sent));
+    if (!ok) {
+        s_errors++;
+    }
+    if (s_pending > 0U) {
+        s_pending--;
+    }
+    s_sent++;
+    prvSkipSent();
+    return ok;
+}
+
+void DetectionLog_Rewind(void) {
+    s_take_slot = s_read_slot;
+    s_take_sequence = s_next_sequence - s_slot_count;
+}
+
+uint32_t DetectionLog_Pending(void) {
+    return s_pending;
+}
+
+void DetectionLog_GetStats(DetectionLogStats_t* stats) {
+    stats->stored = s_stored;
+    stats->sent = s_sent;
+    stats->overwritten = s_overwritten;
+    stats->errors = s_errors;
+    stats->pending = s_pending;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file detection_log.h
+ * @brief Circular log of the detections made while the device is offline.
+ *
+ * The detections that cannot be published are appended to a log on a
+ * storage with the constraints of a NOR flash: it is erased by sectors and
+ * programming only clears bits. Once the device is connected again, they
+ * are taken oldest first and each one marked as sent once its message is
+ * acknowledged. Several can be in flight: a message that fails rewinds the
+ * log, which takes again every detection not marked, so a detection may be
+ * sent twice but is not lost.
+ *
+ * Each detection is a record of DETECTION_LOG_RECORD_SIZE bytes with a CRC,
+ * written in one program operation; marking it as sent clears a state byte.
+ * The sectors are written in turn, each one erased when the log enters it,
+ * so the erases are spread evenly. When the log is full, entering a sector
+ * drops the records not yet sent in it, the oldest ones.
+ *
+ * DetectionLog_Init() rebuilds the log from the records found on the
+ * storage, so a log on a storage kept across a reset still replays its
+ * detections; a record torn by a reset fails its CRC and is skipped.
+ *
+ * The log is used by one task.
+ */
+
+#ifndef DETECTION_LOG_H
+#define DETECTION_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Size of a record on the storage */
+#define DETECTION_LOG_RECORD_SIZE 32U
+
+/** Largest number of classes recorded per detection */
+#define DETECTION_LOG_MAX_LABELS 6U
+
+/**
+ * @brief Storage of the log, with the constraints of a NOR flash.
+ *
+ * The functions return false on error.
+ */
+typedef struct {
+    uint32_t sector_size;   ///< Bytes per erase sector, a multiple of DETECTION_LOG_RECORD_SIZE
+    uint32_t sector_count;  ///< Number of sectors, at least 2
+    bool (*read)(void* context, uint32_t address, void* data, size_t size);
+    bool (*program)(void* context, uint32_t address, const void* data, size_t size); ///< Only clears bits
+    bool (*erase)(void* context, uint32_t sector);                                    ///< Sets the sector bytes to 0xFF
+    void* context;          ///< Passed to the functions
+} DetectionLogStorage_t;
+
+/**
+ * @brief Class of a recorded detection.
+ */
+typedef struct {
+    uint8_t class_idx;      ///< Index of the class in the model
+    uint8_t confidence;     ///< Confidence in percent
+} DetectionLogLabel_t;
+
+/**
+ * @brief Recorded detection.
+ */
+typedef struct {
+    uint32_t sequence;      ///< Detection number, as sent in the binary telemetry
+    uint32_t time_ms;       ///< Device uptime at the detection
+    bool current_boot;      ///< false if recorded before DetectionLog_Init(), time_ms then refers to another boot
+    uint32_t label_count;   ///< Number of classes, at least 1
+    DetectionLogLabel_t labels[DETECTION_LOG_MAX_LABELS]; ///< Classes by decreasing confidence
+    bool logged;            ///< true if taken from the log, log_slot and log_sequence then locate its record
+    uint32_t log_slot;      ///< Slot of the record
+    uint32_t log_sequence;  ///< Number of the record, telling it from a later one in the same slot
+} DetectionLogEntry_t;
+
+/**
+ * @brief Record counters of the log.
+ */
+typedef struct {
+    uint32_t stored;        ///< Detections appended since DetectionLog_Init()
+    uint32_t sent;          ///< Detections marked as sent
+    uint32_t overwritten;   ///< Detections dropped unsent as the log was full
+    uint32_t errors;        ///< Storage errors and unusable record slots skipped
+    uint32_t pending;       ///< Detections not marked as sent, including those taken
+} DetectionLogStats_t;
+
+/**
+ * @brief Rebuild the log from the records found on the storage.
+ *
+ * @param[in] storage Storage, must stay valid while the log is used.
+ *
+ * @return false if the storage geometry is not usable.
+ */
+bool DetectionLog_Init(const DetectionLogStorage_t* storage);
+
+/**
+ * @brief Append a detection, dropping the oldest unsent ones if the log is full.
+ *
+ * @param[in] sequence Detection number.
+ * @param[in] time_ms Device uptime at the detection.
+ * @param[in] labels Classes by decreasing confidence, those past DETECTION_LOG_MAX_LABELS are not recorded.
+ * @param[in] count Number of classes, at least 1.
+ *
+ * @return false on storage error.
+ */
+bool DetectionLog_Append(uint32_t sequence, uint32_t time_ms, const DetectionLogLabel_t* labels, uint32_t count);
+
+/**
+ * @brief Take the oldest detection not sent yet nor taken since the last rewind.
+ *
+ * @param[out] entry Detection, to give back to DetectionLog_MarkSent() once sent.
+ *
+ * @return false if there is none.
+ */
+bool DetectionLog_Take(DetectionLogEntry_t* entry);
+
+/**
+ * @brief Mark a detection returned by DetectionLog_Take() as sent.
+ *
+ * @param[in] entry Detection.
+ *
+ * @return false if it was already marked or dropped as the log was full, or
+ *         on storage error, in which case it is not taken again anyway.
+ */
+bool DetectionLog_MarkSent(const DetectionLogEntry_t* entry);
+
+/**
+ * @brief Take again, from the oldest one, the detections not marked as sent.
+ *
+ * Called when a detection taken could not be sent.
+ */
+void DetectionLog_Rewind(void);
+
+/**
+ * @brief Get the number of detections not marked as sent, including those taken.
+ */
+uint32_t DetectionLog_Pending(void);
+
+/**
+ * @brief Get the record counters.
+ */
+void DetectionLog_GetStats(DetectionLogStats_t* stats);
+
+#endif // DETECTION_LOG_H
@@ -0,0 +1,66 @@
+/**
+ * @file detection_log_ram.c
+ * @brief Detection log storage in RAM, behaving as a NOR flash.
+ */
+
+#include <string.h>
+
+#include "detection_log_ram.h"
+
+/* ============================ Static Function Implementations ============================ */
+
+static bool prvInRange(const DetectionLogRam_t* ram, uint32_t address, size_t size) {
+    uint32_t total = ram->storage.sector_size * ram->storage.sector_count;
+    return address <= total && size <= (size_t)(total - address);
+}
+
+static bool prvRead(void* context, uint32_t address, void* data, size_t size) {
+    DetectionLogRam_t* ram = (DetectionLogRam_t*)context;
+
+    if (!prvInRange(ram, address, size)) {
+        return false;
+    }
+    memcpy(data, &ram->memory[address], size);
+    return true;
+}
+
+static bool prvProgram(void* context, uint32_t address, const void* data, size_t size) {
+    DetectionLogRam_t* ram = (DetectionLogRam_t*)context;
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    if (!prvInRange(ram, address, size)) {
+        return false;
+    }
+    // as on a flash, programming only clears bits
+    for (size_t i = 0; i < size; i++) {
+        ram->memory[address + i] &= bytes[i];
+    }
+    return true;
+}
+
+static bool prvErase(void* context, uint32_t sector) {
+    DetectionLogRam_t* ram = (DetectionLogRam_t*)context;
+
+    if (sector >= ram->storage.sector_count) {
+        return false;
+    }
+    memset(&ram->memory[sector * ram->storage.sector_size], 0xFF, ram->storage.sector_size);
+    if (ram->erase_counts != NULL) {
+        ram->erase_counts[sector]++;
+    }
+    return true;
+}
+
+/* ============================ Function Implementations ============================ */
+
+void DetectionLogRam_Init(DetectionLogRam_t* ram, uint8_t* memory, uint32_t sector_size, uint32_t sector_count,
+                          uint32_t* erase_counts) {
+    ram->storage.sector_size = sector_size;
+    ram->storage.sector_count = sector_count;
+    ram->storage.read = prvRead;
+    ram->storage.program = prvProgram;
+    ram->storage.erase = prvErase;
+    ram->storage.context = ram;
+    ram->memory = memory;
+    ram->erase_counts = erase_counts;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file detection_log_ram.h
+ * @brief Detection log storage in RAM, behaving as a NOR flash.
+ *
+ * Programming ANDs the data into the memory and erasing fills a sector with
+ * 0xFF, so the log runs on it exactly as on a flash. The erases of each
+ * sector are counted to check the wear levelling of the log.
+ *
+ * On the device, the memory holds the log while the link is down; it does
+ * not survive a reset unless placed in a section left alone by the start-up
+ * code.
+ */
+
+#ifndef DETECTION_LOG_RAM_H
+#define DETECTION_LOG_RAM_H
+
+#include <stdint.h>
+
+#include "detection_log.h"
+
+/**
+ * @brief RAM storage, the storage member is the one passed to DetectionLog_Init().
+ */
+typedef struct {
+    DetectionLogStorage_t storage;  ///< Storage functions bound to this memory
+    uint8_t* memory;                ///< sector_size * sector_count bytes
+    uint32_t* erase_counts;         ///< Erases per sector, may be NULL
+} DetectionLogRam_t;
+
+/**
+ * @brief Bind a storage to a memory area, left as it is.
+ *
+ * @param[out] ram Storage.
+ * @param[in] memory Memory of sector_size * sector_count bytes.
+ * @param[in] sector_size Bytes per sector.
+ * @param[in] sector_count Number of sectors.
+ * @param[in] erase_counts Erase counters, one per sector, may be NULL.
+ */
+void DetectionLogRam_Init(DetectionLogRam_t* ram, uint8_t* memory, uint32_t sector_size, uint32_t sector_count,
+                          uint32_t* erase_counts);
+
+#endif // DETECTION_LOG_RAM_H
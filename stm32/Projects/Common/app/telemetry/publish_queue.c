@@ -0,0 +1,246 @@
+/**
+ * @file publish_queue.c
+ * @brief Bounded queue of the MQTT messages between the audio processing and
+ *        a sender task.
+ *
+ * As in inference_pipeline.c, the slot indices travel in two FreeRTOS
+ * queues, the free slots and the messages waiting for the sender, so a slot
+ * is only ever written by the task holding its index. A third queue takes
+ * the released messages with detections back to the submitting task.
+ * Evicting a message takes the waiting indices back and queues again all
+ * but the one evicted, in order; the sender, of a lower priority, only finds
+ * fewer messages waiting if it takes one meanwhile.
+ *
+ * Coalescing cannot rewrite a waiting message, the sender may be reading
+ * it: the newer one is queued as usual and the older one only flagged as
+ * superseded. The sender checks the flag when it takes the message, after
+ * which the flag no longer matters: at worst both messages are sent.
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include "publish_queue.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define NO_SLOT 0xFFU
+
+/* ============================ Static Variables ============================ */
+
+static PublishMessage_t s_slots[PUBLISH_QUEUE_SLOTS];
+static QueueHandle_t s_free_queue = NULL;
+static QueueHandle_t s_ready_queue = NULL;
+static QueueHandle_t s_done_queue = NULL;
+static volatile PublishQueuePolicy_t s_policy = PUBLISH_QUEUE_DEFAULT_POLICY;
+
+/* Written by the submitting task only */
+static uint8_t s_pending_slot[PUBLISH_QUEUE_KEYS];
+static uint32_t s_pending_sequence[PUBLISH_QUEUE_KEYS];
+static uint32_t s_submitted = 0;
+static uint32_t s_dropped = 0;
+static uint32_t s_evicted = 0;
+
+/* Written by the sender task only */
+static uint32_t s_coalesced = 0;
+static uint32_t s_sent = 0;
+static uint32_t s_failed = 0;
+static uint32_t s_max_waiting = 0;
+
+/* Counter values at the last PublishQueue_ClearStats(), written by the caller only */
+static PublishQueueStats_t s_base;
+static volatile bool s_clear_requested = false;
+
+/* ============================ Static Function Implementations ============================ */
+
+/* Take a slot to fill, that of a waiting message without detections if the policy allows it */
+static bool prvTakeSlot(uint8_t* slot) {
+    uint8_t waiting[PUBLISH_QUEUE_SLOTS];
+    uint32_t count = 0;
+    uint32_t victim = PUBLISH_QUEUE_SLOTS;
+
+    if (xQueueReceive(s_free_queue, slot, 0) == pdTRUE) {
+        return true;
+    }
+    if (s_policy != PUBLISH_QUEUE_DROP_OLDEST) {
+        return false;
+    }
+
+    // a superseded message first, the sender would skip it, then the oldest one without detections
+    while (count < PUBLISH_QUEUE_SLOTS && xQueueReceive(s_ready_queue, &waiting[count], 0) == pdTRUE) {
+        count++;
+    }
+    for (uint32_t i = 0; i < count && victim == PUBLISH_QUEUE_SLOTS; i++) {
+        if (s_slots[waiting[i]].superseded) {
+            victim = i;
+        }
+    }
+    for (uint32_t i = 0; i < count && victim == PUBLISH_QUEUE_SLOTS; i++) {
+        if (s_slots[waiting[i]].detection_count == 0U) {
+            victim = i;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (i != victim) {
+            (void)xQueueSend(s_ready_queue, &waiting[i], 0);
+        }
+    }
+
+    if (victim < count) {
+        const PublishMessage_t* evicted = &s_slots[waiting[victim]];
+        *slot = waiting[victim];
+        s_evicted++;
+        LogWarn("Publish queue full: message %lu of %lu bytes to %s dropped.",
+                (unsigned long)evicted->sequence, (unsigned long)evicted->length, evicted->topic);
+        return true;
+    }
+    // only detections waiting, unless the sender took them meanwhile and released one
+    return xQueueReceive(s_free_queue, slot, 0) == pdTRUE;
+}
+
+/* ============================ Function Implementations ============================ */
+
+bool PublishQueue_Init(void) {
+    s_free_queue = xQueueCreate(PUBLISH_QUEUE_SLOTS, sizeof(uint8_t));
+    s_ready_queue = xQueueCreate(PUBLISH_QUEUE_SLOTS, sizeof(uint8_t));
+    s_done_queue = xQueueCreate(PUBLISH_QUEUE_SLOTS, sizeof(uint8_t));
+    if (s_free_queue == NULL || s_ready_queue == NULL || s_done_queue == NULL) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < PUBLISH_QUEUE_SLOTS; i++) {
+        (void)xQueueSend(s_free_queue, &i, 0);
+    }
+    memset(s_pending_slot, NO_SLOT, sizeof(s_pending_slot));
+    return true;
+}
+
+bool PublishQueue_Submit(const char* topic, uint32_t key, const void* payload, size_t length,
+                         const DetectionLogEntry_t* detections, uint32_t detection_count) {
+    uint8_t slot;
+
+    s_submitted++;
+    if (length > PUBLISH_QUEUE_PAYLOAD_SIZE || key >= PUBLISH_QUEUE_KEYS
+            || detection_count > PUBLISH_QUEUE_MAX_DETECTIONS) {
+        s_dropped++;
+        return false;
+    }
+    if (!prvTakeSlot(&slot)) {
+        s_dropped++;
+        return false;
+    }
+
+    PublishMessage_t* message = &s_slots[slot];
+    message->topic = topic;
+    message->key = key;
+    message->sequence = s_submitted;
+    message->superseded = false;
+    message->length = length;
+    memcpy(message->payload, payload, length);
+    message->detection_count = detection_count;
+    if (detection_count > 0U) {
+        memcpy(message->detections, detections, detection_count * sizeof(detections[0]));
+    }
+
+    if (key != PUBLISH_QUEUE_KEY_NONE) {
+        // the previous message of the key, unless its slot was reused since
+        uint8_t previous = s_pending_slot[key];
+        if (previous != NO_SLOT && previous != slot
+                && s_slots[previous].sequence == s_pending_sequence[key]) {
+            s_slots[previous].superseded = true;
+        }
+        s_pending_slot[key] = slot;
+        s_pending_sequence[key] = message->sequence;
+    }
+
+    // never full: there are as many places as slots
+    (void)xQueueSend(s_ready_queue, &slot, 0);
+    return true;
+}
+
+PublishMessage_t* PublishQueue_Receive(TickType_t timeout) {
+    uint8_t slot;
+
+    for (;;) {
+        if (xQueueReceive(s_ready_queue, &slot, timeout) != pdTRUE) {
+            return NULL;
+        }
+        if (s_clear_requested) {
+            s_clear_requested = false;
+            s_max_waiting = 0;
+        }
+        uint32_t waiting = (uint32_t)uxQueueMessagesWaiting(s_ready_queue) + 1U;
+        if (waiting > s_max_waiting) {
+            s_max_waiting = waiting;
+        }
+        if (!s_slots[slot].superseded) {
+            return &s_slots[slot];
+        }
+        s_coalesced++;
+        (void)xQueueSend(s_free_queue, &slot, 0);
+    }
+}
+
+void PublishQueue_Release(PublishMessage_t* message, bool sent) {
+    uint8_t slot = (uint8_t)(message - s_slots);
+
+    if (sent) {
+        s_sent++;
+    } else {
+        s_failed++;
+    }
+    message->sent = sent;
+    // never full either
+    (void)xQueueSend((message->detection_count > 0U) ? s_done_queue : s_free_queue, &slot, 0);
+}
+
+PublishMessage_t* PublishQueue_ReceiveDone(void) {
+    uint8_t slot;
+
+    if (xQueueReceive(s_done_queue, &slot, 0) != pdTRUE) {
+        return NULL;
+    }
+    return &s_slots[slot];
+}
+
+void PublishQueue_Recycle(PublishMessage_t* message) {
+    uint8_t slot = (uint8_t)(message - s_slots);
+
+    (void)xQueueSend(s_free_queue, &slot, 0);
+}
+
+void PublishQueue_SetPolicy(PublishQueuePolicy_t policy) {
+    s_policy = policy;
+}
+
+PublishQueuePolicy_t PublishQueue_GetPolicy(void) {
+    return s_policy;
+}
+
+void PublishQueue_GetStats(PublishQueueStats_t* stats) {
+    stats->submitted = s_submitted - s_base.submitted;
+    stats->dropped = s_dropped - s_base.dropped;
+    stats->evicted = s_evicted - s_base.evicted;
+    stats->coalesced = s_coalesced - s_base.coalesced;
+    stats->sent = s_sent - s_base.sent;
+    stats->failed = s_failed - s_base.failed;
+    stats->max_waiting = s_max_waiting;
+}
+
+void PublishQueue_ClearStats(void) {
+    s_base.submitted = s_submitted;
+    s_base.dropped = s_dropped;
+    s_base.evicted = s_evicted;
+    s_base.coalesced = s_coalesced;
+    s_base.sent = s_sent;
+    s_base.failed = s_failed;
+    s_clear_requested = true;
+}
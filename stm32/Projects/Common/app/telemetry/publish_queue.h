@@ -0,0 +1,188 @@
+/**
+ * @file publish_queue.h
+ * @brief Bounded queue of the MQTT messages between the audio processing and
+ *        a sender task.
+ *
+ * Publishing a message waits for the MQTT agent, up to a second on a slow
+ * link, while the microphone DMA keeps running. The task processing the
+ * audio submits its messages here instead and goes on right away; a sender
+ * task waits in PublishQueue_Receive(), publishes them in order and gives
+ * each slot back with PublishQueue_Release().
+ *
+ * The messages are copied into PUBLISH_QUEUE_SLOTS slots. When they are all
+ * taken, the policy decides which message is lost: the new one, or one not
+ * yet taken by the sender. A waiting message with detections is never
+ * evicted: a superseded message goes first, then the oldest one without
+ * detections, and failing both the new message is dropped, leaving the
+ * caller to keep its detections. A message submitted with a coalescing key
+ * supersedes the previous one with the same key if it is
+ * still waiting: the sender skips the older one, so only the latest state
+ * is sent.
+ *
+ * A message may carry the detections it reports. Once released, such a
+ * message is not free yet: the submitting task gets it back from
+ * PublishQueue_ReceiveDone(), marks its detections as sent in the detection
+ * log, or takes them again if it failed, and then recycles it.
+ */
+
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+
+#include "detection_log.h"
+
+/** Number of message slots */
+#ifndef PUBLISH_QUEUE_SLOTS
+#define PUBLISH_QUEUE_SLOTS 4U
+#endif
+
+/** Largest message size */
+#ifndef PUBLISH_QUEUE_PAYLOAD_SIZE
+#define PUBLISH_QUEUE_PAYLOAD_SIZE 1024U
+#endif
+
+/** Largest number of detections carried by a message */
+#ifndef PUBLISH_QUEUE_MAX_DETECTIONS
+#define PUBLISH_QUEUE_MAX_DETECTIONS 16U
+#endif
+
+/** Number of coalescing keys, key 0 is never coalesced */
+#define PUBLISH_QUEUE_KEYS 4U
+
+/** Key of the messages that are never coalesced */
+#define PUBLISH_QUEUE_KEY_NONE 0U
+
+/**
+ * @brief Message lost when every slot is taken.
+ */
+typedef enum {
+    PUBLISH_QUEUE_DROP_NEWEST = 0,  ///< The message being submitted
+    PUBLISH_QUEUE_DROP_OLDEST,      ///< The oldest message waiting for the sender without detections
+} PublishQueuePolicy_t;
+
+#define PUBLISH_QUEUE_DEFAULT_POLICY PUBLISH_QUEUE_DROP_OLDEST
+
+/**
+ * @brief Message in a slot.
+ */
+typedef struct {
+    const char* topic;              ///< Topic, must stay valid until the message is released
+    uint32_t key;                   ///< Coalescing key, PUBLISH_QUEUE_KEY_NONE if none
+    uint32_t sequence;              ///< Submission number
+    volatile bool superseded;       ///< Set when a newer message with the same key is submitted
+    size_t length;                  ///< Payload length
+    uint8_t payload[PUBLISH_QUEUE_PAYLOAD_SIZE]; ///< Payload, not null terminated
+    uint32_t detection_count;       ///< Number of detections reported
+    DetectionLogEntry_t detections[PUBLISH_QUEUE_MAX_DETECTIONS]; ///< Detections reported
+    bool sent;                      ///< Set on release: whether the message was published
+} PublishMessage_t;
+
+/**
+ * @brief Message counters of the queue.
+ */
+typedef struct {
+    uint32_t submitted;             ///< Messages submitted
+    uint32_t dropped;               ///< Messages submitted and lost, as every slot was taken or too long
+    uint32_t evicted;               ///< Waiting messages lost for a newer one, as every slot was taken
+    uint32_t coalesced;             ///< Messages skipped as superseded by a newer one
+    uint32_t sent;                  ///< Messages published
+    uint32_t failed;                ///< Messages the sender failed to publish
+    uint32_t max_waiting;           ///< Largest number of messages waiting for the sender
+} PublishQueueStats_t;
+
+/**
+ * @brief Create the slot queues.
+ *
+ * Called once, before the sender task starts.
+ *
+ * @return false if the queues cannot be created.
+ */
+bool PublishQueue_Init(void);
+
+/**
+ * @brief Copy a message into a slot for the sender task, without waiting.
+ *
+ * Called by one task only.
+ *
+ * @param[in] topic Topic, must stay valid until the message is released.
+ * @param[in] key Coalescing key below PUBLISH_QUEUE_KEYS, PUBLISH_QUEUE_KEY_NONE if none.
+ * @param[in] payload Payload.
+ * @param[in] length Payload length, up to PUBLISH_QUEUE_PAYLOAD_SIZE.
+ * @param[in] detections Detections reported, given back by PublishQueue_ReceiveDone(), may be NULL if none.
+ * @param[in] detection_count Number of detections, up to PUBLISH_QUEUE_MAX_DETECTIONS.
+ *
+ * @return false if the message was dropped.
+ */
+bool PublishQueue_Submit(const char* topic, uint32_t key, const void* payload, size_t length,
+                         const DetectionLogEntry_t* detections, uint32_t detection_count);
+
+/**
+ * @brief Wait for a message to publish, skipping the superseded ones.
+ *
+ * Called by the sender task only.
+ *
+ * @param[in] timeout Ticks to wait, portMAX_DELAY to wait forever.
+ *
+ * @return Message, to give back with PublishQueue_Release(), NULL on timeout.
+ */
+PublishMessage_t* PublishQueue_Receive(TickType_t timeout);
+
+/**
+ * @brief Give the slot of a message back once published.
+ *
+ * A message with detections is handed to PublishQueue_ReceiveDone() instead.
+ *
+ * @param[in] message Message returned by PublishQueue_Receive().
+ * @param[in] sent false if it could not be published.
+ */
+void PublishQueue_Release(PublishMessage_t* message, bool sent);
+
+/**
+ * @brief Get a released message with detections, without waiting.
+ *
+ * Called by the submitting task only.
+ *
+ * @return Message, its sent member telling whether it was published, to give
+ *         back with PublishQueue_Recycle(), NULL if none.
+ */
+PublishMessage_t* PublishQueue_ReceiveDone(void);
+
+/**
+ * @brief Free the slot of a message returned by PublishQueue_ReceiveDone().
+ */
+void PublishQueue_Recycle(PublishMessage_t* message);
+
+/**
+ * @brief Set the message lost when every slot is taken.
+ */
+void PublishQueue_SetPolicy(PublishQueuePolicy_t policy);
+
+/**
+ * @brief Get the message lost when every slot is taken.
+ */
+PublishQueuePolicy_t PublishQueue_GetPolicy(void);
+
+/**
+ * @brief Get the message counters.
+ */
+void PublishQueue_GetStats(PublishQueueStats_t* stats);
+
+/**
+ * @brief Clear the message counters.
+ *
+ * The largest number of messages waiting is cleared by the sender task
+ * when it takes its next message.
+ */
+void PublishQueue_ClearStats(void);
+
+/**
+ * @brief Register the "publish" CLI command printing the message counters.
+ */
+void PublishQueue_RegisterCliCommand(void);
+
+#endif // PUBLISH_QUEUE_H
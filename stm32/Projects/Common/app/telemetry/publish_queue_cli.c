@@ -0,0 +1,85 @@
+/**
+ * @file publish_queue_cli.c
+ * @brief "publish" CLI command printing the publish queue counters.
+ *
+ * Usage:
+ *   publish                      Print the message counters and the policy
+ *   publish reset                Clear the counters
+ *   publish policy newest|oldest Drop the new or the oldest message without detections when the queue is full
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "cli/cli.h"
+#include "FreeRTOS_CLI.h"
+
+#include "publish_queue.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define PUBLISH_CLI_LINE_LEN 128
+
+/* ============================ Function Implementations ============================ */
+
+static const char* prvPolicyName(PublishQueuePolicy_t policy) {
+    return (policy == PUBLISH_QUEUE_DROP_OLDEST) ? "oldest" : "newest";
+}
+
+static void prvPublishCommand(ConsoleIO_t * const pxCIO, uint32_t ulArgc, char * ppcArgv[]) {
+    char line[PUBLISH_CLI_LINE_LEN];
+
+    if (ulArgc == 2 && 0 == strcmp(ppcArgv[1], "reset")) {
+        PublishQueue_ClearStats();
+        pxCIO->print("Publish counters cleared.\r\n");
+        return;
+    }
+
+    if (ulArgc == 3 && 0 == strcmp(ppcArgv[1], "policy")) {
+        if (0 == strcmp(ppcArgv[2], "newest")) {
+            PublishQueue_SetPolicy(PUBLISH_QUEUE_DROP_NEWEST);
+        } else if (0 == strcmp(ppcArgv[2], "oldest")) {
+            PublishQueue_SetPolicy(PUBLISH_QUEUE_DROP_OLDEST);
+        } else {
+            pxCIO->print("Usage: publish policy newest|oldest\r\n");
+            return;
+        }
+        snprintf(line, sizeof(line), "Drop the %s message when full.\r\n", prvPolicyName(PublishQueue_GetPolicy()));
+        pxCIO->print(line);
+        return;
+    }
+
+    if (ulArgc != 1) {
+        pxCIO->print("Usage: publish [reset | policy newest|oldest]\r\n");
+        return;
+    }
+
+    PublishQueueStats_t stats;
+    PublishQueue_GetStats(&stats);
+
+    snprintf(line, sizeof(line), "submitted: %lu, dropped: %lu, evicted: %lu, coalesced: %lu, sent: %lu, failed: %lu\r\n",
+             (unsigned long)stats.submitted, (unsigned long)stats.dropped, (unsigned long)stats.evicted,
+             (unsigned long)stats.coalesced, (unsigned long)stats.sent, (unsigned long)stats.failed);
+    pxCIO->print(line);
+    snprintf(line, sizeof(line), "slots: %u, max waiting: %lu, drop when full: %s\r\n",
+             (unsigned)PUBLISH_QUEUE_SLOTS, (unsigned long)stats.max_waiting,
+             prvPolicyName(PublishQueue_GetPolicy()));
+    pxCIO->print(line);
+}
+
+static const CLI_Command_Definition_t xCommandDef_publish = {
+    .pcCommand = "publish",
+    .pcHelpString =
+        "publish [reset | policy newest|oldest]\r\n"
+        "    Print the messages queued for the MQTT sender task, those dropped\r\n"
+        "    or evicted as the queue was full and those superseded by a newer one.\r\n"
+        "    reset: clear the counters.\r\n"
+        "    policy: drop the new or the oldest message without detections\r\n"
+        "    when the queue is full.\r\n\n",
+    .pxCommandInterpreter = prvPublishCommand
+};
+
+void PublishQueue_RegisterCliCommand(void) {
+    (void)FreeRTOS_CLIRegisterCommand(&xCommandDef_publish);
+}
@@ -0,0 +1,139 @@
+/**
+ * @file telemetry_batch.c
+ * @brief Batching of the telemetry records into one IoTConnect message.
+ *
+ * The batch is always kept as a complete message: a message is appended by
+ * replacing the closing "],"mt":0}" of the batch with a comma, the records
+ * of the message and the closing again.
+ */
+
+#include <string.h>
+
+#include "telemetry_batch.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#define MESSAGE_OPEN        "{\"d\":["
+#define MESSAGE_CLOSE       "],\"mt\":0}"
+#define RECORD_SEPARATOR    ","
+
+#define CONST_STR_LEN(str)  (sizeof(str) - 1U)
+
+/* ============================ Static Variables ============================ */
+
+static char s_batch[TELEMETRY_BATCH_SIZE];
+static size_t s_length = 0;
+static uint32_t s_messages = 0;
+static uint32_t s_first_ms = 0;
+
+static TelemetryBatchConfig_t s_config;
+static TelemetryBatchConfig_t s_pending_config;
+static volatile bool s_config_pending = false;
+
+/* ============================ Static Function Implementations ============================ */
+
+static bool prvIsValid(const TelemetryBatchConfig_t* config) {
+    if (config->messages == 0U || config->messages > TELEMETRY_BATCH_MAX_MESSAGES
+            || config->window_ms > TELEMETRY_BATCH_MAX_WINDOW_MS) {
+        return false;
+    }
+    // without a window, the last messages of a burst would wait for the next one
+    return (config->messages == 1U) || (config->window_ms > 0U);
+}
+
+static void prvApplyConfig(void) {
+    if (s_config_pending) {
+        s_config = s_pending_config;
+        s_config_pending = false;
+    }
+}
+
+/* ============================ Function Implementations ============================ */
+
+void TelemetryBatch_Init(void) {
+    s_length = 0;
+    s_messages = 0;
+    s_config.messages = TELEMETRY_BATCH_DEFAULT_MESSAGES;
+    s_config.window_ms = TELEMETRY_BATCH_DEFAULT_WINDOW_MS;
+    s_config_pending = false;
+}
+
+bool TelemetryBatch_Configure(const TelemetryBatchConfig_t* config) {
+    if (!prvIsValid(config)) {
+        return false;
+    }
+    s_pending_config = *config;
+    s_config_pending = true;
+    return true;
+}
+
+void TelemetryBatch_GetConfig(TelemetryBatchConfig_t* config) {
+    *config = s_config_pending ? s_pending_config : s_config;
+}
+
+bool TelemetryBatch_Add(const char* message, size_t length, uint32_t now_ms) {
+    prvApplyConfig();
+
+    if (length < (CONST_STR_LEN(MESSAGE_OPEN) + CONST_STR_LEN(MESSAGE_CLOSE))
+            || 0 != strncmp(message, MESSAGE_OPEN, CONST_STR_LEN(MESSAGE_OPEN))
+            || 0 != strncmp(&message[length - CONST_STR_LEN(MESSAGE_CLOSE)], MESSAGE_CLOSE,
+                            CONST_STR_LEN(MESSAGE_CLOSE))) {
+        return false;
+    }
+
+    if (s_messages == 0U) {
+        if (length >= sizeof(s_batch)) {
+            return false;
+        }
+        memcpy(s_batch, message, length);
+        s_length = length;
+        s_first_ms = now_ms;
+    } else {
+        // records of the message, between its opening and closing
+        const char* records = &message[CONST_STR_LEN(MESSAGE_OPEN)];
+        size_t records_len = length - CONST_STR_LEN(MESSAGE_OPEN) - CONST_STR_LEN(MESSAGE_CLOSE);
+        size_t pos = s_length - CONST_STR_LEN(MESSAGE_CLOSE);
+        size_t new_length = pos + CONST_STR_LEN(RECORD_SEPARATOR) + records_len + CONST_STR_LEN(MESSAGE_CLOSE);
+        if (new_length >= sizeof(s_batch)) {
+            return false;
+        }
+        memcpy(&s_batch[pos], RECORD_SEPARATOR, CONST_STR_LEN(RECORD_SEPARATOR));
+        pos += CONST_STR_LEN(RECORD_SEPARATOR);
+        memcpy(&s_batch[pos], records, records_len);
+        pos += records_len;
+        memcpy(&s_batch[pos], MESSAGE_CLOSE, CONST_STR_LEN(MESSAGE_CLOSE));
+        s_length = new_length;
+    }
+    s_batch[s_length] = '\0';
+    s_messages++;
+    return true;
+}
+
+bool TelemetryBatch_IsDue(uint32_t now_ms) {
+    prvApplyConfig();
+
+    if (s_messages == 0U) {
+        return false;
+    }
+    return (s_messages >= s_config.messages) || ((now_ms - s_first_ms) >= s_config.window_ms);
+}
+
+bool TelemetryBatch_IsEmpty(void) {
+    return s_messages == 0U;
+}
+
+const char* TelemetryBatch_Peek(size_t* length, uint32_t* messages) {
+    if (s_messages == 0U) {
+        *length = 0;
+        return NULL;
+    }
+    *length = s_length;
+    if (messages != NULL) {
+        *messages = s_messages;
+    }
+    return s_batch;
+}
+
+void TelemetryBatch_Commit(void) {
+    s_messages = 0;
+}
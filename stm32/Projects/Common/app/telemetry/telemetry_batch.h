@@ -0,0 +1,103 @@
+/**
+ * @file telemetry_batch.h
+ * @brief Batching of the telemetry records into one IoTConnect message.
+ *
+ * An IoTConnect message carries a list of records:
+ *
+ *   {"d":[{"d":{...}},{"d":{...}}],"mt":0}
+ *
+ * so the detections of a burst of sounds can share one MQTT publish. The
+ * messages added to the batch are merged into one, which is due once it
+ * holds the configured number of messages or its first message has waited
+ * for the configured window. The default configuration, one message, sends
+ * each message as it is.
+ *
+ * The batch is used by one task; the configuration may be set from another
+ * one and is applied on the next call of that task.
+ */
+
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Size of the batched message, terminator included */
+#ifndef TELEMETRY_BATCH_SIZE
+#define TELEMETRY_BATCH_SIZE 1024U
+#endif
+
+/** Largest number of messages in a batch */
+#define TELEMETRY_BATCH_MAX_MESSAGES 16U
+
+/** Longest time the first message of a batch waits */
+#define TELEMETRY_BATCH_MAX_WINDOW_MS 600000U
+
+#define TELEMETRY_BATCH_DEFAULT_MESSAGES 1U
+#define TELEMETRY_BATCH_DEFAULT_WINDOW_MS 0U
+
+/**
+ * @brief Batching parameters.
+ */
+typedef struct {
+    uint32_t messages;      ///< Messages per batch, 1 to TELEMETRY_BATCH_MAX_MESSAGES, 1 for no batching
+    uint32_t window_ms;     ///< Longest wait of the first message, above 0 when batching
+} TelemetryBatchConfig_t;
+
+/**
+ * @brief Empty the batch and restore the default configuration.
+ */
+void TelemetryBatch_Init(void);
+
+/**
+ * @brief Set the batching parameters, applied on the next call of the batch task.
+ *
+ * @return false if the parameters are out of range.
+ */
+bool TelemetryBatch_Configure(const TelemetryBatchConfig_t* config);
+
+/**
+ * @brief Get the batching parameters, the pending ones if not applied yet.
+ */
+void TelemetryBatch_GetConfig(TelemetryBatchConfig_t* config);
+
+/**
+ * @brief Add the records of a message to the batch.
+ *
+ * @param[in] message IoTConnect message, {"d":[...],"mt":0}.
+ * @param[in] length Length of the message.
+ * @param[in] now_ms Current time, starting the window of the first message.
+ *
+ * @return false if the message is not an IoTConnect message or does not fit
+ *         in the batch, which is then unchanged.
+ */
+bool TelemetryBatch_Add(const char* message, size_t length, uint32_t now_ms);
+
+/**
+ * @brief Check whether the batch is full enough or old enough to be sent.
+ */
+bool TelemetryBatch_IsDue(uint32_t now_ms);
+
+/**
+ * @brief Check whether the batch holds no message.
+ */
+bool TelemetryBatch_IsEmpty(void);
+
+/**
+ * @brief Get the batched message, the batch being kept until TelemetryBatch_Commit().
+ *
+ * @param[out] length Length of the message.
+ * @param[out] messages Number of messages merged into it, may be NULL.
+ *
+ * @return Message, null terminated, valid until the next call to
+ *         TelemetryBatch_Add() or TelemetryBatch_Commit(), NULL if the batch is empty.
+ */
+const char* TelemetryBatch_Peek(size_t* length, uint32_t* messages);
+
+/**
+ * @brief Empty the batch, once the message returned by TelemetryBatch_Peek() is handed over.
+ */
+void TelemetryBatch_Commit(void);
+
+#endif // TELEMETRY_BATCH_H
@@ -0,0 +1,235 @@
+/**
+ * @file telemetry_encoder.c
+ * @brief Encoding of the detection telemetry messages, JSON or binary
+ *
+ * This module formats the fixed parts of the messages once and splices the
+ * class, the confidence and the labels of each detection between them.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_encoder.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Parts between the class and the suffix */
+#define CONFIDENCE_KEY      "\",\"confidence\":"
+#define LABELS_KEY          ",\"labels\":\""
+#define LABELS_END          "\""
+#define AGE_KEY             ",\"age\":"
+
+#define CONST_STR_LEN(str)  (sizeof(str) - 1U)
+
+/* Largest number of characters of an int in decimal */
+#define INT_DIGITS_MAX      11U
+
+/* CBOR major types, in the 3 upper bits of the initial byte */
+#define CBOR_UNSIGNED       0x00U
+#define CBOR_NEGATIVE       0x20U
+#define CBOR_ARRAY          0x80U
+
+/* CBOR additional information: the argument follows on 1, 2 or 4 bytes */
+#define CBOR_DIRECT_MAX     23U
+#define CBOR_ARG_8          24U
+#define CBOR_ARG_16         25U
+#define CBOR_ARG_32         26U
+
+/* Items of a binary message before the labels */
+#define BINARY_HEADER_ITEMS 3U
+
+static const char* const s_format_names[] = { "json", "cbor" };
+
+/* ============================ Static Function Implementations ============================ */
+
+static bool prvFormat(char* buffer, size_t buffer_size, size_t* length, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer, buffer_size, format, args);
+    va_end(args);
+    if ((written < 0) || ((size_t)written >= buffer_size)) {
+        return false;
+    }
+    *length = (size_t)written;
+    return true;
+}
+
+/* Write value in decimal at the end of digits, return the index of the first character */
+static size_t prvFormatInt(int value, char* digits) {
+    size_t pos = INT_DIGITS_MAX;
+    unsigned int magnitude = (value < 0) ? (0U - (unsigned int)value) : (unsigned int)value;
+
+    do {
+        digits[--pos] = (char)('0' + (magnitude % 10U));
+        magnitude /= 10U;
+    } while (magnitude != 0U);
+    if (value < 0) {
+        digits[--pos] = '-';
+    }
+    return pos;
+}
+
+/* Append a CBOR head in its shortest form, return false if it does not fit */
+static bool prvCborHead(uint8_t major, uint32_t argument, uint8_t* buffer, size_t buffer_size, size_t* pos) {
+    size_t arg_size = (argument <= CBOR_DIRECT_MAX) ? 0U
+                    : (argument <= UINT8_MAX) ? 1U
+                    : (argument <= UINT16_MAX) ? 2U : 4U;
+
+    if ((buffer_size - *pos) < (1U + arg_size)) {
+        return false;
+    }
+    switch (arg_size) {
+    case 0U:
+        buffer[(*pos)++] = (uint8_t)(major | argument);
+        return true;
+    case 1U:
+        buffer[(*pos)++] = (uint8_t)(major | CBOR_ARG_8);
+        break;
+    case 2U:
+        buffer[(*pos)++] = (uint8_t)(major | CBOR_ARG_16);
+        break;
+    default:
+        buffer[(*pos)++] = (uint8_t)(major | CBOR_ARG_32);
+        break;
+    }
+    // big endian
+    for (size_t i = arg_size; i > 0U; i--) {
+        buffer[(*pos)++] = (uint8_t)(argument >> (8U * (i - 1U)));
+    }
+    return true;
+}
+
+static bool prvCborInt(int value, uint8_t* buffer, size_t buffer_size, size_t* pos) {
+    if (value < 0) {
+        // -1 - n is encoded as n
+        return prvCborHead(CBOR_NEGATIVE, (uint32_t)(-1 - value), buffer, buffer_size, pos);
+    }
+    return prvCborHead(CBOR_UNSIGNED, (uint32_t)value, buffer, buffer_size, pos);
+}
+
+/* Encode a detection message, with the age attribute if with_age */
+static size_t prvDetection(const TelemetryEncoder_t* encoder, const char* class_name, int confidence,
+                           const char* labels, bool with_age, int age_s, char* buffer, size_t buffer_size) {
+    char digits[INT_DIGITS_MAX];
+    size_t digits_pos = prvFormatInt(confidence, digits);
+    size_t digits_len = INT_DIGITS_MAX - digits_pos;
+    char age_digits[INT_DIGITS_MAX];
+    size_t age_pos = prvFormatInt(age_s, age_digits);
+    size_t age_len = INT_DIGITS_MAX - age_pos;
+    size_t class_len = strlen(class_name);
+    size_t labels_len = (labels != NULL) ? strlen(labels) : 0U;
+
+    size_t length = encoder->prefix_len + class_len + CONST_STR_LEN(CONFIDENCE_KEY) + digits_len
+                  + encoder->suffix_len;
+    if (labels != NULL) {
+        length += CONST_STR_LEN(LABELS_KEY) + labels_len + CONST_STR_LEN(LABELS_END);
+    }
+    if (with_age) {
+        length += CONST_STR_LEN(AGE_KEY) + age_len;
+    }
+    if (length >= buffer_size) {
+        if (buffer_size > 0U) {
+            buffer[0] = '\0';
+        }
+        return length;
+    }
+
+    char* pos = buffer;
+    memcpy(pos, encoder->prefix, encoder->prefix_len);
+    pos += encoder->prefix_len;
+    memcpy(pos, class_name, class_len);
+    pos += class_len;
+    memcpy(pos, CONFIDENCE_KEY, CONST_STR_LEN(CONFIDENCE_KEY));
+    pos += CONST_STR_LEN(CONFIDENCE_KEY);
+    memcpy(pos, &digits[digits_pos], digits_len);
+    pos += digits_len;
+    if (labels != NULL) {
+        memcpy(pos, LABELS_KEY, CONST_STR_LEN(LABELS_KEY));
+        pos += CONST_STR_LEN(LABELS_KEY);
+        memcpy(pos, labels, labels_len);
+        pos += labels_len;
+        memcpy(pos, LABELS_END, CONST_STR_LEN(LABELS_END));
+        pos += CONST_STR_LEN(LABELS_END);
+    }
+    if (with_age) {
+        memcpy(pos, AGE_KEY, CONST_STR_LEN(AGE_KEY));
+        pos += CONST_STR_LEN(AGE_KEY);
+        memcpy(pos, &age_digits[age_pos], age_len);
+        pos += age_len;
+    }
+    memcpy(pos, encoder->suffix, encoder->suffix_len + 1U);
+
+    return length;
+}
+
+/* ============================ Function Implementations ============================ */
+
+bool TelemetryEncoder_Init(TelemetryEncoder_t* encoder, const char* version, const char* position,
+                           const char* inactive_position) {
+    memset(encoder, 0, sizeof(*encoder));
+
+    // the idle message has always had a space after the version
+    return prvFormat(encoder->prefix, sizeof(encoder->prefix), &encoder->prefix_len,
+                     "{\"d\":[{\"d\":{\"version\":\"MLDEMO-%s\",\"class\":\"", version)
+        && prvFormat(encoder->suffix, sizeof(encoder->suffix), &encoder->suffix_len,
+                     ",\"position\":[%s]}}],\"mt\":0}", position)
+        && prvFormat(encoder->idle, sizeof(encoder->idle), &encoder->idle_len,
+                     "{\"d\":[{\"d\":{\"version\":\"MLDEMO-%s \",\"class\":\"not-active\",\"confidence\":100,"
+                     "\"position\":[%s]}}],\"mt\":0}", version, inactive_position);
+}
+
+size_t TelemetryEncoder_Detection(const TelemetryEncoder_t* encoder, const char* class_name, int confidence,
+                                  const char* labels, char* buffer, size_t buffer_size) {
+    return prvDetection(encoder, class_name, confidence, labels, false, 0, buffer, buffer_size);
+}
+
+size_t TelemetryEncoder_ReplayedDetection(const TelemetryEncoder_t* encoder, const char* class_name, int confidence,
+                                          const char* labels, int age_s, char* buffer, size_t buffer_size) {
+    return prvDetection(encoder, class_name, confidence, labels, true, age_s, buffer, buffer_size);
+}
+
+const char* TelemetryEncoder_Idle(const TelemetryEncoder_t* encoder, size_t* length) {
+    *length = encoder->idle_len;
+    return encoder->idle;
+}
+
+size_t TelemetryEncoder_Binary(uint32_t sequence, uint32_t time_ms, const TelemetryLabel_t* labels, size_t count,
+                               uint8_t* buffer, size_t buffer_size) {
+    size_t pos = 0;
+    bool fits = (count > 0U)
+        && prvCborHead(CBOR_ARRAY, (uint32_t)(BINARY_HEADER_ITEMS + (2U * count)), buffer, buffer_size, &pos)
+        && prvCborHead(CBOR_UNSIGNED, TELEMETRY_BINARY_VERSION, buffer, buffer_size, &pos)
+        && prvCborHead(CBOR_UNSIGNED, sequence, buffer, buffer_size, &pos)
+        && prvCborHead(CBOR_UNSIGNED, time_ms, buffer, buffer_size, &pos);
+
+    for (size_t i = 0; fits && (i < count); i++) {
+        fits = prvCborHead(CBOR_UNSIGNED, labels[i].class_idx, buffer, buffer_size, &pos)
+            && prvCborInt(labels[i].confidence, buffer, buffer_size, &pos);
+    }
+    return fits ? pos : 0U;
+}
+
+bool TelemetryEncoder_ParseFormat(const char* text, TelemetryFormat_t* format) {
+    while (*text == ' ') {
+        text++;
+    }
+    size_t len = strlen(text);
+    while ((len > 0U) && (text[len - 1U] == ' ')) {
+        len--;
+    }
+    for (size_t i = 0; i < (sizeof(s_format_names) / sizeof(s_format_names[0])); i++) {
+        if ((len == strlen(s_format_names[i])) && (0 == strncmp(text, s_format_names[i], len))) {
+            *format = (TelemetryFormat_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* TelemetryEncoder_FormatName(TelemetryFormat_t format) {
+    if ((size_t)format >= (sizeof(s_format_names) / sizeof(s_format_names[0]))) {
+        return "unknown";
+    }
+    return s_format_names[format];
+}
@@ -0,0 +1,168 @@
+/**
+ * @file telemetry_encoder.h
+ * @brief Encoding of the detection telemetry messages.
+ *
+ * A detection message only differs from the previous one by its class and
+ * confidence: the firmware version and the device position are fixed once
+ * the device is provisioned. The encoder formats the parts around the class
+ * and the confidence once, at startup, and each message is then spliced
+ * together with a few copies, without snprintf nor allocation. The idle
+ * message does not change at all and is encoded once.
+ *
+ * The messages are byte for byte the ones of the IoTConnect soundclass
+ * template:
+ *
+ *   {"d":[{"d":{"version":"MLDEMO-1.2.3","class":"Bark","confidence":71,"position":[...]}}],"mt":0}
+ *
+ * with a "labels" attribute after the confidence when set. The detections
+ * replayed from the detection log have an "age" attribute after those, the
+ * seconds elapsed since the detection, or -1 if it was made before the last
+ * reset and its age is unknown.
+ *
+ * The detections can also be encoded as a compact CBOR array (RFC 8949) of
+ * unsigned or negative integers, 10 to 20 bytes instead of about 150:
+ *
+ *   [version, sequence, time_ms, class, confidence, class, confidence, ...]
+ *
+ * version is TELEMETRY_BINARY_VERSION, sequence counts the detections since
+ * startup so that lost messages show, time_ms is the device uptime and the
+ * class / confidence pairs are the labels by decreasing confidence, the best
+ * one first. iot-connect/common/telemetry.py decodes them.
+ */
+
+#ifndef TELEMETRY_ENCODER_H
+#define TELEMETRY_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Largest size of the message part before the class name, terminator included */
+#define TELEMETRY_ENCODER_PREFIX_SIZE   64U
+
+/** Largest size of the message part after the confidence or the labels, terminator included */
+#define TELEMETRY_ENCODER_SUFFIX_SIZE   96U
+
+/** Largest size of the idle message, terminator included */
+#define TELEMETRY_ENCODER_IDLE_SIZE     192U
+
+/** Version of the binary message layout, its first item */
+#define TELEMETRY_BINARY_VERSION        1U
+
+/** Largest size of a binary message with the given number of labels of class index below 256 */
+#define TELEMETRY_BINARY_MAX_SIZE(labels) (3U + 1U + 5U + 5U + ((labels) * 4U))
+
+/**
+ * @brief Encoding of the detection messages.
+ */
+typedef enum {
+    TELEMETRY_FORMAT_JSON = 0,   ///< IoTConnect JSON message
+    TELEMETRY_FORMAT_CBOR,       ///< Binary message, CBOR array
+} TelemetryFormat_t;
+
+/**
+ * @brief Class reported by a binary message.
+ */
+typedef struct {
+    uint32_t class_idx;          ///< Index of the class in the model
+    int confidence;              ///< Confidence in percent
+} TelemetryLabel_t;
+
+/**
+ * @brief Parts of the messages formatted at startup.
+ */
+typedef struct {
+    char prefix[TELEMETRY_ENCODER_PREFIX_SIZE];   ///< Message up to the class name
+    size_t prefix_len;                            ///< Length of prefix
+    char suffix[TELEMETRY_ENCODER_SUFFIX_SIZE];   ///< Message after the confidence or the labels
+    size_t suffix_len;                            ///< Length of suffix
+    char idle[TELEMETRY_ENCODER_IDLE_SIZE];       ///< Whole idle message
+    size_t idle_len;                              ///< Length of idle
+} TelemetryEncoder_t;
+
+/**
+ * @brief Format the fixed parts of the messages.
+ *
+ * @param[out] encoder Encoder state.
+ * @param[in] version Firmware version, e.g. "1.2.3".
+ * @param[in] position Position reported with the detections, "latitude,longitude".
+ * @param[in] inactive_position Position reported with the idle message.
+ *
+ * @return false if a part does not fit in the encoder.
+ */
+bool TelemetryEncoder_Init(TelemetryEncoder_t* encoder, const char* version, const char* position,
+                           const char* inactive_position);
+
+/**
+ * @brief Encode a detection message.
+ *
+ * @param[in] encoder Encoder state.
+ * @param[in] class_name Label of the detected class.
+ * @param[in] confidence Confidence in percent.
+ * @param[in] labels Value of the labels attribute, NULL to leave it out.
+ * @param[out] buffer Message, null terminated.
+ * @param[in] buffer_size Size of buffer.
+ *
+ * @return Length of the message. If it is buffer_size or more, the message
+ *         did not fit and buffer only holds an empty string.
+ */
+size_t TelemetryEncoder_Detection(const TelemetryEncoder_t* encoder, const char* class_name, int confidence,
+                                  const char* labels, char* buffer, size_t buffer_size);
+
+/**
+ * @brief Get the idle message, sent once the detections are no longer blocked.
+ *
+ * @param[in] encoder Encoder state.
+ * @param[out] length Length of the message.
+ *
+ * @return Message, null terminated, valid as long as the encoder.
+ */
+/**
+ * @brief Encode a detection message sent after the detection, with its age.
+ *
+ * @param[in] encoder Encoder state.
+ * @param[in] class_name Label of the detected class.
+ * @param[in] confidence Confidence in percent.
+ * @param[in] labels Value of the labels attribute, NULL to leave it out.
+ * @param[in] age_s Seconds since the detection, -1 if unknown.
+ * @param[out] buffer Message, null terminated.
+ * @param[in] buffer_size Size of buffer.
+ *
+ * @return Length of the message, as TelemetryEncoder_Detection().
+ */
+size_t TelemetryEncoder_ReplayedDetection(const TelemetryEncoder_t* encoder, const char* class_name, int confidence,
+                                          const char* labels, int age_s, char* buffer, size_t buffer_size);
+
+const char* TelemetryEncoder_Idle(const TelemetryEncoder_t* encoder, size_t* length);
+
+/**
+ * @brief Encode a detection as a binary message.
+ *
+ * @param[in] sequence Number of the detection since startup.
+ * @param[in] time_ms Device uptime in milliseconds.
+ * @param[in] labels Classes reported, the best one first.
+ * @param[in] count Number of labels, at least 1.
+ * @param[out] buffer Message.
+ * @param[in] buffer_size Size of buffer.
+ *
+ * @return Length of the message, 0 if it does not fit in buffer.
+ */
+size_t TelemetryEncoder_Binary(uint32_t sequence, uint32_t time_ms, const TelemetryLabel_t* labels, size_t count,
+                               uint8_t* buffer, size_t buffer_size);
+
+/**
+ * @brief Parse the name of a format, "json" or "cbor".
+ *
+ * @param[in] text Name, surrounding spaces allowed.
+ * @param[out] format Format, unchanged on error.
+ *
+ * @return false if the name is unknown.
+ */
+bool TelemetryEncoder_ParseFormat(const char* text, TelemetryFormat_t* format);
+
+/**
+ * @brief Get the name of a format, as parsed by TelemetryEncoder_ParseFormat().
+ */
+const char* TelemetryEncoder_FormatName(TelemetryFormat_t format);
+
+#endif // TELEMETRY_ENCODER_H
@@ -39,6 +39,8 @@ typedef enum KvStoreEnum
     CS_IOTC_CD,
     CS_S3_API_KEY,
     CS_S3_ENDPOINT,
+    CS_DECISION_CONFIG,
+    CS_TELEMETRY_FORMAT,
     CS_NUM_KEYS
 } KVStoreKey_t;
 
@@ -53,6 +55,8 @@ typedef enum KvStoreEnum
 #define WIFI_SECURITY_DFLT
 #define S3_API_KEY_DEFAULT    ""
 #define S3_ENDPOINT_DEFAULT    ""
+#define DECISION_CONFIG_DFLT  ""   /* no record, the firmware defaults apply: even with its terminator, shorter than a record header */
+#define TELEMETRY_FORMAT_DFLT 0    /* TELEMETRY_FORMAT_JSON */
 
 /* Array to map between strings and KVStoreKey_t IDs */
 #define KV_STORE_STRINGS   \
@@ -65,7 +69,9 @@ typedef enum KvStoreEnum
         "time_hwm",        \
         "iotc_cd", 		   \
         "s3_api_key",      \
-        "s3_endpoint"      \
+        "s3_endpoint",     \
+        "decision_config", \
+        "telemetry_format" \
     }
 
 #define KV_STORE_DEFAULTS                                                          \
@@ -79,6 +85,8 @@ typedef enum KvStoreEnum
         KV_DFLT( KV_TYPE_STRING, IOTC_CD_DEFAULT ),    /* CS_IOTC_CD */    		   \
         KV_DFLT( KV_TYPE_STRING, S3_API_KEY_DEFAULT ), /* CS_S3_API_KEY */ 		   \
         KV_DFLT( KV_TYPE_STRING, S3_ENDPOINT_DEFAULT ),/* CS_S3_ENDPOINT */ 	   \
+        KV_DFLT( KV_TYPE_BLOB, DECISION_CONFIG_DFLT ), /* CS_DECISION_CONFIG */    \
+        KV_DFLT( KV_TYPE_UINT32, TELEMETRY_FORMAT_DFLT ), /* CS_TELEMETRY_FORMAT */ \
     }
 
 #endif /* _KVSTORE_CONFIG_H */
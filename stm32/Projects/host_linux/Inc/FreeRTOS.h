@@ -0,0 +1,32 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in for the FreeRTOS base types used by the DPU headers.
+ *
+ * The host build does not run a scheduler; only the portable types and
+ * constants referenced by the preprocessing and AI DPUs are provided, and
+ * the queues of queue.h for the code shared between two tasks. One tick is
+ * one millisecond.
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE    ( ( BaseType_t ) 0 )
+#define pdTRUE     ( ( BaseType_t ) 1 )
+#define pdPASS     ( pdTRUE )
+#define pdFAIL     ( pdFALSE )
+
+#define configASSERT( x )    assert( x )
+
+#define portMAX_DELAY         ( ( TickType_t ) 0xFFFFFFFFUL )
+#define pdMS_TO_TICKS( ms )   ( ( TickType_t ) ( ms ) )
+
+#endif // INC_FREERTOS_H
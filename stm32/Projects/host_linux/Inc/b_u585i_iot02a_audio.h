@@ -0,0 +1,60 @@
+/**
+ * @file b_u585i_iot02a_audio.h
+ * @brief Host stand-in for the B-U585I-IOT02A BSP audio input driver.
+ *
+ * BSP_AUDIO_IN_Record() registers the capture buffer and the DMA events are
+ * produced by BspAudioReplay_Step() from a WAV file, calling the same
+ * half/complete transfer callbacks as the DMA interrupt on target.
+ */
+
+#ifndef B_U585I_IOT02A_AUDIO_H
+#define B_U585I_IOT02A_AUDIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wav_reader.h"
+
+#define BSP_ERROR_NONE                 0
+#define BSP_ERROR_WRONG_PARAM         -2
+
+#define AUDIO_IN_DEVICE_DIGITAL_MIC1   0x10U
+#define AUDIO_FREQUENCY_16K            16000U
+#define AUDIO_RESOLUTION_16B           16U
+
+typedef struct
+{
+  uint32_t Device;
+  uint32_t SampleRate;
+  uint32_t BitsPerSample;
+  uint32_t ChannelsNbr;
+  uint32_t Volume;
+} BSP_AUDIO_Init_t;
+
+int32_t BSP_AUDIO_IN_Init(uint32_t Instance, BSP_AUDIO_Init_t* AudioInit);
+int32_t BSP_AUDIO_IN_Record(uint32_t Instance, uint8_t* pData, uint32_t NbrOfBytes);
+int32_t BSP_AUDIO_IN_Stop(uint32_t Instance);
+
+void BSP_AUDIO_IN_HalfTransfer_CallBack(uint32_t Instance);
+void BSP_AUDIO_IN_TransferComplete_CallBack(uint32_t Instance);
+
+/**
+ * @brief Use an open WAV file as the microphone signal.
+ *
+ * @param[in] reader Open reader, must be 16 kHz mono 16-bit PCM.
+ *
+ * @return true if the file format matches the capture format, false otherwise.
+ */
+bool BspAudioReplay_Attach(WavReader_t* reader);
+
+/**
+ * @brief Fill the next half of the capture buffer and fire its DMA callback.
+ *
+ * A partially available last half is padded with silence.
+ *
+ * @return true if an event was produced, false at the end of the file or if
+ *         no capture is running.
+ */
+bool BspAudioReplay_Step(void);
+
+#endif // B_U585I_IOT02A_AUDIO_H
@@ -0,0 +1,38 @@
+/**
+ * @file decision_compare.h
+ * @brief Decisions of sound_decision.c against the float arithmetic they replace.
+ */
+
+#ifndef DECISION_COMPARE_H
+#define DECISION_COMPARE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Check that SoundDecision_Evaluate() decides as the original float
+ *        arithmetic and print the number of differences on stdout.
+ *
+ * The reference adds offset / 100.0F to each score and converts the best one
+ * with (int)(100.0 * score), every frame. Checked are:
+ *
+ *  - SoundDecision_ToPercent() on every float within 1024 ULPs of each
+ *    confidence level, and on random scores,
+ *  - the class, confidence and outcome of random score vectors, many of
+ *    them on the confidence levels, under random offsets and thresholds
+ *    changed between the vectors,
+ *  - the decoding by decision_config.c of the records of the decision
+ *    parameters: saved, never saved, the 1-byte default of the KVStore
+ *    entry, truncated and with a bit flipped.
+ *
+ * SoundDecision_Init() must have been called. The parameters of the
+ * decision are modified.
+ *
+ * @param[in] labels Class labels passed to SoundDecision_Init().
+ * @param[in] vectors Number of random score vectors.
+ * @param[in] seed Seed of the random generator.
+ *
+ * @return 0 if every decision is identical and every record decoded as expected, 3 otherwise.
+ */
+int DecisionCompare_Run(const char* const* labels, uint32_t vectors, uint32_t seed);
+
+#endif // DECISION_COMPARE_H
@@ -0,0 +1,63 @@
+/**
+ * @file logging.h
+ * @brief Host stand-in for the firmware logging macros.
+ *
+ * Messages are written to stderr so that stdout only carries the replay
+ * results. The LOG_LEVEL defined by each module before including this header
+ * is honoured, and HostLog_SetLevel() lowers it further at run time.
+ */
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include "logging_levels.h"
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_ERROR
+#endif
+
+/**
+ * @brief Set the maximum level of the messages printed at run time.
+ */
+void HostLog_SetLevel(int level);
+
+/**
+ * @brief Print one log message if its level is enabled at run time.
+ */
+void HostLog_Printf(int level, const char* level_name, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif // LOGGING_H
+
+/* The macros are redefined on every inclusion as LOG_LEVEL is set per module */
+#undef LogError
+#undef LogWarn
+#undef LogInfo
+#undef LogDebug
+#undef LogSys
+
+#if LOG_LEVEL >= LOG_ERROR
+#define LogError(...) HostLog_Printf(LOG_ERROR, "ERR", __VA_ARGS__)
+#else
+#define LogError(...)
+#endif
+
+#if LOG_LEVEL >= LOG_WARN
+#define LogWarn(...) HostLog_Printf(LOG_WARN, "WRN", __VA_ARGS__)
+#else
+#define LogWarn(...)
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define LogInfo(...) HostLog_Printf(LOG_INFO, "INF", __VA_ARGS__)
+#else
+#define LogInfo(...)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define LogDebug(...) HostLog_Printf(LOG_DEBUG, "DBG", __VA_ARGS__)
+#else
+#define LogDebug(...)
+#endif
+
+#define LogSys(...) HostLog_Printf(LOG_NONE, "SYS", __VA_ARGS__)
@@ -0,0 +1,15 @@
+/**
+ * @file logging_levels.h
+ * @brief Host stand-in for the firmware logging levels.
+ */
+
+#ifndef LOGGING_LEVELS_H
+#define LOGGING_LEVELS_H
+
+#define LOG_NONE     0
+#define LOG_ERROR    1
+#define LOG_WARN     2
+#define LOG_INFO     3
+#define LOG_DEBUG    4
+
+#endif // LOGGING_LEVELS_H
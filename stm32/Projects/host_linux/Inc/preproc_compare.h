@@ -0,0 +1,32 @@
+/**
+ * @file preproc_compare.h
+ * @brief Accuracy of the fixed-point log-mel columns against the float ones.
+ */
+
+#ifndef PREPROC_COMPARE_H
+#define PREPROC_COMPARE_H
+
+#include <stdint.h>
+
+#include "preproc_dpu.h"
+#include "wav_reader.h"
+
+/**
+ * @brief Compute every column of a WAV file with both LogMelSpectrogramColumn()
+ *        and LogMelFixed_ColumnQuantized() and print the differences on stdout.
+ *
+ * The differences are measured on the log-mel values, on the quantized
+ * network input and on the spectrum sum used by the silence detection,
+ * along with the time spent per column by each implementation.
+ *
+ * @param[in] reader WAV file positioned at the start of the PCM data.
+ * @param[in] proc Preprocessing context, initialized by PreProc_DPUInit() and
+ *                 with the output quantization parameters set.
+ * @param[in] tolerance Largest accepted difference of a quantized value.
+ *
+ * @return 0 if all quantized values are within the tolerance, 1 on error,
+ *         3 otherwise.
+ */
+int PreprocCompare_Run(WavReader_t* reader, AudioProcCtx_t* proc, uint32_t tolerance);
+
+#endif // PREPROC_COMPARE_H
@@ -0,0 +1,21 @@
+/**
+ * @file queue.h
+ * @brief Host stand-in for the FreeRTOS queues, over POSIX threads.
+ *
+ * Items are copied in and out as with FreeRTOS. Only the calls used by the
+ * shared application code are provided, from threads only (no ISR variants).
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
+
+#endif // QUEUE_H
@@ -0,0 +1,66 @@
+/**
+ * @file wav_reader.h
+ * @brief Minimal reader for RIFF/WAVE PCM files.
+ */
+
+#ifndef WAV_READER_H
+#define WAV_READER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief State of an open WAV file.
+ */
+typedef struct {
+    FILE* file;                 ///< Underlying file handle
+    uint32_t sample_rate;       ///< Sample rate in Hz
+    uint16_t channels;          ///< Number of interleaved channels
+    uint16_t bits_per_sample;   ///< Sample resolution in bits
+    uint32_t data_size;         ///< Size of the PCM data chunk in bytes
+    uint32_t data_remaining;    ///< Number of PCM bytes not read yet
+    long data_offset;           ///< File offset of the PCM data chunk
+} WavReader_t;
+
+/**
+ * @brief Open a WAV file and position the reader at the start of the PCM data.
+ *
+ * Only uncompressed PCM files are supported.
+ *
+ * @param[out] reader Reader state to initialize.
+ * @param[in] path Path of the WAV file.
+ *
+ * @return true on success, false if the file cannot be opened or is not a PCM WAV file.
+ */
+bool WavReader_Open(WavReader_t* reader, const char* path);
+
+/**
+ * @brief Read raw PCM bytes.
+ *
+ * @param[in] reader Reader state.
+ * @param[out] buffer Destination buffer.
+ * @param[in] size Number of bytes to read.
+ *
+ * @return Number of bytes read, 0 at the end of the data chunk.
+ */
+size_t WavReader_Read(WavReader_t* reader, uint8_t* buffer, size_t size);
+
+/**
+ * @brief Rewind the reader to the start of the PCM data.
+ *
+ * @param[in] reader Reader state.
+ *
+ * @return true on success, false otherwise.
+ */
+bool WavReader_Rewind(WavReader_t* reader);
+
+/**
+ * @brief Close the WAV file.
+ *
+ * @param[in] reader Reader state.
+ */
+void WavReader_Close(WavReader_t* reader);
+
+#endif // WAV_READER_H
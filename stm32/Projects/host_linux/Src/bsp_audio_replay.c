@@ -0,0 +1,100 @@
+/**
+ * @file bsp_audio_replay.c
+ * @brief Host replacement of the BSP audio input driver that replays a WAV file.
+ *
+ * On target the SAI DMA fills the capture buffer in circular mode and raises
+ * a half transfer event followed by a transfer complete event. This module
+ * reproduces that sequence synchronously: each step copies the next half of
+ * the buffer from the WAV file and calls the matching BSP callback.
+ *
+ * Unlike the DMA, a step only writes a half when it is called, never while
+ * the caller reads it, so the replay cannot show audio overwritten under the
+ * reader. On target the DMA starts refilling the previous half as soon as it
+ * raises an event: this is why, after an overrun, the tracker hands out the
+ * latest half only, and counts the previous one as dropped even though the
+ * replay still holds it intact.
+ */
+
+#include <string.h>
+#include "b_u585i_iot02a_audio.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Capture format expected by the preprocessing */
+#define REPLAY_CHANNELS         1U
+#define REPLAY_BITS_PER_SAMPLE  AUDIO_RESOLUTION_16B
+
+/* ============================ Static Variables ============================ */
+
+static WavReader_t* s_reader = NULL;
+static uint8_t* s_buffer = NULL;
+static uint32_t s_buffer_size = 0;
+static bool s_next_is_half = true;
+
+/* ============================ Function Implementations ============================ */
+
+int32_t BSP_AUDIO_IN_Init(uint32_t Instance, BSP_AUDIO_Init_t* AudioInit) {
+    if (Instance != 0 || AudioInit == NULL || AudioInit->SampleRate != AUDIO_FREQUENCY_16K) {
+        return BSP_ERROR_WRONG_PARAM;
+    }
+    return BSP_ERROR_NONE;
+}
+
+int32_t BSP_AUDIO_IN_Record(uint32_t Instance, uint8_t* pData, uint32_t NbrOfBytes) {
+    /* Both halves must hold a whole number of 16-bit samples */
+    if (Instance != 0 || pData == NULL || NbrOfBytes == 0 || (NbrOfBytes % 4U) != 0) {
+        return BSP_ERROR_WRONG_PARAM;
+    }
+
+    s_buffer = pData;
+    s_buffer_size = NbrOfBytes;
+    s_next_is_half = true;
+    return BSP_ERROR_NONE;
+}
+
+int32_t BSP_AUDIO_IN_Stop(uint32_t Instance) {
+    (void)Instance;
+    s_buffer = NULL;
+    s_buffer_size = 0;
+    return BSP_ERROR_NONE;
+}
+
+bool BspAudioReplay_Attach(WavReader_t* reader) {
+    if (reader == NULL ||
+        reader->sample_rate != AUDIO_FREQUENCY_16K ||
+        reader->channels != REPLAY_CHANNELS ||
+        reader->bits_per_sample != REPLAY_BITS_PER_SAMPLE) {
+        return false;
+    }
+
+    s_reader = reader;
+    return true;
+}
+
+bool BspAudioReplay_Step(void) {
+    if (s_reader == NULL || s_buffer == NULL) {
+        return false;
+    }
+
+    uint32_t half_size = s_buffer_size / 2U;
+    uint8_t* half = s_next_is_half ? s_buffer : (s_buffer + half_size);
+
+    size_t read = WavReader_Read(s_reader, half, half_size);
+    if (read == 0) {
+        return false;
+    }
+
+    /* Pad the last partial transfer with silence */
+    if (read < half_size) {
+        memset(&half[read], 0, half_size - read);
+    }
+
+    if (s_next_is_half) {
+        s_next_is_half = false;
+        BSP_AUDIO_IN_HalfTransfer_CallBack(0);
+    } else {
+        s_next_is_half = true;
+        BSP_AUDIO_IN_TransferComplete_CallBack(0);
+    }
+    return true;
+}
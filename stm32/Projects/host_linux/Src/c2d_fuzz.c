@@ -0,0 +1,395 @@
+/**
+ * @file c2d_fuzz.c
+ * @brief Robustness and dispatch time of the cloud-to-device command parsing.
+ *
+ * Checks c2d_command.c against a list of known payloads, then against
+ * generated envelopes whose extra members, escapes and spacing vary, and
+ * finally feeds it mutations of them: bit flips, truncations, insertions and
+ * random bytes. Each payload is copied into a buffer of exactly its length,
+ * so a build with -fsanitize=address catches any access past its end.
+ *
+ * The dispatch time is then measured for payloads of growing size, the
+ * command coming last, against the strstr chain of mic_sensor_publish.c it
+ * replaces, with the vectorised strstr of the host C library and with a
+ * byte loop as in newlib-nano on target.
+ *
+ * Usage: c2d_fuzz [-n mutations] [-s seed]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app/c2d/c2d_command.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Default number of mutated payloads */
+#define DEFAULT_MUTATIONS 2000000U
+
+/* Largest generated payload */
+#define MAX_PAYLOAD_LEN 4096U
+
+/* Number of dispatches timed per payload size */
+#define BENCH_ROUNDS 20000U
+
+#define ARRAY_LEN(array) (sizeof(array) / sizeof((array)[0]))
+
+/* ============================ Static Variables ============================ */
+
+static uint32_t s_calls = 0;
+static C2dArgs_t s_last_args;
+static char s_last_text[C2D_COMMAND_MAX_LEN];
+
+static uint64_t s_rng = 0x2545F4914F6CDD1DULL;
+
+/* ============================ Function Implementations ============================ */
+
+static bool record_args(const C2dArgs_t* args) {
+    s_calls++;
+    s_last_args = *args;
+    snprintf(s_last_text, sizeof(s_last_text), "%s", args->text);
+    return true;
+}
+
+static bool refuse(const C2dArgs_t* args) {
+    (void)record_args(args);
+    return false;
+}
+
+/* Same schemas as mic_sensor_publish.c with 6 classes */
+static const C2dCommand_t s_commands[] = {
+    { "set-confidence-offsets", C2D_ARGS_INTS, 6, 6, record_args, "<offset> x 6" },
+    { "set-confidence-threshold", C2D_ARGS_INTS, 1, 1, record_args, "<percent>" },
+    { "set-inactivity-timeout", C2D_ARGS_INTS, 1, 1, record_args, "<ms>" },
+    { "set-class-timeouts", C2D_ARGS_INTS, 6, 6, record_args, "<ms> x 6" },
+    { "set-inference-stride", C2D_ARGS_INTS, 1, 1, record_args, "<columns>" },
+    { "set-score-smoothing", C2D_ARGS_TEXT, 0, 0, record_args, "none | ema <alpha> | median <n> | vote <k> <n>" },
+    { "set-hysteresis", C2D_ARGS_INTS, 1, 1, record_args, "<percent>" },
+    { "set-max-labels", C2D_ARGS_INTS, 1, 1, record_args, "<count>" },
+    { "set-telemetry-format", C2D_ARGS_TEXT, 0, 0, record_args, "json | cbor" },
+    { "set-detection-batch", C2D_ARGS_INTS, 2, 2, record_args, "<detections> <window_ms>" },
+    { "retrain_start", C2D_ARGS_INTS, 1, 1, record_args, "<class>" },
+    { "creds_s3", C2D_ARGS_TEXT, 0, 0, record_args, "<endpoint> <api key>" },
+    { "refused", C2D_ARGS_NONE, 0, 0, refuse, "" },
+};
+
+typedef struct {
+    const char* payload;
+    C2dResult_t result;
+    const char* name;       ///< Command expected, NULL if none
+    uint32_t count;         ///< Integers expected
+    int values[6];
+    const char* text;       ///< Text expected
+} KnownCase_t;
+
+static const KnownCase_t s_known[] = {
+    { "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-confidence-threshold 22\"}", C2D_OK, "set-confidence-threshold", 1, { 22 }, "" },
+    { " { \"cmd\" : \"set-max-labels  3 \" , \"ct\" : 0 } ", C2D_OK, "set-max-labels", 1, { 3 }, "" },
+    { "{\"v\":\"2.1\",\"ct\":0,\"cmd\":\"set-confidence-offsets 1 -2 3 -4 5 -6\",\"ack\":\"a1b2\"}",
+      C2D_OK, "set-confidence-offsets", 6, { 1, -2, 3, -4, 5, -6 }, "" },
+    { "set-confidence-offsets 0, -45, -19, 39, 27, -25", C2D_OK, "set-confidence-offsets", 6,
+      { 0, -45, -19, 39, 27, -25 }, "" },
+    { "set-class-timeouts 1000, 30000, 30000, 10000, 5000, 5000", C2D_OK, "set-class-timeouts", 6,
+      { 1000, 30000, 30000, 10000, 5000, 5000 }, "" },
+    { "{\"cmd\":\"set-class-timeouts 1,2 ,3 , 4  ,5,6\"}", C2D_OK, "set-class-timeouts", 6, { 1, 2, 3, 4, 5, 6 }, "" },
+    { "{\"cmd\":\"set-detection-batch 5 3000\"}", C2D_OK, "set-detection-batch", 2, { 5, 3000 }, "" },
+    { "{\"cmd\":\"set-score-smoothing vote 3 5\"}", C2D_OK, "set-score-smoothing", 0, { 0 }, "vote 3 5" },
+    { "{\"cmd\":\"creds_s3 {\\\"endpoint\\\": \\\"https:\\/\\/x\\\"}\"}", C2D_OK, "creds_s3", 0, { 0 },
+      "{\"endpoint\": \"https://x\"}" },
+    { "{\"x\":{\"cmd\":\"set-hysteresis 1\",\"y\":[1,2.5e3,true,null,{}]},\"cmd\":\"set-hysteresis 4\"}",
+      C2D_OK, "set-hysteresis", 1, { 4 }, "" },
+    { "set-telemetry-format cbor", C2D_OK, "set-telemetry-format", 0, { 0 }, "cbor" },
+    { "{\"cmd\":\"set-telemetry-\\u0066ormat json\"}", C2D_OK, "set-telemetry-format", 0, { 0 }, "json" },
+    { "{\"cmd\":\"retrain_start -2147483648\"}", C2D_OK, "retrain_start", 1, { -2147483647 - 1 }, "" },
+    { "{\"cmd\":\"refused\"}", C2D_FAILED, "refused", 0, { 0 }, "" },
+    { "{\"cmd\":\"set-confidence-threshold\"}", C2D_BAD_ARGUMENTS, "set-confidence-threshold", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-confidence-threshold 22 23\"}", C2D_BAD_ARGUMENTS, "set-confidence-threshold", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-confidence-threshold 22abc\"}", C2D_BAD_ARGUMENTS, "set-confidence-threshold", 0, { 0 }, NULL },
+    { "{\"cmd\":\"retrain_start 2147483648\"}", C2D_BAD_ARGUMENTS, "retrain_start", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-confidence-offsets 1 2 3 4 5\"}", C2D_BAD_ARGUMENTS, "set-confidence-offsets", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-class-timeouts 1, 2, 3, 4, 5, 6,\"}", C2D_BAD_ARGUMENTS, "set-class-timeouts", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-class-timeouts 1, 2,, 3, 4, 5, 6\"}", C2D_BAD_ARGUMENTS, "set-class-timeouts", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-class-timeouts , 1, 2, 3, 4, 5, 6\"}", C2D_BAD_ARGUMENTS, "set-class-timeouts", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-telemetry-format\"}", C2D_BAD_ARGUMENTS, "set-telemetry-format", 0, { 0 }, NULL },
+    { "{\"cmd\":\"refused now\"}", C2D_BAD_ARGUMENTS, "refused", 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-confidence\"}", C2D_UNKNOWN_COMMAND, NULL, 0, { 0 }, NULL },
+    { "{\"cmd\":\"\"}", C2D_UNKNOWN_COMMAND, NULL, 0, { 0 }, NULL },
+    { "{\"v\":\"2.1\",\"ct\":0}", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-max-labels 3\"", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-max-labels 3}", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-max-labels 3\"} x", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-max-labels\\u0000 3\"}", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "{\"cmd\":\"set-max-labels \\q\"}", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "{\"a\":[[[[[[[[[[1]]]]]]]]]],\"cmd\":\"set-max-labels 3\"}", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+    { "", C2D_BAD_ENVELOPE, NULL, 0, { 0 }, NULL },
+};
+
+static uint32_t rng_next(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng >> 32);
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/* Dispatch a copy of the payload in a buffer of exactly its length */
+static C2dResult_t dispatch_exact(const char* payload, size_t length, C2dEnvelope_t* envelope,
+                                  const C2dCommand_t** command) {
+    char* copy = malloc(length > 0U ? length : 1U);
+    memcpy(copy, payload, length);
+    C2dResult_t result = C2dCommand_Dispatch(s_commands, ARRAY_LEN(s_commands), copy, length, envelope, command);
+    free(copy);
+    return result;
+}
+
+static bool check_known(void) {
+    C2dEnvelope_t envelope;
+    const C2dCommand_t* command;
+    bool ok = true;
+
+    for (size_t i = 0; i < ARRAY_LEN(s_known); i++) {
+        const KnownCase_t* known = &s_known[i];
+        uint32_t calls = s_calls;
+        C2dResult_t result = dispatch_exact(known->payload, strlen(known->payload), &envelope, &command);
+        bool called = (s_calls != calls);
+        bool same = (result == known->result)
+            && ((command == NULL) ? (known->name == NULL) : (known->name != NULL && 0 == strcmp(command->name, known->name)))
+            && (called == (result == C2D_OK || result == C2D_FAILED));
+        if (same && called) {
+            same = (s_last_args.count == known->count)
+                && 0 == memcmp(s_last_args.values, known->values, known->count * sizeof(int))
+                && 0 == strcmp(s_last_text, known->text);
+        }
+        if (!same) {
+            fprintf(stderr, "%s: %s, expected %s\n", known->payload, C2dCommand_ResultName(result),
+                    C2dCommand_ResultName(known->result));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* Append text to a payload, escaping some characters at random */
+static size_t append_escaped(char* payload, size_t pos, const char* text) {
+    for (; *text != '\0'; text++) {
+        uint32_t choice = rng_next() % 8U;
+        if (*text == '"' || *text == '\\') {
+            pos += (size_t)sprintf(&payload[pos], "\\%c", *text);
+        } else if (choice == 0U) {
+            pos += (size_t)sprintf(&payload[pos], "\\u%04x", (unsigned)(uint8_t)*text);
+        } else if (choice == 1U && *text == '/') {
+            pos += (size_t)sprintf(&payload[pos], "\\/");
+        } else {
+            payload[pos++] = *text;
+        }
+    }
+    return pos;
+}
+
+static const char* random_spaces(void) {
+    static const char* const spaces[] = { "", "", "", " ", "\r\n", "\t " };
+    return spaces[rng_next() % ARRAY_LEN(spaces)];
+}
+
+/* Envelope of a command line with random extra members, return its length */
+static size_t generate_envelope(char* payload, const char* line) {
+    static const char* const extras[] = {
+        "\"v\":\"2.1\"", "\"ct\":0", "\"ack\":\"7f0e6f1a-9d2b\"", "\"cmd_id\":12",
+        "\"d\":{\"cmd\":\"set-max-labels 1\",\"a\":[1,-2.5E-3,\"x\\\"y\",false,null]}", "\"t\":[]", "\"o\":{}"
+    };
+    size_t pos = (size_t)sprintf(payload, "%s{", random_spaces());
+    uint32_t before = rng_next() % 3U;
+    uint32_t after = rng_next() % 3U;
+
+    for (uint32_t i = 0; i < before; i++) {
+        pos += (size_t)sprintf(&payload[pos], "%s%s%s,", random_spaces(), extras[rng_next() % ARRAY_LEN(extras)],
+                               random_spaces());
+    }
+    pos += (size_t)sprintf(&payload[pos], "%s\"cmd\"%s:%s\"", random_spaces(), random_spaces(), random_spaces());
+    pos = append_escaped(payload, pos, line);
+    pos += (size_t)sprintf(&payload[pos], "\"%s", random_spaces());
+    for (uint32_t i = 0; i < after; i++) {
+        pos += (size_t)sprintf(&payload[pos], ",%s%s", random_spaces(), extras[rng_next() % ARRAY_LEN(extras)]);
+    }
+    pos += (size_t)sprintf(&payload[pos], "}%s", random_spaces());
+    return pos;
+}
+
+static const char* const s_lines[] = {
+    "set-confidence-threshold 22", "set-confidence-offsets 1 2 3 4 5 6", "set-class-timeouts 0 0 3000 0 0 1",
+    "set-inference-stride 16", "set-score-smoothing ema 0.5", "set-hysteresis 5", "set-max-labels 3",
+    "set-telemetry-format cbor", "set-detection-batch 5 3000", "retrain_start 2",
+    "creds_s3 https://abc.execute-api.us-west-2.amazonaws.com/prod A5A5-A5A5", "set-inactivity-timeout 60000",
+};
+
+static bool check_generated(uint32_t count) {
+    char payload[MAX_PAYLOAD_LEN];
+    C2dEnvelope_t envelope;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char* line = s_lines[rng_next() % ARRAY_LEN(s_lines)];
+        size_t length = generate_envelope(payload, line);
+        C2dResult_t result = dispatch_exact(payload, length, &envelope, NULL);
+        if (result != C2D_OK || 0 != strcmp(envelope.command, line)) {
+            fprintf(stderr, "%.*s: %s, command \"%s\"\n", (int)length, payload, C2dCommand_ResultName(result),
+                    envelope.command);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void mutate(char* payload, size_t* length) {
+    uint32_t mutations = 1U + rng_next() % 4U;
+
+    for (uint32_t m = 0; m < mutations && *length > 0U; m++) {
+        size_t pos = rng_next() % *length;
+        switch (rng_next() % 5U) {
+        case 0:
+            payload[pos] ^= (char)(1U << (rng_next() % 8U));
+            break;
+        case 1:
+            *length = pos;
+            break;
+        case 2:
+            if (*length < MAX_PAYLOAD_LEN) {
+                memmove(&payload[pos + 1U], &payload[pos], *length - pos);
+                payload[pos] = "\"\\{}[]:,u0 \x00"[rng_next() % 13U];
+                (*length)++;
+            }
+            break;
+        case 3:
+            memmove(&payload[pos], &payload[pos + 1U], *length - pos - 1U);
+            (*length)--;
+            break;
+        default:
+            payload[pos] = (char)rng_next();
+            break;
+        }
+    }
+}
+
+static void fuzz(uint32_t count, uint32_t results[]) {
+    char payload[MAX_PAYLOAD_LEN];
+    C2dEnvelope_t envelope;
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t length = generate_envelope(payload, s_lines[rng_next() % ARRAY_LEN(s_lines)]);
+        mutate(payload, &length);
+        C2dResult_t result = dispatch_exact(payload, length, &envelope, NULL);
+        results[result]++;
+    }
+}
+
+/* strstr as a byte loop, as newlib-nano built for size has it */
+static char* bytewise_strstr(const char* haystack, const char* needle) {
+    for (; *haystack != '\0'; haystack++) {
+        size_t i = 0;
+        while (needle[i] != '\0' && haystack[i] == needle[i]) {
+            i++;
+        }
+        if (needle[i] == '\0') {
+            return (char*)haystack;
+        }
+    }
+    return NULL;
+}
+
+/* The strstr chain of on_c2d_message, with its sscanf */
+static bool legacy_dispatch(char* payload, size_t length, char* (*find)(const char*, const char*)) {
+    static const char* const names[] = {
+        "set-confidence-offsets ", "set-confidence-threshold ", "set-inactivity-timeout ", "set-class-timeouts ",
+        "set-inference-stride ", "set-score-smoothing ", "set-hysteresis ", "set-max-labels ",
+        "set-telemetry-format ", "set-detection-batch ", "retrain_start", "creds_s3"
+    };
+    int value;
+
+    payload[length] = '\0';
+    for (size_t i = 0; i < ARRAY_LEN(names); i++) {
+        const char* pos = find(payload, names[i]);
+        if (pos != NULL) {
+            return 1 == sscanf(find(payload, names[i]) + strlen(names[i]), "%d", &value);
+        }
+    }
+    return false;
+}
+
+static void bench(void) {
+    static char payload[16384 + 64];
+    C2dEnvelope_t envelope;
+    volatile uint32_t sink = 0;
+
+    printf("%-8s %12s %12s %12s\n", "bytes", "table ns", "strstr ns", "bytewise ns");
+    for (size_t size = 64; size <= 16384; size *= 4) {
+        // the longest padding member the size allows, the command last as the worst case of the chain
+        const char* tail = "\"cmd\":\"set-inactivity-timeout 60000\"}";
+        size_t pad = size - strlen("{\"p\":\"\",") - strlen(tail);
+        size_t length = (size_t)sprintf(payload, "{\"p\":\"");
+        memset(&payload[length], '.', pad);
+        length += pad;
+        length += (size_t)sprintf(&payload[length], "\",%s", tail);
+
+        uint64_t start = get_time_ns();
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+            sink += (uint32_t)C2dCommand_Dispatch(s_commands, ARRAY_LEN(s_commands), payload, length, &envelope, NULL);
+        }
+        uint64_t table_ns = get_time_ns() - start;
+
+        start = get_time_ns();
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+            sink += (uint32_t)legacy_dispatch(payload, length, strstr);
+        }
+        uint64_t legacy_ns = get_time_ns() - start;
+
+        start = get_time_ns();
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+            sink += (uint32_t)legacy_dispatch(payload, length, bytewise_strstr);
+        }
+        uint64_t bytewise_ns = get_time_ns() - start;
+
+        printf("%-8zu %12.1f %12.1f %12.1f\n", length, (double)table_ns / BENCH_ROUNDS,
+               (double)legacy_ns / BENCH_ROUNDS, (double)bytewise_ns / BENCH_ROUNDS);
+    }
+    (void)sink;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t mutations = DEFAULT_MUTATIONS;
+    uint32_t results[C2D_FAILED + 1] = { 0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-n") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            mutations = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc) {
+            s_rng ^= strtoull(argv[++i], NULL, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [-n mutations] [-s seed]\n", argv[0]);
+            fprintf(stderr, "  -n  number of mutated payloads (default %u)\n", (unsigned)DEFAULT_MUTATIONS);
+            fprintf(stderr, "  -s  seed of the generated payloads\n");
+            return 2;
+        }
+    }
+
+    if (!check_known() || !check_generated(mutations / 10U + 1U)) {
+        return 3;
+    }
+    printf("known payloads: %zu, generated envelopes: %u, ok\n", ARRAY_LEN(s_known), (unsigned)(mutations / 10U + 1U));
+
+    fuzz(mutations, results);
+    printf("mutated payloads: %u\n", (unsigned)mutations);
+    for (int r = 0; r <= C2D_FAILED; r++) {
+        printf("  %-18s %u\n", C2dCommand_ResultName((C2dResult_t)r), (unsigned)results[r]);
+    }
+
+    bench();
+    return 0;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file decision_compare.c
+ * @brief Decisions of sound_decision.c against the float arithmetic they replace.
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decision_compare.h"
+#include "app/audio/sound_decision.h"
+#include "app/audio/decision_config.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Number of floats checked on each side of a confidence level */
+#define LEVEL_ULPS 1024
+
+/* Number of random scores checked by the percent conversion */
+#define RANDOM_PERCENT_SCORES 1000000U
+
+/* Number of score vectors evaluated between two changes of the parameters */
+#define VECTORS_PER_PARAMETERS 64U
+
+/* Offsets in a record of the decision parameters, see decision_config.c */
+#define RECORD_CLASSES_OFFSET 5U
+#define RECORD_HEADER_SIZE 12U
+
+/* ============================ Static Variables ============================ */
+
+static uint32_t s_random_state;
+static int s_offsets[SOUND_DECISION_CLASS_NUMBER];
+static int s_threshold;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t prvRandom(void) {
+    // xorshift32, the state must not be 0
+    s_random_state ^= s_random_state << 13;
+    s_random_state ^= s_random_state >> 17;
+    s_random_state ^= s_random_state << 5;
+    return s_random_state;
+}
+
+static float prvRandomScore(void) {
+    return (float)(prvRandom() >> 8) / (float)(1U << 24);
+}
+
+static int prvRandomRange(int min, int max) {
+    return min + (int)(prvRandom() % (uint32_t)(max - min + 1));
+}
+
+static float prvNudge(float value, int ulps) {
+    while (ulps > 0) {
+        value = nextafterf(value, INFINITY);
+        ulps--;
+    }
+    while (ulps < 0) {
+        value = nextafterf(value, -INFINITY);
+        ulps++;
+    }
+    return value;
+}
+
+/* The percent conversion of sound_decision.c before the levels */
+static int prvReferencePercent(float score) {
+    int percent = (int)(100.0 * score);
+    if (percent > 100) {
+        percent = 100;
+    } else if (percent < 0) {
+        percent = 0;
+    }
+    return percent;
+}
+
+/* The decision of sound_decision.c before the levels, without inactivity timeout nor hysteresis */
+static void prvReferenceEvaluate(const float* scores, const char* const* labels, SoundDecision_t* decision) {
+    uint32_t max_idx = 0;
+    float max_out = scores[0] + ((float)s_offsets[0]) / 100.0F;
+
+    for (uint32_t i = 1; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        float class_out = scores[i] + ((float)s_offsets[i] / 100.0F);
+        if (class_out > max_out) {
+            max_idx = i;
+            max_out = class_out;
+        }
+    }
+
+    decision->class_idx = max_idx;
+    decision->class_name = labels[max_idx];
+    decision->confidence_percent = prvReferencePercent(max_out);
+    if (0 == strcmp("other", labels[max_idx])) {
+        decision->outcome = SOUND_DECISION_OTHER;
+    } else if (decision->confidence_percent < s_threshold) {
+        decision->outcome = SOUND_DECISION_LOW_CONFIDENCE;
+    } else {
+        decision->outcome = SOUND_DECISION_DETECTED;
+    }
+}
+
+static bool prvCheckPercent(float score) {
+    int expected = prvReferencePercent(score);
+    int actual = SoundDecision_ToPercent(score);
+    if (actual != expected) {
+        LogError("Score %.9g: confidence %d instead of %d.", (double)score, actual, expected);
+        return false;
+    }
+    return true;
+}
+
+static void prvRandomParameters(void) {
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        s_offsets[i] = prvRandomRange(-60, 60);
+    }
+    s_threshold = prvRandomRange(-5, 105);
+    SoundDecision_SetOffsets(s_offsets);
+    SoundDecision_SetThreshold(s_threshold);
+}
+
+/* Random scores, some of them on a confidence level once the offset is added, some tied */
+static void prvRandomVector(float* scores) {
+    for (uint32_t i = 0; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+        scores[i] = prvRandomScore();
+    }
+
+    uint32_t kind = prvRandom() % 4U;
+    uint32_t class_idx = prvRandom() % SOUND_DECISION_CLASS_NUMBER;
+    if (kind == 1U || kind == 2U) {
+        int percent = (kind == 1U) ? s_threshold : prvRandomRange(0, 100);
+        float level = ((float)percent - (float)s_offsets[class_idx]) / 100.0F;
+        scores[class_idx] = prvNudge(level, prvRandomRange(-3, 3));
+    } else if (kind == 3U) {
+        scores[(class_idx + 1U) % SOUND_DECISION_CLASS_NUMBER] = scores[class_idx];
+    }
+}
+
+static bool prvCheckRecord(const char* name, const uint8_t* record, size_t length, DecisionConfigResult_t expected) {
+    DecisionConfig_t config;
+    DecisionConfigResult_t actual = DecisionConfig_Decode(record, length, &config);
+    if (actual != expected) {
+        LogError("Record %s: %s instead of %s.", name,
+                 DecisionConfig_ResultName(actual), DecisionConfig_ResultName(expected));
+        return false;
+    }
+    return true;
+}
+
+/* Records of the decision parameters as read from the KVStore */
+static uint32_t prvCheckRecords(uint32_t* checks) {
+    uint8_t record[DECISION_CONFIG_RECORD_SIZE];
+    uint8_t copy[DECISION_CONFIG_RECORD_SIZE];
+    DecisionConfig_t saved;
+    DecisionConfig_t loaded;
+    uint32_t diffs = 0;
+
+    DecisionConfig_Capture(&saved);
+    if (DecisionConfig_Encode(&saved, record, sizeof(record)) != DECISION_CONFIG_RECORD_SIZE) {
+        LogError("Record not encoded.");
+        diffs++;
+    }
+
+    // the default value of the entry, "", may be stored with its terminator
+    diffs += prvCheckRecord("never saved", NULL, 0U, DECISION_CONFIG_EMPTY) ? 0U : 1U;
+    diffs += prvCheckRecord("default", (const uint8_t*)"", 1U, DECISION_CONFIG_EMPTY) ? 0U : 1U;
+    diffs += prvCheckRecord("shorter than a header", record, RECORD_HEADER_SIZE - 1U, DECISION_CONFIG_EMPTY) ? 0U : 1U;
+    diffs += prvCheckRecord("header only", record, RECORD_HEADER_SIZE, DECISION_CONFIG_CORRUPT) ? 0U : 1U;
+    diffs += prvCheckRecord("truncated", record, DECISION_CONFIG_RECORD_SIZE - 1U, DECISION_CONFIG_CORRUPT) ? 0U : 1U;
+    *checks += 5U;
+
+    if (DecisionConfig_Decode(record, DECISION_CONFIG_RECORD_SIZE, &loaded) != DECISION_CONFIG_OK
+            || memcmp(&loaded, &saved, sizeof(saved)) != 0) {
+        LogError("Record saved: not decoded as the parameters encoded.");
+        diffs++;
+    }
+    (*checks)++;
+
+    for (size_t i = 0; i < DECISION_CONFIG_RECORD_SIZE; i++) {
+        memcpy(copy, record, sizeof(copy));
+        copy[i] ^= 0x01U;
+        DecisionConfigResult_t expected = (i == RECORD_CLASSES_OFFSET)
+                                          ? DECISION_CONFIG_OTHER_MODEL : DECISION_CONFIG_CORRUPT;
+        diffs += prvCheckRecord("with a bit flipped", copy, sizeof(copy), expected) ? 0U : 1U;
+        (*checks)++;
+    }
+    return diffs;
+}
+
+int DecisionCompare_Run(const char* const* labels, uint32_t vectors, uint32_t seed) {
+    uint32_t percent_checks = 0;
+    uint32_t percent_diffs = 0;
+    uint32_t decision_diffs = 0;
+    uint32_t outcomes[SOUND_DECISION_HELD + 1] = { 0 };
+    uint32_t now_ms = 0;
+    uint32_t record_checks = 0;
+    uint32_t record_diffs = prvCheckRecords(&record_checks);
+
+    s_random_state = (seed != 0U) ? seed : 1U;
+
+    for (int percent = 0; percent <= 101; percent++) {
+        float level = (float)percent / 100.0F;
+        for (int ulps = -LEVEL_ULPS; ulps <= LEVEL_ULPS; ulps++) {
+            percent_diffs += prvCheckPercent(prvNudge(level, ulps)) ? 0U : 1U;
+            percent_checks++;
+        }
+    }
+    for (uint32_t i = 0; i < RANDOM_PERCENT_SCORES; i++) {
+        float score = 2.0F * prvRandomScore() - 0.5F;
+        percent_diffs += prvCheckPercent(score) ? 0U : 1U;
+        percent_checks++;
+    }
+
+    SoundDecision_SetInactivityTimeout(0);
+    SoundDecision_SetHysteresis(0);
+    for (uint32_t i = 0; i < vectors; i++) {
+        float scores[SOUND_DECISION_CLASS_NUMBER];
+        SoundDecision_t expected;
+        SoundDecision_t actual;
+
+        if ((i % VECTORS_PER_PARAMETERS) == 0U) {
+            prvRandomParameters();
+        }
+
+        prvRandomVector(scores);
+        prvReferenceEvaluate(scores, labels, &expected);
+        bool detected = SoundDecision_Evaluate(scores, now_ms++, &actual);
+
+        if (actual.class_idx != expected.class_idx
+                || actual.confidence_percent != expected.confidence_percent
+                || actual.outcome != expected.outcome
+                || detected != (expected.outcome == SOUND_DECISION_DETECTED)) {
+            LogError("Vector %u: %s %d%% outcome %d instead of %s %d%% outcome %d.",
+                     (unsigned)i, actual.class_name, actual.confidence_percent, (int)actual.outcome,
+                     expected.class_name, expected.confidence_percent, (int)expected.outcome);
+            decision_diffs++;
+        }
+        outcomes[expected.outcome]++;
+    }
+
+    printf("percent conversions: %u, differences: %u\n", (unsigned)percent_checks, (unsigned)percent_diffs);
+    printf("decisions: %u (detected %u, other %u, low-confidence %u), differences: %u\n",
+           (unsigned)vectors,
+           (unsigned)outcomes[SOUND_DECISION_DETECTED],
+           (unsigned)outcomes[SOUND_DECISION_OTHER],
+           (unsigned)outcomes[SOUND_DECISION_LOW_CONFIDENCE],
+           (unsigned)decision_diffs);
+    printf("decision records: %u, differences: %u\n", (unsigned)record_checks, (unsigned)record_diffs);
+
+    return (percent_diffs == 0U && decision_diffs == 0U && record_diffs == 0U) ? 0 : 3;
+}
@@ -0,0 +1,350 @@
+/**
+ * @file detection_log_sim.c
+ * @brief Offline periods, resets and torn writes on the detection log.
+ *
+ * Runs detection_log.c on the RAM storage of detection_log_ram.c through
+ * random link outages: the detections made while the link is down are
+ * appended to the log and taken a few at a time once it is up again, as
+ * mic_sensor_publish.c does. The detections taken are in flight until their
+ * message is acknowledged, which marks them as sent, or fails, which rewinds
+ * the log; the link going down fails them all. Resets, some of them in the
+ * middle of the programming of a record or of its sent mark, rebuild the
+ * log from the storage and lose the detections in flight.
+ *
+ * The detections must be taken in order, and each one marked as sent
+ * exactly once, unless it was dropped as the log was full, in which case it
+ * must be among the oldest ones and counted as overwritten, or it was torn
+ * by a reset. A detection taken again after a rewind is sent twice: its
+ * second acknowledgement must leave the log alone. The erases of each
+ * sector are printed to check that the wear is even.
+ *
+ * Usage: detection_log_sim [-n steps] [-s seed]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app/telemetry/detection_log.h"
+#include "app/telemetry/detection_log_ram.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Same geometry as the firmware */
+#define SECTOR_SIZE 1024U
+#define SECTOR_COUNT 8U
+#define SLOT_COUNT ((SECTOR_SIZE / DETECTION_LOG_RECORD_SIZE) * SECTOR_COUNT)
+
+/* Default number of simulated inference periods */
+#define DEFAULT_STEPS 2000000U
+
+/* Records taken per step while the link is up, as MIC_REPLAY_RECORDS */
+#define REPLAY_RECORDS 4U
+
+/* Detections in flight at most, as in the publish queue slots */
+#define MAX_IN_FLIGHT 8U
+
+/* Odds per step, in 1/1000000 */
+#define DETECTION_ODDS 300000U
+#define LINK_DOWN_ODDS 200U
+#define LINK_UP_ODDS 500U
+#define RESET_ODDS 20U
+#define TEAR_ODDS 500U
+#define DONE_ODDS 400000U
+#define FAIL_ODDS 5000U
+
+/* Labels drawn for a detection, more than the log records */
+#define MAX_DRAWN_LABELS (DETECTION_LOG_MAX_LABELS + 2U)
+
+/* Detections waiting in the model, more than the log holds */
+#define MODEL_SIZE (2U * SLOT_COUNT)
+
+/* ============================ Static Variables ============================ */
+
+typedef struct {
+    DetectionLogEntry_t entry;
+    uint32_t boot;
+} ModelEntry_t;
+
+static uint8_t s_memory[SECTOR_SIZE * SECTOR_COUNT];
+static uint32_t s_erase_counts[SECTOR_COUNT];
+static DetectionLogRam_t s_ram;
+static DetectionLogStorage_t s_storage;
+
+/* Tearing of the next program operation: stop after that many bytes */
+static bool s_tear_armed = false;
+static size_t s_tear_bytes = 0;
+
+/* Detections expected from the log, oldest first, the first ones taken since the last rewind */
+static ModelEntry_t s_model[MODEL_SIZE];
+static uint32_t s_model_count = 0;
+static uint32_t s_model_taken = 0;
+
+/* Detections taken and not acknowledged yet, oldest first */
+static DetectionLogEntry_t s_flight[MAX_IN_FLIGHT];
+static uint32_t s_flight_count = 0;
+
+static uint64_t s_rng = 0x9E3779B97F4A7C15ULL;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t rng_next(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng >> 32);
+}
+
+static bool rng_odds(uint32_t odds) {
+    return (rng_next() % 1000000U) < odds;
+}
+
+/* Program of the RAM storage, torn on request as by a reset */
+static bool tearing_program(void* context, uint32_t address, const void* data, size_t size) {
+    if (!s_tear_armed) {
+        return s_ram.storage.program(context, address, data, size);
+    }
+    s_tear_armed = false;
+    if (size == 1U) {
+        // some bits of the sent mark cleared, not all
+        static const uint8_t partial = 0x07U;
+        (void)s_ram.storage.program(context, address, &partial, 1U);
+    } else {
+        (void)s_ram.storage.program(context, address, data, s_tear_bytes);
+    }
+    return false;
+}
+
+static void model_remove(uint32_t index) {
+    memmove(&s_model[index], &s_model[index + 1U], (s_model_count - index - 1U) * sizeof(s_model[0]));
+    s_model_count--;
+    if (index < s_model_taken) {
+        s_model_taken--;
+    }
+}
+
+static bool model_push(const ModelEntry_t* entry) {
+    if (s_model_count == MODEL_SIZE) {
+        return false;
+    }
+    s_model[s_model_count++] = *entry;
+    return true;
+}
+
+/* Index of a detection in the model, -1 if not there */
+static int model_find(uint32_t sequence) {
+    for (uint32_t i = 0; i < s_model_count; i++) {
+        if (s_model[i].entry.sequence == sequence) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void flight_pop(void) {
+    memmove(&s_flight[0], &s_flight[1], (s_flight_count - 1U) * sizeof(s_flight[0]));
+    s_flight_count--;
+}
+
+static bool same_entry(const DetectionLogEntry_t* a, const DetectionLogEntry_t* b) {
+    if (a->sequence != b->sequence || a->time_ms != b->time_ms || a->label_count != b->label_count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a->label_count; i++) {
+        if (a->labels[i].class_idx != b->labels[i].class_idx || a->labels[i].confidence != b->labels[i].confidence) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t steps = DEFAULT_STEPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-n") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            steps = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc) {
+            s_rng ^= strtoull(argv[++i], NULL, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [-n steps] [-s seed]\n", argv[0]);
+            fprintf(stderr, "  -n  number of simulated inference periods (default %u)\n", (unsigned)DEFAULT_STEPS);
+            fprintf(stderr, "  -s  seed of the random outages, resets and detections\n");
+            return 2;
+        }
+    }
+
+    // blank memory of a new device is not erased
+    memset(s_memory, 0x5A, sizeof(s_memory));
+    DetectionLogRam_Init(&s_ram, s_memory, SECTOR_SIZE, SECTOR_COUNT, s_erase_counts);
+    s_storage = s_ram.storage;
+    s_storage.program = tearing_program;
+    if (!DetectionLog_Init(&s_storage)) {
+        fprintf(stderr, "Unusable log geometry.\n");
+        return 1;
+    }
+
+    bool link_up = true;
+    uint32_t boot = 0;
+    uint32_t detection_seq = 0;
+    uint32_t time_ms = 0;
+    uint32_t logged = 0, replayed = 0, overwritten = 0, torn = 0, resets = 0, max_pending = 0;
+    uint32_t rewinds = 0, resent = 0;
+    uint32_t overwritten_seen = 0;
+
+    for (uint32_t step = 0; step < steps; step++) {
+        time_ms += 1000U;
+        bool reset = false;
+
+        if (link_up ? rng_odds(LINK_DOWN_ODDS) : rng_odds(LINK_UP_ODDS)) {
+            link_up = !link_up;
+            if (!link_up && s_flight_count > 0U) {
+                // the messages in flight fail
+                s_flight_count = 0;
+                s_model_taken = 0;
+                DetectionLog_Rewind();
+                rewinds++;
+            }
+        }
+
+        if (!link_up && rng_odds(DETECTION_ODDS)) {
+            DetectionLogLabel_t labels[MAX_DRAWN_LABELS];
+            ModelEntry_t expected;
+            uint32_t count = 1U + rng_next() % MAX_DRAWN_LABELS;
+
+            for (uint32_t i = 0; i < count; i++) {
+                labels[i].class_idx = (uint8_t)rng_next();
+                labels[i].confidence = (uint8_t)(rng_next() % 101U);
+            }
+            memset(&expected, 0, sizeof(expected));
+            expected.entry.sequence = detection_seq;
+            expected.entry.time_ms = time_ms;
+            expected.entry.label_count = (count < DETECTION_LOG_MAX_LABELS) ? count : DETECTION_LOG_MAX_LABELS;
+            memcpy(expected.entry.labels, labels, expected.entry.label_count * sizeof(labels[0]));
+            expected.boot = boot;
+
+            bool tear = rng_odds(TEAR_ODDS);
+            if (tear) {
+                s_tear_armed = true;
+                s_tear_bytes = 1U + rng_next() % (DETECTION_LOG_RECORD_SIZE - 1U);
+            }
+            bool stored = DetectionLog_Append(detection_seq++, time_ms, labels, count);
+
+            DetectionLogStats_t stats;
+            DetectionLog_GetStats(&stats);
+            for (; overwritten_seen < stats.overwritten; overwritten_seen++) {
+                if (s_model_count == 0U) {
+                    fprintf(stderr, "step %u: more detections overwritten than logged\n", (unsigned)step);
+                    return 3;
+                }
+                model_remove(0);
+                overwritten++;
+            }
+            if (stored) {
+                if (!model_push(&expected)) {
+                    fprintf(stderr, "step %u: the log holds more detections than it can\n", (unsigned)step);
+                    return 3;
+                }
+                logged++;
+            } else if (!tear || s_tear_armed) {
+                fprintf(stderr, "step %u: detection not logged\n", (unsigned)step);
+                return 3;
+            } else {
+                torn++;
+                reset = true;
+            }
+        }
+
+        // acknowledgements, in order
+        while (link_up && !reset && s_flight_count > 0U && rng_odds(DONE_ODDS)) {
+            if (rng_odds(FAIL_ODDS)) {
+                // the messages still in flight may yet be acknowledged
+                flight_pop();
+                s_model_taken = 0;
+                DetectionLog_Rewind();
+                rewinds++;
+                continue;
+            }
+            int index = model_find(s_flight[0].sequence);
+            // a torn mark still counts as sent
+            bool tear = index >= 0 && rng_odds(TEAR_ODDS);
+            s_tear_armed = tear;
+            bool marked = DetectionLog_MarkSent(&s_flight[0]);
+            if (tear) {
+                torn++;
+                reset = true;
+            } else if (marked != (index >= 0)) {
+                fprintf(stderr, "step %u: detection %u %s\n", (unsigned)step, (unsigned)s_flight[0].sequence,
+                        marked ? "marked twice" : "not marked");
+                return 3;
+            }
+            if (index >= 0) {
+                model_remove((uint32_t)index);
+                replayed++;
+            } else {
+                resent++;
+            }
+            flight_pop();
+        }
+
+        for (uint32_t i = 0; link_up && !reset && i < REPLAY_RECORDS && s_flight_count < MAX_IN_FLIGHT; i++) {
+            DetectionLogEntry_t entry;
+            if (!DetectionLog_Take(&entry)) {
+                if (s_model_taken < s_model_count) {
+                    fprintf(stderr, "step %u: detection %u not taken\n", (unsigned)step,
+                            (unsigned)s_model[s_model_taken].entry.sequence);
+                    return 3;
+                }
+                break;
+            }
+            const ModelEntry_t* expected = &s_model[s_model_taken];
+            if (s_model_taken == s_model_count || !same_entry(&entry, &expected->entry)
+                    || entry.current_boot != (expected->boot == boot)) {
+                fprintf(stderr, "step %u: detection %u taken out of order\n",
+                        (unsigned)step, (unsigned)entry.sequence);
+                return 3;
+            }
+            s_model_taken++;
+            s_flight[s_flight_count++] = entry;
+        }
+
+        if (reset || rng_odds(RESET_ODDS)) {
+            resets++;
+            boot++;
+            overwritten_seen = 0;
+            s_flight_count = 0;
+            s_model_taken = 0;
+            if (!DetectionLog_Init(&s_storage)) {
+                fprintf(stderr, "step %u: log not rebuilt\n", (unsigned)step);
+                return 3;
+            }
+        }
+
+        if (DetectionLog_Pending() != s_model_count) {
+            fprintf(stderr, "step %u: %u detections pending, %u expected\n", (unsigned)step,
+                    (unsigned)DetectionLog_Pending(), (unsigned)s_model_count);
+            return 3;
+        }
+        if (s_model_count > max_pending) {
+            max_pending = s_model_count;
+        }
+    }
+
+    uint32_t min_erases = s_erase_counts[0];
+    uint32_t max_erases = s_erase_counts[0];
+    for (uint32_t i = 1; i < SECTOR_COUNT; i++) {
+        min_erases = (s_erase_counts[i] < min_erases) ? s_erase_counts[i] : min_erases;
+        max_erases = (s_erase_counts[i] > max_erases) ? s_erase_counts[i] : max_erases;
+    }
+
+    printf("steps: %u, resets: %u, log: %u records of %u bytes\n",
+           (unsigned)steps, (unsigned)resets, (unsigned)SLOT_COUNT, (unsigned)DETECTION_LOG_RECORD_SIZE);
+    printf("logged: %u, replayed: %u, overwritten: %u, torn: %u, pending: %u, max pending: %u\n",
+           (unsigned)logged, (unsigned)replayed, (unsigned)overwritten, (unsigned)torn,
+           (unsigned)s_model_count, (unsigned)max_pending);
+    printf("rewinds: %u, acknowledged again or once overwritten: %u\n", (unsigned)rewinds, (unsigned)resent);
+    printf("sector erases: min %u, max %u\n", (unsigned)min_erases, (unsigned)max_erases);
+    return 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file host_logging.c
+ * @brief Host implementation of the firmware logging macros.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include "logging.h"
+
+/* ============================ Static Variables ============================ */
+
+static int s_log_level = LOG_INFO;
+
+/* ============================ Function Implementations ============================ */
+
+void HostLog_SetLevel(int level) {
+    s_log_level = level;
+}
+
+void HostLog_Printf(int level, const char* level_name, const char* format, ...) {
+    if (level > s_log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "<%s> ", level_name);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
@@ -0,0 +1,111 @@
+/**
+ * @file host_queue.c
+ * @brief Host stand-in for the FreeRTOS queues, over POSIX threads.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+
+/* ============================ Type Definitions ============================ */
+
+struct HostQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t* storage;
+};
+
+/* ============================ Function Implementations ============================ */
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->storage = calloc(uxQueueLength, uxItemSize);
+    if (queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    return queue;
+}
+
+/* Wait for the queue to change, until the absolute deadline unless waiting forever. Returns false on timeout */
+static bool prvWait(QueueHandle_t queue, TickType_t ticks, const struct timespec* deadline) {
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+        return true;
+    }
+    return pthread_cond_timedwait(&queue->changed, &queue->lock, deadline) != ETIMEDOUT;
+}
+
+static void prvDeadline(TickType_t ticks, struct timespec* deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += (time_t)(ticks / 1000U);
+    deadline->tv_nsec += (long)(ticks % 1000U) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait) {
+    struct timespec deadline;
+    prvDeadline(xTicksToWait, &deadline);
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->length) {
+        if (!prvWait(xQueue, xTicksToWait, &deadline)) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFALSE;
+        }
+    }
+    UBaseType_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+    memcpy(&xQueue->storage[tail * xQueue->item_size], pvItemToQueue, xQueue->item_size);
+    xQueue->count++;
+    pthread_cond_broadcast(&xQueue->changed);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait) {
+    struct timespec deadline;
+    prvDeadline(xTicksToWait, &deadline);
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0) {
+        if (!prvWait(xQueue, xTicksToWait, &deadline)) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFALSE;
+        }
+    }
+    memcpy(pvBuffer, &xQueue->storage[xQueue->head * xQueue->item_size], xQueue->item_size);
+    xQueue->head = (xQueue->head + 1U) % xQueue->length;
+    xQueue->count--;
+    pthread_cond_broadcast(&xQueue->changed);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
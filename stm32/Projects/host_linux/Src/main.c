@@ -0,0 +1,662 @@
+/**
+ * @file main.c
+ * @brief Host replay driver for the mic -> spectrogram -> inference pipeline.
+ *
+ * Runs the same preprocessing, AI and decision code as vMicSensorPublishTask
+ * on a WAV file instead of the board microphone. The DMA half/complete events
+ * are produced by the BSP replay stand-in, one per half buffer, so every frame
+ * sees exactly the audio it would see on target.
+ *
+ * One CSV line per frame is printed on stdout; the per-stage latency
+ * statistics are printed on stderr at the end of the file.
+ *
+ * A slow consumer can be simulated with -e: that many DMA events are raised
+ * before each processing step, exercising the overrun policy selected with -p.
+ *
+ * The spectrogram is built by the incremental engine as on target, with one
+ * inference every -s columns (by default one per half buffer); -l selects the
+ * former PreProc_DPU() per half buffer instead, for comparison.
+ *
+ * With -t, the preprocessing and the inference run in two threads handing
+ * the spectrograms over through the ping-pong buffers of inference_pipeline.h,
+ * as the two tasks do on target with MIC_INFERENCE_PIPELINE. The replay does
+ * not drop frames but waits for the inference thread, so the wall time and
+ * real-time factor printed at the end compare the throughput of both modes.
+ *
+ * -c does not run the pipeline but compares the fixed-point log-mel columns
+ * with the float ones on every column of the file.
+ *
+ * The spectrogram is built in the network input tensor and the scores are
+ * read from the output tensor, in the activations buffer when the model
+ * allows it. -i checks this against a second spectrogram engine and
+ * inference with separate input and output buffers: the spectrogram and the
+ * scores must be bit-identical.
+ *
+ * Usage: sound_replay [-q] [-v] [-l] [-c] [-i] [-t] [-e events] [-s columns] file.wav
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "b_u585i_iot02a_audio.h"
+#include "wav_reader.h"
+
+/* Preprocessing includes */
+#include "preproc_dpu.h"
+
+/* AI includes */
+#include "ai_dpu.h"
+
+/* Decision includes */
+#include "app/audio/sound_decision.h"
+#include "app/audio/score_smoothing.h"
+
+/* Latency instrumentation includes */
+#include "app/audio/audio_latency.h"
+
+/* DMA overrun detection includes */
+#include "app/audio/mic_dma_tracker.h"
+
+/* Incremental spectrogram includes */
+#include "app/audio/spectrogram_engine.h"
+
+/* Fixed-point preprocessing comparison includes */
+#include "preproc_compare.h"
+#include "decision_compare.h"
+
+/* Network tensors includes */
+#include "app/audio/network_buffers.h"
+
+/* Preprocessing/inference hand-off includes */
+#include "app/audio/inference_pipeline.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Number of 16-bit mono samples in one half buffer */
+#define HALF_BUFF_SAMPLES ((uint32_t)(AUDIO_HALF_BUFF_SIZE / sizeof(int16_t)))
+
+/* Default number of columns between two inferences, as on target: one inference per half buffer */
+#define DEFAULT_INFERENCE_STRIDE (HALF_BUFF_SAMPLES / CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH)
+
+/* Processing budget of one frame, as on target: the duration of the audio between two inferences */
+#define STRIDE_DEADLINE_US(columns) \
+    ((columns) * CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH * 1000U / (AUDIO_FREQUENCY_16K / 1000U))
+
+/* Largest accepted difference of a network input value between the fixed-point and float columns */
+#define PREPROC_COMPARE_TOLERANCE 1U
+
+/* Number of random score vectors of the decision check */
+#define DECISION_COMPARE_VECTORS 1000000U
+
+/* Ticks the inference thread waits for a frame before checking for the end of the replay */
+#define INFERENCE_THREAD_POLL_TICKS pdMS_TO_TICKS(10U)
+
+/* Stream position of a sample in milliseconds */
+#define SAMPLES_TO_MS(samples) ((uint32_t)(((uint64_t)(samples) * 1000U) / AUDIO_FREQUENCY_16K))
+
+/* ============================ Static Variables ============================ */
+
+static uint8_t pucAudioBuff[AUDIO_BUFF_SIZE];
+static int8_t pcKeptColumns[SPECTROGRAM_ENGINE_KEPT_SIZE];
+
+/* Reference pipeline of -i, with its own input and output buffers */
+static int8_t pcReferenceInput[SPECTROGRAM_ENGINE_SIZE];
+static float32_t pfReferenceOutput[AI_NETWORK_OUT_1_SIZE];
+static SpectrogramEngine_t xReferenceEngine;
+static bool check_in_place = false;
+static uint32_t mismatch_count = 0;
+
+static const char *sAiClassLabels[CTRL_X_CUBE_AI_MODE_CLASS_NUMBER] = CTRL_X_CUBE_AI_MODE_CLASS_LIST;
+
+static AudioProcCtx_t xAudioProcCtx;
+static AIProcCtx_t xAIProcCtx;
+static SpectrogramEngine_t xSpectrogramEngine;
+static NetworkBuffers_t xNetworkBuffers;
+
+static uint32_t frame_count = 0;
+static uint32_t detection_count = 0;
+
+/* DMA work of the frame in each pipeline buffer, for the frame lines printed by the inference thread */
+typedef struct {
+    const int8_t* buffer;
+    uint32_t halves;
+    uint32_t dropped;
+} PendingWork_t;
+
+static PendingWork_t pending_work[INFERENCE_PIPELINE_SLOTS];
+static volatile bool inference_stop = false;
+
+/* ============================ Function Implementations ============================ */
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static const char* outcome_to_string(SoundDecisionOutcome_t outcome) {
+    switch (outcome) {
+        case SOUND_DECISION_DETECTED:       return "detected";
+        case SOUND_DECISION_OTHER:          return "other";
+        case SOUND_DECISION_LOW_CONFIDENCE: return "low-confidence";
+        case SOUND_DECISION_BLOCKED:        return "blocked";
+        case SOUND_DECISION_HELD:           return "held";
+        default:                            return "unknown";
+    }
+}
+
+/**
+ * Parse the inactivity timeouts: one for every class, or one per class, comma separated.
+ */
+static bool parse_timeouts(const char* text, int* timeouts) {
+    uint32_t count = 0;
+    const char* pos = text;
+    while (count < SOUND_DECISION_CLASS_NUMBER) {
+        char* end;
+        long value = strtol(pos, &end, 10);
+        if (end == pos || value < 0 || value > INT32_MAX) {
+            return false;
+        }
+        timeouts[count++] = (int)value;
+        if (*end != ',') {
+            pos = end;
+            break;
+        }
+        pos = end + 1;
+    }
+    if (*pos != '\0') {
+        return false;
+    }
+    if (count == 1U) {
+        for (uint32_t i = 1; i < SOUND_DECISION_CLASS_NUMBER; i++) {
+            timeouts[i] = timeouts[0];
+        }
+        return true;
+    }
+    return (count == SOUND_DECISION_CLASS_NUMBER);
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-q] [-v] [-l] [-c] [-i] [-t] [-e events] [-s columns] [-f smoothing] [-y margin]\n"
+            "       [-k labels] [-w timeouts] file.wav\n"
+            "       %s [-q] -d\n",
+            program,
+            program);
+    fprintf(stderr, "  -q  only print errors on stderr\n");
+    fprintf(stderr, "  -v  print debug messages on stderr\n");
+    fprintf(stderr, "  -l  compute the whole spectrogram with PreProc_DPU on every half buffer\n");
+    fprintf(stderr, "  -c  compare the fixed-point log-mel columns with the float ones, within %u\n",
+            (unsigned)PREPROC_COMPARE_TOLERANCE);
+    fprintf(stderr, "  -d  check the decisions against the float arithmetic of the original decision, without audio\n");
+    fprintf(stderr, "  -i  check the in-place network input and output against separate buffers\n");
+    fprintf(stderr, "  -t  run the preprocessing and the inference in two threads\n");
+    fprintf(stderr, "  -e  number of DMA events raised per processing step (default 1)\n");
+    fprintf(stderr, "  -s  spectrogram columns between two inferences, 1 to %u (default %u)\n",
+            (unsigned)SPECTROGRAM_ENGINE_MAX_STRIDE, (unsigned)DEFAULT_INFERENCE_STRIDE);
+    fprintf(stderr, "  -f  score smoothing: none, \"ema <alpha>\", \"median <n>\" or \"vote <k> <n>\" (default none)\n");
+    fprintf(stderr, "  -k  largest number of classes reported by one detection, 1 to %u (default %u)\n",
+            (unsigned)SOUND_DECISION_MAX_LABELS, (unsigned)SOUND_DECISION_DEFAULT_LABELS);
+    fprintf(stderr, "  -w  inactivity timeout in ms of every class, or of each of the %u classes comma separated\n"
+            "      (default %d)\n", (unsigned)SOUND_DECISION_CLASS_NUMBER, SOUND_DECISION_DEFAULT_INACTIVITY_TIMEOUT);
+    fprintf(stderr, "  -y  hysteresis margin in percent, 0 to disable (default %d)\n", SOUND_DECISION_DEFAULT_HYSTERESIS);
+}
+
+/**
+ * Compare the network input and output with the reference pipeline: the
+ * input before the inference overwrites it, the output after it.
+ */
+static bool check_input(void) {
+    return 0 == memcmp(xNetworkBuffers.input, pcReferenceInput, SPECTROGRAM_ENGINE_SIZE);
+}
+
+static bool check_output(void) {
+    float32_t output[AI_NETWORK_OUT_1_SIZE];
+
+    /* The reference inference overwrites the activations buffer, output included */
+    memcpy(output, xNetworkBuffers.output, sizeof(output));
+    AiDPUProcess(&xAIProcCtx, pcReferenceInput, pfReferenceOutput);
+    memcpy(xNetworkBuffers.output, output, sizeof(output));
+
+    return 0 == memcmp(output, pfReferenceOutput, sizeof(pfReferenceOutput));
+}
+
+/**
+ * Run the inference and the decision on the spectrogram and print the frame line.
+ */
+static void process_frame(uint32_t time_ms, uint32_t halves, uint32_t dropped, float32_t energy,
+                          uint64_t preproc_ns, int8_t* input) {
+    bool identical = !check_in_place || check_input();
+
+    uint64_t start_ns = get_time_ns();
+    AiDPUProcess(&xAIProcCtx, input, xNetworkBuffers.output);
+    uint64_t inference_ns = get_time_ns() - start_ns;
+
+    if (check_in_place) {
+        identical = check_output() && identical;
+        if (!identical) {
+            LogError("Frame %u differs from the reference pipeline.", (unsigned)frame_count);
+            mismatch_count++;
+        }
+    }
+
+    AudioLatency_Record(AUDIO_LATENCY_STAGE_INFERENCE, (uint32_t)(inference_ns / 1000U));
+
+    start_ns = get_time_ns();
+    const char* class_name = "silence";
+    const char* outcome = "silence";
+    int confidence = 0;
+    char labels[256] = "";
+
+    if (energy > CTRL_X_CUBE_AI_SPECTROGRAM_SILENCE_THR) {
+        SoundDecision_t xDecision;
+        const float* scores = ScoreSmoothing_Update(xNetworkBuffers.output);
+        if (SoundDecision_Evaluate(scores, time_ms, &xDecision)) {
+            detection_count++;
+        }
+        class_name = xDecision.class_name;
+        outcome = outcome_to_string(xDecision.outcome);
+        confidence = xDecision.confidence_percent;
+        (void)SoundDecision_FormatLabels(&xDecision, labels, sizeof(labels));
+        for (char* comma = strchr(labels, ','); comma != NULL; comma = strchr(comma, ',')) {
+            *comma = ' ';
+        }
+    } else {
+        ScoreSmoothing_Reset();
+        SoundDecision_ClearHysteresis();
+    }
+    AudioLatency_Record(AUDIO_LATENCY_STAGE_DECISION, (uint32_t)((get_time_ns() - start_ns) / 1000U));
+    AudioLatency_EndFrame();
+
+    printf("%u,%u,%u,%u,%s,%d,%s,%llu,%llu,%s\n",
+           (unsigned)frame_count,
+           (unsigned)time_ms,
+           (unsigned)halves,
+           (unsigned)dropped,
+           class_name,
+           confidence,
+           outcome,
+           (unsigned long long)(preproc_ns / 1000U),
+           (unsigned long long)(inference_ns / 1000U),
+           labels);
+    frame_count++;
+}
+
+static void remember_work(const int8_t* buffer, const MicDmaWork_t* work) {
+    for (uint32_t i = 0; i < INFERENCE_PIPELINE_SLOTS; i++) {
+        if (pending_work[i].buffer == buffer || pending_work[i].buffer == NULL) {
+            pending_work[i].buffer = buffer;
+            pending_work[i].halves = work->count;
+            pending_work[i].dropped = work->dropped;
+            return;
+        }
+    }
+}
+
+static const PendingWork_t* recall_work(const int8_t* buffer) {
+    for (uint32_t i = 0; i < INFERENCE_PIPELINE_SLOTS; i++) {
+        if (pending_work[i].buffer == buffer) {
+            return &pending_work[i];
+        }
+    }
+    return &pending_work[0];
+}
+
+/**
+ * Stand-in for the inference task: run the inference on the frames handed
+ * over by the replay loop until it ends.
+ */
+static void* inference_thread(void* arg) {
+    (void)arg;
+
+    for (;;) {
+        InferenceFrame_t frame;
+        if (!InferencePipeline_Receive(&frame, INFERENCE_THREAD_POLL_TICKS)) {
+            if (inference_stop) {
+                break;
+            }
+            continue;
+        }
+
+        AudioLatency_Record(AUDIO_LATENCY_STAGE_PREPROC, frame.preproc_us);
+        AudioLatency_Stop(AUDIO_LATENCY_STAGE_HANDOFF, frame.submit_ticks);
+
+        const PendingWork_t* work = recall_work(frame.spectrogram);
+        process_frame(frame.time_ms, work->halves, work->dropped, frame.energy,
+                      (uint64_t)frame.preproc_us * 1000U, frame.spectrogram);
+        InferencePipeline_Release(&frame);
+    }
+    return NULL;
+}
+
+void BSP_AUDIO_IN_HalfTransfer_CallBack(uint32_t Instance) {
+    (void)Instance;
+    MicDmaTracker_OnTransfer(MIC_DMA_FIRST_HALF);
+}
+
+void BSP_AUDIO_IN_TransferComplete_CallBack(uint32_t Instance) {
+    (void)Instance;
+    MicDmaTracker_OnTransfer(MIC_DMA_SECOND_HALF);
+}
+
+int main(int argc, char* argv[]) {
+    const char* wav_path = NULL;
+    WavReader_t reader;
+    uint32_t events_per_step = 1;
+    uint32_t inference_stride = DEFAULT_INFERENCE_STRIDE;
+    bool legacy_preproc = false;
+    bool compare_preproc = false;
+    bool pipeline = false;
+    bool check_decision = false;
+    ScoreSmoothingConfig_t smoothing = { SCORE_SMOOTHING_NONE, 100U, 1U, 1U };
+    int hysteresis = SOUND_DECISION_DEFAULT_HYSTERESIS;
+    uint32_t max_labels = SOUND_DECISION_DEFAULT_LABELS;
+    int timeouts[SOUND_DECISION_CLASS_NUMBER];
+    bool set_timeouts = false;
+    pthread_t inference_thread_id;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-q")) {
+            HostLog_SetLevel(LOG_ERROR);
+        } else if (0 == strcmp(argv[i], "-v")) {
+            HostLog_SetLevel(LOG_DEBUG);
+        } else if (0 == strcmp(argv[i], "-l")) {
+            legacy_preproc = true;
+        } else if (0 == strcmp(argv[i], "-c")) {
+            compare_preproc = true;
+        } else if (0 == strcmp(argv[i], "-d")) {
+            check_decision = true;
+        } else if (0 == strcmp(argv[i], "-i")) {
+            check_in_place = true;
+        } else if (0 == strcmp(argv[i], "-t")) {
+            pipeline = true;
+        } else if (0 == strcmp(argv[i], "-e") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            events_per_step = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc && atoi(argv[i + 1]) > 0
+                   && (uint32_t)atoi(argv[i + 1]) <= SPECTROGRAM_ENGINE_MAX_STRIDE) {
+            inference_stride = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-f") && (i + 1) < argc && ScoreSmoothing_Parse(argv[i + 1], &smoothing)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "-k") && (i + 1) < argc && atoi(argv[i + 1]) > 0
+                   && (uint32_t)atoi(argv[i + 1]) <= SOUND_DECISION_MAX_LABELS) {
+            max_labels = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-w") && (i + 1) < argc && parse_timeouts(argv[i + 1], timeouts)) {
+            set_timeouts = true;
+            i++;
+        } else if (0 == strcmp(argv[i], "-y") && (i + 1) < argc && atoi(argv[i + 1]) >= 0) {
+            hysteresis = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && wav_path == NULL) {
+            wav_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (check_decision) {
+        SoundDecision_Init(sAiClassLabels);
+        return DecisionCompare_Run(sAiClassLabels, DECISION_COMPARE_VECTORS, 1U);
+    }
+
+    if (wav_path == NULL || (pipeline && (legacy_preproc || check_in_place))) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if (!WavReader_Open(&reader, wav_path)) {
+        LogError("Failed to open %s as a PCM WAV file.", wav_path);
+        return 1;
+    }
+
+    if (!BspAudioReplay_Attach(&reader)) {
+        LogError("%s must be %u Hz mono 16-bit PCM (got %u Hz, %u channels, %u bits).",
+                 wav_path, AUDIO_FREQUENCY_16K,
+                 (unsigned)reader.sample_rate, (unsigned)reader.channels, (unsigned)reader.bits_per_sample);
+        WavReader_Close(&reader);
+        return 1;
+    }
+
+    if (PreProc_DPUInit(&xAudioProcCtx) != pdTRUE) {
+        LogError("Error while initializing Preprocessing.");
+        WavReader_Close(&reader);
+        return 1;
+    }
+
+    /**
+     * get the AI model
+     */
+    AiDPULoadModel(&xAIProcCtx, "network");
+
+    /**
+     * transfer quantization parametres included in AI model to the Audio DPU
+     */
+    xAudioProcCtx.output_Q_offset = xAIProcCtx.input_Q_offset;
+    xAudioProcCtx.output_Q_inv_scale = xAIProcCtx.input_Q_inv_scale;
+
+    if (compare_preproc) {
+        int result = PreprocCompare_Run(&reader, &xAudioProcCtx, PREPROC_COMPARE_TOLERANCE);
+        WavReader_Close(&reader);
+        return result;
+    }
+
+    if (!NetworkBuffers_Init(&xNetworkBuffers)) {
+        LogError("Error while locating the network input and output.");
+        WavReader_Close(&reader);
+        return 1;
+    }
+    LogInfo("Network input and output %s.",
+            xNetworkBuffers.in_activations ? "in the activations buffer" : "in separate buffers");
+
+    if (!SpectrogramEngine_Init(&xSpectrogramEngine, &xAudioProcCtx, xNetworkBuffers.input)
+        || !SpectrogramEngine_Init(&xReferenceEngine, &xAudioProcCtx, pcReferenceInput)) {
+        LogError("Error while initializing the spectrogram.");
+        WavReader_Close(&reader);
+        return 1;
+    }
+    if (pipeline) {
+        /* The spectrogram is built in the pipeline buffers, copied from the previous one when they overlap */
+        int8_t* first_buffer = InferencePipeline_Init();
+        if (first_buffer == NULL) {
+            LogError("Error while creating the inference pipeline.");
+            WavReader_Close(&reader);
+            return 1;
+        }
+        SpectrogramEngine_SwapWindow(&xSpectrogramEngine, first_buffer);
+    } else if (xNetworkBuffers.in_activations) {
+        SpectrogramEngine_SetVolatileWindow(&xSpectrogramEngine, pcKeptColumns);
+    }
+    SoundDecision_Init(sAiClassLabels);
+    SoundDecision_SetHysteresis(hysteresis);
+    (void)SoundDecision_SetMaxLabels(max_labels);
+    if (set_timeouts) {
+        SoundDecision_SetClassTimeouts(timeouts);
+    }
+    ScoreSmoothing_Init();
+    (void)ScoreSmoothing_Configure(&smoothing);
+    if (legacy_preproc) {
+        AudioLatency_Init(STRIDE_DEADLINE_US(DEFAULT_INFERENCE_STRIDE));
+    } else {
+        (void)SpectrogramEngine_SetStride(&xSpectrogramEngine, inference_stride);
+        (void)SpectrogramEngine_SetStride(&xReferenceEngine, inference_stride);
+        AudioLatency_Init(STRIDE_DEADLINE_US(inference_stride));
+    }
+
+    MicDmaTracker_Reset();
+    if (BSP_AUDIO_IN_Record(0, pucAudioBuff, AUDIO_BUFF_SIZE) != BSP_ERROR_NONE) {
+        LogError("AUDIO IN : FAILED.");
+        WavReader_Close(&reader);
+        return 1;
+    }
+
+    uint64_t stream_samples = 0;
+    SoundDecision_SetDetectedNever(0);
+
+    printf("frame,time_ms,halves,dropped,class,confidence,outcome,preproc_us,inference_us,labels\n");
+
+    if (pipeline && pthread_create(&inference_thread_id, NULL, inference_thread, NULL) != 0) {
+        LogError("Error while starting the inference thread.");
+        WavReader_Close(&reader);
+        return 1;
+    }
+
+    uint64_t run_start_ns = get_time_ns();
+    uint64_t preproc_ns = 0;
+    bool more_audio = true;
+    while (more_audio) {
+        MicDmaWork_t work;
+
+        /* Raise the DMA events that occur while the previous frame is processed */
+        for (uint32_t i = 0; i < events_per_step && more_audio; i++) {
+            more_audio = BspAudioReplay_Step();
+        }
+        if (!MicDmaTracker_Next(&work)) {
+            break;
+        }
+        stream_samples += (uint64_t)work.dropped * HALF_BUFF_SAMPLES;
+
+        if (legacy_preproc) {
+            uint64_t start_ns = get_time_ns();
+            xAudioProcCtx.S_Spectr.spectro_sum = 0;
+            for (uint32_t i = 0; i < work.count; i++) {
+                PreProc_DPU(&xAudioProcCtx, pucAudioBuff + (work.halves[i] * AUDIO_HALF_BUFF_SIZE),
+                            xNetworkBuffers.input);
+            }
+            preproc_ns = get_time_ns() - start_ns;
+            if (check_in_place) {
+                memcpy(pcReferenceInput, xNetworkBuffers.input, SPECTROGRAM_ENGINE_SIZE);
+            }
+            stream_samples += (uint64_t)work.count * HALF_BUFF_SAMPLES;
+
+            AudioLatency_Record(AUDIO_LATENCY_STAGE_PREPROC, (uint32_t)(preproc_ns / 1000U));
+            process_frame(SAMPLES_TO_MS(stream_samples), work.count, work.dropped,
+                          (float32_t)xAudioProcCtx.S_Spectr.spectro_sum, preproc_ns, xNetworkBuffers.input);
+            continue;
+        }
+
+        if (work.dropped > 0) {
+            SpectrogramEngine_MarkGap(&xSpectrogramEngine);
+            SpectrogramEngine_MarkGap(&xReferenceEngine);
+        }
+
+        /* Feed each half up to the inference points it contains, as the mic task does */
+        for (uint32_t i = 0; i < work.count; i++) {
+            const int16_t* samples = (const int16_t*)(pucAudioBuff + (work.halves[i] * AUDIO_HALF_BUFF_SIZE));
+            uint32_t offset = 0;
+            uint32_t reference_offset = 0;
+
+            while (offset < HALF_BUFF_SAMPLES) {
+                bool inference_due = false;
+                uint64_t start_ns = get_time_ns();
+                offset += SpectrogramEngine_Feed(&xSpectrogramEngine, &samples[offset],
+                                                 HALF_BUFF_SAMPLES - offset, &inference_due);
+                uint64_t feed_ns = get_time_ns() - start_ns;
+
+                if (check_in_place) {
+                    bool reference_due = false;
+                    reference_offset += SpectrogramEngine_Feed(&xReferenceEngine, &samples[reference_offset],
+                                                               HALF_BUFF_SAMPLES - reference_offset, &reference_due);
+                    if (reference_offset != offset || reference_due != inference_due) {
+                        LogError("The reference spectrogram is out of step at %u ms.",
+                                 (unsigned)SAMPLES_TO_MS(stream_samples + offset));
+                        mismatch_count++;
+                        reference_offset = offset;
+                    }
+                }
+
+                preproc_ns += feed_ns;
+                if (pipeline) {
+                    if (inference_due) {
+                        InferenceFrame_t frame = {
+                            .spectrogram = SpectrogramEngine_GetView(&xSpectrogramEngine),
+                            .energy = SpectrogramEngine_GetEnergy(&xSpectrogramEngine),
+                            .time_ms = SAMPLES_TO_MS(stream_samples + offset),
+                            .half = work.halves[i],
+                            .preproc_us = (uint32_t)(preproc_ns / 1000U),
+                        };
+                        remember_work(frame.spectrogram, &work);
+                        SpectrogramEngine_SwapWindow(&xSpectrogramEngine,
+                                                     InferencePipeline_Submit(&frame, portMAX_DELAY));
+                        preproc_ns = 0;
+                    }
+                    continue;
+                }
+
+                AudioLatency_Record(AUDIO_LATENCY_STAGE_PREPROC, (uint32_t)(feed_ns / 1000U));
+                if (inference_due) {
+                    process_frame(SAMPLES_TO_MS(stream_samples + offset), work.count, work.dropped,
+                                  SpectrogramEngine_GetEnergy(&xSpectrogramEngine), preproc_ns,
+                                  SpectrogramEngine_GetView(&xSpectrogramEngine));
+                    preproc_ns = 0;
+                }
+            }
+            stream_samples += HALF_BUFF_SAMPLES;
+        }
+    }
+
+    if (pipeline) {
+        inference_stop = true;
+        pthread_join(inference_thread_id, NULL);
+    }
+    uint64_t run_ns = get_time_ns() - run_start_ns;
+
+    BSP_AUDIO_IN_Stop(0);
+    WavReader_Close(&reader);
+
+    if (frame_count == 0) {
+        LogError("%s does not contain any audio.", wav_path);
+        return 1;
+    }
+
+    fprintf(stderr, "frames: %u, detections: %u, audio: %u ms\n",
+            (unsigned)frame_count, (unsigned)detection_count, (unsigned)SAMPLES_TO_MS(stream_samples));
+    for (uint32_t stage = AUDIO_LATENCY_STAGE_PREPROC; stage <= AUDIO_LATENCY_STAGE_DECISION; stage++) {
+        AudioLatencyStats_t stats;
+        AudioLatency_GetStats((AudioLatencyStage_t)stage, &stats);
+        if (stats.count == 0) {
+            continue;
+        }
+        fprintf(stderr, "%-10s min %lu us, avg %lu us, p99 %lu us, max %lu us\n",
+                AudioLatency_GetStageName((AudioLatencyStage_t)stage),
+                (unsigned long)stats.min_us, (unsigned long)stats.avg_us,
+                (unsigned long)stats.p99_us, (unsigned long)stats.max_us);
+    }
+
+    uint32_t frames;
+    uint32_t deadline_misses;
+    AudioLatency_GetFrameStats(&frames, &deadline_misses);
+    fprintf(stderr, "deadline: %u us, misses: %u\n", (unsigned)AudioLatency_GetDeadline(), (unsigned)deadline_misses);
+
+    MicDmaStats_t dma_stats;
+    MicDmaTracker_GetStats(&dma_stats);
+    fprintf(stderr, "dma events: %u, processed: %u, dropped: %u, overruns: %u\n",
+            (unsigned)dma_stats.events, (unsigned)dma_stats.processed,
+            (unsigned)dma_stats.dropped, (unsigned)dma_stats.overruns);
+    if (!legacy_preproc) {
+        fprintf(stderr, "spectrogram columns computed: %u, skipped: %u\n",
+                (unsigned)xSpectrogramEngine.columns_computed, (unsigned)xSpectrogramEngine.columns_skipped);
+    }
+    if (pipeline) {
+        InferencePipelineStats_t pipeline_stats;
+        InferencePipeline_GetStats(&pipeline_stats);
+        fprintf(stderr, "pipeline submitted: %u, dropped: %u, completed: %u\n",
+                (unsigned)pipeline_stats.submitted, (unsigned)pipeline_stats.dropped,
+                (unsigned)pipeline_stats.completed);
+    }
+    fprintf(stderr, "wall time: %llu ms, real-time factor: %.1f\n", (unsigned long long)(run_ns / 1000000U),
+            (run_ns > 0) ? ((double)SAMPLES_TO_MS(stream_samples) * 1e6 / (double)run_ns) : 0.0);
+    if (check_in_place) {
+        fprintf(stderr, "in-place check: %u of %u frames differ\n", (unsigned)mismatch_count, (unsigned)frame_count);
+        return (mismatch_count == 0) ? 0 : 3;
+    }
+
+    return 0;
+}
@@ -0,0 +1,367 @@
+/**
+ * @file patch_scores.c
+ * @brief Offline scoring of recorded audio with the firmware network.
+ *
+ * Computes the spectrogram patches of WAV files with the incremental engine,
+ * as the device does, one every -s columns, and runs the network of
+ * network.c on them -b patches at a time with the batch API of
+ * network_batch.h. One CSV line per patch is printed on stdout with the
+ * class scores, the spectrum energy of the patch and whether the device would
+ * skip it as silent; a summary is printed on stderr.
+ *
+ * Each file starts with an empty spectrogram: its first patch is scored once
+ * the audio fills the window, as after a reset of the device.
+ *
+ * The generated network code holds a single network instance, so -j shares
+ * the files between that many worker processes instead of threads. The lines
+ * of each file are kept together and in the order of the arguments.
+ *
+ * Usage: patch_scores [-q] [-v] [-s columns] [-b patches] [-j workers] file.wav...
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "b_u585i_iot02a_audio.h"
+#include "wav_reader.h"
+
+/* Preprocessing includes */
+#include "preproc_dpu.h"
+
+/* Incremental spectrogram includes */
+#include "app/audio/spectrogram_engine.h"
+
+/* Batch inference includes */
+#include "app/audio/network_batch.h"
+
+/* ============================ Constants and Macros ============================ */
+
+#if CTRL_X_CUBE_AI_MODE_CLASS_NUMBER != NETWORK_BATCH_CLASSES
+#error "The class list of ai_model_config.h does not match the network output"
+#endif
+
+/* Number of 16-bit mono samples in one DMA half buffer */
+#define HALF_BUFF_SAMPLES ((uint32_t)(AUDIO_HALF_BUFF_SIZE / sizeof(int16_t)))
+
+/* Default number of columns between two patches, as on target: one inference per half buffer */
+#define DEFAULT_INFERENCE_STRIDE (HALF_BUFF_SAMPLES / CTRL_X_CUBE_AI_SPECTROGRAM_HOP_LENGTH)
+
+/* Largest and default number of patches per batch */
+#define MAX_BATCH_PATCHES 64U
+#define DEFAULT_BATCH_PATCHES 16U
+
+/* Largest number of worker processes */
+#define MAX_WORKERS 64U
+
+/* Number of samples read from the file at a time */
+#define READ_SAMPLES 4096U
+
+/* Stream position of a sample in milliseconds */
+#define SAMPLES_TO_MS(samples) ((uint32_t)(((uint64_t)(samples) * 1000U) / AUDIO_FREQUENCY_16K))
+
+/* ============================ Static Variables ============================ */
+
+/**
+ * @brief Position of a patch in its file, for its CSV line.
+ */
+typedef struct {
+    uint32_t index;         ///< Patch number in the file
+    uint32_t time_ms;       ///< Time of the end of the audio of the patch
+    float32_t energy;       ///< Spectrum sum of the patch
+} PatchInfo_t;
+
+static const char *sAiClassLabels[CTRL_X_CUBE_AI_MODE_CLASS_NUMBER] = CTRL_X_CUBE_AI_MODE_CLASS_LIST;
+
+AI_ALIGNED(32) static uint8_t pucActivations[NETWORK_BATCH_ACTIVATIONS_SIZE];
+static int8_t pcPatches[MAX_BATCH_PATCHES * NETWORK_BATCH_PATCH_SIZE];
+static float32_t pfScores[MAX_BATCH_PATCHES * NETWORK_BATCH_CLASSES];
+static PatchInfo_t xPatchInfo[MAX_BATCH_PATCHES];
+static int16_t psSamples[READ_SAMPLES];
+
+static AudioProcCtx_t xAudioProcCtx;
+static SpectrogramEngine_t xSpectrogramEngine;
+static NetworkBatch_t xNetworkBatch;
+static int8_t pcWindow[SPECTROGRAM_ENGINE_SIZE];
+
+static uint32_t batch_patches = DEFAULT_BATCH_PATCHES;
+
+/* ============================ Function Implementations ============================ */
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-q] [-v] [-s columns] [-b patches] [-j workers] file.wav...\n", program);
+    fprintf(stderr, "  -q  only print errors on stderr\n");
+    fprintf(stderr, "  -v  print debug messages on stderr\n");
+    fprintf(stderr, "  -s  spectrogram columns between two patches, 1 to %u (default %u)\n",
+            (unsigned)SPECTROGRAM_ENGINE_MAX_STRIDE, (unsigned)DEFAULT_INFERENCE_STRIDE);
+    fprintf(stderr, "  -b  patches per network batch, 1 to %u (default %u)\n",
+            (unsigned)MAX_BATCH_PATCHES, (unsigned)DEFAULT_BATCH_PATCHES);
+    fprintf(stderr, "  -j  worker processes, 1 to %u (default 1)\n", (unsigned)MAX_WORKERS);
+}
+
+/**
+ * Run the network on the pending patches and print their lines.
+ */
+static bool flush_batch(const char* path, uint32_t count, FILE* out) {
+    if (count == 0) {
+        return true;
+    }
+
+    if (NetworkBatch_Run(&xNetworkBatch, pcPatches, count, pfScores) != count) {
+        LogError("The network failed on %s.", path);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const PatchInfo_t* info = &xPatchInfo[i];
+        fprintf(out, "%s,%u,%u,%.1f,%d", path, (unsigned)info->index, (unsigned)info->time_ms,
+                (double)info->energy, (info->energy > CTRL_X_CUBE_AI_SPECTROGRAM_SILENCE_THR) ? 0 : 1);
+        for (uint32_t class = 0; class < NETWORK_BATCH_CLASSES; class++) {
+            fprintf(out, ",%.6f", (double)pfScores[(i * NETWORK_BATCH_CLASSES) + class]);
+        }
+        fprintf(out, "\n");
+    }
+    return true;
+}
+
+/**
+ * Score every patch of one file. Returns the number of patches, -1 on error.
+ */
+static int32_t score_file(const char* path, FILE* out) {
+    WavReader_t reader;
+
+    if (!WavReader_Open(&reader, path)) {
+        LogError("Failed to open %s as a PCM WAV file.", path);
+        return -1;
+    }
+    if (reader.sample_rate != AUDIO_FREQUENCY_16K || reader.channels != 1U || reader.bits_per_sample != 16U) {
+        LogError("%s must be %u Hz mono 16-bit PCM (got %u Hz, %u channels, %u bits).",
+                 path, AUDIO_FREQUENCY_16K,
+                 (unsigned)reader.sample_rate, (unsigned)reader.channels, (unsigned)reader.bits_per_sample);
+        WavReader_Close(&reader);
+        return -1;
+    }
+
+    SpectrogramEngine_Reset(&xSpectrogramEngine);
+
+    uint64_t stream_samples = 0;
+    uint32_t patches = 0;
+    uint32_t pending = 0;
+    size_t bytes;
+    bool ok = true;
+
+    while (ok && (bytes = WavReader_Read(&reader, (uint8_t*)psSamples, sizeof(psSamples))) > 0) {
+        uint32_t count = (uint32_t)(bytes / sizeof(int16_t));
+        uint32_t offset = 0;
+
+        while (ok && offset < count) {
+            bool inference_due = false;
+            offset += SpectrogramEngine_Feed(&xSpectrogramEngine, &psSamples[offset], count - offset,
+                                             &inference_due);
+            if (!inference_due) {
+                continue;
+            }
+
+            memcpy(&pcPatches[pending * NETWORK_BATCH_PATCH_SIZE], SpectrogramEngine_GetView(&xSpectrogramEngine),
+                   NETWORK_BATCH_PATCH_SIZE);
+            xPatchInfo[pending].index = patches++;
+            xPatchInfo[pending].time_ms = SAMPLES_TO_MS(stream_samples + offset);
+            xPatchInfo[pending].energy = SpectrogramEngine_GetEnergy(&xSpectrogramEngine);
+            if (++pending == batch_patches) {
+                ok = flush_batch(path, pending, out);
+                pending = 0;
+            }
+        }
+        stream_samples += count;
+    }
+    ok = ok && flush_batch(path, pending, out);
+
+    WavReader_Close(&reader);
+    LogDebug("%s: %u patches, %u ms.", path, (unsigned)patches, (unsigned)SAMPLES_TO_MS(stream_samples));
+    return ok ? (int32_t)patches : -1;
+}
+
+/**
+ * Score the files first, first + step, ... Returns the number of files that failed.
+ */
+static uint32_t score_files(char* const files[], uint32_t file_count, uint32_t first, uint32_t step,
+                            FILE* const outputs[], uint64_t* patches) {
+    uint32_t failures = 0;
+
+    for (uint32_t i = first; i < file_count; i += step) {
+        int32_t result = score_file(files[i], outputs[i]);
+        if (result < 0) {
+            failures++;
+        } else {
+            *patches += (uint64_t)result;
+        }
+        fflush(outputs[i]);
+    }
+    return failures;
+}
+
+/**
+ * Score the files in worker processes, each writing the lines of its files
+ * to temporary files, then print them in order. Returns the number of files
+ * that failed, or of workers that did not complete.
+ */
+static uint32_t score_files_in_workers(char* const files[], uint32_t file_count, uint32_t workers) {
+    FILE* outputs[file_count];
+    pid_t pids[MAX_WORKERS];
+    uint32_t failures = 0;
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        outputs[i] = tmpfile();
+        if (outputs[i] == NULL) {
+            LogError("Failed to create a temporary file.");
+            for (uint32_t j = 0; j < i; j++) {
+                fclose(outputs[j]);
+            }
+            return file_count;
+        }
+    }
+
+    /* Flush stdout so that the workers do not print its pending lines again */
+    fflush(stdout);
+    for (uint32_t w = 0; w < workers; w++) {
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            uint64_t patches = 0;
+            uint32_t worker_failures = score_files(files, file_count, w, workers, outputs, &patches);
+            _exit((worker_failures > 0) ? 1 : 0);
+        } else if (pids[w] < 0) {
+            LogError("Failed to start worker %u.", (unsigned)w);
+            failures++;
+        }
+    }
+
+    for (uint32_t w = 0; w < workers; w++) {
+        int status = 0;
+        if (pids[w] > 0 && (waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            failures++;
+        }
+    }
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        char line[4096];
+
+        rewind(outputs[i]);
+        while (fgets(line, sizeof(line), outputs[i]) != NULL) {
+            fputs(line, stdout);
+        }
+        fclose(outputs[i]);
+    }
+    return failures;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t inference_stride = DEFAULT_INFERENCE_STRIDE;
+    uint32_t workers = 1;
+    int first_file = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-q")) {
+            HostLog_SetLevel(LOG_ERROR);
+        } else if (0 == strcmp(argv[i], "-v")) {
+            HostLog_SetLevel(LOG_DEBUG);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc && atoi(argv[i + 1]) > 0
+                   && (uint32_t)atoi(argv[i + 1]) <= SPECTROGRAM_ENGINE_MAX_STRIDE) {
+            inference_stride = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-b") && (i + 1) < argc && atoi(argv[i + 1]) > 0
+                   && (uint32_t)atoi(argv[i + 1]) <= MAX_BATCH_PATCHES) {
+            batch_patches = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-j") && (i + 1) < argc && atoi(argv[i + 1]) > 0
+                   && (uint32_t)atoi(argv[i + 1]) <= MAX_WORKERS) {
+            workers = (uint32_t)atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            first_file = i;
+            break;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (first_file >= argc) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    char* const* files = &argv[first_file];
+    uint32_t file_count = (uint32_t)(argc - first_file);
+    if (workers > file_count) {
+        workers = file_count;
+    }
+
+    if (PreProc_DPUInit(&xAudioProcCtx) != pdTRUE) {
+        LogError("Error while initializing Preprocessing.");
+        return 1;
+    }
+
+    if (!NetworkBatch_Init(&xNetworkBatch, pucActivations)) {
+        LogError("Error while creating the network.");
+        return 1;
+    }
+
+    /**
+     * quantize the spectrogram as the network input expects it
+     */
+    xAudioProcCtx.output_Q_inv_scale = 1.0F / xNetworkBatch.input_scale;
+    xAudioProcCtx.output_Q_offset = xNetworkBatch.input_zero_point;
+
+    if (!SpectrogramEngine_Init(&xSpectrogramEngine, &xAudioProcCtx, pcWindow)) {
+        LogError("Error while initializing the spectrogram.");
+        NetworkBatch_Deinit(&xNetworkBatch);
+        return 1;
+    }
+    (void)SpectrogramEngine_SetStride(&xSpectrogramEngine, inference_stride);
+
+    printf("file,patch,time_ms,energy,silent");
+    for (uint32_t class = 0; class < NETWORK_BATCH_CLASSES; class++) {
+        printf(",%s", sAiClassLabels[class]);
+    }
+    printf("\n");
+
+    uint64_t start_ns = get_time_ns();
+    uint64_t patches = 0;
+    uint32_t failures;
+    if (workers > 1) {
+        failures = score_files_in_workers(files, file_count, workers);
+    } else {
+        FILE* outputs[file_count];
+        for (uint32_t i = 0; i < file_count; i++) {
+            outputs[i] = stdout;
+        }
+        failures = score_files(files, file_count, 0, 1, outputs, &patches);
+    }
+    uint64_t run_ns = get_time_ns() - start_ns;
+
+    NetworkBatch_Deinit(&xNetworkBatch);
+
+    if (workers > 1) {
+        fprintf(stderr, "files: %u, workers: %u, failures: %u, wall time: %llu ms\n",
+                (unsigned)file_count, (unsigned)workers, (unsigned)failures,
+                (unsigned long long)(run_ns / 1000000U));
+    } else {
+        fprintf(stderr, "files: %u, patches: %llu, failures: %u, wall time: %llu ms, patches/s: %.1f\n",
+                (unsigned)file_count, (unsigned long long)patches, (unsigned)failures,
+                (unsigned long long)(run_ns / 1000000U),
+                (run_ns > 0) ? ((double)patches * 1e9 / (double)run_ns) : 0.0);
+    }
+    return (failures > 0) ? 1 : 0;
+}
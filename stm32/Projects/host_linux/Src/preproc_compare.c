@@ -0,0 +1,142 @@
+/**
+ * @file preproc_compare.c
+ * @brief Accuracy of the fixed-point log-mel columns against the float ones.
+ */
+
+#include "logging_levels.h"
+
+/* Define LOG_LEVEL here if you want to modify the logging level from the default */
+#define LOG_LEVEL LOG_INFO
+#include "logging.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "preproc_compare.h"
+#include "app/audio/logmel_fixed.h"
+#include "app/audio/spectrogram_engine.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Number of buckets of the quantized difference histogram: 0, 1, 2 and more */
+#define DIFF_BUCKETS 4
+
+/* ============================ Static Variables ============================ */
+
+static LogMelFixed_t s_fixed;
+static float32_t s_frame[SPECTROGRAM_ENGINE_FRAME_LEN];
+static float32_t s_mel_float[SPECTROGRAM_ENGINE_NMEL];
+static float32_t s_mel_fixed[SPECTROGRAM_ENGINE_NMEL];
+static int8_t s_input_float[SPECTROGRAM_ENGINE_NMEL];
+static int8_t s_input_fixed[SPECTROGRAM_ENGINE_NMEL];
+
+/* ============================ Function Implementations ============================ */
+
+static uint64_t prvTimeNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static int16_t* prvReadAll(WavReader_t* reader, uint32_t* count) {
+    int16_t* samples = malloc(reader->data_size);
+    if (samples == NULL) {
+        return NULL;
+    }
+    *count = (uint32_t)(WavReader_Read(reader, (uint8_t*)samples, reader->data_size) / sizeof(int16_t));
+    return samples;
+}
+
+int PreprocCompare_Run(WavReader_t* reader, AudioProcCtx_t* proc, uint32_t tolerance) {
+    uint32_t count = 0;
+    int16_t* samples = prvReadAll(reader, &count);
+
+    if (samples == NULL) {
+        LogError("Not enough memory for %lu bytes of audio.", (unsigned long)reader->data_size);
+        return 1;
+    }
+    if (!LogMelFixed_Init(&s_fixed, proc)) {
+        LogError("Fixed-point FFT of %u points or quantization scale %f is not supported.",
+                 (unsigned)LOGMEL_FIXED_NFFT, (double)proc->output_Q_inv_scale);
+        free(samples);
+        return 1;
+    }
+
+    uint64_t histogram[DIFF_BUCKETS] = { 0 };
+    uint32_t columns = 0;
+    uint32_t max_diff = 0;
+    double log_error_sum = 0.0;
+    double log_error_max = 0.0;
+    double energy_error_max = 0.0;
+    uint64_t float_ns = 0;
+    uint64_t fixed_ns = 0;
+
+    for (uint32_t start = 0; start + SPECTROGRAM_ENGINE_FRAME_LEN <= count; start += SPECTROGRAM_ENGINE_HOP) {
+        uint64_t t0 = prvTimeNs();
+        for (uint32_t i = 0; i < SPECTROGRAM_ENGINE_FRAME_LEN; i++) {
+            s_frame[i] = (float32_t)samples[start + i] / 32768.0F;
+        }
+        proc->S_Spectr.spectro_sum = 0;
+        LogMelSpectrogramColumn(&proc->S_LogMelSpectr, s_frame, s_mel_float);
+        for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+            s_input_float[mel] = SpectrogramEngine_Quantize(proc, s_mel_float[mel]);
+        }
+        double energy_float = (double)proc->S_Spectr.spectro_sum;
+
+        uint64_t t1 = prvTimeNs();
+        double energy_fixed = (double)LogMelFixed_ColumnQuantized(&s_fixed, &samples[start],
+                                                                  SPECTROGRAM_ENGINE_FRAME_LEN, NULL,
+                                                                  s_input_fixed, 1U);
+        uint64_t t2 = prvTimeNs();
+
+        float_ns += t1 - t0;
+        fixed_ns += t2 - t1;
+
+        /* Log-mel values of the same spectrum, only to report the accuracy before quantization */
+        (void)LogMelFixed_Column(&s_fixed, &samples[start], SPECTROGRAM_ENGINE_FRAME_LEN, NULL, s_mel_fixed);
+
+        for (uint32_t mel = 0; mel < SPECTROGRAM_ENGINE_NMEL; mel++) {
+            uint32_t diff = (uint32_t)abs((int32_t)s_input_float[mel] - (int32_t)s_input_fixed[mel]);
+            double log_error = fabs((double)s_mel_float[mel] - (double)s_mel_fixed[mel]);
+
+            histogram[(diff < DIFF_BUCKETS) ? diff : (DIFF_BUCKETS - 1U)]++;
+            if (diff > max_diff) {
+                max_diff = diff;
+            }
+            log_error_sum += log_error;
+            if (log_error > log_error_max) {
+                log_error_max = log_error;
+            }
+        }
+
+        if (energy_float > 0.0) {
+            double energy_error = fabs(energy_float - energy_fixed) / energy_float;
+            if (energy_error > energy_error_max) {
+                energy_error_max = energy_error;
+            }
+        }
+        columns++;
+    }
+    free(samples);
+
+    if (columns == 0) {
+        LogError("The file is shorter than one column.");
+        return 1;
+    }
+
+    double values = (double)columns * SPECTROGRAM_ENGINE_NMEL;
+    printf("columns: %u, fft: %s\n", (unsigned)columns, LOGMEL_FIXED_FFT_Q31 ? "q31" : "q15");
+    printf("input diff: 0: %.3f%%, 1: %.3f%%, 2: %.3f%%, >2: %.3f%%, max: %u (tolerance %u)\n",
+           100.0 * (double)histogram[0] / values, 100.0 * (double)histogram[1] / values,
+           100.0 * (double)histogram[2] / values, 100.0 * (double)histogram[3] / values,
+           (unsigned)max_diff, (unsigned)tolerance);
+    printf("log-mel error: mean %.6f, max %.6f\n", log_error_sum / values, log_error_max);
+    printf("spectrum sum relative error: max %.6f\n", energy_error_max);
+    printf("time per column: float %.2f us, fixed %.2f us\n",
+           (double)float_ns / 1000.0 / columns, (double)fixed_ns / 1000.0 / columns);
+
+    return (max_diff <= tolerance) ? 0 : 3;
+}
@@ -0,0 +1,304 @@
+/**
+ * @file retrain_codec_bench.c
+ * @brief Size, quality and speed of the encodings of the retrain uploads.
+ *
+ * Encodes windows of RETRAIN_RING_WINDOW_SAMPLES with retrain_codec.c, fed in
+ * two parts split at a random sample as the windows wrapping around their
+ * ring slot, decodes them as the retrain trigger lambda and prints for each
+ * encoding the bytes uploaded, the signal to noise ratio of the decoded
+ * audio and the time to encode a window.
+ *
+ * The windows are random sounds: tones, sweeps and noise bursts over a
+ * quiet background at random levels, or the windows of a 16 kHz mono WAV
+ * file. -o writes the IMA-ADPCM body of the first window and the PCM it
+ * decodes to, as test vectors of the lambda.
+ *
+ * Usage: retrain_codec_bench [-n windows] [-s seed] [-o prefix] [file.wav]
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app/retrain/retrain_codec.h"
+#include "app/retrain/retrain_ring.h"
+#include "wav_reader.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Default number of windows encoded */
+#define DEFAULT_WINDOWS 200U
+
+#define WINDOW_SAMPLES RETRAIN_RING_WINDOW_SAMPLES
+
+#define PI 3.14159265358979323846
+
+/* ============================ Static Variables ============================ */
+
+static const RetrainCodec_t s_codecs[] = {RETRAIN_CODEC_PCM16, RETRAIN_CODEC_IMA_ADPCM, RETRAIN_CODEC_MULAW};
+#define CODEC_COUNT (sizeof(s_codecs) / sizeof(s_codecs[0]))
+
+static int16_t s_window[WINDOW_SAMPLES];
+static int16_t s_decoded[WINDOW_SAMPLES];
+static uint8_t s_encoded[RETRAIN_CODEC_SIZE(RETRAIN_CODEC_PCM16, WINDOW_SAMPLES)];
+
+static const int16_t s_ima_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t s_ima_index_steps[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static uint64_t s_rng = 0x9E3779B97F4A7C15ULL;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t rng_next(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng >> 32);
+}
+
+static double rng_unit(void) {
+    return (double)rng_next() / 4294967296.0;
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int16_t clamp_sample(double value) {
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)lrint(value);
+}
+
+/* Background noise, then a tone, a sweep or a noise burst around the middle, as a triggering sound */
+static void make_window(void) {
+    double background = 30.0 + rng_unit() * 300.0;
+    double level = 500.0 + rng_unit() * 20000.0;
+    uint32_t kind = rng_next() % 3U;
+    uint32_t start = (uint32_t)(rng_unit() * WINDOW_SAMPLES / 2);
+    uint32_t length = WINDOW_SAMPLES / 8U + rng_next() % (WINDOW_SAMPLES / 2U);
+    double f0 = 100.0 + rng_unit() * 3000.0;
+    double f1 = 100.0 + rng_unit() * 7000.0;
+    double phase = 0.0;
+
+    for (uint32_t i = 0; i < WINDOW_SAMPLES; i++) {
+        double value = background * (rng_unit() * 2.0 - 1.0);
+        if (i >= start && i < start + length) {
+            double t = (double)(i - start) / length;
+            double envelope = level * sin(PI * t);
+            if (kind == 0U) {
+                phase += 2.0 * PI * f0 / RETRAIN_RING_SAMPLE_RATE;
+                value += envelope * sin(phase);
+            } else if (kind == 1U) {
+                phase += 2.0 * PI * (f0 + (f1 - f0) * t) / RETRAIN_RING_SAMPLE_RATE;
+                value += envelope * sin(phase);
+            } else {
+                value += envelope * (rng_unit() * 2.0 - 1.0);
+            }
+        }
+        s_window[i] = clamp_sample(value);
+    }
+}
+
+static bool read_window(WavReader_t* reader) {
+    size_t size = WavReader_Read(reader, (uint8_t*)s_window, sizeof(s_window));
+    memset((uint8_t*)s_window + size, 0, sizeof(s_window) - size);
+    return size > 0U;
+}
+
+/* Decoders, as the retrain trigger lambda */
+
+static size_t decode_ima(const uint8_t* in, size_t length, int16_t* out) {
+    size_t count = 0;
+
+    for (size_t block = 0; block < length; block += RETRAIN_CODEC_IMA_BLOCK_SIZE) {
+        size_t end = (block + RETRAIN_CODEC_IMA_BLOCK_SIZE < length) ? (block + RETRAIN_CODEC_IMA_BLOCK_SIZE) : length;
+        int32_t predictor = (int16_t)(in[block] | (in[block + 1U] << 8));
+        int32_t index = in[block + 2U];
+        out[count++] = (int16_t)predictor;
+        for (size_t i = block + 4U; i < end; i++) {
+            for (int shift = 0; shift <= 4; shift += 4) {
+                uint8_t nibble = (uint8_t)((in[i] >> shift) & 0x0F);
+                int32_t step = s_ima_steps[index];
+                int32_t delta = step >> 3;
+                if (nibble & 4U) {
+                    delta += step;
+                }
+                if (nibble & 2U) {
+                    delta += step >> 1;
+                }
+                if (nibble & 1U) {
+                    delta += step >> 2;
+                }
+                predictor += (nibble & 8U) ? -delta : delta;
+                predictor = (predictor > INT16_MAX) ? INT16_MAX : (predictor < INT16_MIN) ? INT16_MIN : predictor;
+                index += s_ima_index_steps[nibble];
+                index = (index < 0) ? 0 : (index > 88) ? 88 : index;
+                out[count++] = (int16_t)predictor;
+            }
+        }
+    }
+    return count;
+}
+
+static size_t decode_mulaw(const uint8_t* in, size_t length, int16_t* out) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t code = (uint8_t)~in[i];
+        int32_t exponent = (code >> 4) & 0x07;
+        int32_t magnitude = ((((code & 0x0F) << 3) + 0x84) << exponent) - 0x84;
+        out[i] = (int16_t)((code & 0x80) ? -magnitude : magnitude);
+    }
+    return length;
+}
+
+static size_t decode_pcm(const uint8_t* in, size_t length, int16_t* out) {
+    for (size_t i = 0; i + 1U < length; i += 2U) {
+        out[i / 2U] = (int16_t)(in[i] | (in[i + 1U] << 8));
+    }
+    return length / 2U;
+}
+
+static size_t decode(RetrainCodec_t codec, const uint8_t* in, size_t length, int16_t* out) {
+    switch (codec) {
+    case RETRAIN_CODEC_IMA_ADPCM:
+        return decode_ima(in, length, out);
+    case RETRAIN_CODEC_MULAW:
+        return decode_mulaw(in, length, out);
+    default:
+        return decode_pcm(in, length, out);
+    }
+}
+
+static bool write_file(const char* prefix, const char* suffix, const void* data, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s%s", prefix, suffix);
+    FILE* file = fopen(path, "wb");
+    bool written = (file != NULL) && fwrite(data, 1, size, file) == size;
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (!written) {
+        fprintf(stderr, "Cannot write %s\n", path);
+    }
+    return written;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t windows = DEFAULT_WINDOWS;
+    const char* wav_path = NULL;
+    const char* prefix = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-n") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            windows = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc) {
+            s_rng ^= strtoull(argv[++i], NULL, 0);
+        } else if (0 == strcmp(argv[i], "-o") && (i + 1) < argc) {
+            prefix = argv[++i];
+        } else if (argv[i][0] != '-' && wav_path == NULL) {
+            wav_path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [-n windows] [-s seed] [-o prefix] [file.wav]\n", argv[0]);
+            fprintf(stderr, "  -n  number of windows encoded (default %u)\n", (unsigned)DEFAULT_WINDOWS);
+            fprintf(stderr, "  -s  seed of the random sounds\n");
+            fprintf(stderr, "  -o  write the IMA-ADPCM body of the first window to <prefix>.adpcm\n");
+            fprintf(stderr, "      and the PCM it decodes to to <prefix>.pcm\n");
+            fprintf(stderr, "  file.wav  16 kHz mono 16-bit windows instead of random sounds\n");
+            return 2;
+        }
+    }
+
+    WavReader_t reader;
+    if (wav_path != NULL) {
+        if (!WavReader_Open(&reader, wav_path)) {
+            fprintf(stderr, "Cannot open %s as a PCM WAV file\n", wav_path);
+            return 1;
+        }
+        if (reader.sample_rate != RETRAIN_RING_SAMPLE_RATE || reader.channels != 1U || reader.bits_per_sample != 16U) {
+            fprintf(stderr, "%s is not 16 kHz mono 16-bit\n", wav_path);
+            WavReader_Close(&reader);
+            return 1;
+        }
+    }
+
+    size_t bytes[CODEC_COUNT] = {0};
+    double signal[CODEC_COUNT] = {0}, noise[CODEC_COUNT] = {0};
+    uint64_t encode_ns[CODEC_COUNT] = {0};
+    uint32_t count = 0;
+
+    for (; count < windows; count++) {
+        if (wav_path != NULL) {
+            if (!read_window(&reader)) {
+                break;
+            }
+        } else {
+            make_window();
+        }
+        size_t split = rng_next() % WINDOW_SAMPLES;
+
+        for (uint32_t c = 0; c < CODEC_COUNT; c++) {
+            RetrainEncoder_t encoder;
+            RetrainEncoder_Init(&encoder, s_codecs[c], s_encoded, RETRAIN_CODEC_SIZE(s_codecs[c], WINDOW_SAMPLES));
+            uint64_t start = get_time_ns();
+            bool encoded = RetrainEncoder_Write(&encoder, s_window, split)
+                           && RetrainEncoder_Write(&encoder, &s_window[split], WINDOW_SAMPLES - split);
+            encode_ns[c] += get_time_ns() - start;
+
+            if (!encoded || encoder.length != RETRAIN_CODEC_SIZE(s_codecs[c], WINDOW_SAMPLES)) {
+                fprintf(stderr, "window %u: %s encoded to %u bytes, %u expected\n", (unsigned)count,
+                        RetrainCodec_Name(s_codecs[c]), (unsigned)encoder.length,
+                        (unsigned)RETRAIN_CODEC_SIZE(s_codecs[c], WINDOW_SAMPLES));
+                return 3;
+            }
+            if (decode(s_codecs[c], s_encoded, encoder.length, s_decoded) != WINDOW_SAMPLES) {
+                fprintf(stderr, "window %u: %s decoded to another number of samples\n", (unsigned)count,
+                        RetrainCodec_Name(s_codecs[c]));
+                return 3;
+            }
+            if (count == 0U && prefix != NULL && s_codecs[c] == RETRAIN_CODEC_IMA_ADPCM
+                    && !(write_file(prefix, ".adpcm", s_encoded, encoder.length)
+                         && write_file(prefix, ".pcm", s_decoded, sizeof(s_decoded)))) {
+                return 1;
+            }
+            bytes[c] += encoder.length;
+            for (uint32_t i = 0; i < WINDOW_SAMPLES; i++) {
+                double error = (double)s_decoded[i] - s_window[i];
+                signal[c] += (double)s_window[i] * s_window[i];
+                noise[c] += error * error;
+            }
+        }
+    }
+    if (wav_path != NULL) {
+        WavReader_Close(&reader);
+    }
+    if (count == 0U) {
+        fprintf(stderr, "No window encoded\n");
+        return 1;
+    }
+
+    printf("windows: %u of %u samples\n", (unsigned)count, (unsigned)WINDOW_SAMPLES);
+    printf("%-10s %10s %8s %10s %14s\n", "encoding", "bytes", "ratio", "snr (dB)", "encode (us)");
+    for (uint32_t c = 0; c < CODEC_COUNT; c++) {
+        double snr = (noise[c] > 0.0) ? 10.0 * log10(signal[c] / noise[c]) : INFINITY;
+        printf("%-10s %10u %8.2f %10.1f %14.1f\n", RetrainCodec_Name(s_codecs[c]), (unsigned)(bytes[c] / count),
+               (double)bytes[0] / (double)bytes[c], snr, (double)encode_ns[c] / 1000.0 / count);
+    }
+    return 0;
+}
@@ -0,0 +1,294 @@
+/**
+ * @file retrain_ring_sim.c
+ * @brief Random triggers, uploads and overruns on the retrain audio ring.
+ *
+ * Feeds retrain_ring.c with a stream of samples numbering themselves, in
+ * chunks of random sizes as the DMA halves, with random triggers of random
+ * confidences and DMA overruns skipping samples. Windows are locked into a
+ * queue of messages, at times twice in a row, and sent one after the other
+ * after a random delay as by the retrain task. Without a READY window, a
+ * lock takes the last window queued once more: those are counted apart from
+ * the new windows queued.
+ *
+ * Each window sent must be made of consecutive samples, the trigger being
+ * the first sample written after a RetrainRing_Trigger() call, preceded by
+ * up to RETRAIN_RING_PRE_SAMPLES and followed by RETRAIN_RING_POST_SAMPLES
+ * at least, and must not have changed since it was queued. Once the queue
+ * is empty, no slot may be left locked, and no more new windows may have
+ * been queued than captured. The mean confidence of the new windows sent,
+ * which depends on the eviction policy, the time spent in the audio task by
+ * the writes and the time to put a window in order are printed.
+ *
+ * Usage: retrain_ring_sim [-n chunks] [-s seed] [-e oldest|confidence]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app/retrain/retrain_ring.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Default number of chunks written */
+#define DEFAULT_CHUNKS 200000U
+
+/* Largest chunk, a DMA half of the firmware is 15360 samples */
+#define MAX_CHUNK 16000U
+
+/* Odds per chunk, in 1/1000 */
+#define TRIGGER_ODDS 30U
+#define LOCK_ODDS 100U
+#define RELOCK_ODDS 200U
+#define GAP_ODDS 2U
+
+/* Chunks before the message at the head of the queue is sent */
+#define MAX_UPLOAD_CHUNKS 40U
+
+/* Messages queued, as the retrain queue */
+#define MAX_MESSAGES 10U
+
+/* Stream positions remembered as trigger points */
+#define MAX_TRIGGER_POINTS 4096U
+
+typedef struct {
+    int32_t slot;
+    uint32_t checksum;          // of the samples, in order
+    bool relocked;              // window queued before
+} Message_t;
+
+/* ============================ Static Variables ============================ */
+
+static int16_t s_chunk[MAX_CHUNK];
+static uint32_t s_trigger_points[MAX_TRIGGER_POINTS];
+static int s_trigger_confidences[MAX_TRIGGER_POINTS];
+static uint32_t s_trigger_count = 0;
+
+static Message_t s_messages[MAX_MESSAGES];
+static uint32_t s_message_head = 0;
+static uint32_t s_message_count = 0;
+
+static uint64_t s_rng = 0x9E3779B97F4A7C15ULL;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t rng_next(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng >> 32);
+}
+
+static bool rng_odds(uint32_t odds) {
+    return (rng_next() % 1000U) < odds;
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Highest confidence of the last trigger points at a sample, by the 16 low bits of their position, -1 if none */
+static int trigger_confidence(uint16_t sample) {
+    uint32_t count = (s_trigger_count < MAX_TRIGGER_POINTS) ? s_trigger_count : MAX_TRIGGER_POINTS;
+    int confidence = -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if ((uint16_t)s_trigger_points[i] == sample && s_trigger_confidences[i] > confidence) {
+            confidence = s_trigger_confidences[i];
+        }
+    }
+    return confidence;
+}
+
+static uint32_t checksum_part(uint32_t sum, const int16_t* samples, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        sum = (sum * 31U) + (uint16_t)samples[i];
+    }
+    return sum;
+}
+
+static uint32_t checksum_window(const RetrainRingWindow_t* window) {
+    uint32_t sum = checksum_part(0, window->first, window->first_count);
+    return checksum_part(sum, window->second, window->second_count);
+}
+
+/* Check a window put in order, its samples being the 16 low bits of their stream position */
+static bool check_window(const RetrainRingWindow_t* window, uint32_t chunk) {
+    const int16_t* samples = window->first;
+
+    if (window->second_count != 0U || window->first_count != RETRAIN_RING_WINDOW_SAMPLES) {
+        fprintf(stderr, "chunk %u: window not in order\n", (unsigned)chunk);
+        return false;
+    }
+    for (uint32_t i = 1; i < RETRAIN_RING_WINDOW_SAMPLES; i++) {
+        if ((uint16_t)(samples[i] - samples[i - 1]) != 1U) {
+            fprintf(stderr, "chunk %u: samples %u and %u of the window are not consecutive\n",
+                    (unsigned)chunk, (unsigned)(i - 1U), (unsigned)i);
+            return false;
+        }
+    }
+    if (window->trigger_offset > RETRAIN_RING_PRE_SAMPLES
+            || (RETRAIN_RING_WINDOW_SAMPLES - window->trigger_offset) < RETRAIN_RING_POST_SAMPLES) {
+        fprintf(stderr, "chunk %u: trigger at %u of the window\n", (unsigned)chunk, (unsigned)window->trigger_offset);
+        return false;
+    }
+    uint16_t trigger = (uint16_t)samples[window->trigger_offset];
+    int confidence = trigger_confidence(trigger);
+    if (confidence < 0 || window->confidence > confidence) {
+        fprintf(stderr, "chunk %u: window triggered at sample %u, confidence %d, not a trigger point\n",
+                (unsigned)chunk, (unsigned)trigger, window->confidence);
+        return false;
+    }
+    return true;
+}
+
+/* Send the message at the head of the queue as the retrain task */
+static bool send_message(uint32_t chunk, uint64_t* linearize_ns, uint64_t* confidence_sum) {
+    const Message_t* message = &s_messages[s_message_head];
+    RetrainRingWindow_t window;
+
+    if (!RetrainRing_GetWindow(message->slot, &window)) {
+        fprintf(stderr, "chunk %u: window of slot %d not locked\n", (unsigned)chunk, (int)message->slot);
+        return false;
+    }
+    uint64_t start = get_time_ns();
+    RetrainRing_Linearize(&window);
+    *linearize_ns += get_time_ns() - start;
+    if (!check_window(&window, chunk)) {
+        return false;
+    }
+    if (checksum_window(&window) != message->checksum) {
+        fprintf(stderr, "chunk %u: window of slot %d changed while queued\n", (unsigned)chunk, (int)message->slot);
+        return false;
+    }
+    *confidence_sum += message->relocked ? 0U : (uint64_t)window.confidence;
+    RetrainRing_Release(message->slot);
+    s_message_head = (s_message_head + 1U) % MAX_MESSAGES;
+    s_message_count--;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t chunks = DEFAULT_CHUNKS;
+    RetrainRingEviction_t eviction = RETRAIN_RING_EVICTION;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-n") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            chunks = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc) {
+            s_rng ^= strtoull(argv[++i], NULL, 0);
+        } else if (0 == strcmp(argv[i], "-e") && (i + 1) < argc && 0 == strcmp(argv[i + 1], "oldest")) {
+            eviction = RETRAIN_RING_EVICT_OLDEST;
+            i++;
+        } else if (0 == strcmp(argv[i], "-e") && (i + 1) < argc && 0 == strcmp(argv[i + 1], "confidence")) {
+            eviction = RETRAIN_RING_EVICT_LOWEST_CONFIDENCE;
+            i++;
+        } else {
+            fprintf(stderr, "Usage: %s [-n chunks] [-s seed] [-e oldest|confidence]\n", argv[0]);
+            fprintf(stderr, "  -n  number of chunks of samples written (default %u)\n", (unsigned)DEFAULT_CHUNKS);
+            fprintf(stderr, "  -s  seed of the random chunks, triggers, uploads and overruns\n");
+            fprintf(stderr, "  -e  window evicted when no slot is free, the oldest or the least confident\n");
+            return 2;
+        }
+    }
+
+    RetrainRing_Init(NULL, NULL);
+    RetrainRing_SetEviction(eviction);
+
+    uint32_t position = 0;              // stream position of the next sample
+    uint32_t send_chunk = 0;
+    uint32_t queued = 0, relocked = 0, frozen = 0, samples = 0;
+    uint64_t write_ns = 0, linearize_ns = 0, confidence_sum = 0;
+
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        if (rng_odds(GAP_ODDS)) {
+            // DMA overrun, the samples of the lost halves are skipped
+            position += 1U + rng_next() % MAX_CHUNK;
+            RetrainRing_MarkGap();
+        }
+        if (rng_odds(TRIGGER_ODDS)) {
+            // the trigger is the first sample written next
+            int confidence = (int)(rng_next() % 100U);
+            RetrainRing_Trigger(confidence);
+            s_trigger_points[s_trigger_count % MAX_TRIGGER_POINTS] = position;
+            s_trigger_confidences[s_trigger_count % MAX_TRIGGER_POINTS] = confidence;
+            s_trigger_count++;
+        }
+
+        uint32_t count = 1U + rng_next() % MAX_CHUNK;
+        for (uint32_t i = 0; i < count; i++) {
+            s_chunk[i] = (int16_t)(uint16_t)(position + i);
+        }
+        uint64_t start = get_time_ns();
+        frozen += RetrainRing_Write(s_chunk, count) ? 1U : 0U;
+        write_ns += get_time_ns() - start;
+        position += count;
+        samples += count;
+
+        if (s_message_count > 0U && chunk >= send_chunk) {
+            if (!send_message(chunk, &linearize_ns, &confidence_sum)) {
+                return 3;
+            }
+            send_chunk = chunk + rng_next() % MAX_UPLOAD_CHUNKS;
+        }
+        RetrainRingWindow_t window;
+        uint32_t locks = rng_odds(RELOCK_ODDS) ? 2U : 1U;
+        for (uint32_t i = 0; i < locks && s_message_count < MAX_MESSAGES && rng_odds(LOCK_ODDS); i++) {
+            if (!RetrainRing_Lock(&window)) {
+                break;
+            }
+            if (s_message_count == 0U) {
+                send_chunk = chunk + rng_next() % MAX_UPLOAD_CHUNKS;
+            }
+            Message_t* message = &s_messages[(s_message_head + s_message_count) % MAX_MESSAGES];
+            message->slot = window.slot;
+            message->checksum = checksum_window(&window);
+            message->relocked = window.relocked;
+            s_message_count++;
+            queued++;
+            relocked += window.relocked ? 1U : 0U;
+        }
+    }
+
+    // the queue is emptied, every slot must be released
+    while (s_message_count > 0U) {
+        if (!send_message(chunks, &linearize_ns, &confidence_sum)) {
+            return 3;
+        }
+    }
+    for (int32_t slot = 0; slot < (int32_t)RETRAIN_RING_SLOTS; slot++) {
+        RetrainRingWindow_t window;
+        if (RetrainRing_GetWindow(slot, &window)) {
+            fprintf(stderr, "slot %d still locked\n", (int)slot);
+            return 3;
+        }
+    }
+
+    RetrainRingStats_t stats;
+    RetrainRing_GetStats(&stats);
+    printf("chunks: %u, samples: %u, window: %u samples (%u before the trigger), slots: %u\n", (unsigned)chunks,
+           (unsigned)samples, (unsigned)RETRAIN_RING_WINDOW_SAMPLES, (unsigned)RETRAIN_RING_PRE_SAMPLES,
+           (unsigned)RETRAIN_RING_SLOTS);
+    printf("captured: %u, sent: %u new windows and %u locked again, evicted: %u, dropped samples: %u, gaps: %u\n",
+           (unsigned)stats.captured, (unsigned)(queued - relocked), (unsigned)relocked, (unsigned)stats.evicted,
+           (unsigned)stats.dropped_samples, (unsigned)stats.gaps);
+    printf("mean confidence of the new windows sent: %.1f%%\n",
+           (queued > relocked) ? (double)confidence_sum / (queued - relocked) : 0.0);
+    if (stats.captured != frozen) {
+        fprintf(stderr, "%u windows frozen, %u counted\n", (unsigned)frozen, (unsigned)stats.captured);
+        return 3;
+    }
+    if (stats.relocked != relocked || queued - relocked > stats.captured) {
+        fprintf(stderr, "%u windows locked again, %u counted, %u new ones for %u captured\n", (unsigned)relocked,
+                (unsigned)stats.relocked, (unsigned)(queued - relocked), (unsigned)stats.captured);
+        return 3;
+    }
+    printf("write: %.2f ns per sample, linearize: %.1f us per window\n",
+           (double)write_ns / (double)samples, queued ? (double)linearize_ns / 1000.0 / queued : 0.0);
+    return 0;
+}
@@ -0,0 +1,628 @@
+/**
+ * @file s3_keepalive_bench.c
+ * @brief TLS handshakes avoided by keeping the retrain upload connection open.
+ *
+ * Runs a local HTTPS server in a thread, with a self-signed RSA-2048
+ * certificate as the retrain endpoint, and posts bodies of a retrain window
+ * to it separated by random pauses, in three modes:
+ *
+ *  - close: a connection per upload, as the retrain task did before,
+ *  - keepalive: the connection kept between the uploads as decided by
+ *    s3_connection.c, closed once idle as the retrain task does,
+ *  - resume: keepalive, a new connection resuming the session of the last
+ *    full handshake with its session ticket.
+ *
+ * The server closes a connection idle for its own timeout, or answers
+ * "Connection: close" after a number of requests, as the front ends of the
+ * endpoint do: an idle timeout of the server below the one of the client
+ * makes requests fail on a connection it closed, sent once more on a new one.
+ * Every upload must get its 200 and the server receive each body once.
+ *
+ * Prints for each mode the full and resumed handshakes counted by the
+ * server, the requests sent on a kept connection, the closes and the mean
+ * time of an upload.
+ *
+ * Usage: s3_keepalive_bench [-n uploads] [-s seed] [-p pause_ms] [-i idle_ms]
+ *                           [-S server_idle_ms] [-r requests] [-b bytes] [-2]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include "app/s3_client/s3_connection.h"
+#include "app/retrain/retrain_codec.h"
+#include "app/retrain/retrain_ring.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Default number of uploads of each mode */
+#define DEFAULT_UPLOADS 60U
+
+/* Default mean pause between two uploads, the pauses being uniform up to twice the mean */
+#define DEFAULT_PAUSE_MS 60U
+
+/* Default idle timeouts of the client and the server */
+#define DEFAULT_IDLE_MS 100U
+#define DEFAULT_SERVER_IDLE_MS 150U
+
+/* Default body, a window encoded in IMA-ADPCM */
+#define DEFAULT_BODY_SIZE RETRAIN_CODEC_SIZE(RETRAIN_CODEC_IMA_ADPCM, RETRAIN_RING_WINDOW_SAMPLES)
+#define MAX_BODY_SIZE (1U << 20)
+
+#define HOST "localhost"
+
+/* Receive timeout of the sockets, against a hang on an error of the bench */
+#define SOCKET_TIMEOUT_S 5
+
+#define HEADERS_SIZE 1024U
+
+typedef enum {
+    MODE_CLOSE = 0,
+    MODE_KEEPALIVE,
+    MODE_RESUME,
+    MODE_COUNT,
+} Mode_t;
+
+typedef struct {
+    SSL_CTX* ctx;
+    int listen_fd;
+    uint32_t idle_ms;
+    uint32_t max_requests;
+    pthread_mutex_t mutex;
+    bool stop;
+    bool busy;              // a connection is being served
+    uint32_t handshakes;
+    uint32_t resumptions;
+    uint32_t requests;
+    uint32_t idle_closes;
+    uint64_t bytes;
+    uint32_t bad_bodies;
+} Server_t;
+
+typedef struct {
+    SSL* ssl;
+    int fd;
+} Client_t;
+
+/* ============================ Static Variables ============================ */
+
+static const char* const s_mode_names[MODE_COUNT] = {"close", "keepalive", "resume"};
+
+static Server_t s_server;
+static uint8_t s_body[MAX_BODY_SIZE];
+static uint8_t s_received[MAX_BODY_SIZE];
+
+static uint64_t s_rng = 0x9E3779B97F4A7C15ULL;
+
+/* ============================ Function Implementations ============================ */
+
+static uint32_t rng_next(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng >> 32);
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t get_time_ms(void) {
+    return (uint32_t)(get_time_ns() / 1000000ULL);
+}
+
+static void sleep_ms(uint32_t ms) {
+    struct timespec ts = {.tv_sec = ms / 1000U, .tv_nsec = (long)(ms % 1000U) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+/* Timeouts, and no delay of the body sent after the headers by the delayed ACK of the headers */
+static void set_socket_options(int fd) {
+    struct timeval tv = {.tv_sec = SOCKET_TIMEOUT_S, .tv_usec = 0};
+    int nodelay = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+}
+
+/* Self-signed certificate of HOST */
+static bool make_certificate(EVP_PKEY** key, X509** cert) {
+    *key = EVP_RSA_gen(2048);
+    *cert = X509_new();
+    if (*key == NULL || *cert == NULL) {
+        return false;
+    }
+    X509_set_version(*cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(*cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(*cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(*cert), 24 * 3600);
+    X509_set_pubkey(*cert, *key);
+    X509_NAME* name = X509_get_subject_name(*cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)HOST, -1, -1, 0);
+    X509_set_issuer_name(*cert, name);
+
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, *cert, *cert, NULL, NULL, 0);
+    X509_EXTENSION* san = X509V3_EXT_conf_nid(NULL, &v3, NID_subject_alt_name, "DNS:" HOST);
+    if (san == NULL) {
+        return false;
+    }
+    X509_add_ext(*cert, san, -1);
+    X509_EXTENSION_free(san);
+    return X509_sign(*cert, *key, EVP_sha256()) > 0;
+}
+
+static void server_count(uint32_t* counter, uint32_t add) {
+    pthread_mutex_lock(&s_server.mutex);
+    *counter += add;
+    pthread_mutex_unlock(&s_server.mutex);
+}
+
+/* Reads the headers of a request and its body, false once the connection is closed */
+static bool server_read_request(SSL* ssl, int fd, size_t* body_length) {
+    char headers[HEADERS_SIZE + 1U];
+    size_t length = 0;
+    char* end = NULL;
+
+    // the connection is closed once idle, as the server of the endpoint does
+    if (SSL_pending(ssl) == 0) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, (int)s_server.idle_ms) == 0) {
+            server_count(&s_server.idle_closes, 1);
+            return false;
+        }
+    }
+
+    while (end == NULL) {
+        if (length == HEADERS_SIZE) {
+            return false;
+        }
+        int read = SSL_read(ssl, &headers[length], (int)(HEADERS_SIZE - length));
+        if (read <= 0) {
+            return false;
+        }
+        length += (size_t)read;
+        headers[length] = '\0';
+        end = strstr(headers, "\r\n\r\n");
+    }
+
+    const char* content_length = strstr(headers, "Content-Length: ");
+    if (content_length == NULL) {
+        return false;
+    }
+    *body_length = strtoul(content_length + strlen("Content-Length: "), NULL, 10);
+    if (*body_length > MAX_BODY_SIZE) {
+        return false;
+    }
+
+    size_t received = length - (size_t)(end + 4 - headers);
+    if (received > *body_length) {
+        return false;
+    }
+    memcpy(s_received, end + 4, received);
+    while (received < *body_length) {
+        int read = SSL_read(ssl, &s_received[received], (int)(*body_length - received));
+        if (read <= 0) {
+            return false;
+        }
+        received += (size_t)read;
+    }
+    return true;
+}
+
+static void server_serve(SSL* ssl, int fd) {
+    uint32_t requests = 0;
+
+    if (SSL_accept(ssl) <= 0) {
+        return;
+    }
+    server_count(SSL_session_reused(ssl) ? &s_server.resumptions : &s_server.handshakes, 1);
+
+    size_t body_length = 0;
+    while (server_read_request(ssl, fd, &body_length)) {
+        requests++;
+        bool close = s_server.max_requests > 0U && requests >= s_server.max_requests;
+
+        pthread_mutex_lock(&s_server.mutex);
+        s_server.requests++;
+        s_server.bytes += body_length;
+        // the first word numbers the upload, the rest is the common body
+        if (body_length <= sizeof(uint32_t)
+                || memcmp(&s_received[sizeof(uint32_t)], &s_body[sizeof(uint32_t)], body_length - sizeof(uint32_t)) != 0) {
+            s_server.bad_bodies++;
+        }
+        pthread_mutex_unlock(&s_server.mutex);
+
+        char response[128];
+        int length = snprintf(response, sizeof(response),
+                              "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: %s\r\n\r\nOK",
+                              close ? "close" : "keep-alive");
+        if (SSL_write(ssl, response, length) != length || close) {
+            break;
+        }
+    }
+    SSL_shutdown(ssl);
+}
+
+static void* server_thread(void* arg) {
+    (void)arg;
+
+    for (;;) {
+        struct pollfd pfd = {.fd = s_server.listen_fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, 50);
+
+        pthread_mutex_lock(&s_server.mutex);
+        bool stop = s_server.stop;
+        s_server.busy = ready > 0;
+        pthread_mutex_unlock(&s_server.mutex);
+        if (stop) {
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        int fd = accept(s_server.listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            set_socket_options(fd);
+            SSL* ssl = SSL_new(s_server.ctx);
+            SSL_set_fd(ssl, fd);
+            server_serve(ssl, fd);
+            SSL_free(ssl);
+            close(fd);
+        }
+        pthread_mutex_lock(&s_server.mutex);
+        s_server.busy = false;
+        pthread_mutex_unlock(&s_server.mutex);
+    }
+    return NULL;
+}
+
+static int server_start(SSL_CTX* ctx, uint16_t* port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = 0, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_length = sizeof(addr);
+
+    s_server.ctx = ctx;
+    s_server.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s_server.listen_fd < 0
+            || bind(s_server.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+            || listen(s_server.listen_fd, 4) != 0
+            || getsockname(s_server.listen_fd, (struct sockaddr*)&addr, &addr_length) != 0) {
+        perror("server socket");
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    pthread_mutex_init(&s_server.mutex, NULL);
+    return 0;
+}
+
+/* Waits for the server to be done with the connections of a mode, then takes its counters */
+static Server_t server_take_counters(void) {
+    Server_t counters;
+
+    for (;;) {
+        sleep_ms(60);
+        pthread_mutex_lock(&s_server.mutex);
+        bool busy = s_server.busy;
+        counters = s_server;
+        if (!busy) {
+            s_server.handshakes = 0;
+            s_server.resumptions = 0;
+            s_server.requests = 0;
+            s_server.idle_closes = 0;
+            s_server.bytes = 0;
+            s_server.bad_bodies = 0;
+        }
+        pthread_mutex_unlock(&s_server.mutex);
+        if (!busy) {
+            return counters;
+        }
+    }
+}
+
+static bool client_open(Client_t* client, SSL_CTX* ctx, uint16_t port, SSL_SESSION* session, bool* resumed) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("client socket");
+        return false;
+    }
+    set_socket_options(client->fd);
+    client->ssl = SSL_new(ctx);
+    SSL_set_fd(client->ssl, client->fd);
+    SSL_set_tlsext_host_name(client->ssl, HOST);
+    SSL_set1_host(client->ssl, HOST);
+    if (session != NULL) {
+        SSL_set_session(client->ssl, session);
+    }
+    if (SSL_connect(client->ssl) <= 0) {
+        ERR_print_errors_fp(stderr);
+        SSL_free(client->ssl);
+        close(client->fd);
+        client->ssl = NULL;
+        return false;
+    }
+    *resumed = SSL_session_reused(client->ssl) != 0;
+    return true;
+}
+
+static void client_close(Client_t* client) {
+    if (client->ssl != NULL) {
+        SSL_shutdown(client->ssl);
+        SSL_free(client->ssl);
+        close(client->fd);
+        client->ssl = NULL;
+    }
+}
+
+/* Posts a body and reads the response, false if it failed before a 200 */
+static bool client_post(Client_t* client, size_t body_length, bool* keep_alive) {
+    char request[256];
+    int length = snprintf(request, sizeof(request),
+                          "POST /retrain HTTP/1.1\r\nHost: " HOST "\r\nConnection: keep-alive\r\n"
+                          "Content-Type: application/octet-stream\r\nContent-Length: %u\r\n\r\n",
+                          (unsigned)body_length);
+    if (SSL_write(client->ssl, request, length) != length
+            || SSL_write(client->ssl, s_body, (int)body_length) != (int)body_length) {
+        return false;
+    }
+
+    char response[HEADERS_SIZE + 1U];
+    size_t received = 0;
+    const char* end = NULL;
+    while (end == NULL && received < HEADERS_SIZE) {
+        int read = SSL_read(client->ssl, &response[received], (int)(HEADERS_SIZE - received));
+        if (read <= 0) {
+            return false;
+        }
+        received += (size_t)read;
+        response[received] = '\0';
+        end = strstr(response, "\r\n\r\n");
+    }
+    // the body of the response is read with its headers, as 2 bytes sent at once
+    if (end == NULL || strncmp(response, "HTTP/1.1 200", 12) != 0 || strlen(end) < 4U + 2U) {
+        return false;
+    }
+    *keep_alive = strstr(response, "Connection: close") == NULL;
+    return true;
+}
+
+/* Keeps the session of the connection, once its ticket was received with the response */
+static void keep_session(Client_t* client, SSL_SESSION** session) {
+    SSL_SESSION* current = SSL_get1_session(client->ssl);
+
+    if (current != NULL && SSL_SESSION_is_resumable(current)) {
+        SSL_SESSION_free(*session);
+        *session = current;
+    } else {
+        SSL_SESSION_free(current);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t uploads = DEFAULT_UPLOADS;
+    uint32_t pause_ms = DEFAULT_PAUSE_MS;
+    uint32_t idle_ms = DEFAULT_IDLE_MS;
+    uint32_t server_idle_ms = DEFAULT_SERVER_IDLE_MS;
+    uint32_t max_requests = 0;
+    size_t body_length = DEFAULT_BODY_SIZE;
+    bool tls12 = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-n") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            uploads = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s") && (i + 1) < argc) {
+            s_rng ^= strtoull(argv[++i], NULL, 0);
+        } else if (0 == strcmp(argv[i], "-p") && (i + 1) < argc && atoi(argv[i + 1]) >= 0) {
+            pause_ms = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-i") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            idle_ms = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-S") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            server_idle_ms = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-r") && (i + 1) < argc && atoi(argv[i + 1]) >= 0) {
+            max_requests = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-b") && (i + 1) < argc && atoi(argv[i + 1]) > (int)sizeof(uint32_t)
+                   && atoi(argv[i + 1]) <= (int)MAX_BODY_SIZE) {
+            body_length = (size_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-2")) {
+            tls12 = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-n uploads] [-s seed] [-p pause_ms] [-i idle_ms] [-S server_idle_ms]\n"
+                    "          [-r requests] [-b bytes] [-2]\n", argv[0]);
+            fprintf(stderr, "  -n  number of uploads of each mode (default %u)\n", (unsigned)DEFAULT_UPLOADS);
+            fprintf(stderr, "  -s  seed of the pauses\n");
+            fprintf(stderr, "  -p  mean pause between two uploads, in ms (default %u)\n", (unsigned)DEFAULT_PAUSE_MS);
+            fprintf(stderr, "  -i  idle timeout of the client, in ms (default %u)\n", (unsigned)DEFAULT_IDLE_MS);
+            fprintf(stderr, "  -S  idle timeout of the server, in ms (default %u)\n", (unsigned)DEFAULT_SERVER_IDLE_MS);
+            fprintf(stderr, "  -r  requests the server answers on a connection before closing it (default no limit)\n");
+            fprintf(stderr, "  -b  bytes of a body (default %u)\n", (unsigned)DEFAULT_BODY_SIZE);
+            fprintf(stderr, "  -2  TLS 1.2 instead of 1.3\n");
+            return 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    for (size_t i = 0; i < body_length; i++) {
+        s_body[i] = (uint8_t)rng_next();
+    }
+
+    EVP_PKEY* key = NULL;
+    X509* cert = NULL;
+    SSL_CTX* server_ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    if (!make_certificate(&key, &cert) || server_ctx == NULL || client_ctx == NULL
+            || SSL_CTX_use_certificate(server_ctx, cert) != 1 || SSL_CTX_use_PrivateKey(server_ctx, key) != 1
+            || X509_STORE_add_cert(SSL_CTX_get_cert_store(client_ctx), cert) != 1) {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+    // the client is the only one to keep its session, as the device
+    SSL_CTX_set_session_cache_mode(server_ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_session_cache_mode(client_ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_verify(client_ctx, SSL_VERIFY_PEER, NULL);
+    if (tls12) {
+        SSL_CTX_set_max_proto_version(client_ctx, TLS1_2_VERSION);
+    }
+
+    uint16_t port = 0;
+    s_server.idle_ms = server_idle_ms;
+    s_server.max_requests = max_requests;
+    pthread_t thread;
+    if (server_start(server_ctx, &port) != 0 || pthread_create(&thread, NULL, server_thread, NULL) != 0) {
+        return 1;
+    }
+
+    printf("uploads: %u of %u bytes, pauses up to %u ms, idle timeouts %u ms (client) %u ms (server), TLS %s\n",
+           (unsigned)uploads, (unsigned)body_length, (unsigned)(2U * pause_ms), (unsigned)idle_ms,
+           (unsigned)server_idle_ms, tls12 ? "1.2" : "1.3");
+    printf("%-10s %10s %8s %8s %8s %8s %8s %12s %10s\n", "mode", "handshakes", "resumed", "reused", "idle",
+           "closed", "resent", "upload (ms)", "avoided");
+
+    uint32_t close_handshakes = 0;
+    uint64_t seed = s_rng;
+    int status = 0;
+
+    for (uint32_t mode = 0; mode < MODE_COUNT && status == 0; mode++) {
+        const S3ConnectionConfig_t config = {
+            .idle_timeout_ms = idle_ms,
+            .session_lifetime_ms = (mode == MODE_RESUME) ? 3600000U : 0U,
+            .max_requests = 0,
+        };
+        S3Connection_t connection;
+        S3Connection_Init(&connection, &config);
+        Client_t client = {.ssl = NULL, .fd = -1};
+        SSL_SESSION* session = NULL;
+        uint64_t upload_ns = 0;
+
+        // the same pauses in every mode
+        s_rng = seed;
+
+        for (uint32_t n = 0; n < uploads && status == 0; n++) {
+            uint32_t pause = (n == 0U) ? 0U : rng_next() % (2U * pause_ms + 1U);
+
+            // the retrain task waits for a message no longer than the idle time left
+            uint32_t idle_left = S3Connection_IdleLeft(&connection, get_time_ms());
+            if (mode != MODE_CLOSE && idle_left < pause) {
+                sleep_ms(idle_left);
+                pause -= idle_left;
+                if (S3Connection_CloseIdle(&connection, get_time_ms())) {
+                    client_close(&client);
+                }
+            }
+            sleep_ms(pause);
+
+            memcpy(s_body, &n, sizeof(n));
+            uint64_t start = get_time_ns();
+            bool keep_alive = false;
+            bool resumed = false;
+
+            if (mode == MODE_CLOSE) {
+                if (!client_open(&client, client_ctx, port, NULL, &resumed)
+                        || !client_post(&client, body_length, &keep_alive)) {
+                    fprintf(stderr, "%s: upload %u failed\n", s_mode_names[mode], (unsigned)n);
+                    status = 3;
+                }
+                client_close(&client);
+                upload_ns += get_time_ns() - start;
+                continue;
+            }
+
+            if (S3Connection_Prepare(&connection, HOST, strlen(HOST), get_time_ms()) == S3_CONNECTION_REOPEN) {
+                client_close(&client);
+            }
+            for (bool sent = false; !sent && status == 0;) {
+                if (client.ssl == NULL) {
+                    bool offered = S3Connection_CanResume(&connection, HOST, strlen(HOST), get_time_ms());
+                    if (!client_open(&client, client_ctx, port, offered ? session : NULL, &resumed)) {
+                        S3Connection_Closed(&connection, offered);
+                        fprintf(stderr, "%s: connection %u failed\n", s_mode_names[mode], (unsigned)n);
+                        status = 3;
+                        break;
+                    }
+                    S3Connection_Opened(&connection, HOST, strlen(HOST), get_time_ms(), offered && resumed,
+                                        mode == MODE_RESUME);
+                }
+                sent = client_post(&client, body_length, &keep_alive);
+                if (!sent) {
+                    bool stale = S3Connection_Failed(&connection);
+                    client_close(&client);
+                    if (!stale) {
+                        fprintf(stderr, "%s: upload %u failed on a new connection\n", s_mode_names[mode], (unsigned)n);
+                        status = 3;
+                    }
+                }
+            }
+            if (status != 0) {
+                break;
+            }
+            if (mode == MODE_RESUME) {
+                keep_session(&client, &session);
+            }
+            if (!S3Connection_Completed(&connection, get_time_ms(), keep_alive)) {
+                client_close(&client);
+            }
+            upload_ns += get_time_ns() - start;
+        }
+        client_close(&client);
+        SSL_SESSION_free(session);
+
+        Server_t server = server_take_counters();
+        if (status != 0) {
+            break;
+        }
+        if (server.requests != uploads || server.bytes != (uint64_t)uploads * body_length || server.bad_bodies != 0U) {
+            fprintf(stderr, "%s: the server received %u requests, %llu bytes, %u bad bodies\n", s_mode_names[mode],
+                    (unsigned)server.requests, (unsigned long long)server.bytes, (unsigned)server.bad_bodies);
+            status = 3;
+            break;
+        }
+        const S3ConnectionStats_t* stats = &connection.stats;
+        if (mode != MODE_CLOSE
+                && (server.handshakes != stats->handshakes || server.resumptions != stats->resumptions)) {
+            fprintf(stderr, "%s: the server counted %u handshakes and %u resumed, the client %u and %u\n",
+                    s_mode_names[mode], (unsigned)server.handshakes, (unsigned)server.resumptions,
+                    (unsigned)stats->handshakes, (unsigned)stats->resumptions);
+            status = 3;
+            break;
+        }
+        if (mode == MODE_CLOSE) {
+            close_handshakes = server.handshakes;
+        }
+        printf("%-10s %10u %8u %8u %8u %8u %8u %12.2f %10u\n", s_mode_names[mode], (unsigned)server.handshakes,
+               (unsigned)server.resumptions, (unsigned)stats->reuses, (unsigned)stats->idle_closes,
+               (unsigned)(stats->server_closes + server.idle_closes), (unsigned)stats->stale_retries,
+               (double)upload_ns / 1e6 / uploads, (unsigned)(close_handshakes - server.handshakes));
+    }
+
+    pthread_mutex_lock(&s_server.mutex);
+    s_server.stop = true;
+    pthread_mutex_unlock(&s_server.mutex);
+    pthread_join(thread, NULL);
+    close(s_server.listen_fd);
+    SSL_CTX_free(server_ctx);
+    SSL_CTX_free(client_ctx);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return status;
+}
@@ -0,0 +1,291 @@
+/**
+ * @file telemetry_bench.c
+ * @brief Encoding time and stack usage of the detection telemetry messages.
+ *
+ * Encodes the same detection messages with telemetry_encoder.c and with the
+ * snprintf calls the firmware used before, including the formatting of the
+ * firmware version for every message, and checks that both give the same
+ * bytes. Each implementation runs in a thread with a painted stack so that
+ * its stack high-water mark is measured as uxTaskGetStackHighWaterMark()
+ * does on target, minus the one of a thread doing nothing.
+ *
+ * The figures are those of the host C library: newlib-nano on target uses
+ * less stack in snprintf than glibc, the ratio is what matters.
+ *
+ * The binary encoding is timed as well and the size of the messages in both
+ * formats printed. With -x, the binary messages of the check are printed in
+ * hexadecimal instead, for iot-connect/iot_connect_telemetry_decode.py.
+ *
+ * Usage: telemetry_bench [-n messages] [-x]
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app/telemetry/telemetry_encoder.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* Same as the firmware */
+#define MQTT_PUBLISH_MAX_LEN 512
+
+/* Default number of messages encoded by each implementation */
+#define DEFAULT_MESSAGES 1000000U
+
+/* Size of the painted stack of the measuring threads */
+#define BENCH_STACK_SIZE (256U * 1024U)
+
+/* Value the stack is painted with */
+#define STACK_PAINT 0xA5U
+
+#define VERSION_MAJOR 1
+#define VERSION_MINOR 4
+#define VERSION_BUILD 2
+#define DEVICE_POSITION "36.0863886,-115.1732692"
+#define INACTIVE_POSITION "36.2409530, -115.0633452"
+
+/* ============================ Static Variables ============================ */
+
+static const char* const s_classes[] = {
+    "Alarm", "Bark", "Liquid", "Race_car_and_auto_racing", "Vehicle_horn_and_car_horn_and_honking"
+};
+#define CLASS_COUNT (sizeof(s_classes) / sizeof(s_classes[0]))
+
+static const char* const s_labels = "Alarm:71,Bark:45";
+static const TelemetryLabel_t s_binary_labels[] = { { 0U, 71 }, { 1U, 45 } };
+
+static TelemetryEncoder_t s_encoder;
+static uint32_t s_messages = DEFAULT_MESSAGES;
+static char s_payload[MQTT_PUBLISH_MAX_LEN];   // in the inference context on target, not on the stack
+static volatile size_t s_sink;
+
+/* ============================ Function Implementations ============================ */
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/* As getAppFirmwareVersionString() of mic_sensor_publish.c */
+static const char* get_version_string(void) {
+    static char versionString[16];
+    snprintf(versionString, sizeof(versionString), "%d.%d.%d", VERSION_MAJOR, VERSION_MINOR, VERSION_BUILD);
+    return versionString;
+}
+
+/* The detection message as mic_sensor_publish.c formatted it before the encoder */
+static size_t snprintf_detection(const char* class_name, int confidence, const char* labels, char* buffer) {
+    if (labels != NULL) {
+        return (size_t)snprintf(buffer, (size_t)MQTT_PUBLISH_MAX_LEN,
+                "{\"d\":"\
+                "[{\"d\":{\"version\":\"MLDEMO-%s\",\"class\":\"%s\",\"confidence\":%d,\"labels\":\"%s\",\"position\":[%s]}}]"\
+                ",\"mt\":0}",
+                get_version_string(),
+                class_name,
+                confidence,
+                labels,
+                DEVICE_POSITION
+        );
+    }
+    return (size_t)snprintf(buffer, (size_t)MQTT_PUBLISH_MAX_LEN,
+            "{\"d\":"\
+            "[{\"d\":{\"version\":\"MLDEMO-%s\",\"class\":\"%s\",\"confidence\":%d,\"position\":[%s]}}]"\
+            ",\"mt\":0}",
+            get_version_string(),
+            class_name,
+            confidence,
+            DEVICE_POSITION
+    );
+}
+
+static size_t snprintf_idle(char* buffer) {
+    return (size_t)snprintf(buffer, (size_t)MQTT_PUBLISH_MAX_LEN,
+            "{\"d\":"\
+            "[{\"d\":{\"version\":\"MLDEMO-%s \",\"class\":\"%s\",\"confidence\":%d,\"position\":[%s]}}]"\
+            ",\"mt\":0}",
+            get_version_string(),
+            "not-active",
+            100,
+            INACTIVE_POSITION
+    );
+}
+
+static size_t encoder_detection(const char* class_name, int confidence, const char* labels, char* buffer) {
+    return TelemetryEncoder_Detection(&s_encoder, class_name, confidence, labels, buffer, MQTT_PUBLISH_MAX_LEN);
+}
+
+static size_t binary_detection(uint32_t sequence, uint32_t class_idx, int confidence, bool labels, uint8_t* buffer) {
+    TelemetryLabel_t label = { class_idx, confidence };
+    if (labels) {
+        return TelemetryEncoder_Binary(sequence, sequence * 1500U, s_binary_labels, 2U, buffer, MQTT_PUBLISH_MAX_LEN);
+    }
+    return TelemetryEncoder_Binary(sequence, sequence * 1500U, &label, 1U, buffer, MQTT_PUBLISH_MAX_LEN);
+}
+
+static void* run_nothing(void* arg) {
+    (void)arg;
+    return NULL;
+}
+
+static void* run_snprintf(void* arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < s_messages; i++) {
+        s_sink = snprintf_detection(s_classes[i % CLASS_COUNT], (int)(i % 101U), NULL, s_payload);
+    }
+    return NULL;
+}
+
+static void* run_encoder(void* arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < s_messages; i++) {
+        s_sink = encoder_detection(s_classes[i % CLASS_COUNT], (int)(i % 101U), NULL, s_payload);
+    }
+    return NULL;
+}
+
+static void* run_binary(void* arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < s_messages; i++) {
+        s_sink = binary_detection(i, i % CLASS_COUNT, (int)(i % 101U), false, (uint8_t*)s_payload);
+    }
+    return NULL;
+}
+
+/* The binary messages of the check, one per line in hexadecimal */
+static void print_binary(void) {
+    uint8_t message[MQTT_PUBLISH_MAX_LEN];
+
+    for (uint32_t i = 0; i < CLASS_COUNT * 2U; i++) {
+        size_t len = binary_detection(i, i % CLASS_COUNT, (int)(i * 23U % 101U), i >= CLASS_COUNT, message);
+        for (size_t j = 0; j < len; j++) {
+            printf("%02x", message[j]);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * Run a function in a thread with a painted stack.
+ *
+ * @return Number of bytes of stack used, 0 on error.
+ */
+static size_t run_measured(void* (*function)(void*), uint64_t* duration_ns) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    uint8_t* stack = aligned_alloc(64U, BENCH_STACK_SIZE);
+    size_t used = 0;
+
+    if (stack == NULL) {
+        return 0;
+    }
+    memset(stack, STACK_PAINT, BENCH_STACK_SIZE);
+    pthread_attr_init(&attr);
+    if (pthread_attr_setstack(&attr, stack, BENCH_STACK_SIZE) == 0) {
+        uint64_t start_ns = get_time_ns();
+        if (pthread_create(&thread, &attr, function, NULL) == 0) {
+            pthread_join(thread, NULL);
+            *duration_ns = get_time_ns() - start_ns;
+            // the stack grows down: the untouched bytes are at the start
+            size_t untouched = 0;
+            while (untouched < BENCH_STACK_SIZE && stack[untouched] == STACK_PAINT) {
+                untouched++;
+            }
+            used = BENCH_STACK_SIZE - untouched;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    free(stack);
+    return used;
+}
+
+static bool check_identical(void) {
+    char expected[MQTT_PUBLISH_MAX_LEN];
+    char actual[MQTT_PUBLISH_MAX_LEN];
+    bool identical = true;
+
+    for (uint32_t i = 0; i < CLASS_COUNT * 2U; i++) {
+        const char* labels = (i < CLASS_COUNT) ? NULL : s_labels;
+        int confidence = (int)(i * 23U % 101U);
+        size_t expected_len = snprintf_detection(s_classes[i % CLASS_COUNT], confidence, labels, expected);
+        size_t actual_len = encoder_detection(s_classes[i % CLASS_COUNT], confidence, labels, actual);
+        if (expected_len != actual_len || 0 != strcmp(expected, actual)) {
+            fprintf(stderr, "detection differs:\n  %s\n  %s\n", expected, actual);
+            identical = false;
+        }
+    }
+
+    size_t idle_len;
+    const char* idle = TelemetryEncoder_Idle(&s_encoder, &idle_len);
+    size_t expected_len = snprintf_idle(expected);
+    if (expected_len != idle_len || 0 != strcmp(expected, idle)) {
+        fprintf(stderr, "idle message differs:\n  %s\n  %s\n", expected, idle);
+        identical = false;
+    }
+    return identical;
+}
+
+int main(int argc, char* argv[]) {
+    bool hex = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-n") && (i + 1) < argc && atoi(argv[i + 1]) > 0) {
+            s_messages = (uint32_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-x")) {
+            hex = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-n messages] [-x]\n", argv[0]);
+            fprintf(stderr, "  -n  number of messages encoded by each implementation (default %u)\n",
+                    (unsigned)DEFAULT_MESSAGES);
+            fprintf(stderr, "  -x  print the binary messages of the check in hexadecimal\n");
+            return 2;
+        }
+    }
+    if (hex) {
+        print_binary();
+        return 0;
+    }
+
+    if (!TelemetryEncoder_Init(&s_encoder, get_version_string(), DEVICE_POSITION, INACTIVE_POSITION)) {
+        fprintf(stderr, "The telemetry messages do not fit in the encoder.\n");
+        return 1;
+    }
+    if (!check_identical()) {
+        return 3;
+    }
+
+    uint64_t nothing_ns = 0;
+    uint64_t snprintf_ns = 0;
+    uint64_t encoder_ns = 0;
+    uint64_t binary_ns = 0;
+    size_t nothing_stack = run_measured(run_nothing, &nothing_ns);
+    size_t snprintf_stack = run_measured(run_snprintf, &snprintf_ns);
+    size_t encoder_stack = run_measured(run_encoder, &encoder_ns);
+    size_t binary_stack = run_measured(run_binary, &binary_ns);
+    if (nothing_stack == 0 || snprintf_stack == 0 || encoder_stack == 0 || binary_stack == 0) {
+        fprintf(stderr, "Failed to run the measuring threads.\n");
+        return 1;
+    }
+
+    printf("messages: %u, identical: yes\n", (unsigned)s_messages);
+    printf("%-8s %8.1f ns/message, stack %zu bytes\n", "snprintf",
+           (double)snprintf_ns / s_messages, snprintf_stack - nothing_stack);
+    printf("%-8s %8.1f ns/message, stack %zu bytes\n", "encoder",
+           (double)encoder_ns / s_messages, encoder_stack - nothing_stack);
+    printf("%-8s %8.1f ns/message, stack %zu bytes\n", "cbor",
+           (double)binary_ns / s_messages, binary_stack - nothing_stack);
+
+    // message of the last class, with the longest name, an hour after startup
+    size_t json_len = encoder_detection(s_classes[CLASS_COUNT - 1U], 71, NULL, s_payload);
+    size_t json_labels_len = encoder_detection(s_classes[0], 71, s_labels, s_payload);
+    size_t binary_len = binary_detection(2400U, CLASS_COUNT - 1U, 71, false, (uint8_t*)s_payload);
+    size_t binary_labels_len = binary_detection(2400U, 0U, 71, true, (uint8_t*)s_payload);
+    printf("message size: json %zu bytes, %zu with 2 labels; cbor %zu bytes, %zu with 2 labels\n",
+           json_len, json_labels_len, binary_len, binary_labels_len);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file wav_reader.c
+ * @brief Minimal reader for RIFF/WAVE PCM files.
+ */
+
+#include <string.h>
+#include "wav_reader.h"
+
+/* ============================ Constants and Macros ============================ */
+
+/* WAVE format tag for uncompressed PCM */
+#define WAVE_FORMAT_PCM 1
+
+/* WAVE format tag for formats described by a sub-format GUID */
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+/* ============================ Function Implementations ============================ */
+
+static uint16_t prvReadLe16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t prvReadLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool WavReader_Open(WavReader_t* reader, const char* path) {
+    uint8_t header[12];
+    bool fmt_found = false;
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        return false;
+    }
+
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(&header[8], "WAVE", 4) != 0) {
+        WavReader_Close(reader);
+        return false;
+    }
+
+    /* Walk the chunks until the data chunk is found */
+    for (;;) {
+        uint8_t chunk[8];
+        if (fread(chunk, 1, sizeof(chunk), reader->file) != sizeof(chunk)) {
+            break;
+        }
+
+        uint32_t chunk_size = prvReadLe32(&chunk[4]);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if (chunk_size < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), reader->file) != sizeof(fmt)) {
+                break;
+            }
+            uint16_t format = prvReadLe16(&fmt[0]);
+            if (format != WAVE_FORMAT_PCM && format != WAVE_FORMAT_EXTENSIBLE) {
+                break;
+            }
+            reader->channels = prvReadLe16(&fmt[2]);
+            reader->sample_rate = prvReadLe32(&fmt[4]);
+            reader->bits_per_sample = prvReadLe16(&fmt[14]);
+            fmt_found = true;
+            chunk_size -= sizeof(fmt);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!fmt_found) {
+                break;
+            }
+            reader->data_size = chunk_size;
+            reader->data_remaining = chunk_size;
+            reader->data_offset = ftell(reader->file);
+            return true;
+        }
+
+        /* Chunks are padded to an even size */
+        if (fseek(reader->file, (long)(chunk_size + (chunk_size & 1U)), SEEK_CUR) != 0) {
+            break;
+        }
+    }
+
+    WavReader_Close(reader);
+    return false;
+}
+
+size_t WavReader_Read(WavReader_t* reader, uint8_t* buffer, size_t size) {
+    if (reader->file == NULL) {
+        return 0;
+    }
+
+    if (size > reader->data_remaining) {
+        size = reader->data_remaining;
+    }
+
+    size_t read = fread(buffer, 1, size, reader->file);
+    reader->data_remaining -= (uint32_t)read;
+    return read;
+}
+
+bool WavReader_Rewind(WavReader_t* reader) {
+    if (reader->file == NULL || fseek(reader->file, reader->data_offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    reader->data_remaining = reader->data_size;
+    return true;
+}
+
+void WavReader_Close(WavReader_t* reader) {
+    if (reader->file != NULL) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}